@@ -0,0 +1,115 @@
+#!/bin/sh
+#
+# Throughput regression check: build sr at two git revisions and compare
+# them on the same replayed workload with srregress (see srregress.c).
+# Needs nothing but a compiler and the repository; no network.
+#
+#   ./regress.sh HEAD~1            the working tree against HEAD~1
+#   ./regress.sh v1 v2             two revisions
+#   ./regress.sh -n 20 -t 3 HEAD   stricter
+#
+# The workload is an rtgen table and Zipf trace (fixed seed) unless -r,
+# -I and -R name one.  Both builds are optimized, traces compiled out,
+# with the flags of BENCH_CFLAGS in the Makefile, each from clean in a
+# scratch directory.  Exits 1 on a regression, 2 on any other failure.
+
+usage()
+{
+  echo "Usage: `basename $0` [-n runs] [-p passes] [-t pct] [-a alpha] [-c cpu]"
+  echo "         [-P prefixes] [-F frames] [-r rtable -I ifconfig -R pcap]"
+  echo "         [-o out.json] [-k] base_rev [new_rev]"
+  echo "  new_rev defaults to the working tree; -k keeps the build directory"
+  exit 2
+}
+
+# -- as BENCH_CFLAGS; $(ARCH) is left for make to expand --
+cflags='-O2 -g -Wall -ansi -D_GNU_SOURCE -DSR_LOG_LEVEL=SR_LOG_WARN $(ARCH)'
+
+runs=10; passes=5; threshold=5; alpha=0.05; cpu=
+prefixes=10000; frames=100000
+rtable=; ifconfig=; pcap=; out=; keep=
+
+while getopts n:p:t:a:c:P:F:r:I:R:o:kh opt
+do
+  case $opt in
+    n) runs=$OPTARG ;;
+    p) passes=$OPTARG ;;
+    t) threshold=$OPTARG ;;
+    a) alpha=$OPTARG ;;
+    c) cpu=$OPTARG ;;
+    P) prefixes=$OPTARG ;;
+    F) frames=$OPTARG ;;
+    r) rtable=$OPTARG ;;
+    I) ifconfig=$OPTARG ;;
+    R) pcap=$OPTARG ;;
+    o) out=$OPTARG ;;
+    k) keep=1 ;;
+    *) usage ;;
+  esac
+done
+shift `expr $OPTIND - 1`
+[ $# -eq 1 -o $# -eq 2 ] || usage
+base=$1; new=$2
+
+here=`cd \`dirname $0\` && pwd`
+top=`git -C "$here" rev-parse --show-toplevel` || exit 2
+sub=`git -C "$here" rev-parse --show-prefix`
+sub=${sub%/}
+
+work=`mktemp -d ${TMPDIR:-/tmp}/srregress.XXXXXX` || exit 2
+trap '[ -n "$keep" ] || rm -rf "$work"' EXIT
+[ -z "$keep" ] || echo "building in $work"
+
+# -- paths given relative to where we were started --
+abs()
+{
+  case $1 in
+    "") ;;
+    /*) echo "$1" ;;
+    *) echo "`pwd`/$1" ;;
+  esac
+}
+rtable=`abs "$rtable"`; ifconfig=`abs "$ifconfig"`; pcap=`abs "$pcap"`
+out=`abs "$out"`
+
+# -- sr at a revision, or the working tree if rev is empty, into $work/$2;
+#    the working tree is copied without its objects, which may be from a
+#    debug build --
+build()
+{
+  rev=$1; name=$2
+  mkdir -p "$work/$name/$sub"
+  if [ -z "$rev" ]
+  then
+    echo "building the working tree"
+    (cd "$here" && tar -cf - --exclude='*.o' --exclude='.*.d' .) |
+      tar -x -C "$work/$name/$sub"
+  else
+    echo "building $rev (`git -C "$top" rev-parse --short "$rev"`)"
+    git -C "$top" archive "$rev" "$sub" | tar -x -C "$work/$name"
+  fi &&
+    make -C "$work/$name/$sub" CFLAGS="$cflags" sr > "$work/$name.log" 2>&1 &&
+    cp "$work/$name/$sub/sr" "$work/$name/sr" ||
+    { echo "build of ${rev:-the working tree} failed, see $work/$name.log"; keep=1; exit 2; }
+}
+
+build "$base" base
+build "$new" new
+
+make -C "$here" srregress rtgen > "$work/tools.log" 2>&1 ||
+  { echo "cannot build srregress and rtgen"; exit 2; }
+
+if [ -z "$pcap" ]
+then
+  rtable=$work/rtable; ifconfig=$work/if.conf; pcap=$work/trace.pcap
+  "$here/rtgen" -n $prefixes -o "$rtable" -A "$ifconfig" -T "$pcap" \
+    -p $frames || exit 2
+elif [ -z "$rtable" -o -z "$ifconfig" ]
+then
+  usage
+fi
+
+cd "$work"
+"$here/srregress" -n $runs -p $passes -t $threshold -a $alpha \
+  ${cpu:+-c $cpu} ${out:+-o "$out"} \
+  -r "$rtable" -I "$ifconfig" -R "$pcap" "$work/base/sr" "$work/new/sr"
@@ -0,0 +1,494 @@
+/*-----------------------------------------------------------------------------
+ * file:  rtgen.c
+ *
+ * Description:
+ *
+ * Synthetic Internet-scale routing tables, and traffic to go with them,
+ * for benchmarking the FIB against something bigger than the sample
+ * rtable.
+ *
+ * The table is in the "dest gw mask iface" format sr_load_rt(..) reads,
+ * prefix lengths drawn from the shape of the public BGP table (well over
+ * half /24, most of the rest /19 to /23, a thin tail of short prefixes)
+ * with about a fifth of the /23 and longer prefixes carved out of a
+ * shorter one already in the table, as deaggregated announcements are.
+ * Prefixes are unique, and stay clear of 0/8, 10/8, 127/8 and class D/E;
+ * the connected routes of the interfaces come first.
+ *
+ * The trace (-T) is a pcap of UDP frames arriving on the first interface,
+ * each to a host inside one of the generated prefixes.  Prefixes are
+ * ranked in a random order and picked with Zipf(-z) probability by rank,
+ * so a few destinations carry most of the traffic, as in real traffic.
+ *
+ *   ./rtgen -n 900000 -o rtable.900k -A if.conf -T trace.pcap -p 1000000
+ *   ./sr -r rtable.900k -I if.conf -R trace.pcap
+ *
+ * Interfaces come from -I (the sr -I format, see sr_load_if_config(..))
+ * or default to eth1-3 on 10.0.1-3.0/24.  -A writes the interfaces back
+ * out with a static ARP entry for every gateway, ready for sr -I.  The
+ * output depends only on the arguments and -s.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_router.h"
+#include "sr_utils.h"
+#include "sr_dumper.h"
+
+#define RG_MAX_IFACES   16
+#define RG_DEFAULT_SIZE 10000
+#define RG_DEAGG_PCT    20      /* of /23 and longer, carved from a shorter */
+
+struct rg_iface
+{
+    char name[32];
+    uint32_t ip;                /* host order, as is everything here */
+    uint32_t mask;
+    unsigned char mac[ETHER_ADDR_LEN];
+    uint32_t gw;                /* next hop for routes out this interface */
+};
+
+struct rg_prefix
+{
+    uint32_t dest;
+    uint8_t len;
+    uint8_t iface;
+};
+
+/* -- share of each prefix length, per 10000, after the public IPv4 table
+ *    of the early 2020s -- */
+static const struct
+{
+    unsigned int len;
+    unsigned int share;
+} rg_lengths[] =
+{
+    {  8,    2 }, {  9,    2 }, { 10,    4 }, { 11,    8 }, { 12,   16 },
+    { 13,   30 }, { 14,   55 }, { 15,   95 }, { 16,  140 }, { 17,  100 },
+    { 18,  170 }, { 19,  250 }, { 20,  420 }, { 21,  540 }, { 22, 1250 },
+    { 23,  900 }, { 24, 6018 },
+};
+
+static struct rg_iface rg_ifs[RG_MAX_IFACES];
+static unsigned int rg_nifs;
+static uint64_t rg_state;
+
+/* -- xorshift64* -- */
+static uint64_t rg_rand(void)
+{
+    rg_state ^= rg_state >> 12;
+    rg_state ^= rg_state << 25;
+    rg_state ^= rg_state >> 27;
+    return rg_state * 2685821657736338717ULL;
+} /* -- rg_rand -- */
+
+/* -- uniform in [0,1) -- */
+static double rg_uniform(void)
+{ return (rg_rand() >> 11) * (1.0 / 9007199254740992.0); }
+
+static uint32_t rg_mask(unsigned int len)
+{ return len ? 0xffffffffu << (32 - len) : 0; }
+
+static const char* rg_ntoa(uint32_t a, char* buf)
+{
+    struct in_addr in;
+
+    in.s_addr = htonl(a);
+    return strcpy(buf, inet_ntoa(in));
+} /* -- rg_ntoa -- */
+
+/* -- the first host of the subnet that is not the interface itself -- */
+static uint32_t rg_gateway(const struct rg_iface* f)
+{
+    uint32_t net = f->ip & f->mask;
+
+    return net + 1 == f->ip ? net + 2 : net + 1;
+} /* -- rg_gateway -- */
+
+static int rg_load_ifaces(const char* path)
+{
+    FILE* fp;
+    char line[BUFSIZ], name[32], ip[32], mask[32], mac[32];
+    struct in_addr a, m;
+    struct rg_iface* f;
+    int fields;
+
+    if((fp = fopen(path, "r")) == 0)
+    { perror(path); return -1; }
+    while(fgets(line, sizeof(line), fp) != 0)
+    {
+        fields = sscanf(line, "%31s %31s %31s %31s", name, ip, mask, mac);
+        if(fields <= 0 || name[0] == '#' || strcmp(name, "arp") == 0)
+        { continue; }
+        if(fields != 4 || rg_nifs == RG_MAX_IFACES ||
+                inet_aton(ip, &a) == 0 || inet_aton(mask, &m) == 0)
+        {
+            fprintf(stderr, "%s: bad line: %s", path, line);
+            fclose(fp);
+            return -1;
+        }
+
+        f = &rg_ifs[rg_nifs++];
+        strcpy(f->name, name);
+        f->ip = ntohl(a.s_addr);
+        f->mask = ntohl(m.s_addr);
+        if(parse_addr_eth(mac, f->mac) != 0)
+        {
+            fprintf(stderr, "%s: bad MAC %s\n", path, mac);
+            fclose(fp);
+            return -1;
+        }
+    }
+    fclose(fp);
+    return rg_nifs ? 0 : -1;
+} /* -- rg_load_ifaces -- */
+
+static void rg_default_ifaces(void)
+{
+    struct rg_iface* f;
+    unsigned int i;
+
+    for(i = 0; i < 3; i++)
+    {
+        f = &rg_ifs[rg_nifs++];
+        sprintf(f->name, "eth%u", i + 1);
+        f->ip = 0x0a000001 | ((i + 1) << 8);
+        f->mask = 0xffffff00;
+        memset(f->mac, 0, ETHER_ADDR_LEN);
+        f->mac[0] = 0x02;
+        f->mac[5] = (unsigned char)(i + 1);
+    }
+} /* -- rg_default_ifaces -- */
+
+/*-----------------------------------------------------------------------------
+ * Prefix set: open addressing on (dest, len), sized at twice the table.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint64_t* rg_set;
+static uint64_t rg_set_mask;
+
+static uint64_t rg_key(uint32_t dest, unsigned int len)
+{ return ((uint64_t)dest << 8 | len) + 1; }     /* 0 is empty */
+
+/* -- 1 if added, 0 if already there -- */
+static int rg_set_add(uint32_t dest, unsigned int len)
+{
+    uint64_t k = rg_key(dest, len), h;
+
+    for(h = (k * 0x9e3779b97f4a7c15ULL) >> 20; ; h++)
+    {
+        if(rg_set[h & rg_set_mask] == k)
+        { return 0; }
+        if(rg_set[h & rg_set_mask] == 0)
+        { rg_set[h & rg_set_mask] = k; return 1; }
+    }
+} /* -- rg_set_add -- */
+
+static unsigned int rg_pick_len(void)
+{
+    unsigned int r = (unsigned int)(rg_rand() % 10000), i;
+
+    for(i = 0; i < sizeof(rg_lengths) / sizeof(rg_lengths[0]) - 1; i++)
+    {
+        if(r < rg_lengths[i].share)
+        { return rg_lengths[i].len; }
+        r -= rg_lengths[i].share;
+    }
+    return rg_lengths[i].len;
+} /* -- rg_pick_len -- */
+
+/* -- clear of 0/8, 10/8, 127/8 and 224/3 -- */
+static int rg_routable(uint32_t dest, unsigned int len)
+{
+    uint32_t first = dest >> 24, last = (dest | ~rg_mask(len)) >> 24;
+
+    return first >= 1 && last < 224 && !(first <= 10 && last >= 10) &&
+           !(first <= 127 && last >= 127);
+} /* -- rg_routable -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: rg_table(..)
+ *
+ * n unique prefixes.  Routes leave on every interface but the first,
+ * which is where the trace comes in, unless there is only one.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct rg_prefix* rg_table(unsigned int n)
+{
+    struct rg_prefix* t;
+    unsigned int i = 0, len, outs, first_out;
+    uint32_t dest;
+    struct rg_prefix* parent;
+
+    for(rg_set_mask = 1; rg_set_mask < 2 * (uint64_t)n; rg_set_mask <<= 1);
+    rg_set = (uint64_t*)calloc(rg_set_mask, sizeof(uint64_t));
+    t = (struct rg_prefix*)malloc((n ? n : 1) * sizeof(struct rg_prefix));
+    if(rg_set == 0 || t == 0)
+    { fprintf(stderr, "out of memory\n"); exit(1); }
+    rg_set_mask--;
+
+    first_out = rg_nifs > 1 ? 1 : 0;
+    outs = rg_nifs - first_out;
+    while(i < n)
+    {
+        len = rg_pick_len();
+        parent = i ? &t[rg_rand() % i] : 0;
+        if(len >= 23 && parent && parent->len < len &&
+                rg_rand() % 100 < RG_DEAGG_PCT)
+        {
+            dest = parent->dest | ((uint32_t)rg_rand() & ~rg_mask(parent->len));
+        }
+        else
+        { dest = (uint32_t)rg_rand(); }
+        dest &= rg_mask(len);
+
+        if(!rg_routable(dest, len) || !rg_set_add(dest, len))
+        { continue; }
+        t[i].dest = dest;
+        t[i].len = (uint8_t)len;
+        t[i].iface = (uint8_t)(first_out + rg_rand() % outs);
+        i++;
+    }
+    free(rg_set);
+    return t;
+} /* -- rg_table -- */
+
+static int rg_write_table(const char* path, const struct rg_prefix* t,
+                          unsigned int n, int dflt)
+{
+    FILE* fp = stdout;
+    char a[16], b[16], c[16];
+    unsigned int i;
+
+    if(path && (fp = fopen(path, "w")) == 0)
+    { perror(path); return -1; }
+
+    for(i = 0; i < rg_nifs; i++)
+    {
+        fprintf(fp, "%s 0.0.0.0 %s %s\n",
+                rg_ntoa(rg_ifs[i].ip & rg_ifs[i].mask, a),
+                rg_ntoa(rg_ifs[i].mask, c), rg_ifs[i].name);
+    }
+    for(i = 0; i < n; i++)
+    {
+        fprintf(fp, "%s %s %s %s\n", rg_ntoa(t[i].dest, a),
+                rg_ntoa(rg_ifs[t[i].iface].gw, b),
+                rg_ntoa(rg_mask(t[i].len), c), rg_ifs[t[i].iface].name);
+    }
+    if(dflt)
+    {
+        fprintf(fp, "0.0.0.0 %s 0.0.0.0 %s\n",
+                rg_ntoa(rg_ifs[rg_nifs - 1].gw, b), rg_ifs[rg_nifs - 1].name);
+    }
+
+    if(fp != stdout)
+    { fclose(fp); }
+    return 0;
+} /* -- rg_write_table -- */
+
+/* -- the interfaces for sr -I, plus a static ARP entry per gateway -- */
+static int rg_write_ifconfig(const char* path)
+{
+    FILE* fp;
+    char a[16], b[16];
+    unsigned int i, k;
+
+    if((fp = fopen(path, "w")) == 0)
+    { perror(path); return -1; }
+    fprintf(fp, "# rtgen: interfaces, then a static ARP entry per gateway\n");
+    for(i = 0; i < rg_nifs; i++)
+    {
+        fprintf(fp, "%s %s %s", rg_ifs[i].name, rg_ntoa(rg_ifs[i].ip, a),
+                rg_ntoa(rg_ifs[i].mask, b));
+        for(k = 0; k < ETHER_ADDR_LEN; k++)
+        { fprintf(fp, "%c%02x", k ? ':' : ' ', rg_ifs[i].mac[k]); }
+        fprintf(fp, "\n");
+    }
+    for(i = 0; i < rg_nifs; i++)
+    {
+        fprintf(fp, "arp %s 02:00:00:00:%02x:%02x\n", rg_ntoa(rg_ifs[i].gw, a),
+                0x10 + (i >> 8), i & 0xff);
+    }
+    fclose(fp);
+    return 0;
+} /* -- rg_write_ifconfig -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: rg_write_trace(..)
+ *
+ * count frames of frame_len bytes, Zipf(alpha) over a random ranking of
+ * the prefixes, one destination host per prefix.  Timestamps are 1us
+ * apart, for sr -R paced replay.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int rg_write_trace(const char* path, const struct rg_prefix* t,
+                          unsigned int n, unsigned long count,
+                          double alpha, unsigned int frame_len)
+{
+    unsigned char frame[SR_MAX_FRAME_JUMBO];
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eth + 1);
+    uint16_t* udp = (uint16_t*)(ip + 1);
+    const struct rg_iface* in = &rg_ifs[0];
+    struct pcap_pkthdr h;
+    unsigned int *rank, i, lo, hi, mid, tmp;
+    uint32_t* host;
+    double* cdf;
+    double sum = 0, u;
+    unsigned long k;
+    FILE* fp;
+
+    rank = (unsigned int*)malloc(n * sizeof(unsigned int));
+    host = (uint32_t*)malloc(n * sizeof(uint32_t));
+    cdf = (double*)malloc(n * sizeof(double));
+    if(rank == 0 || host == 0 || cdf == 0)
+    { fprintf(stderr, "out of memory\n"); exit(1); }
+
+    /* -- Fisher-Yates for the ranking, then the Zipf CDF over ranks -- */
+    for(i = 0; i < n; i++)
+    { rank[i] = i; }
+    for(i = n - 1; i > 0; i--)
+    {
+        k = rg_rand() % (i + 1);
+        tmp = rank[i]; rank[i] = rank[k]; rank[k] = tmp;
+    }
+    for(i = 0; i < n; i++)
+    {
+        host[i] = t[rank[i]].dest | ((uint32_t)rg_rand() &
+                ~rg_mask(t[rank[i]].len));
+        sum += 1.0 / pow(i + 1, alpha);
+        cdf[i] = sum;
+    }
+
+    if((fp = sr_dump_open(path, 0, SR_MAX_FRAME_JUMBO)) == 0)
+    { perror(path); return -1; }
+
+    memset(frame, 0, sizeof(frame));
+    memcpy(eth->ether_dhost, in->mac, ETHER_ADDR_LEN);
+    eth->ether_shost[0] = 0x02;
+    eth->ether_shost[4] = 0x20;
+    eth->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(frame_len - sizeof(sr_ethernet_hdr_t));
+    ip->ip_ttl = 64;
+    ip->ip_p = ip_protocol_udp;
+    ip->ip_src = htonl((in->ip & in->mask) | (100 & ~in->mask));
+    udp[0] = htons(40000);
+    udp[1] = htons(9);
+    udp[2] = htons(frame_len - sizeof(sr_ethernet_hdr_t) -
+            sizeof(sr_ip_hdr_t));
+
+    h.caplen = h.len = frame_len;
+    for(k = 0; k < count; k++)
+    {
+        /* -- inverse CDF by binary search -- */
+        u = rg_uniform() * sum;
+        for(lo = 0, hi = n - 1; lo < hi; )
+        {
+            mid = lo + (hi - lo) / 2;
+            if(cdf[mid] < u)
+            { lo = mid + 1; }
+            else
+            { hi = mid; }
+        }
+        ip->ip_dst = htonl(host[lo]);
+        ip->ip_id = htons((uint16_t)k);
+        ip->ip_sum = 0;
+        ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+        h.ts.tv_sec = k / 1000000;
+        h.ts.tv_usec = k % 1000000;
+        sr_dump(fp, &h, frame);
+    }
+    sr_dump_close(fp);
+
+    free(rank);
+    free(host);
+    free(cdf);
+    return 0;
+} /* -- rg_write_trace -- */
+
+static void usage(const char* argv0)
+{
+    printf("Synthetic routing tables and Zipf traffic for sr\n");
+    printf("Format: %s [-h] [-n prefixes] [-s seed] [-D] [-I ifconfig] "
+           "[-o rtable]\n"
+           "          [-A ifconfig out] [-T trace.pcap [-p packets] "
+           "[-z alpha] [-b bytes]]\n", argv0);
+    printf("   -n prefixes besides the connected ones (default %d)\n",
+            RG_DEFAULT_SIZE);
+    printf("   -D adds a default route, so no destination is unroutable\n");
+    printf("   -o defaults to stdout\n");
+    printf("   -T frames (-p, default 100000) of -b bytes (default 64), "
+           "Zipf exponent -z (default 1.0)\n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    const char *if_in = 0, *if_out = 0, *rt_out = 0, *trace = 0;
+    unsigned int n = RG_DEFAULT_SIZE, frame_len = 64, i;
+    unsigned long count = 100000;
+    double alpha = 1.0;
+    struct rg_prefix* t;
+    int c, dflt = 0;
+
+    rg_state = 0x5eed5eed5eedULL;
+    while((c = getopt(argc, argv, "hn:s:DI:o:A:T:p:z:b:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'n': n = (unsigned int)strtoul(optarg, 0, 0); break;
+            case 's':
+                rg_state ^= strtoull(optarg, 0, 0) * 0x9e3779b97f4a7c15ULL;
+                break;
+            case 'D': dflt = 1; break;
+            case 'I': if_in = optarg; break;
+            case 'o': rt_out = optarg; break;
+            case 'A': if_out = optarg; break;
+            case 'T': trace = optarg; break;
+            case 'p': count = strtoul(optarg, 0, 0); break;
+            case 'z': alpha = atof(optarg); break;
+            case 'b': frame_len = (unsigned int)atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if(optind != argc || rg_state == 0 || alpha < 0 ||
+            frame_len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + 8 ||
+            frame_len > SR_MAX_FRAME_JUMBO || (trace && n == 0) ||
+            n > 16000000)
+    { usage(argv[0]); return 1; }
+
+    if(if_in)
+    {
+        if(rg_load_ifaces(if_in) != 0)
+        { fprintf(stderr, "%s: no interfaces\n", if_in); return 1; }
+    }
+    else
+    { rg_default_ifaces(); }
+    for(i = 0; i < rg_nifs; i++)
+    { rg_ifs[i].gw = rg_gateway(&rg_ifs[i]); }
+
+    t = rg_table(n);
+    if(rg_write_table(rt_out, t, n, dflt) != 0)
+    { return 1; }
+    if(if_out && rg_write_ifconfig(if_out) != 0)
+    { return 1; }
+    if(trace && rg_write_trace(trace, t, n, count, alpha, frame_len) != 0)
+    { return 1; }
+    free(t);
+    return 0;
+} /* -- main -- */
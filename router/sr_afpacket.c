@@ -0,0 +1,529 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ *
+ * Description:
+ *
+ * AF_PACKET TPACKET_V3 backend.
+ *
+ * RX: the kernel fills variable sized frames into fixed size blocks and
+ * flips a block to TP_STATUS_USER when it is full or SR_AFP_BLOCK_TOV
+ * has passed.  We walk every frame of a user block, let the router have
+ * it in place, and hand the block back with TP_STATUS_KERNEL.
+ *
+ * TX: slots are claimed in order under tx_lock, filled and marked
+ * TP_STATUS_SEND_REQUEST.  Frames the main thread sends while handling
+ * a poll pass are pushed with one sendto per port at the end of the
+ * pass; frames from other threads (the ARP sweeper) are pushed at once.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "sr_afpacket.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_log.h"
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+static int  sr_afpacket_poll(struct sr_instance* sr);
+static int  sr_afpacket_send(struct sr_instance* sr, uint8_t* buf,
+                             unsigned int len, struct sr_if* iface);
+static void sr_afpacket_close(struct sr_instance* sr);
+static int  sr_afpacket_sendv(struct sr_instance* sr, const struct iovec* iov,
+                              int iovcnt, unsigned int len,
+                              struct sr_if* iface);
+
+static const struct sr_io_ops sr_afpacket_io =
+{
+    "afpacket",
+    sr_afpacket_poll,
+    sr_afpacket_send,
+    sr_afpacket_close,
+    sr_afpacket_sendv
+};
+
+static volatile sig_atomic_t sr_afpacket_stop;
+
+static void sr_afpacket_sigint(int sig)
+{
+    sr_afpacket_stop = 1;
+} /* -- sr_afpacket_sigint -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_port_open(..)
+ *
+ * Open, ring and bind the socket for one interface.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afp_port_open(struct sr_afp_port* port)
+{
+    static const unsigned char zero[ETHER_ADDR_LEN];
+    struct tpacket_req3 rx_req, tx_req;
+    struct packet_mreq mreq;
+    struct sockaddr_ll sll;
+    struct ifreq ifr;
+    int version = TPACKET_V3, one = 1;
+    size_t rx_len, tx_len;
+
+    if((port->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0)
+    { perror("socket(AF_PACKET)"); return -1; }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, port->iface->name, IFNAMSIZ - 1);
+    if(ioctl(port->fd, SIOCGIFINDEX, &ifr) < 0)
+    { perror(port->iface->name); return -1; }
+    port->kernel_ifindex = ifr.ifr_ifindex;
+
+    /* -- no MAC in the config: use the one the interface already has -- */
+    if(memcmp(port->iface->addr, zero, ETHER_ADDR_LEN) == 0)
+    {
+        if(ioctl(port->fd, SIOCGIFHWADDR, &ifr) < 0)
+        { perror(port->iface->name); return -1; }
+        memcpy(port->iface->addr, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+    }
+
+    /* -- nor an MTU: the same -- */
+    if(port->iface->mtu == 0)
+    {
+        if(ioctl(port->fd, SIOCGIFMTU, &ifr) < 0)
+        { perror(port->iface->name); return -1; }
+        port->iface->mtu = ifr.ifr_mtu;
+    }
+
+    if(setsockopt(port->fd, SOL_PACKET, PACKET_VERSION,
+                &version, sizeof(version)) < 0)
+    { perror("PACKET_VERSION"); return -1; }
+
+    /* -- our own transmissions would otherwise come back on RX -- */
+    setsockopt(port->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING,
+            &one, sizeof(one));
+    setsockopt(port->fd, SOL_PACKET, PACKET_QDISC_BYPASS,
+            &one, sizeof(one));
+
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    rx_req.tp_block_nr = SR_AFP_BLOCK_NR;
+    rx_req.tp_frame_size = SR_AFP_TX_FRAME;
+    rx_req.tp_frame_nr = SR_AFP_BLOCK_SIZE / SR_AFP_TX_FRAME *
+        SR_AFP_BLOCK_NR;
+    rx_req.tp_retire_blk_tov = SR_AFP_BLOCK_TOV;
+    rx_req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if(setsockopt(port->fd, SOL_PACKET, PACKET_RX_RING,
+                &rx_req, sizeof(rx_req)) < 0)
+    { perror("PACKET_RX_RING"); return -1; }
+
+    /* -- TX slots are fixed size, the V3 block timer must be off -- */
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_frame_size = SR_AFP_TX_FRAME;
+    tx_req.tp_frame_nr = SR_AFP_TX_FRAMES;
+    tx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    tx_req.tp_block_nr = SR_AFP_TX_FRAMES * SR_AFP_TX_FRAME /
+        SR_AFP_BLOCK_SIZE;
+    if(setsockopt(port->fd, SOL_PACKET, PACKET_TX_RING,
+                &tx_req, sizeof(tx_req)) < 0)
+    { perror("PACKET_TX_RING"); return -1; }
+
+    rx_len = (size_t)rx_req.tp_block_size * rx_req.tp_block_nr;
+    tx_len = (size_t)tx_req.tp_block_size * tx_req.tp_block_nr;
+    port->map_len = rx_len + tx_len;
+    port->map = (uint8_t*)mmap(0, port->map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_LOCKED | MAP_POPULATE, port->fd, 0);
+    if(port->map == MAP_FAILED)
+    {
+        /* -- MAP_LOCKED needs RLIMIT_MEMLOCK, do without -- */
+        port->map = (uint8_t*)mmap(0, port->map_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, port->fd, 0);
+        if(port->map == MAP_FAILED)
+        { perror("mmap"); port->map = 0; return -1; }
+    }
+    port->rx = port->map;
+    port->tx = port->map + rx_len;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = port->kernel_ifindex;
+    if(bind(port->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+    { perror("bind(AF_PACKET)"); return -1; }
+
+    /* -- the router's MAC need not be the interface's -- */
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = port->kernel_ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if(setsockopt(port->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                &mreq, sizeof(mreq)) < 0)
+    { perror("PACKET_ADD_MEMBERSHIP"); return -1; }
+
+    pthread_mutex_init(&port->tx_lock, 0);
+    return 0;
+} /* -- sr_afp_port_open -- */
+
+static void sr_afp_port_close(struct sr_afp_port* port)
+{
+    if(port->map)
+    { munmap(port->map, port->map_len); }
+    port->map = 0;
+    if(port->fd >= 0)
+    { close(port->fd); }
+    port->fd = -1;
+} /* -- sr_afp_port_close -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_open(..)
+ *
+ * Read interfaces from ifconfig (see sr_load_if_config; a MAC of
+ * 00:00:00:00:00:00 takes the Linux interface's own, as does a missing
+ * MTU), attach each one and install the backend.  Expects the routing table loaded and sr_init
+ * done.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_afpacket_open(struct sr_instance* sr, const char* ifconfig)
+{
+    struct sr_afpacket* ap;
+    struct sr_afp_port* port;
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(ifconfig);
+
+    if(sr_load_if_config(sr, ifconfig) != 0)
+    { return -1; }
+
+    ap = (struct sr_afpacket*)calloc(1, sizeof(struct sr_afpacket));
+    assert(ap);
+    ap->main_thread = pthread_self();
+
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        port = &ap->ports[ap->nports++];
+        port->fd = -1;
+        port->iface = sr->if_table[i];
+        if(sr_afp_port_open(port) != 0)
+        {
+            fprintf(stderr, "Error attaching %s\n", port->iface->name);
+            while(ap->nports)
+            { sr_afp_port_close(&ap->ports[--ap->nports]); }
+            free(ap);
+            return -1;
+        }
+    }
+
+    sr_io_interfaces_ready(sr);
+    if(sr_verify_routing_table(sr) != 0)
+    {
+        fprintf(stderr,"Routing table not consistent with %s\n", ifconfig);
+        while(ap->nports)
+        { sr_afp_port_close(&ap->ports[--ap->nports]); }
+        free(ap);
+        return -1;
+    }
+
+    signal(SIGINT, sr_afpacket_sigint);
+    signal(SIGTERM, sr_afpacket_sigint);
+
+    sr->io = &sr_afpacket_io;
+    sr->io_state = ap;
+    printf(" <-- Ready to process packets --> \n");
+    return 0;
+} /* -- sr_afpacket_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_kick(..)
+ *
+ * Tell the kernel about filled TX slots.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afp_kick(struct sr_afp_port* port)
+{
+    port->tx_pending = 0;
+    port->tx_kicks++;
+    if(sendto(port->fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0 &&
+            errno != EAGAIN && errno != ENOBUFS)
+    { LogWarn("afpacket %s: tx: %s\n", port->iface->name, strerror(errno)); }
+} /* -- sr_afp_kick -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_finish_csum(..)
+ *
+ * Frames a local sender (the far end of a veth) left for checksum offload
+ * arrive marked TP_STATUS_CSUMNOTREADY: the TCP/UDP checksum field holds
+ * only the pseudo header sum.  Forwarded as is they would be dropped by
+ * the receiver, so finish the sum over the segment here.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afp_finish_csum(uint8_t* frame, unsigned int len)
+{
+    sr_ip_hdr_t* ip_hdr;
+    unsigned int hl, tot, off;
+    uint16_t sum;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+            ethertype(frame) != ethertype_ip)
+    { return; }
+
+    ip_hdr = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    hl = ip_hdr->ip_hl * 4;
+    tot = ntohs(ip_hdr->ip_len);
+    if(ntohs(ip_hdr->ip_off) & (IP_MF | IP_OFFMASK) ||
+            tot > len - sizeof(sr_ethernet_hdr_t))
+    { return; }
+
+    if(ip_hdr->ip_p == ip_protocol_udp)
+    { off = 6; }
+    else if(ip_hdr->ip_p == ip_protocol_tcp)
+    { off = 16; }
+    else
+    { return; }
+    if(tot < hl + off + 2)
+    { return; }
+
+    sum = cksum((uint8_t*)ip_hdr + hl, tot - hl);
+    memcpy((uint8_t*)ip_hdr + hl + off, &sum, sizeof(sum));
+} /* -- sr_afp_finish_csum -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afp_rx(..)
+ *
+ * Run every block the kernel has handed over.  Returns frames seen.
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int sr_afp_rx(struct sr_instance* sr, struct sr_afp_port* port)
+{
+    struct tpacket_block_desc* bd;
+    struct tpacket3_hdr* hdr;
+    unsigned int i, n, total = 0;
+
+    for(;;)
+    {
+        bd = (struct tpacket_block_desc*)
+            (port->rx + (size_t)port->rx_block * SR_AFP_BLOCK_SIZE);
+        if(!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+                    TP_STATUS_USER))
+        { break; }
+
+        n = bd->hdr.bh1.num_pkts;
+        hdr = (struct tpacket3_hdr*)
+            ((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for(i = 0; i < n; i++)
+        {
+            if(hdr->tp_snaplen < hdr->tp_len)
+            {
+                /* -- an offload super frame, cannot forward half of it -- */
+                if(port->rx_truncated++ == 0)
+                {
+                    LogWarn("afpacket %s: %u byte frame truncated, "
+                            "disable TSO/GSO on the peer\n",
+                            port->iface->name, hdr->tp_len);
+                }
+            }
+            else
+            {
+                if(hdr->tp_status & TP_STATUS_CSUMNOTREADY)
+                {
+                    sr_afp_finish_csum((uint8_t*)hdr + hdr->tp_mac,
+                            hdr->tp_snaplen);
+                }
+                sr_io_receive(sr, (uint8_t*)hdr + hdr->tp_mac,
+                        hdr->tp_snaplen, port->iface);
+            }
+            hdr = (struct tpacket3_hdr*)((uint8_t*)hdr + hdr->tp_next_offset);
+        }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                __ATOMIC_RELEASE);
+        port->rx_block = (port->rx_block + 1) % SR_AFP_BLOCK_NR;
+        port->rx_blocks++;
+        port->rx_frames += n;
+        total += n;
+    }
+    return total;
+} /* -- sr_afp_rx -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_poll(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afpacket_poll(struct sr_instance* sr)
+{
+    struct sr_afpacket* ap = (struct sr_afpacket*)sr->io_state;
+    struct pollfd pfd[SR_MAX_IFACES];
+    unsigned int i, seen = 0;
+
+    if(sr_afpacket_stop)
+    { return 0; }
+
+    /* -- drain what is already there before sleeping; busy polling
+     *    never sleeps -- */
+    for(i = 0; i < ap->nports; i++)
+    { seen += sr_afp_rx(sr, &ap->ports[i]); }
+
+    if(seen == 0 && !sr->busy)
+    {
+        for(i = 0; i < ap->nports; i++)
+        {
+            pfd[i].fd = ap->ports[i].fd;
+            pfd[i].events = POLLIN | POLLERR;
+            pfd[i].revents = 0;
+        }
+        if(poll(pfd, ap->nports, SR_AFP_POLL_MS) < 0 && errno != EINTR)
+        { perror("poll"); return -1; }
+        for(i = 0; i < ap->nports; i++)
+        {
+            if(pfd[i].revents)
+            { sr_afp_rx(sr, &ap->ports[i]); }
+        }
+    }
+
+    /* -- one push per port for everything this pass sent -- */
+    for(i = 0; i < ap->nports; i++)
+    {
+        pthread_mutex_lock(&ap->ports[i].tx_lock);
+        if(ap->ports[i].tx_pending)
+        { sr_afp_kick(&ap->ports[i]); }
+        pthread_mutex_unlock(&ap->ports[i].tx_lock);
+    }
+
+    return sr_afpacket_stop ? 0 : 1;
+} /* -- sr_afpacket_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_sendv(..)
+ *
+ * Copy the pieces straight into the next TX slot.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afpacket_sendv(struct sr_instance* sr, const struct iovec* iov,
+                             int iovcnt, unsigned int len, struct sr_if* iface)
+{
+    struct sr_afpacket* ap = (struct sr_afpacket*)sr->io_state;
+    struct sr_afp_port* port;
+    struct tpacket3_hdr* hdr;
+    unsigned int status;
+    uint8_t* slot;
+    int i, ret = 0;
+
+    if(iface->ifindex >= ap->nports || len >
+            SR_AFP_TX_FRAME - (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll)))
+    { return -1; }
+    port = &ap->ports[iface->ifindex];
+
+    pthread_mutex_lock(&port->tx_lock);
+    if(port->fd < 0)
+    { pthread_mutex_unlock(&port->tx_lock); return -1; }
+
+    hdr = (struct tpacket3_hdr*)
+        (port->tx + (size_t)port->tx_head * SR_AFP_TX_FRAME);
+    status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if(status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT)
+    {
+        /* -- ring full: push what is queued and hope the slot frees -- */
+        sr_afp_kick(port);
+        status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    }
+
+    if(status == TP_STATUS_AVAILABLE || status == TP_STATUS_WRONG_FORMAT)
+    {
+        slot = (uint8_t*)hdr + TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+        for(i = 0; i < iovcnt; i++)
+        {
+            memcpy(slot, iov[i].iov_base, iov[i].iov_len);
+            slot += iov[i].iov_len;
+        }
+        hdr->tp_len = len;
+        hdr->tp_snaplen = len;
+        hdr->tp_next_offset = 0;
+        __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                __ATOMIC_RELEASE);
+        port->tx_head = (port->tx_head + 1) % SR_AFP_TX_FRAMES;
+        port->tx_frames++;
+        port->tx_pending++;
+
+        if(!pthread_equal(pthread_self(), ap->main_thread))
+        { sr_afp_kick(port); }
+    }
+    else
+    {
+        port->tx_full++;
+        ret = -1;
+    }
+    pthread_mutex_unlock(&port->tx_lock);
+
+    return ret;
+} /* -- sr_afpacket_sendv -- */
+
+static int sr_afpacket_send(struct sr_instance* sr, uint8_t* buf,
+                            unsigned int len, struct sr_if* iface)
+{
+    struct iovec iov;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    return sr_afpacket_sendv(sr, &iov, 1, len, iface);
+} /* -- sr_afpacket_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afpacket_close(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afpacket_close(struct sr_instance* sr)
+{
+    struct sr_afpacket* ap = (struct sr_afpacket*)sr->io_state;
+    struct sr_afp_port* port;
+    struct tpacket_stats_v3 st;
+    socklen_t slen;
+    unsigned int i;
+
+    for(i = 0; i < ap->nports; i++)
+    {
+        port = &ap->ports[i];
+        memset(&st, 0, sizeof(st));
+        slen = sizeof(st);
+        getsockopt(port->fd, SOL_PACKET, PACKET_STATISTICS, &st, &slen);
+
+        LogInfo("afpacket %s: rx %llu frames in %llu blocks, "
+                "%llu truncated, kernel drops %u, freezes %u; tx %llu frames, "
+                "%llu kicks, %llu ring full\n", port->iface->name,
+                (unsigned long long)port->rx_frames,
+                (unsigned long long)port->rx_blocks,
+                (unsigned long long)port->rx_truncated,
+                st.tp_drops, st.tp_freeze_q_cnt,
+                (unsigned long long)port->tx_frames,
+                (unsigned long long)port->tx_kicks,
+                (unsigned long long)port->tx_full);
+
+        pthread_mutex_lock(&port->tx_lock);
+        sr_afp_port_close(port);
+        pthread_mutex_unlock(&port->tx_lock);
+    }
+} /* -- sr_afpacket_close -- */
@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.h
+ *
+ * Description:
+ *
+ * Linux AF_PACKET backend: every sr_if is attached to the Linux
+ * interface of the same name (a veth end, say) through a PACKET_MMAP
+ * TPACKET_V3 RX ring and TX ring shared with the kernel.  Received
+ * frames are handed to the router straight out of the ring a block at a
+ * time, and sent frames are written into the TX ring and pushed to the
+ * kernel once per poll pass rather than once per frame.
+ *
+ * Segmentation offload on the far end of a veth hands us frames of up to
+ * 64k that do not fit a ring frame; those are dropped, so turn TSO/GSO
+ * off there (ethtool -K <peer> tso off gso off).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_AFPACKET_H
+#define SR_AFPACKET_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+
+/* RX ring: blocks the kernel fills and retires after SR_AFP_BLOCK_TOV ms */
+#define SR_AFP_BLOCK_SIZE  (1 << 18)
+#define SR_AFP_BLOCK_NR    16
+#define SR_AFP_BLOCK_TOV   1
+
+/* TX ring: fixed size slots, one frame each */
+#define SR_AFP_TX_FRAME    2048
+#define SR_AFP_TX_FRAMES   1024
+
+/* how long one poll waits for traffic, ms */
+#define SR_AFP_POLL_MS     100
+
+struct sr_instance;
+
+struct sr_afp_port
+{
+    struct sr_if* iface;
+    int fd;
+    int kernel_ifindex;
+
+    uint8_t* map;               /* RX blocks followed by TX frames */
+    size_t map_len;
+    uint8_t* rx;
+    unsigned int rx_block;      /* next block to look at */
+    uint8_t* tx;
+    unsigned int tx_head;       /* next slot to fill */
+    unsigned int tx_pending;    /* filled but not pushed */
+    pthread_mutex_t tx_lock;    /* the ARP sweeper sends too */
+
+    uint64_t rx_frames;
+    uint64_t rx_blocks;
+    uint64_t rx_truncated;      /* larger than a ring frame, dropped */
+    uint64_t tx_frames;
+    uint64_t tx_kicks;
+    uint64_t tx_full;           /* dropped, no free slot */
+};
+
+struct sr_afpacket
+{
+    struct sr_afp_port ports[SR_MAX_IFACES];
+    unsigned int nports;
+    pthread_t main_thread;      /* sends from here are batched */
+};
+
+int sr_afpacket_open(struct sr_instance* sr, const char* ifconfig);
+
+#endif /* -- SR_AFPACKET_H -- */
@@ -0,0 +1,706 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afxdp.c
+ *
+ * Description:
+ *
+ * AF_XDP backend, with no libbpf: the XDP program is five instructions
+ * loaded with bpf(2) and attached through a BPF link, so it goes away
+ * with the process.
+ *
+ * Chunk life cycle: pool -> fill ring -> (kernel) -> RX ring -> router.
+ * If the router forwards the frame it was handed, the chunk goes straight
+ * onto the egress TX ring and comes back through that port's completion
+ * ring; otherwise it returns to the pool when the router is done with it.
+ * Frames the router builds are copied into a pool chunk for TX.
+ *
+ * The RX rings are only touched by the main thread.  Everything else is
+ * under one lock, as the ARP sweeper sends too.  Main thread sends are
+ * kicked once per port at the end of a poll pass.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/if_xdp.h>
+#include <linux/bpf.h>
+
+#include "sr_afxdp.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define SR_XDP_FLAGS_SKB_MODE (1U << 1)
+#define SR_XDP_FLAGS_DRV_MODE (1U << 2)
+
+#define SR_XDP_NO_CHUNK ((uint64_t)-1)
+
+static int  sr_afxdp_poll(struct sr_instance* sr);
+static int  sr_afxdp_send(struct sr_instance* sr, uint8_t* buf,
+                          unsigned int len, struct sr_if* iface);
+static void sr_afxdp_close(struct sr_instance* sr);
+
+static const struct sr_io_ops sr_afxdp_io =
+{
+    "afxdp",
+    sr_afxdp_poll,
+    sr_afxdp_send,
+    sr_afxdp_close,
+    0           /* no sendv: sr_io gathers */
+};
+
+static volatile sig_atomic_t sr_afxdp_stop;
+
+static void sr_afxdp_sigint(int sig)
+{
+    sr_afxdp_stop = 1;
+} /* -- sr_afxdp_sigint -- */
+
+static int sr_bpf(int cmd, union bpf_attr* attr)
+{ return syscall(__NR_bpf, cmd, attr, sizeof(*attr)); }
+
+static void sr_bpf_insn(struct bpf_insn* insn, uint8_t code, uint8_t dst,
+                        uint8_t src, int16_t off, int32_t imm)
+{
+    insn->code = code;
+    insn->dst_reg = dst;
+    insn->src_reg = src;
+    insn->off = off;
+    insn->imm = imm;
+} /* -- sr_bpf_insn -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_attach(..)
+ *
+ * Create the XSKMAP, load
+ *
+ *     r2 = ctx->rx_queue_index
+ *     return bpf_redirect_map(&xskmap, r2, XDP_PASS)
+ *
+ * and attach it in the given mode ("native", "generic" or "auto" for
+ * native falling back to generic).  Returns the mode that worked, or 0.
+ *
+ *---------------------------------------------------------------------------*/
+
+static const char* sr_xdp_attach(struct sr_xdp_port* port, const char* mode)
+{
+    struct bpf_insn prog[6];
+    union bpf_attr attr;
+    char log[1024];
+    const char* tried[2];
+    unsigned int flags[2], i, n = 0;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 1;
+    if((port->map_fd = sr_bpf(BPF_MAP_CREATE, &attr)) < 0)
+    { perror("bpf(XSKMAP)"); return 0; }
+
+    sr_bpf_insn(&prog[0], BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1,
+            offsetof(struct xdp_md, rx_queue_index), 0);
+    sr_bpf_insn(&prog[1], BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1,
+            BPF_PSEUDO_MAP_FD, 0, port->map_fd);
+    sr_bpf_insn(&prog[2], 0, 0, 0, 0, 0);
+    sr_bpf_insn(&prog[3], BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0,
+            XDP_PASS);
+    sr_bpf_insn(&prog[4], BPF_JMP | BPF_CALL, 0, 0, 0,
+            BPF_FUNC_redirect_map);
+    sr_bpf_insn(&prog[5], BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    memset(&attr, 0, sizeof(attr));
+    log[0] = '\0';
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.insns = (uint64_t)(unsigned long)prog;
+    attr.license = (uint64_t)(unsigned long)"GPL";
+    attr.log_buf = (uint64_t)(unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    if((port->prog_fd = sr_bpf(BPF_PROG_LOAD, &attr)) < 0)
+    {
+        perror("bpf(BPF_PROG_LOAD)");
+        fprintf(stderr, "%s", log);
+        return 0;
+    }
+
+    if(strcmp(mode, "native") == 0 || strcmp(mode, "auto") == 0)
+    { tried[n] = "native"; flags[n++] = SR_XDP_FLAGS_DRV_MODE; }
+    if(strcmp(mode, "generic") == 0 || strcmp(mode, "auto") == 0)
+    { tried[n] = "generic"; flags[n++] = SR_XDP_FLAGS_SKB_MODE; }
+    if(n == 0)
+    { fprintf(stderr, "Unknown XDP mode %s\n", mode); return 0; }
+
+    for(i = 0; i < n; i++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = port->prog_fd;
+        attr.link_create.target_ifindex = port->kernel_ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = flags[i];
+        if((port->link_fd = sr_bpf(BPF_LINK_CREATE, &attr)) >= 0)
+        { return tried[i]; }
+        fprintf(stderr, "%s: %s XDP: %s\n", port->iface->name, tried[i],
+                strerror(errno));
+    }
+    return 0;
+} /* -- sr_xdp_attach -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_ring_map(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_xdp_ring_map(int fd, struct sr_xdp_ring* ring,
+                           const struct xdp_ring_offset* off,
+                           size_t desc_size, off_t pgoff)
+{
+    ring->map_len = off->desc + SR_XDP_RING * desc_size;
+    ring->map = mmap(0, ring->map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if(ring->map == MAP_FAILED)
+    { ring->map = 0; perror("mmap(xdp ring)"); return -1; }
+
+    ring->producer = (uint32_t*)((uint8_t*)ring->map + off->producer);
+    ring->consumer = (uint32_t*)((uint8_t*)ring->map + off->consumer);
+    ring->flags = (uint32_t*)((uint8_t*)ring->map + off->flags);
+    ring->descs = (uint8_t*)ring->map + off->desc;
+    ring->mask = SR_XDP_RING - 1;
+    return 0;
+} /* -- sr_xdp_ring_map -- */
+
+static void sr_xdp_ring_unmap(struct sr_xdp_ring* ring)
+{
+    if(ring->map)
+    { munmap(ring->map, ring->map_len); }
+    ring->map = 0;
+} /* -- sr_xdp_ring_unmap -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_port_open(..)
+ *
+ * Attach the program, then open the socket.  The first port registers
+ * the UMEM; the others share it through the first port's socket but
+ * have fill and completion rings of their own.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_xdp_port_open(struct sr_afxdp* xdp, struct sr_xdp_port* port,
+                            const char* mode)
+{
+    static const unsigned char zero[ETHER_ADDR_LEN];
+    struct ifreq ifr;
+    int sd;
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    union bpf_attr attr;
+    socklen_t optlen;
+    int size = SR_XDP_RING;
+    uint32_t queue = 0;
+    const char* attached;
+
+    if((port->kernel_ifindex = if_nametoindex(port->iface->name)) == 0)
+    { perror(port->iface->name); return -1; }
+
+    /* -- no MAC in the config: use the one the interface already has -- */
+    if(memcmp(port->iface->addr, zero, ETHER_ADDR_LEN) == 0)
+    {
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, port->iface->name, IFNAMSIZ - 1);
+        if((sd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+                ioctl(sd, SIOCGIFHWADDR, &ifr) < 0)
+        { perror(port->iface->name); if(sd >= 0) close(sd); return -1; }
+        close(sd);
+        memcpy(port->iface->addr, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+    }
+
+    /* -- nor an MTU: the same -- */
+    if(port->iface->mtu == 0)
+    {
+        memset(&ifr, 0, sizeof(ifr));
+        strncpy(ifr.ifr_name, port->iface->name, IFNAMSIZ - 1);
+        if((sd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+                ioctl(sd, SIOCGIFMTU, &ifr) < 0)
+        { perror(port->iface->name); if(sd >= 0) close(sd); return -1; }
+        close(sd);
+        port->iface->mtu = ifr.ifr_mtu;
+    }
+
+    if((attached = sr_xdp_attach(port, mode)) == 0)
+    { return -1; }
+    if(xdp->mode && strcmp(xdp->mode, attached) != 0)
+    { LogWarn("afxdp %s: attached in %s mode\n", port->iface->name, attached); }
+    if(!xdp->mode)
+    { xdp->mode = attached; }
+
+    if((port->fd = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+    { perror("socket(AF_XDP)"); return -1; }
+
+    if(port == &xdp->ports[0])
+    {
+        memset(&reg, 0, sizeof(reg));
+        reg.addr = (uint64_t)(unsigned long)xdp->umem;
+        reg.len = xdp->umem_len;
+        reg.chunk_size = SR_XDP_CHUNK;
+        if(setsockopt(port->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0)
+        { perror("XDP_UMEM_REG"); return -1; }
+    }
+
+    if(setsockopt(port->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size,
+                sizeof(size)) < 0 ||
+       setsockopt(port->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+                sizeof(size)) < 0 ||
+       setsockopt(port->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) < 0 ||
+       setsockopt(port->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) < 0)
+    { perror("setsockopt(xdp ring)"); return -1; }
+
+    optlen = sizeof(off);
+    if(getsockopt(port->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+    { perror("XDP_MMAP_OFFSETS"); return -1; }
+
+    if(sr_xdp_ring_map(port->fd, &port->fill, &off.fr, sizeof(uint64_t),
+                XDP_UMEM_PGOFF_FILL_RING) ||
+       sr_xdp_ring_map(port->fd, &port->comp, &off.cr, sizeof(uint64_t),
+                XDP_UMEM_PGOFF_COMPLETION_RING) ||
+       sr_xdp_ring_map(port->fd, &port->rx, &off.rx,
+                sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+       sr_xdp_ring_map(port->fd, &port->tx, &off.tx,
+                sizeof(struct xdp_desc), XDP_PGOFF_TX_RING))
+    { return -1; }
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = port->kernel_ifindex;
+    sxdp.sxdp_queue_id = queue;
+    if(port != &xdp->ports[0])
+    {
+        sxdp.sxdp_flags = XDP_SHARED_UMEM;
+        sxdp.sxdp_shared_umem_fd = xdp->ports[0].fd;
+        if(bind(port->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0)
+        { perror("bind(AF_XDP, shared umem)"); return -1; }
+    }
+    else
+    {
+        /* -- zero copy where the driver has it, veth does not -- */
+        sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_ZEROCOPY;
+        if(bind(port->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0)
+        {
+            sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP | XDP_COPY;
+            if(bind(port->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0)
+            { perror("bind(AF_XDP)"); return -1; }
+        }
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = port->map_fd;
+    attr.key = (uint64_t)(unsigned long)&queue;
+    attr.value = (uint64_t)(unsigned long)&port->fd;
+    if(sr_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    { perror("bpf(BPF_MAP_UPDATE_ELEM)"); return -1; }
+
+    return 0;
+} /* -- sr_xdp_port_open -- */
+
+static void sr_xdp_port_close(struct sr_xdp_port* port)
+{
+    /* -- program first, so nothing is redirected to a closed socket -- */
+    if(port->link_fd >= 0)
+    { close(port->link_fd); }
+    if(port->prog_fd >= 0)
+    { close(port->prog_fd); }
+    if(port->map_fd >= 0)
+    { close(port->map_fd); }
+    port->link_fd = port->prog_fd = port->map_fd = -1;
+
+    sr_xdp_ring_unmap(&port->fill);
+    sr_xdp_ring_unmap(&port->comp);
+    sr_xdp_ring_unmap(&port->rx);
+    sr_xdp_ring_unmap(&port->tx);
+    if(port->fd >= 0)
+    { close(port->fd); }
+    port->fd = -1;
+} /* -- sr_xdp_port_close -- */
+
+static void sr_afxdp_free(struct sr_afxdp* xdp)
+{
+    /* -- sockets sharing the UMEM go before its owner -- */
+    while(xdp->nports)
+    { sr_xdp_port_close(&xdp->ports[--xdp->nports]); }
+    if(xdp->umem)
+    { munmap(xdp->umem, xdp->umem_len); }
+    free(xdp->pool);
+    free(xdp);
+} /* -- sr_afxdp_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afxdp_open(..)
+ *
+ * Read interfaces from ifconfig (see sr_load_if_config; a MAC of
+ * 00:00:00:00:00:00 takes the Linux interface's own, as does a missing
+ * MTU), attach each one and install the backend.
+ * Expects the routing table loaded and sr_init done.  Returns 0 on
+ * success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_afxdp_open(struct sr_instance* sr, const char* ifconfig,
+                  const char* mode)
+{
+    struct sr_afxdp* xdp;
+    struct sr_xdp_port* port;
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(ifconfig);
+    assert(mode);
+
+    /* -- a received frame has its chunk less the kernel's headroom -- */
+    if(sr->max_frame > SR_XDP_CHUNK - SR_XDP_HEADROOM)
+    {
+        fprintf(stderr, "AF_XDP frames are at most %d bytes (-j %u)\n",
+                SR_XDP_CHUNK - SR_XDP_HEADROOM, sr->max_frame);
+        return -1;
+    }
+
+    if(sr_load_if_config(sr, ifconfig) != 0)
+    { return -1; }
+
+    xdp = (struct sr_afxdp*)calloc(1, sizeof(struct sr_afxdp));
+    assert(xdp);
+    xdp->main_thread = pthread_self();
+    xdp->cur_chunk = SR_XDP_NO_CHUNK;
+    pthread_mutex_init(&xdp->lock, 0);
+
+    xdp->umem_len = (size_t)sr->num_ifaces * SR_XDP_PORT_CHUNKS *
+        SR_XDP_CHUNK;
+    xdp->umem = (uint8_t*)mmap(0, xdp->umem_len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(xdp->umem == MAP_FAILED)
+    { perror("mmap(umem)"); xdp->umem = 0; sr_afxdp_free(xdp); return -1; }
+
+    xdp->pool = (uint64_t*)malloc(sizeof(uint64_t) *
+            sr->num_ifaces * SR_XDP_PORT_CHUNKS);
+    assert(xdp->pool);
+    for(i = 0; i < sr->num_ifaces * SR_XDP_PORT_CHUNKS; i++)
+    { xdp->pool[xdp->npool++] = (uint64_t)i * SR_XDP_CHUNK; }
+
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        port = &xdp->ports[xdp->nports++];
+        port->fd = port->map_fd = port->prog_fd = port->link_fd = -1;
+        port->iface = sr->if_table[i];
+        if(sr_xdp_port_open(xdp, port, mode) != 0)
+        {
+            fprintf(stderr, "Error attaching %s\n", port->iface->name);
+            sr_afxdp_free(xdp);
+            return -1;
+        }
+    }
+
+    sr_io_interfaces_ready(sr);
+    if(sr_verify_routing_table(sr) != 0)
+    {
+        fprintf(stderr,"Routing table not consistent with %s\n", ifconfig);
+        sr_afxdp_free(xdp);
+        return -1;
+    }
+
+    signal(SIGINT, sr_afxdp_sigint);
+    signal(SIGTERM, sr_afxdp_sigint);
+
+    sr->io = &sr_afxdp_io;
+    sr->io_state = xdp;
+    LogInfo("AF_XDP in %s mode, %u chunk UMEM\n", xdp->mode, xdp->npool);
+    printf(" <-- Ready to process packets --> \n");
+    return 0;
+} /* -- sr_afxdp_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_recycle(..)
+ *
+ * Take completed TX chunks back into the pool and top up the fill rings
+ * from it.  Caller holds the lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_xdp_recycle(struct sr_afxdp* xdp)
+{
+    struct sr_xdp_port* port;
+    uint64_t* addrs;
+    uint32_t prod, cons, n;
+    unsigned int i;
+
+    for(i = 0; i < xdp->nports; i++)
+    {
+        port = &xdp->ports[i];
+
+        addrs = (uint64_t*)port->comp.descs;
+        prod = __atomic_load_n(port->comp.producer, __ATOMIC_ACQUIRE);
+        cons = *port->comp.consumer;
+        /* -- frames sent in place start past the RX headroom -- */
+        for(; cons != prod; cons++)
+        {
+            xdp->pool[xdp->npool++] = addrs[cons & port->comp.mask] &
+                ~(uint64_t)(SR_XDP_CHUNK - 1);
+        }
+        __atomic_store_n(port->comp.consumer, cons, __ATOMIC_RELEASE);
+
+        addrs = (uint64_t*)port->fill.descs;
+        prod = *port->fill.producer;
+        cons = __atomic_load_n(port->fill.consumer, __ATOMIC_ACQUIRE);
+        n = SR_XDP_RING - (prod - cons);
+        for(; n && xdp->npool; n--, prod++)
+        { addrs[prod & port->fill.mask] = xdp->pool[--xdp->npool]; }
+        __atomic_store_n(port->fill.producer, prod, __ATOMIC_RELEASE);
+    }
+} /* -- sr_xdp_recycle -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_kick(..)
+ *
+ * Copy mode only transmits inside sendto; zero copy drivers only need it
+ * when they ask.  Caller holds the lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_xdp_kick(struct sr_xdp_port* port)
+{
+    port->tx_pending = 0;
+    port->tx_kicks++;
+    if(sendto(port->fd, 0, 0, MSG_DONTWAIT, 0, 0) < 0 && errno != EAGAIN &&
+            errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+    { LogWarn("afxdp %s: tx: %s\n", port->iface->name, strerror(errno)); }
+} /* -- sr_xdp_kick -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_xdp_rx(..)
+ *
+ * Hand up to SR_XDP_BATCH frames to the router.  Returns frames seen.
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int sr_xdp_rx(struct sr_instance* sr, struct sr_afxdp* xdp,
+                              struct sr_xdp_port* port)
+{
+    struct xdp_desc* descs = (struct xdp_desc*)port->rx.descs;
+    struct xdp_desc* desc;
+    uint64_t done[SR_XDP_BATCH];
+    uint32_t prod, cons;
+    unsigned int n = 0, ndone = 0;
+
+    prod = __atomic_load_n(port->rx.producer, __ATOMIC_ACQUIRE);
+    cons = *port->rx.consumer;
+
+    for(; cons != prod && n < SR_XDP_BATCH; cons++, n++)
+    {
+        desc = &descs[cons & port->rx.mask];
+        xdp->cur_chunk = desc->addr & ~(uint64_t)(SR_XDP_CHUNK - 1);
+        xdp->cur_claimed = 0;
+
+        sr_io_receive(sr, xdp->umem + desc->addr, desc->len, port->iface);
+
+        if(!xdp->cur_claimed)
+        { done[ndone++] = xdp->cur_chunk; }
+    }
+    xdp->cur_chunk = SR_XDP_NO_CHUNK;
+    __atomic_store_n(port->rx.consumer, cons, __ATOMIC_RELEASE);
+    port->rx_frames += n;
+
+    if(ndone)
+    {
+        pthread_mutex_lock(&xdp->lock);
+        while(ndone)
+        { xdp->pool[xdp->npool++] = done[--ndone]; }
+        pthread_mutex_unlock(&xdp->lock);
+    }
+    return n;
+} /* -- sr_xdp_rx -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afxdp_poll(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afxdp_poll(struct sr_instance* sr)
+{
+    struct sr_afxdp* xdp = (struct sr_afxdp*)sr->io_state;
+    struct pollfd pfd[SR_MAX_IFACES];
+    unsigned int i, seen = 0;
+
+    if(sr_afxdp_stop)
+    { return 0; }
+
+    pthread_mutex_lock(&xdp->lock);
+    sr_xdp_recycle(xdp);
+    pthread_mutex_unlock(&xdp->lock);
+
+    for(i = 0; i < xdp->nports; i++)
+    { seen += sr_xdp_rx(sr, xdp, &xdp->ports[i]); }
+
+    if(seen == 0)
+    {
+        /* -- also wakes the driver up for the fill ring -- */
+        for(i = 0; i < xdp->nports; i++)
+        {
+            pfd[i].fd = xdp->ports[i].fd;
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+        }
+        if(poll(pfd, xdp->nports, sr->busy ? 0 : SR_XDP_POLL_MS) < 0 &&
+                errno != EINTR)
+        { perror("poll"); return -1; }
+    }
+
+    pthread_mutex_lock(&xdp->lock);
+    for(i = 0; i < xdp->nports; i++)
+    {
+        if(xdp->ports[i].tx_pending)
+        { sr_xdp_kick(&xdp->ports[i]); }
+    }
+    pthread_mutex_unlock(&xdp->lock);
+
+    return sr_afxdp_stop ? 0 : 1;
+} /* -- sr_afxdp_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afxdp_send(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_afxdp_send(struct sr_instance* sr, uint8_t* buf,
+                         unsigned int len, struct sr_if* iface)
+{
+    struct sr_afxdp* xdp = (struct sr_afxdp*)sr->io_state;
+    struct sr_xdp_port* port;
+    struct xdp_desc* desc;
+    uint64_t addr;
+    uint32_t prod;
+    int inplace = 0;
+
+    if(iface->ifindex >= xdp->nports || len > SR_XDP_CHUNK)
+    { return -1; }
+    port = &xdp->ports[iface->ifindex];
+
+    pthread_mutex_lock(&xdp->lock);
+    if(port->fd < 0)
+    { pthread_mutex_unlock(&xdp->lock); return -1; }
+
+    /* -- make room: kick what is queued, take back what has gone -- */
+    prod = *port->tx.producer;
+    if(prod - __atomic_load_n(port->tx.consumer, __ATOMIC_ACQUIRE) ==
+            SR_XDP_RING)
+    { sr_xdp_kick(port); }
+    if(xdp->npool == 0 ||
+            prod - __atomic_load_n(port->tx.consumer, __ATOMIC_ACQUIRE) ==
+            SR_XDP_RING)
+    { sr_xdp_recycle(xdp); }
+
+    if(prod - __atomic_load_n(port->tx.consumer, __ATOMIC_ACQUIRE) ==
+            SR_XDP_RING)
+    {
+        port->tx_full++;
+        pthread_mutex_unlock(&xdp->lock);
+        return -1;
+    }
+
+    if(xdp->cur_chunk != SR_XDP_NO_CHUNK && !xdp->cur_claimed &&
+            buf >= xdp->umem + xdp->cur_chunk &&
+            buf + len <= xdp->umem + xdp->cur_chunk + SR_XDP_CHUNK &&
+            pthread_equal(pthread_self(), xdp->main_thread))
+    {
+        /* -- forwarding the frame we were handed: send it from its chunk -- */
+        addr = buf - xdp->umem;
+        xdp->cur_claimed = 1;
+        inplace = 1;
+    }
+    else if(xdp->npool)
+    {
+        addr = xdp->pool[--xdp->npool];
+        memcpy(xdp->umem + addr, buf, len);
+    }
+    else
+    {
+        port->tx_full++;
+        pthread_mutex_unlock(&xdp->lock);
+        return -1;
+    }
+
+    desc = &((struct xdp_desc*)port->tx.descs)[prod & port->tx.mask];
+    desc->addr = addr;
+    desc->len = len;
+    desc->options = 0;
+    __atomic_store_n(port->tx.producer, prod + 1, __ATOMIC_RELEASE);
+
+    port->tx_frames++;
+    port->tx_inplace += inplace;
+    port->tx_pending++;
+    if(!pthread_equal(pthread_self(), xdp->main_thread))
+    { sr_xdp_kick(port); }
+    pthread_mutex_unlock(&xdp->lock);
+
+    return 0;
+} /* -- sr_afxdp_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_afxdp_close(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_afxdp_close(struct sr_instance* sr)
+{
+    struct sr_afxdp* xdp = (struct sr_afxdp*)sr->io_state;
+    struct sr_xdp_port* port;
+    struct xdp_statistics st;
+    socklen_t slen;
+    unsigned int i;
+
+    for(i = 0; i < xdp->nports; i++)
+    {
+        port = &xdp->ports[i];
+        memset(&st, 0, sizeof(st));
+        slen = sizeof(st);
+        getsockopt(port->fd, SOL_XDP, XDP_STATISTICS, &st, &slen);
+
+        LogInfo("afxdp %s: rx %llu frames, kernel drops %llu, "
+                "fill empty %llu; tx %llu frames (%llu in place), "
+                "%llu kicks, %llu ring full\n", port->iface->name,
+                (unsigned long long)port->rx_frames,
+                (unsigned long long)(st.rx_dropped + st.rx_ring_full),
+                (unsigned long long)st.rx_fill_ring_empty_descs,
+                (unsigned long long)port->tx_frames,
+                (unsigned long long)port->tx_inplace,
+                (unsigned long long)port->tx_kicks,
+                (unsigned long long)port->tx_full);
+    }
+
+    /* -- the ARP sweeper may still send: leave the UMEM mapped, but
+     *    make every port refuse -- */
+    pthread_mutex_lock(&xdp->lock);
+    for(i = xdp->nports; i > 0; i--)
+    { sr_xdp_port_close(&xdp->ports[i - 1]); }
+    pthread_mutex_unlock(&xdp->lock);
+} /* -- sr_afxdp_close -- */
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afxdp.h
+ *
+ * Description:
+ *
+ * Linux AF_XDP backend: every sr_if is attached to queue 0 of the Linux
+ * interface of the same name.  A small XDP program redirects that queue
+ * into an XDP socket, and all sockets share one UMEM that doubles as the
+ * router's packet buffer pool.  Frames are handled in place in their UMEM
+ * chunk, and a forwarded frame leaves from the very chunk it arrived in;
+ * only frames the router builds itself (ARP, ICMP) are copied into a
+ * chunk from the pool.
+ *
+ * Works in native (driver) or generic XDP mode, so veth pairs between
+ * network namespaces are enough to run it.  As with AF_PACKET, turn
+ * segmentation and checksum offload off on the veth peers.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_AFXDP_H
+#define SR_AFXDP_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+
+#define SR_XDP_CHUNK        2048    /* UMEM chunk, one frame */
+#define SR_XDP_HEADROOM     256     /* XDP_PACKET_HEADROOM ahead of RX data */
+#define SR_XDP_PORT_CHUNKS  4096    /* chunks added to the pool per port */
+#define SR_XDP_RING         2048    /* fill, completion, RX and TX rings */
+#define SR_XDP_BATCH        64      /* RX descriptors per port per pass */
+
+/* how long one poll waits for traffic, ms */
+#define SR_XDP_POLL_MS      100
+
+struct sr_instance;
+
+struct sr_xdp_ring
+{
+    uint32_t* producer;
+    uint32_t* consumer;
+    uint32_t* flags;
+    void* descs;                /* uint64_t addrs or struct xdp_desc */
+    uint32_t mask;
+    void* map;
+    size_t map_len;
+};
+
+struct sr_xdp_port
+{
+    struct sr_if* iface;
+    int fd;
+    int kernel_ifindex;
+    int map_fd;                 /* XSKMAP, rx queue -> socket */
+    int prog_fd;
+    int link_fd;                /* closing it detaches the program */
+
+    struct sr_xdp_ring fill;
+    struct sr_xdp_ring comp;
+    struct sr_xdp_ring rx;
+    struct sr_xdp_ring tx;
+    unsigned int tx_pending;    /* queued but not kicked */
+
+    uint64_t rx_frames;
+    uint64_t tx_frames;
+    uint64_t tx_inplace;        /* sent from the chunk they arrived in */
+    uint64_t tx_kicks;
+    uint64_t tx_full;           /* dropped, no ring slot or chunk */
+};
+
+struct sr_afxdp
+{
+    struct sr_xdp_port ports[SR_MAX_IFACES];
+    unsigned int nports;
+    const char* mode;           /* the XDP mode that attached */
+
+    uint8_t* umem;
+    size_t umem_len;
+
+    /* -- the buffer pool: chunks not in any ring, under lock -- */
+    uint64_t* pool;
+    unsigned int npool;
+    pthread_mutex_t lock;       /* pool, fill, completion and TX rings */
+
+    pthread_t main_thread;
+    uint64_t cur_chunk;         /* chunk the router is handling */
+    int cur_claimed;            /* ... and already queued it for TX */
+};
+
+int sr_afxdp_open(struct sr_instance* sr, const char* ifconfig,
+                  const char* mode);
+
+#endif /* -- SR_AFXDP_H -- */
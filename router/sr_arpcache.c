@@ -10,6 +10,7 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_stats.h"
 
 /* 
   This function gets called every second. For each request sent out, we keep
@@ -17,7 +18,13 @@
   See the comments in the header file for an idea of what it should look like.
 */
 void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
-    /* Fill this in */
+    struct sr_arpreq *req, *next;
+
+    /* sr_handle_arpreq may destroy req, so grab next first */
+    for (req = sr->cache.requests; req != NULL; req = next) {
+        next = req->next;
+        sr_handle_arpreq(sr, req);
+    }
 }
 
 /* You should not need to touch the rest of this code. */
@@ -58,7 +65,7 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
-                                       char *iface)
+                                       struct sr_if *iface)
 {
     pthread_mutex_lock(&(cache->lock));
     
@@ -84,8 +91,8 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         new_pkt->buf = (uint8_t *)malloc(packet_len);
         memcpy(new_pkt->buf, packet, packet_len);
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
+        new_pkt->iface = iface;
+        new_pkt->rx_tsc = sr_stats_rx_started();
         new_pkt->next = req->packets;
         req->packets = new_pkt;
     }
@@ -96,8 +103,9 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
 }
 
 /* This method performs two functions:
-   1) Looks up this IP in the request queue. If it is found, returns a pointer
-      to the sr_arpreq with this IP. Otherwise, returns NULL.
+   1) Looks up this IP in the request queue. If it is found, takes it off the
+      queue, so the sweeper no longer sees it, and returns a pointer to the
+      sr_arpreq with this IP. Otherwise, returns NULL.
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
@@ -133,6 +141,7 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         cache->entries[i].ip = ip;
         cache->entries[i].added = time(NULL);
         cache->entries[i].valid = 1;
+        cache->entries[i].permanent = 0;
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -140,6 +149,36 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
     return req;
 }
 
+/* Adds an IP->MAC mapping that is never timed out. */
+int sr_arpcache_insert_static(struct sr_arpcache *cache,
+                              const unsigned char *mac,
+                              uint32_t ip)
+{
+    pthread_mutex_lock(&(cache->lock));
+    
+    int i, slot = SR_ARPCACHE_SZ;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
+            slot = i;
+            break;
+        }
+        if (!(cache->entries[i].valid) && slot == SR_ARPCACHE_SZ)
+            slot = i;
+    }
+    
+    if (slot != SR_ARPCACHE_SZ) {
+        memcpy(cache->entries[slot].mac, mac, 6);
+        cache->entries[slot].ip = ip;
+        cache->entries[slot].added = time(NULL);
+        cache->entries[slot].valid = 1;
+        cache->entries[slot].permanent = 1;
+    }
+    
+    pthread_mutex_unlock(&(cache->lock));
+    
+    return slot != SR_ARPCACHE_SZ ? 0 : -1;
+}
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
@@ -169,8 +208,6 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
             nxt = pkt->next;
             if (pkt->buf)
                 free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
             free(pkt);
         }
         
@@ -182,6 +219,8 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
 
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+
     fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
     fprintf(stderr, "-----------------------------------------------------------\n");
     
@@ -193,6 +232,8 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
     }
     
     fprintf(stderr, "\n");
+
+    pthread_mutex_unlock(&(cache->lock));
 }
 
 /* Initialize table + table lock. Returns 0 on success. */
@@ -217,29 +258,34 @@ int sr_arpcache_destroy(struct sr_arpcache *cache) {
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+/* Invalidates entries that were added more than SR_ARPCACHE_TO seconds ago
+   and sweeps the requests; the timeout thread's work once a second. */
+void sr_arpcache_tick(struct sr_instance *sr) {
+    struct sr_arpcache *cache = &(sr->cache);
+
+    pthread_mutex_lock(&(cache->lock));
+
+    time_t curtime = time(NULL);
+
+    int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && !(cache->entries[i].permanent) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
+            cache->entries[i].valid = 0;
+        }
+    }
+
+    sr_arpcache_sweepreqs(sr);
+
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+/* Thread which runs sr_arpcache_tick every second. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
-    struct sr_arpcache *cache = &(sr->cache);
     
     while (1) {
         sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
-        }
-        
-        sr_arpcache_sweepreqs(sr);
-
-        pthread_mutex_unlock(&(cache->lock));
+        sr_arpcache_tick(sr);
     }
     
     return NULL;
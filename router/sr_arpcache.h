@@ -77,7 +77,9 @@
 struct sr_packet {
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    struct sr_if *iface;        /* The outgoing interface */
+    uint64_t rx_tsc;            /* When it was received, for the latency
+                                   stats; 0 if not */
     struct sr_packet *next;
 };
 
@@ -86,6 +88,7 @@ struct sr_arpentry {
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    int permanent;              /* configured, never timed out */
 };
 
 struct sr_arpreq {
@@ -121,16 +124,24 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
-                         char *iface);
+                         struct sr_if *iface);
 
 /* This method performs two functions:
-   1) Looks up this IP in the request queue. If it is found, returns a pointer
-      to the sr_arpreq with this IP. Otherwise, returns NULL.
+   1) Looks up this IP in the request queue. If it is found, takes it off the
+      queue, so the sweeper no longer sees it, and returns a pointer to the
+      sr_arpreq with this IP. Otherwise, returns NULL.
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
                                      uint32_t ip);
 
+/* Adds an IP->MAC mapping that the timeout thread leaves alone, for
+   backends without a live ARP peer.  Returns 0 on success, -1 if the
+   cache is full. */
+int sr_arpcache_insert_static(struct sr_arpcache *cache,
+                              const unsigned char *mac,
+                              uint32_t ip);
+
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
@@ -147,4 +158,9 @@ int   sr_arpcache_init(struct sr_arpcache *cache);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
 
+/* One pass of the timeout thread, for a main loop that runs it itself
+   (busy-poll mode, see sr_busy.h). */
+struct sr_instance;
+void  sr_arpcache_tick(struct sr_instance *sr);
+
 #endif
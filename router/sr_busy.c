@@ -0,0 +1,106 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_busy.c
+ *
+ * Description:
+ *
+ * Busy-poll mode, see sr_busy.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+
+#include <sys/socket.h>
+
+#include "sr_busy.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_busy_open(..)
+ *
+ * Pin the calling (main) thread to cpu and take over the ARP sweeper's
+ * work.  Call before sr_init(..), which then starts no sweeper thread.
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_busy_open(struct sr_instance* sr, int cpu)
+{
+    struct sr_busy* b;
+    cpu_set_t set;
+    int usec = SR_BUSY_POLL_US;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->stats);  /* its TSC calibration */
+
+    if(cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        fprintf(stderr, "Bad cpu %d\n", cpu);
+        return -1;
+    }
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        perror("sched_setaffinity");
+        return -1;
+    }
+
+    /* -- lets the kernel spin on the device queue too, where it has one -- */
+    if(sr->sockfd >= 0 && setsockopt(sr->sockfd, SOL_SOCKET, SO_BUSY_POLL,
+                &usec, sizeof(usec)) != 0)
+    { LogWarn("SO_BUSY_POLL: %s\n", strerror(errno)); }
+
+    b = (struct sr_busy*)calloc(1, sizeof(struct sr_busy));
+    assert(b);
+    b->cpu = cpu;
+    b->tsc_hz = sr->stats->tsc_hz;
+    b->next_tick = sr_stats_tsc() + b->tsc_hz;
+    sr->busy = b;
+
+    LogInfo("busy-poll: pinned to cpu %d, TSC at %.3f GHz\n",
+            cpu, b->tsc_hz / 1e9);
+    return 0;
+} /* -- sr_busy_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_busy_tick(..)
+ *
+ * Once per main loop pass: the ARP sweep, when a second has gone by.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_busy_tick(struct sr_instance* sr)
+{
+    struct sr_busy* b = sr->busy;
+    uint64_t now = sr_stats_tsc();
+
+    b->loops++;
+    if(now < b->next_tick)
+    { return; }
+
+    sr_arpcache_tick(sr);
+    b->ticks++;
+    b->next_tick = now + b->tsc_hz;
+} /* -- sr_busy_tick -- */
+
+void sr_busy_close(struct sr_instance* sr)
+{
+    struct sr_busy* b = sr->busy;
+
+    if(!b)
+    { return; }
+    LogInfo("busy-poll: %llu passes, %llu ARP sweeps on cpu %d\n",
+            (unsigned long long)b->loops, (unsigned long long)b->ticks,
+            b->cpu);
+    free(b);
+    sr->busy = 0;
+} /* -- sr_busy_close -- */
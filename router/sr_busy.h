@@ -0,0 +1,44 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_busy.h
+ *
+ * Description:
+ *
+ * Busy-poll mode (-b cpu) for latency over efficiency.  The main thread
+ * is pinned to one core and never sleeps: each backend's poll looks for
+ * work without blocking (VNS checks the socket with MSG_DONTWAIT and sets
+ * SO_BUSY_POLL, shm spins on its ring, io_uring enters without waiting,
+ * AF_PACKET reads the ring and AF_XDP polls with no timeout) and comes
+ * straight back.  There is no ARP sweeper thread; the main loop runs the
+ * once a second ARP work itself when the TSC says it is due.
+ *
+ * Give it a core of its own: on a shared core the spinning competes with
+ * whatever else runs there, the traffic source included.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_BUSY_H
+#define SR_BUSY_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#define SR_BUSY_POLL_US  50     /* SO_BUSY_POLL on the VNS socket */
+
+struct sr_instance;
+
+struct sr_busy
+{
+    int cpu;
+    uint64_t tsc_hz;            /* the stats segment's calibration */
+    uint64_t next_tick;         /* TSC of the next ARP sweep */
+
+    uint64_t loops;
+    uint64_t ticks;
+};
+
+int  sr_busy_open(struct sr_instance* sr, int cpu);
+void sr_busy_tick(struct sr_instance* sr);
+void sr_busy_close(struct sr_instance* sr);
+
+#endif /* -- SR_BUSY_H -- */
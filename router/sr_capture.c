@@ -0,0 +1,591 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.c
+ *
+ * Description:
+ *
+ * Lock-free capture ring and the writer thread draining it.
+ *
+ * Slot i starts with seq == i.  A producer that has claimed position p
+ * (by moving head from p to p+1) owns the slot until it publishes it by
+ * storing seq = p+1.  The writer consumes position t once seq == t+1
+ * and hands the slot back for the next lap by storing seq = t+nslots.
+ * A producer that finds seq < p has lapped the writer: the ring is full.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "sr_capture.h"
+#include "sr_dumper.h"
+#include "sr_protocol.h"
+#include "sr_log.h"
+
+static void* sr_capture_writer(void* arg);
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_open(..)
+ *
+ * Open the dump file and start the writer.  Returns 0 on failure.
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sr_capture* sr_capture_open(const char* fname,
+                                   const struct sr_capture_opts* opts)
+{
+    struct sr_capture* cap;
+    int snaplen;
+    uint32_t i;
+
+    /* REQUIRES */
+    assert(fname);
+    assert(opts);
+    assert(opts->snaplen > 0);
+
+    snaplen = opts->snaplen;
+
+    cap = (struct sr_capture*)calloc(1, sizeof(struct sr_capture));
+    assert(cap);
+
+    cap->sample = opts->sample ? opts->sample : 1;
+    if(opts->filter)
+    {
+        cap->ninsn = sr_capture_compile(opts->filter, cap->insn,
+                SR_CAPTURE_MAX_INSN);
+        if(cap->ninsn < 0)
+        {
+            free(cap);
+            return 0;
+        }
+    }
+
+    /* -- pcapng if asked, or if the name says so -- */
+    cap->pcapng = opts->pcapng ||
+        (strlen(fname) > 7 && strcmp(fname + strlen(fname) - 7, ".pcapng") == 0);
+    cap->ng_anon_id = -1;
+    for(i = 0; i < SR_MAX_IFACES; i++)
+    { cap->ifs[i].ng_id = -1; }
+
+    cap->fp = cap->pcapng ? sr_dump_ng_open(fname)
+                          : sr_dump_open(fname, 0, snaplen);
+    if(!cap->fp)
+    {
+        free(cap);
+        return 0;
+    }
+
+    /* -- one big stdio buffer so the writer issues few large writes -- */
+    cap->iobuf = (char*)malloc(SR_CAPTURE_IOBUF);
+    assert(cap->iobuf);
+    setvbuf(cap->fp, cap->iobuf, _IOFBF, SR_CAPTURE_IOBUF);
+
+    cap->snaplen = snaplen;
+    cap->mask = SR_CAPTURE_SLOTS - 1;
+    cap->slots = (struct sr_capture_slot*)calloc(SR_CAPTURE_SLOTS,
+            sizeof(struct sr_capture_slot));
+    cap->data = (unsigned char*)malloc((size_t)SR_CAPTURE_SLOTS * snaplen);
+    assert(cap->slots && cap->data);
+
+    for(i = 0; i < SR_CAPTURE_SLOTS; i++)
+    {
+        cap->slots[i].seq = i;
+        cap->slots[i].data = cap->data + (size_t)i * snaplen;
+    }
+
+    if(pthread_create(&cap->writer, 0, sr_capture_writer, cap) != 0)
+    {
+        perror("pthread_create(..):sr_capture_open");
+        sr_dump_close(cap->fp);
+        free(cap->iobuf);
+        free(cap->slots);
+        free(cap->data);
+        free(cap);
+        return 0;
+    }
+
+    return cap;
+} /* -- sr_capture_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_packet(..)
+ *
+ * Called on the forwarding path.  Never blocks: copies at most snaplen
+ * bytes into a free slot, or counts a drop if there is none.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf,
+                       unsigned int len, int ifindex, int dir)
+{
+    struct sr_capture_slot* slot;
+    struct timespec ts;
+    uint32_t pos, seq;
+    int32_t diff;
+
+    __atomic_add_fetch(&cap->seen, 1, __ATOMIC_RELAXED);
+
+    /* -- filter and sample before touching the ring -- */
+    if(cap->ninsn && !sr_capture_match(cap->insn, cap->ninsn, buf, len))
+    {
+        __atomic_add_fetch(&cap->filtered, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    if(cap->sample > 1 &&
+       (__atomic_fetch_add(&cap->matched, 1, __ATOMIC_RELAXED) % cap->sample))
+    { return; }
+
+    pos = __atomic_load_n(&cap->head, __ATOMIC_RELAXED);
+    for(;;)
+    {
+        slot = &cap->slots[pos & cap->mask];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        diff = (int32_t)(seq - pos);
+
+        if(diff == 0)
+        {
+            if(__atomic_compare_exchange_n(&cap->head, &pos, pos + 1, 0,
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            { break; }
+            /* -- lost the race, pos now holds the current head -- */
+        }
+        else if(diff < 0)
+        {
+            __atomic_add_fetch(&cap->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        { pos = __atomic_load_n(&cap->head, __ATOMIC_RELAXED); }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    slot->ifindex = (ifindex >= 0 && ifindex < SR_MAX_IFACES) ? ifindex : -1;
+    slot->dir = dir;
+    slot->len = len;
+    slot->caplen = (len < (unsigned int)cap->snaplen) ? len : cap->snaplen;
+    memcpy(slot->data, buf, slot->caplen);
+
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&cap->captured, 1, __ATOMIC_RELAXED);
+} /* -- sr_capture_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_interface(..)
+ *
+ * Tell the writer what interface ifindex is called, for pcapng.  Must be
+ * called before frames on that interface are captured.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_interface(struct sr_capture* cap, unsigned int ifindex,
+                          const char* name, const unsigned char* mac)
+{
+    if(!cap || ifindex >= SR_MAX_IFACES)
+    { return; }
+
+    strncpy(cap->ifs[ifindex].name, name, sr_IFACE_NAMELEN - 1);
+    memcpy(cap->ifs[ifindex].mac, mac, ETHER_ADDR_LEN);
+    __atomic_store_n(&cap->ifs[ifindex].known, 1, __ATOMIC_RELEASE);
+} /* -- sr_capture_interface -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_ng_id(..)
+ *
+ * pcapng interface id for a slot, writing the IDB on first use.  Frames
+ * with no interface share one anonymous IDB.
+ *
+ *---------------------------------------------------------------------------*/
+
+static uint32_t sr_capture_ng_id(struct sr_capture* cap, int ifindex)
+{
+    struct sr_capture_if* cif;
+    char name[16];
+
+    if(ifindex < 0)
+    {
+        if(cap->ng_anon_id < 0)
+        {
+            sr_dump_ng_interface(cap->fp, 0, 0, cap->snaplen);
+            cap->ng_anon_id = cap->ng_next_id++;
+        }
+        return cap->ng_anon_id;
+    }
+
+    cif = &cap->ifs[ifindex];
+    if(cif->ng_id < 0)
+    {
+        if(__atomic_load_n(&cif->known, __ATOMIC_ACQUIRE))
+        { sr_dump_ng_interface(cap->fp, cif->name, cif->mac, cap->snaplen); }
+        else
+        {
+            snprintf(name, sizeof(name), "if%d", ifindex);
+            sr_dump_ng_interface(cap->fp, name, 0, cap->snaplen);
+        }
+        cif->ng_id = cap->ng_next_id++;
+    }
+
+    return cif->ng_id;
+} /* -- sr_capture_ng_id -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_drain(..)
+ *
+ * Write every published slot to the file.  Returns how many were written.
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int sr_capture_drain(struct sr_capture* cap)
+{
+    struct sr_capture_slot* slot;
+    struct pcap_pkthdr h;
+    unsigned int n = 0;
+
+    for(;;)
+    {
+        slot = &cap->slots[cap->tail & cap->mask];
+        if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != cap->tail + 1)
+        { break; }
+
+        if(cap->pcapng)
+        {
+            sr_dump_ng(cap->fp, sr_capture_ng_id(cap, slot->ifindex),
+                    slot->ts_ns, slot->caplen, slot->len, slot->dir,
+                    slot->data);
+        }
+        else
+        {
+            h.ts.tv_sec = slot->ts_ns / 1000000000ull;
+            h.ts.tv_usec = (slot->ts_ns % 1000000000ull) / 1000;
+            h.caplen = slot->caplen;
+            h.len = slot->len;
+            sr_dump(cap->fp, &h, slot->data);
+        }
+
+        __atomic_store_n(&slot->seq, cap->tail + SR_CAPTURE_SLOTS,
+                __ATOMIC_RELEASE);
+        cap->tail++;
+        n++;
+    }
+
+    cap->written += n;
+    return n;
+} /* -- sr_capture_drain -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_writer(..)
+ *
+ * Writer thread: drain, and when there is nothing to do flush whatever is
+ * buffered once it gets stale, then nap.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void* sr_capture_writer(void* arg)
+{
+    struct sr_capture* cap = (struct sr_capture*)arg;
+    struct timespec nap;
+    unsigned int stale_us = 0;
+    int dirty = 0;
+
+    nap.tv_sec = 0;
+    nap.tv_nsec = SR_CAPTURE_IDLE_US * 1000;
+
+    while(!__atomic_load_n(&cap->stop, __ATOMIC_ACQUIRE))
+    {
+        if(sr_capture_drain(cap))
+        {
+            dirty = 1;
+            continue;
+        }
+
+        if(dirty && stale_us >= SR_CAPTURE_FLUSH_MS * 1000)
+        {
+            fflush(cap->fp);
+            dirty = 0;
+            stale_us = 0;
+        }
+
+        nanosleep(&nap, 0);
+        if(dirty)
+        { stale_us += SR_CAPTURE_IDLE_US; }
+    }
+
+    sr_capture_drain(cap);
+    fflush(cap->fp);
+    return 0;
+} /* -- sr_capture_writer -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_close(..)
+ *
+ * Stop the writer once it has drained the ring, and close the file.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_capture_close(struct sr_capture* cap)
+{
+    if(!cap)
+    { return; }
+
+    __atomic_store_n(&cap->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(cap->writer, 0);
+
+    LogInfo("capture: %llu seen, %llu filtered, %llu captured, "
+            "%llu written, %llu dropped\n",
+            (unsigned long long)cap->seen,
+            (unsigned long long)cap->filtered,
+            (unsigned long long)cap->captured,
+            (unsigned long long)cap->written,
+            (unsigned long long)cap->dropped);
+
+    sr_dump_close(cap->fp);
+    free(cap->iobuf);
+    free(cap->slots);
+    free(cap->data);
+    free(cap);
+} /* -- sr_capture_close -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_parse_net(..)
+ *
+ * "A.B.C.D" or "A.B.C.D/LEN" into a network byte order addr/mask.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_capture_parse_net(char* tok, int want_prefix,
+                                struct sr_capture_insn* in)
+{
+    char* slash = strchr(tok, '/');
+    struct in_addr a;
+    long bits = 32;
+    char* end = 0;
+
+    if(slash)
+    {
+        if(!want_prefix)
+        { return -1; }
+        *slash = '\0';
+        bits = strtol(slash + 1, &end, 10);
+        if(*end != '\0' || bits < 0 || bits > 32)
+        { return -1; }
+    }
+
+    if(inet_pton(AF_INET, tok, &a) != 1)
+    { return -1; }
+
+    in->mask = bits ? htonl(0xffffffffu << (32 - bits)) : 0;
+    in->addr = a.s_addr & in->mask;
+    return 0;
+} /* -- sr_capture_parse_net -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_compile(..)
+ *
+ * Compile a filter expression (grammar in sr_capture.h).  Returns the
+ * number of instructions, or -1 after reporting the offending token.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_capture_compile(const char* expr, struct sr_capture_insn* insn,
+                       int max_insn)
+{
+    char* copy = strdup(expr);
+    char* save = 0;
+    char* tok;
+    char* arg;
+    char* end;
+    struct sr_capture_insn* in;
+    int n = 0, negate = 0, want_term = 1;
+    int dir;
+    long v;
+
+    assert(copy);
+
+    for(tok = strtok_r(copy, " \t", &save); tok;
+        tok = strtok_r(0, " \t", &save))
+    {
+        if(!want_term)
+        {
+            if(strcmp(tok, "or") == 0)
+            {
+                if(n >= max_insn)
+                { goto too_long; }
+                memset(&insn[n], 0, sizeof(insn[n]));
+                insn[n++].op = sr_cap_or;
+            }
+            else if(strcmp(tok, "and") != 0)
+            { goto bad; }
+            want_term = 1;
+            continue;
+        }
+
+        if(strcmp(tok, "not") == 0)
+        {
+            negate = !negate;
+            continue;
+        }
+
+        if(n >= max_insn)
+        { goto too_long; }
+        in = &insn[n];
+        memset(in, 0, sizeof(*in));
+        in->negate = negate;
+
+        if(strcmp(tok, "ip") == 0)
+        { in->op = sr_cap_ethertype; in->value = ethertype_ip; }
+        else if(strcmp(tok, "arp") == 0)
+        { in->op = sr_cap_ethertype; in->value = ethertype_arp; }
+        else if(strcmp(tok, "icmp") == 0)
+        { in->op = sr_cap_ipproto; in->value = ip_protocol_icmp; }
+        else if(strcmp(tok, "tcp") == 0)
+        { in->op = sr_cap_ipproto; in->value = ip_protocol_tcp; }
+        else if(strcmp(tok, "udp") == 0)
+        { in->op = sr_cap_ipproto; in->value = ip_protocol_udp; }
+        else if(strcmp(tok, "ether") == 0 || strcmp(tok, "proto") == 0)
+        {
+            in->op = (tok[0] == 'e') ? sr_cap_ethertype : sr_cap_ipproto;
+            if(in->op == sr_cap_ethertype)
+            {
+                tok = strtok_r(0, " \t", &save);
+                if(!tok || strcmp(tok, "proto") != 0)
+                { goto bad; }
+            }
+            if(!(arg = strtok_r(0, " \t", &save)))
+            { goto bad; }
+            v = strtol(arg, &end, 0);
+            if(*end != '\0' || v < 0 ||
+               v > (in->op == sr_cap_ethertype ? 0xffff : 0xff))
+            { tok = arg; goto bad; }
+            in->value = (uint16_t)v;
+        }
+        else
+        {
+            dir = sr_cap_any_net;
+            if(strcmp(tok, "src") == 0 || strcmp(tok, "dst") == 0)
+            {
+                dir = (tok[0] == 's') ? sr_cap_src_net : sr_cap_dst_net;
+                if(!(tok = strtok_r(0, " \t", &save)))
+                { goto bad; }
+            }
+            if(strcmp(tok, "host") != 0 && strcmp(tok, "net") != 0)
+            { goto bad; }
+            if(!(arg = strtok_r(0, " \t", &save)) ||
+               sr_capture_parse_net(arg, tok[0] == 'n', in) != 0)
+            { tok = arg ? arg : tok; goto bad; }
+            in->op = dir;
+        }
+
+        n++;
+        negate = 0;
+        want_term = 0;
+    }
+
+    if(want_term && (n > 0 || negate))
+    {
+        fprintf(stderr, "capture filter: incomplete expression '%s'\n", expr);
+        free(copy);
+        return -1;
+    }
+
+    free(copy);
+    return n;
+
+bad:
+    fprintf(stderr, "capture filter: unexpected '%s' in '%s'\n",
+            tok ? tok : "end of filter", expr);
+    free(copy);
+    return -1;
+
+too_long:
+    fprintf(stderr, "capture filter: more than %d terms in '%s'\n",
+            max_insn, expr);
+    free(copy);
+    return -1;
+} /* -- sr_capture_compile -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_capture_match(..)
+ *
+ * Run the compiled filter over a raw frame.  Headers are read in place;
+ * nothing is copied.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_capture_match(const struct sr_capture_insn* insn, int ninsn,
+                     const uint8_t* buf, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)buf;
+    uint16_t type = 0;
+    int have_addrs = 0, have_proto = 0;
+    uint8_t proto = 0;
+    uint32_t src = 0, dst = 0;
+    int ok = 1, r = 0, i;
+
+    if(len >= sizeof(sr_ethernet_hdr_t))
+    { type = ntohs(eth->ether_type); }
+
+    if(type == ethertype_ip &&
+       len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    {
+        const sr_ip_hdr_t* ip =
+            (const sr_ip_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+        proto = ip->ip_p;
+        src = ip->ip_src;
+        dst = ip->ip_dst;
+        have_addrs = have_proto = 1;
+    }
+    else if(type == ethertype_arp &&
+            len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+    {
+        const sr_arp_hdr_t* arp =
+            (const sr_arp_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+        src = arp->ar_sip;
+        dst = arp->ar_tip;
+        have_addrs = 1;
+    }
+
+    for(i = 0; i < ninsn; i++)
+    {
+        if(insn[i].op == sr_cap_or)
+        {
+            if(ok)
+            { return 1; }
+            ok = 1;
+            continue;
+        }
+        if(!ok)
+        { continue; } /* -- clause already failed -- */
+
+        switch(insn[i].op)
+        {
+            case sr_cap_ethertype:
+                r = (type == insn[i].value);
+                break;
+            case sr_cap_ipproto:
+                r = have_proto && (proto == insn[i].value);
+                break;
+            case sr_cap_src_net:
+                r = have_addrs && ((src & insn[i].mask) == insn[i].addr);
+                break;
+            case sr_cap_dst_net:
+                r = have_addrs && ((dst & insn[i].mask) == insn[i].addr);
+                break;
+            case sr_cap_any_net:
+                r = have_addrs && (((src & insn[i].mask) == insn[i].addr) ||
+                                   ((dst & insn[i].mask) == insn[i].addr));
+                break;
+        }
+
+        if(insn[i].negate)
+        { r = !r; }
+        if(!r)
+        { ok = 0; }
+    }
+
+    return ok;
+} /* -- sr_capture_match -- */
@@ -0,0 +1,152 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_capture.h
+ *
+ * Description:
+ *
+ * Asynchronous packet capture for the -l logfile.  The forwarding path
+ * copies each frame into a slot of a bounded lock-free ring and returns;
+ * a dedicated writer thread drains the ring into the dump file through a
+ * large stdio buffer.  When the ring is full the capture is dropped and
+ * counted rather than stalling the router.
+ *
+ * The ring is a bounded multi-producer queue (each slot carries a
+ * sequence number) because frames are sent from both the main thread and
+ * the ARP sweeper thread.  There is exactly one consumer.
+ *
+ * Before anything is copied a frame must pass the compiled filter and
+ * the 1-in-N sampler, so with a selective filter capture can stay on.
+ * Filter syntax (a small subset of tcpdump's):
+ *
+ *   expr   := clause { "or" clause }
+ *   clause := term { "and" term }
+ *   term   := [ "not" ] prim
+ *   prim   := "ip" | "arp" | "ether" "proto" N
+ *           | "icmp" | "tcp" | "udp" | "proto" N
+ *           | [ "src" | "dst" ] ( "host" A.B.C.D | "net" A.B.C.D/LEN )
+ *
+ * Address terms match IPv4 source/destination or ARP sender/target.
+ *
+ * Output is legacy pcap, or pcapng when asked for (-G or a .pcapng file
+ * name).  pcapng records carry the interface and direction, and an
+ * Interface Description Block is emitted for each interface the first
+ * time a frame on it is written.  Timestamps are taken with
+ * clock_gettime() in nanoseconds either way.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CAPTURE_H
+#define SR_CAPTURE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sr_if.h"
+#include "sr_dumper.h"
+
+#define SR_CAPTURE_SLOTS    4096          /* power of two */
+#define SR_CAPTURE_IOBUF    (1 << 20)     /* stdio buffer for the dump file */
+#define SR_CAPTURE_IDLE_US  1000          /* writer nap when the ring is empty */
+#define SR_CAPTURE_FLUSH_MS 200           /* flush at most this stale */
+#define SR_CAPTURE_MAX_INSN 32
+
+enum sr_capture_op {
+    sr_cap_ethertype,           /* value == ether_type */
+    sr_cap_ipproto,             /* IPv4 and value == ip_p */
+    sr_cap_src_net,             /* (src & mask) == addr */
+    sr_cap_dst_net,
+    sr_cap_any_net,             /* src or dst */
+    sr_cap_or,                  /* ends a clause */
+};
+
+struct sr_capture_insn
+{
+    uint8_t  op;
+    uint8_t  negate;
+    uint16_t value;
+    uint32_t addr;              /* network byte order, pre-masked */
+    uint32_t mask;              /* network byte order */
+};
+
+struct sr_capture_opts
+{
+    int snaplen;                /* bytes kept per frame */
+    unsigned int sample;        /* keep 1 in sample matches, 0/1 keeps all */
+    const char* filter;         /* 0 captures everything */
+    int pcapng;                 /* write pcapng instead of pcap */
+};
+
+struct sr_capture_slot
+{
+    uint32_t seq;               /* ring sequence, see sr_capture.c */
+    uint32_t len;               /* length on the wire */
+    uint32_t caplen;            /* bytes in data */
+    int16_t  ifindex;           /* -1 if not known */
+    uint8_t  dir;               /* PCAPNG_DIR_IN / PCAPNG_DIR_OUT */
+    uint64_t ts_ns;             /* CLOCK_REALTIME */
+    unsigned char* data;        /* snaplen bytes owned by the ring */
+};
+
+/* what the writer needs to describe an interface in pcapng */
+struct sr_capture_if
+{
+    char name[sr_IFACE_NAMELEN];
+    unsigned char mac[ETHER_ADDR_LEN];
+    int known;                  /* set (release) once name/mac are filled */
+    int ng_id;                  /* pcapng interface id, -1 until written */
+};
+
+struct sr_capture
+{
+    FILE* fp;
+    char* iobuf;
+    int snaplen;
+    unsigned int sample;
+    int pcapng;
+
+    struct sr_capture_if ifs[SR_MAX_IFACES];
+    int ng_anon_id;             /* IDB for frames with no interface */
+    int ng_next_id;             /* writer only */
+
+    struct sr_capture_insn insn[SR_CAPTURE_MAX_INSN];
+    int ninsn;
+
+    struct sr_capture_slot* slots;
+    unsigned char* data;
+    uint32_t mask;              /* SR_CAPTURE_SLOTS - 1 */
+
+    uint32_t head;              /* next sequence to claim (producers) */
+    uint32_t tail;              /* next sequence to drain (writer only) */
+
+    uint64_t seen;              /* offered to sr_capture_packet */
+    uint64_t filtered;          /* rejected by the filter */
+    uint64_t matched;           /* passed the filter, drives the sampler */
+    uint64_t captured;          /* handed to the writer */
+    uint64_t dropped;           /* ring was full */
+    uint64_t written;           /* records written to fp */
+
+    int stop;
+    pthread_t writer;
+};
+
+struct sr_capture* sr_capture_open(const char* fname,
+                                   const struct sr_capture_opts* opts);
+int sr_capture_compile(const char* expr, struct sr_capture_insn* insn,
+                       int max_insn);
+int sr_capture_match(const struct sr_capture_insn* insn, int ninsn,
+                     const uint8_t* buf, unsigned int len);
+void sr_capture_interface(struct sr_capture* cap, unsigned int ifindex,
+                          const char* name, const unsigned char* mac);
+void sr_capture_packet(struct sr_capture* cap, const uint8_t* buf,
+                       unsigned int len, int ifindex, int dir);
+void sr_capture_close(struct sr_capture* cap);
+
+#endif /* -- SR_CAPTURE_H -- */
@@ -0,0 +1,645 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * Control socket, see sr_ctl.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "sr_ctl.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_stats.h"
+#include "sr_perf.h"
+#include "sr_log.h"
+
+#define SR_CTL_MAX_REQS  64     /* pending ARP requests listed */
+
+struct sr_ctl_out
+{
+    char* buf;
+    size_t len;
+    size_t cap;
+};
+
+static void sr_ctl_printf(struct sr_ctl_out* out, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+static void sr_ctl_printf(struct sr_ctl_out* out, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for(;;)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(out->buf + out->len, out->cap - out->len, fmt, ap);
+        va_end(ap);
+        if(n >= 0 && out->len + n < out->cap)
+        { break; }
+        out->cap = out->cap * 2 + n;
+        out->buf = (char*)realloc(out->buf, out->cap);
+        assert(out->buf);
+    }
+    out->len += n;
+} /* -- sr_ctl_printf -- */
+
+/* -- a JSON string; interface names come from the server -- */
+static void sr_ctl_str(struct sr_ctl_out* out, const char* s, size_t max)
+{
+    size_t i;
+
+    sr_ctl_printf(out, "\"");
+    for(i = 0; i < max && s[i]; i++)
+    {
+        if(s[i] == '"' || s[i] == '\\')
+        { sr_ctl_printf(out, "\\%c", s[i]); }
+        else if((unsigned char)s[i] < 0x20)
+        { sr_ctl_printf(out, "\\u%04x", (unsigned char)s[i]); }
+        else
+        { sr_ctl_printf(out, "%c", s[i]); }
+    }
+    sr_ctl_printf(out, "\"");
+} /* -- sr_ctl_str -- */
+
+static void sr_ctl_ip(struct sr_ctl_out* out, uint32_t ip_nbo)
+{
+    char buf[INET_ADDRSTRLEN];
+    struct in_addr a;
+
+    a.s_addr = ip_nbo;
+    sr_ctl_printf(out, "\"%s\"", inet_ntop(AF_INET, &a, buf, sizeof(buf)));
+} /* -- sr_ctl_ip -- */
+
+static void sr_ctl_error(struct sr_ctl_out* out, const char* msg)
+{
+    sr_ctl_printf(out, "{\"ok\":false,\"error\":\"%s\"}", msg);
+} /* -- sr_ctl_error -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_swap(..)
+ *
+ * Make table the routing table and retire the one it replaces, for
+ * sr_ctl_reap(..) to free.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_ctl_swap(struct sr_instance* sr, struct sr_rt* table)
+{
+    struct sr_ctl* ctl = sr->ctl;
+    struct sr_ctl_retired* r;
+
+    r = (struct sr_ctl_retired*)malloc(sizeof(struct sr_ctl_retired));
+    assert(r);
+    r->table = __atomic_exchange_n(&sr->routing_table, table,
+            __ATOMIC_ACQ_REL);
+    r->next = __atomic_load_n(&ctl->retired, __ATOMIC_RELAXED);
+    while(!__atomic_compare_exchange_n(&ctl->retired, &r->next, r, 0,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    sr_stats_fib_routes(sr);
+} /* -- sr_ctl_swap -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_reap(..)
+ *
+ * Main loop, between poll passes: free the tables swapped out since the
+ * last call.  This thread is in no lookup now, and taking the cache lock
+ * waits out an ARP sweep that may have started on an old table.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ctl_reap(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+    struct sr_ctl_retired *r, *next;
+
+    if(!ctl || __atomic_load_n(&ctl->retired, __ATOMIC_RELAXED) == 0)
+    { return; }
+
+    r = __atomic_exchange_n(&ctl->retired, 0, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&sr->cache.lock);
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    for(; r; r = next)
+    {
+        next = r->next;
+        sr_rt_free(r->table);
+        free(r);
+    }
+} /* -- sr_ctl_reap -- */
+
+/*-----------------------------------------------------------------------------
+ * Commands
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_ctl_stats(struct sr_instance* sr, struct sr_ctl_out* out)
+{
+    struct sr_stats_seg* seg = sr->stats;
+    struct sr_stats_slot sum;
+    unsigned int i, r, p, n;
+
+    if(!seg)
+    { sr_ctl_error(out, "no counters"); return; }
+
+    sr_stats_sum(seg, &sum);
+    n = __atomic_load_n(&seg->num_ifaces, __ATOMIC_ACQUIRE);
+
+    sr_ctl_printf(out, "{\"ok\":true,\"uptime\":%ld,\"interfaces\":[",
+            (long)(time(NULL) - (time_t)seg->started));
+    for(i = 0; i < n; i++)
+    {
+        sr_ctl_printf(out, "%s{\"name\":", i ? "," : "");
+        sr_ctl_str(out, seg->ifname[i], sr_IFACE_NAMELEN);
+        sr_ctl_printf(out, ",\"rx_pkts\":%llu,\"rx_bytes\":%llu,"
+                "\"tx_pkts\":%llu,\"tx_bytes\":%llu}",
+                (unsigned long long)sum.ifs[i].rx_pkts,
+                (unsigned long long)sum.ifs[i].rx_bytes,
+                (unsigned long long)sum.ifs[i].tx_pkts,
+                (unsigned long long)sum.ifs[i].tx_bytes);
+    }
+    sr_ctl_printf(out, "],\"drops\":{");
+    for(r = 0; r < SR_DROP_REASONS; r++)
+    {
+        sr_ctl_printf(out, "%s\"%s\":{", r ? "," : "",
+                sr_drop_reason_names[r]);
+        for(p = 0; p < SR_STATS_PROTOS; p++)
+        {
+            sr_ctl_printf(out, "%s\"%s\":%llu", p ? "," : "",
+                    sr_stats_proto_names[p],
+                    (unsigned long long)sum.drops[r][p]);
+        }
+        sr_ctl_printf(out, "}");
+    }
+    sr_ctl_printf(out, "},\"fib_routes\":%llu",
+            (unsigned long long)seg->fib_routes);
+    for(r = 0; r < SR_STATS_COUNTERS; r++)
+    {
+        sr_ctl_printf(out, ",\"%s\":%llu", sr_stats_counter_names[r],
+                (unsigned long long)sum.counters[r]);
+    }
+    sr_ctl_printf(out, ",\"latency_ns\":{");
+    for(p = 0; p < SR_LAT_PATHS; p++)
+    {
+        sr_ctl_printf(out, "%s\"%s\":{\"p50\":%.0f,\"p90\":%.0f,"
+                "\"p99\":%.0f,\"p99.9\":%.0f}", p ? "," : "",
+                sr_lat_path_names[p],
+                sr_stats_percentile(sum.lat[p], 0.5, seg->tsc_hz),
+                sr_stats_percentile(sum.lat[p], 0.9, seg->tsc_hz),
+                sr_stats_percentile(sum.lat[p], 0.99, seg->tsc_hz),
+                sr_stats_percentile(sum.lat[p], 0.999, seg->tsc_hz));
+    }
+    sr_ctl_printf(out, "}}");
+} /* -- sr_ctl_stats -- */
+
+static void sr_ctl_routes(struct sr_instance* sr, struct sr_ctl_out* out)
+{
+    struct sr_rt* rt;
+    int first = 1;
+
+    /* -- only this thread replaces the table, so it stays put -- */
+    sr_ctl_printf(out, "{\"ok\":true,\"routes\":[");
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        sr_ctl_printf(out, "%s{\"dest\":", first ? "" : ",");
+        sr_ctl_ip(out, rt->dest.s_addr);
+        sr_ctl_printf(out, ",\"gw\":");
+        sr_ctl_ip(out, rt->gw.s_addr);
+        sr_ctl_printf(out, ",\"mask\":");
+        sr_ctl_ip(out, rt->mask.s_addr);
+        sr_ctl_printf(out, ",\"iface\":");
+        sr_ctl_str(out, rt->interface, sr_IFACE_NAMELEN);
+        sr_ctl_printf(out, ",\"bound\":%s}", rt->iface ? "true" : "false");
+        first = 0;
+    }
+    sr_ctl_printf(out, "]}");
+} /* -- sr_ctl_routes -- */
+
+static void sr_ctl_arp(struct sr_instance* sr, struct sr_ctl_out* out)
+{
+    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct
+    {
+        uint32_t ip;
+        uint32_t times_sent;
+        unsigned int queued;
+    } reqs[SR_CTL_MAX_REQS];
+    struct sr_arpreq* req;
+    struct sr_packet* pkt;
+    unsigned int nreqs = 0, more = 0;
+    time_t now;
+    int i, first = 1;
+
+    /* -- copy under the lock, format after -- */
+    pthread_mutex_lock(&sr->cache.lock);
+    memcpy(entries, sr->cache.entries, sizeof(entries));
+    for(req = sr->cache.requests; req; req = req->next)
+    {
+        if(nreqs == SR_CTL_MAX_REQS)
+        { more++; continue; }
+        reqs[nreqs].ip = req->ip;
+        reqs[nreqs].times_sent = req->times_sent;
+        reqs[nreqs].queued = 0;
+        for(pkt = req->packets; pkt; pkt = pkt->next)
+        { reqs[nreqs].queued++; }
+        nreqs++;
+    }
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    now = time(NULL);
+    sr_ctl_printf(out, "{\"ok\":true,\"entries\":[");
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        if(!entries[i].valid)
+        { continue; }
+        sr_ctl_printf(out, "%s{\"ip\":", first ? "" : ",");
+        sr_ctl_ip(out, entries[i].ip);
+        sr_ctl_printf(out, ",\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\","
+                "\"age\":%ld,\"static\":%s}",
+                entries[i].mac[0], entries[i].mac[1], entries[i].mac[2],
+                entries[i].mac[3], entries[i].mac[4], entries[i].mac[5],
+                (long)(now - entries[i].added),
+                entries[i].permanent ? "true" : "false");
+        first = 0;
+    }
+    sr_ctl_printf(out, "],\"requests\":[");
+    for(i = 0; i < (int)nreqs; i++)
+    {
+        sr_ctl_printf(out, "%s{\"ip\":", i ? "," : "");
+        sr_ctl_ip(out, reqs[i].ip);
+        sr_ctl_printf(out, ",\"sent\":%u,\"queued\":%u}",
+                reqs[i].times_sent, reqs[i].queued);
+    }
+    sr_ctl_printf(out, "],\"more_requests\":%u}", more);
+} /* -- sr_ctl_arp -- */
+
+static void sr_ctl_arp_flush(struct sr_instance* sr, struct sr_ctl_out* out)
+{
+    int i, n = 0;
+
+    pthread_mutex_lock(&sr->cache.lock);
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        if(sr->cache.entries[i].valid && !sr->cache.entries[i].permanent)
+        {
+            sr->cache.entries[i].valid = 0;
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    sr_ctl_printf(out, "{\"ok\":true,\"flushed\":%d}", n);
+} /* -- sr_ctl_arp_flush -- */
+
+static void sr_ctl_route_add(struct sr_instance* sr, char** argv, int argc,
+                             struct sr_ctl_out* out)
+{
+    struct in_addr dest, gw, mask;
+    struct sr_if* iface;
+    struct sr_rt *table, *rt, **tail;
+
+    if(argc != 6 || !inet_aton(argv[2], &dest) || !inet_aton(argv[3], &gw) ||
+            !inet_aton(argv[4], &mask))
+    { sr_ctl_error(out, "usage: route add dest gw mask iface"); return; }
+    if((dest.s_addr & ~mask.s_addr) != 0)
+    { sr_ctl_error(out, "dest has bits outside the mask"); return; }
+    if((iface = sr_get_interface(sr, argv[5])) == 0)
+    { sr_ctl_error(out, "no such interface"); return; }
+
+    table = sr_rt_copy(sr->routing_table);
+    for(tail = &table; *tail; tail = &(*tail)->next);
+    rt = (struct sr_rt*)calloc(1, sizeof(struct sr_rt));
+    assert(rt);
+    rt->dest = dest;
+    rt->gw = gw;
+    rt->mask = mask;
+    strncpy(rt->interface, iface->name, sr_IFACE_NAMELEN - 1);
+    rt->iface = iface;
+    *tail = rt;
+
+    sr_ctl_swap(sr, table);
+    LogInfo("ctl: route add %s/%s via %s\n", argv[2], argv[4], argv[5]);
+    sr_ctl_printf(out, "{\"ok\":true}");
+} /* -- sr_ctl_route_add -- */
+
+static void sr_ctl_route_del(struct sr_instance* sr, char** argv, int argc,
+                             struct sr_ctl_out* out)
+{
+    struct in_addr dest, mask;
+    struct sr_rt *table, *rt, **link;
+    int n = 0;
+
+    if(argc != 4 || !inet_aton(argv[2], &dest) || !inet_aton(argv[3], &mask))
+    { sr_ctl_error(out, "usage: route del dest mask"); return; }
+
+    table = sr_rt_copy(sr->routing_table);
+    for(link = &table; (rt = *link) != 0; )
+    {
+        if(rt->dest.s_addr == dest.s_addr && rt->mask.s_addr == mask.s_addr)
+        {
+            *link = rt->next;
+            free(rt);
+            n++;
+        }
+        else
+        { link = &rt->next; }
+    }
+    if(n == 0)
+    {
+        sr_rt_free(table);
+        sr_ctl_error(out, "no such route");
+        return;
+    }
+
+    sr_ctl_swap(sr, table);
+    LogInfo("ctl: route del %s/%s\n", argv[2], argv[3]);
+    sr_ctl_printf(out, "{\"ok\":true,\"deleted\":%d}", n);
+} /* -- sr_ctl_route_del -- */
+
+static void sr_ctl_perf_span(struct sr_perf* perf, struct sr_ctl_out* out,
+                             const char* name,
+                             const struct sr_perf_sample* now,
+                             const struct sr_perf_sample* prev)
+{
+    double v;
+    unsigned int i;
+
+    sr_ctl_printf(out, ",\"%s\":{\"frames\":%llu", name,
+            (unsigned long long)(now->packets - prev->packets));
+    for(i = 0; i < SR_PERF_EVENTS; i++)
+    {
+        if((v = sr_perf_per_packet(perf, now, prev, i)) < 0)
+        { sr_ctl_printf(out, ",\"%s\":null", sr_perf_event_names[i]); }
+        else
+        { sr_ctl_printf(out, ",\"%s\":%.1f", sr_perf_event_names[i], v); }
+    }
+    sr_ctl_printf(out, "}");
+} /* -- sr_ctl_perf_span -- */
+
+/* -- per frame averages since start and since the last "perf" -- */
+static void sr_ctl_perf(struct sr_instance* sr, struct sr_ctl_out* out)
+{
+    struct sr_perf* perf = sr->perf;
+    struct sr_perf_sample now, prev;
+
+    if(!perf)
+    { sr_ctl_error(out, "not counting, start sr with --perf"); return; }
+
+    pthread_mutex_lock(&perf->lock);
+    if(sr_perf_read(sr, &now) != 0)
+    {
+        pthread_mutex_unlock(&perf->lock);
+        sr_ctl_error(out, "counters unreadable");
+        return;
+    }
+    prev = perf->polled;
+    perf->polled = now;
+    pthread_mutex_unlock(&perf->lock);
+
+    sr_ctl_printf(out, "{\"ok\":true,\"kernel\":%s",
+            perf->user_only ? "false" : "true");
+    sr_ctl_perf_span(perf, out, "since_start", &now, &perf->start);
+    sr_ctl_perf_span(perf, out, "since_last", &now, &prev);
+    sr_ctl_printf(out, "}");
+} /* -- sr_ctl_perf -- */
+
+static void sr_ctl_log(char** argv, int argc, struct sr_ctl_out* out)
+{
+    int level;
+
+    if(argc != 2 || (level = sr_log_level_parse(argv[1])) < 0)
+    { sr_ctl_error(out, "usage: log none|error|warn|info|debug|trace"); return; }
+
+    __atomic_store_n(&sr_log_level, level, __ATOMIC_RELAXED);
+    sr_ctl_printf(out, "{\"ok\":true,\"level\":\"%s\",\"compiled\":\"%s\"}",
+            sr_log_level_name(level), sr_log_level_name(SR_LOG_LEVEL));
+} /* -- sr_ctl_log -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_command(..)
+ *
+ * Run one command line, leaving the JSON answer in out.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_ctl_command(struct sr_instance* sr, char* line,
+                           struct sr_ctl_out* out)
+{
+    char* argv[8];
+    char* save;
+    int argc = 0;
+
+    for(argv[0] = strtok_r(line, " \t\r", &save); argv[argc] && argc < 7;
+            argv[++argc] = strtok_r(0, " \t\r", &save));
+
+    if(argc == 0)
+    { sr_ctl_error(out, "empty command"); }
+    else if(strcmp(argv[0], "stats") == 0 && argc == 1)
+    { sr_ctl_stats(sr, out); }
+    else if(strcmp(argv[0], "routes") == 0 && argc == 1)
+    { sr_ctl_routes(sr, out); }
+    else if(strcmp(argv[0], "arp") == 0 && argc == 1)
+    { sr_ctl_arp(sr, out); }
+    else if(strcmp(argv[0], "arp") == 0 && argc == 2 &&
+            strcmp(argv[1], "flush") == 0)
+    { sr_ctl_arp_flush(sr, out); }
+    else if(strcmp(argv[0], "route") == 0 && argc > 1 &&
+            strcmp(argv[1], "add") == 0)
+    { sr_ctl_route_add(sr, argv, argc, out); }
+    else if(strcmp(argv[0], "route") == 0 && argc > 1 &&
+            strcmp(argv[1], "del") == 0)
+    { sr_ctl_route_del(sr, argv, argc, out); }
+    else if(strcmp(argv[0], "log") == 0)
+    { sr_ctl_log(argv, argc, out); }
+    else if(strcmp(argv[0], "perf") == 0 && argc == 1)
+    { sr_ctl_perf(sr, out); }
+    else
+    {
+        sr_ctl_error(out, "commands: stats, routes, arp, arp flush, "
+                "route add, route del, log, perf");
+    }
+    sr_ctl_printf(out, "\n");
+} /* -- sr_ctl_command -- */
+
+static int sr_ctl_write(int fd, const char* buf, size_t len)
+{
+    ssize_t n;
+
+    while(len > 0)
+    {
+        if((n = send(fd, buf, len, MSG_NOSIGNAL)) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+} /* -- sr_ctl_write -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_serve(..)
+ *
+ * One client, until it hangs up.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_ctl_serve(struct sr_instance* sr, int fd)
+{
+    char line[SR_CTL_LINE];
+    struct sr_ctl_out out;
+    size_t len = 0;
+    ssize_t n;
+    char *nl, *start;
+
+    out.cap = 4096;
+    out.buf = (char*)malloc(out.cap);
+    assert(out.buf);
+
+    for(;;)
+    {
+        if((n = read(fd, line + len, sizeof(line) - 1 - len)) <= 0)
+        {
+            if(n < 0 && errno == EINTR)
+            { continue; }
+            break;
+        }
+        len += n;
+        line[len] = 0;
+
+        out.len = 0;
+        for(start = line; (nl = strchr(start, '\n')) != 0; start = nl + 1)
+        {
+            *nl = 0;
+            sr_ctl_command(sr, start, &out);
+            __atomic_fetch_add(&sr->ctl->cmds, 1, __ATOMIC_RELAXED);
+        }
+        if(out.len && sr_ctl_write(fd, out.buf, out.len) != 0)
+        { break; }
+
+        len -= start - line;
+        memmove(line, start, len);
+        if(len == sizeof(line) - 1)
+        {
+            out.len = 0;
+            sr_ctl_error(&out, "command too long");
+            sr_ctl_printf(&out, "\n");
+            sr_ctl_write(fd, out.buf, out.len);
+            break;
+        }
+    }
+    free(out.buf);
+} /* -- sr_ctl_serve -- */
+
+static void* sr_ctl_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    int fd;
+
+    for(;;)
+    {
+        if((fd = accept(sr->ctl->fd, 0, 0)) < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            { continue; }
+            break;
+        }
+        sr_ctl_serve(sr, fd);
+        close(fd);
+    }
+    return 0;
+} /* -- sr_ctl_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_open(..)
+ *
+ * Listen on path, replacing a stale socket there, and start serving.
+ * Call after sr_init(..).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_ctl_open(struct sr_instance* sr, const char* path)
+{
+    struct sockaddr_un addr;
+    struct sr_ctl* ctl;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(path);
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    { fprintf(stderr, "Control socket path too long: %s\n", path); return -1; }
+
+    ctl = (struct sr_ctl*)calloc(1, sizeof(struct sr_ctl));
+    assert(ctl);
+    strncpy(ctl->path, path, sizeof(ctl->path) - 1);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if((ctl->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    { perror("socket(AF_UNIX)"); free(ctl); return -1; }
+    unlink(path);
+    if(bind(ctl->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            chmod(path, 0600) != 0 || listen(ctl->fd, 4) != 0)
+    {
+        perror(path);
+        close(ctl->fd);
+        free(ctl);
+        return -1;
+    }
+
+    sr->ctl = ctl;
+    if(pthread_create(&ctl->thread, 0, sr_ctl_thread, sr) != 0)
+    {
+        perror("pthread_create(..):sr_ctl_open");
+        close(ctl->fd);
+        unlink(path);
+        sr->ctl = 0;
+        free(ctl);
+        return -1;
+    }
+    pthread_detach(ctl->thread);
+    return 0;
+} /* -- sr_ctl_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ctl_close(..)
+ *
+ * Stop listening.  A client still connected is cut off when we exit.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_ctl_close(struct sr_instance* sr)
+{
+    struct sr_ctl* ctl = sr->ctl;
+
+    if(!ctl)
+    { return; }
+
+    shutdown(ctl->fd, SHUT_RDWR);
+    unlink(ctl->path);
+    sr_ctl_reap(sr);
+    LogInfo("ctl: %llu commands\n", (unsigned long long)ctl->cmds);
+} /* -- sr_ctl_close -- */
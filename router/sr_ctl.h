@@ -0,0 +1,61 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.h
+ *
+ * Description:
+ *
+ * Control socket (-C path): a unix stream socket taking one command per
+ * line and answering each with one line of JSON.
+ *
+ *   stats                            counters, as srstat adds them up
+ *   routes                           the routing table
+ *   arp                              cache entries and pending requests
+ *   route add <dest> <gw> <mask> <iface>
+ *   route del <dest> <mask>
+ *   arp flush                        drop every learned entry
+ *   log <level>                      none|error|warn|info|debug|trace
+ *   perf                             CPU counters per frame (--perf)
+ *
+ * Commands run on a thread of their own so that forwarding never waits
+ * on a client, whichever backend the main loop is blocked in.  Route
+ * changes copy the table and swap the new one in; the old one is freed
+ * by the main loop between poll passes (sr_ctl_reap), when no lookup
+ * can still be walking it.  ARP state is read under the cache lock and
+ * formatted after it is dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CTL_H
+#define SR_CTL_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#define SR_CTL_LINE  512        /* longest command */
+
+struct sr_instance;
+struct sr_rt;
+
+struct sr_ctl_retired
+{
+    struct sr_rt* table;
+    struct sr_ctl_retired* next;
+};
+
+struct sr_ctl
+{
+    int fd;                     /* listening */
+    char path[108];
+    pthread_t thread;
+    struct sr_ctl_retired* retired; /* swapped out, for the main loop */
+
+    uint64_t cmds;
+};
+
+int  sr_ctl_open(struct sr_instance* sr, const char* path);
+void sr_ctl_reap(struct sr_instance* sr);
+void sr_ctl_close(struct sr_instance* sr);
+
+#endif /* -- SR_CTL_H -- */
@@ -2,6 +2,8 @@
 #include <sys/types.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "sr_dumper.h"
 
 static void
@@ -69,3 +71,421 @@ sr_dump_close(FILE *fp)
   fclose(fp);
 }
 
+
+/*
+ * pcapng.  Blocks are written in host byte order, which the byte-order
+ * magic in the section header tells readers about.
+ */
+
+#define PCAPNG_PAD(n) (((n) + 3) & ~3u)
+
+static void
+ng_write_u32(FILE *fp, uint32_t v)
+{
+        (void)fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void
+ng_write_option(FILE *fp, uint16_t code, uint16_t len, const void *val)
+{
+        static const unsigned char zero[4];
+
+        (void)fwrite(&code, sizeof(code), 1, fp);
+        (void)fwrite(&len, sizeof(len), 1, fp);
+        if (len) {
+                (void)fwrite(val, len, 1, fp);
+                (void)fwrite(zero, PCAPNG_PAD(len) - len, 1, fp);
+        }
+}
+
+FILE *
+sr_dump_ng_open(const char *fname)
+{
+        FILE *fp;
+        uint16_t version[2] = { 1, 0 };
+        int64_t section_len = -1;
+
+        if (fname[0] == '-' && fname[1] == '\0')
+                fp = stdout;
+        else {
+                fp = fopen(fname, "w");
+                if (fp == NULL) {
+                        fprintf(stderr, "sr_dump_ng_open: can't open %s",
+                            fname);
+                        return (NULL);
+                }
+        }
+
+        ng_write_u32(fp, PCAPNG_SHB_TYPE);
+        ng_write_u32(fp, 28);
+        ng_write_u32(fp, PCAPNG_BYTE_ORDER);
+        (void)fwrite(version, sizeof(version), 1, fp);
+        (void)fwrite(&section_len, sizeof(section_len), 1, fp);
+        ng_write_u32(fp, 28);
+
+        return fp;
+}
+
+void
+sr_dump_ng_interface(FILE *fp, const char *name, const unsigned char *mac,
+                     int snaplen)
+{
+        uint16_t linktype = LINKTYPE_ETHERNET, reserved = 0;
+        uint16_t name_len = name ? strlen(name) : 0;
+        uint8_t tsresol = 9; /* 10^-9 s */
+        uint32_t total;
+
+        total = 20                                        /* fixed part */
+              + (name_len ? 4 + PCAPNG_PAD(name_len) : 0)
+              + (mac ? 4 + PCAPNG_PAD(PCAP_ETHA_LEN) : 0)
+              + 4 + PCAPNG_PAD(1)                         /* if_tsresol */
+              + 4;                                        /* opt_endofopt */
+
+        ng_write_u32(fp, PCAPNG_IDB_TYPE);
+        ng_write_u32(fp, total);
+        (void)fwrite(&linktype, sizeof(linktype), 1, fp);
+        (void)fwrite(&reserved, sizeof(reserved), 1, fp);
+        ng_write_u32(fp, snaplen);
+        if (name_len)
+                ng_write_option(fp, PCAPNG_OPT_IF_NAME, name_len, name);
+        if (mac)
+                ng_write_option(fp, PCAPNG_OPT_IF_MAC, PCAP_ETHA_LEN, mac);
+        ng_write_option(fp, PCAPNG_OPT_IF_TSRES, 1, &tsresol);
+        ng_write_option(fp, PCAPNG_OPT_END, 0, 0);
+        ng_write_u32(fp, total);
+}
+
+void
+sr_dump_ng(FILE *fp, uint32_t ifid, uint64_t ts_ns, uint32_t caplen,
+           uint32_t len, int dir, const unsigned char *sp)
+{
+        static const unsigned char zero[4];
+        uint32_t hdr[7];
+        uint32_t flags = dir;
+        uint32_t total;
+
+        total = 28 + PCAPNG_PAD(caplen) + (dir ? 4 + 4 : 0) + 4 + 4;
+
+        hdr[0] = PCAPNG_EPB_TYPE;
+        hdr[1] = total;
+        hdr[2] = ifid;
+        hdr[3] = (uint32_t)(ts_ns >> 32);
+        hdr[4] = (uint32_t)ts_ns;
+        hdr[5] = caplen;
+        hdr[6] = len;
+        (void)fwrite(hdr, sizeof(hdr), 1, fp);
+        (void)fwrite(sp, caplen, 1, fp);
+        (void)fwrite(zero, PCAPNG_PAD(caplen) - caplen, 1, fp);
+        if (dir)
+                ng_write_option(fp, PCAPNG_OPT_EPB_FLAGS, 4, &flags);
+        ng_write_option(fp, PCAPNG_OPT_END, 0, 0);
+        ng_write_u32(fp, total);
+}
+
+
+/*
+ * Reading.
+ */
+
+struct sr_dump_reader {
+        unsigned char *buf;
+        size_t size;
+        size_t off;
+        int ng;                 /* pcapng rather than legacy pcap */
+        int swapped;            /* file byte order is not ours */
+        uint64_t units;         /* legacy pcap timestamp ticks per second */
+        uint32_t nifs;          /* pcapng interfaces in this section */
+        struct {
+                uint64_t units;
+                int linktype;
+                char name[32];
+        } ifs[PCAPNG_MAX_IFACES];
+};
+
+static uint32_t
+rd_u32(const struct sr_dump_reader *rd, const unsigned char *p)
+{
+        uint32_t v;
+
+        memcpy(&v, p, sizeof(v));
+        if (rd->swapped)
+                v = (v >> 24) | ((v >> 8) & 0xff00) |
+                    ((v << 8) & 0xff0000) | (v << 24);
+        return v;
+}
+
+static uint16_t
+rd_u16(const struct sr_dump_reader *rd, const unsigned char *p)
+{
+        uint16_t v;
+
+        memcpy(&v, p, sizeof(v));
+        if (rd->swapped)
+                v = (uint16_t)((v >> 8) | (v << 8));
+        return v;
+}
+
+static uint64_t
+rd_ts_ns(uint64_t ticks, uint64_t units)
+{
+        const uint64_t ns = 1000000000;
+
+        if (units == ns)
+                return ticks;
+        if (units > ns)
+                return ticks / (units / ns);
+        return ticks / units * ns + ticks % units * ns / units;
+}
+
+/*
+ * Find option code between p and end, the options area of a block.
+ */
+static const unsigned char *
+ng_find_option(const struct sr_dump_reader *rd, const unsigned char *p,
+               const unsigned char *end, uint16_t code, uint16_t *len)
+{
+        uint16_t c, l;
+
+        while (p + 4 <= end) {
+                c = rd_u16(rd, p);
+                l = rd_u16(rd, p + 2);
+                if (c == PCAPNG_OPT_END || p + 4 + l > end)
+                        break;
+                if (c == code) {
+                        *len = l;
+                        return p + 4;
+                }
+                p += 4 + PCAPNG_PAD(l);
+        }
+        return NULL;
+}
+
+static void
+ng_read_interface(struct sr_dump_reader *rd, const unsigned char *p,
+                  uint32_t total)
+{
+        const unsigned char *opt, *end = p + total - 4;
+        uint16_t len;
+        uint32_t id = rd->nifs++;
+        uint64_t units = 1000000;
+        int i, res;
+
+        if (id >= PCAPNG_MAX_IFACES || total < 20)
+                return;
+
+        rd->ifs[id].linktype = rd_u16(rd, p + 8);
+        rd->ifs[id].name[0] = '\0';
+
+        if ((opt = ng_find_option(rd, p + 16, end, PCAPNG_OPT_IF_NAME,
+            &len)) != NULL) {
+                len = min(len, sizeof(rd->ifs[id].name) - 1);
+                memcpy(rd->ifs[id].name, opt, len);
+                rd->ifs[id].name[len] = '\0';
+        }
+
+        if ((opt = ng_find_option(rd, p + 16, end, PCAPNG_OPT_IF_TSRES,
+            &len)) != NULL && len >= 1) {
+                res = opt[0] & 0x7f;
+                if (opt[0] & 0x80) {
+                        if (res < 64)
+                                units = (uint64_t)1 << res;
+                } else if (res <= 19) {
+                        for (units = 1, i = 0; i < res; i++)
+                                units *= 10;
+                }
+        }
+        rd->ifs[id].units = units;
+}
+
+static int
+ng_read(struct sr_dump_reader *rd, struct sr_dump_record *rec)
+{
+        const unsigned char *p, *opt;
+        uint32_t type, total, magic, caplen;
+        uint16_t len;
+
+        while (rd->off + 12 <= rd->size) {
+                p = rd->buf + rd->off;
+                memcpy(&type, p, sizeof(type));
+
+                /* -- the section header tells us the byte order -- */
+                if (type == PCAPNG_SHB_TYPE) {
+                        memcpy(&magic, p + 8, sizeof(magic));
+                        rd->swapped = 0;
+                        if (magic != PCAPNG_BYTE_ORDER) {
+                                rd->swapped = 1;
+                                if (rd_u32(rd, p + 8) != PCAPNG_BYTE_ORDER)
+                                        return -1;
+                        }
+                        rd->nifs = 0;
+                }
+
+                type = rd_u32(rd, p);
+                total = rd_u32(rd, p + 4);
+                if (total < 12 || (total & 3) || total > rd->size - rd->off)
+                        return -1;
+                rd->off += total;
+
+                switch (type) {
+                case PCAPNG_IDB_TYPE:
+                        ng_read_interface(rd, p, total);
+                        break;
+
+                case PCAPNG_EPB_TYPE:
+                        if (total < 32)
+                                return -1;
+                        caplen = rd_u32(rd, p + 20);
+                        if (caplen > total - 32)
+                                return -1;
+                        rec->ifid = rd_u32(rd, p + 8);
+                        if (rec->ifid >= rd->nifs ||
+                            rec->ifid >= PCAPNG_MAX_IFACES ||
+                            rd->ifs[rec->ifid].linktype != LINKTYPE_ETHERNET)
+                                break;
+                        rec->ts_ns = rd_ts_ns(
+                            ((uint64_t)rd_u32(rd, p + 12) << 32) |
+                            rd_u32(rd, p + 16), rd->ifs[rec->ifid].units);
+                        rec->caplen = caplen;
+                        rec->len = rd_u32(rd, p + 24);
+                        rec->data = p + 28;
+                        rec->dir = 0;
+                        if ((opt = ng_find_option(rd,
+                            p + 28 + PCAPNG_PAD(caplen), p + total - 4,
+                            PCAPNG_OPT_EPB_FLAGS, &len)) != NULL && len >= 4)
+                                rec->dir = rd_u32(rd, opt) & 3;
+                        return 1;
+
+                case PCAPNG_SPB_TYPE:
+                        if (total < 16 || rd->nifs == 0 ||
+                            rd->ifs[0].linktype != LINKTYPE_ETHERNET)
+                                break;
+                        rec->ifid = 0;
+                        rec->ts_ns = 0;
+                        rec->len = rd_u32(rd, p + 8);
+                        rec->caplen = min(rec->len, total - 16);
+                        rec->data = p + 12;
+                        rec->dir = 0;
+                        return 1;
+
+                default:
+                        break;
+                }
+        }
+        return rd->off == rd->size ? 0 : -1;
+}
+
+static int
+sf_read(struct sr_dump_reader *rd, struct sr_dump_record *rec)
+{
+        const unsigned char *p = rd->buf + rd->off;
+
+        if (rd->off == rd->size)
+                return 0;
+        if (rd->size - rd->off < sizeof(struct pcap_sf_pkthdr))
+                return -1;
+
+        rec->caplen = rd_u32(rd, p + 8);
+        rec->len = rd_u32(rd, p + 12);
+        if (rec->caplen > rd->size - rd->off - sizeof(struct pcap_sf_pkthdr))
+                return -1;
+
+        rec->ts_ns = (uint64_t)rd_u32(rd, p) * 1000000000 +
+            rd_ts_ns(rd_u32(rd, p + 4), rd->units);
+        rec->ifid = 0;
+        rec->dir = 0;
+        rec->data = p + sizeof(struct pcap_sf_pkthdr);
+        rd->off += sizeof(struct pcap_sf_pkthdr) + rec->caplen;
+        return 1;
+}
+
+struct sr_dump_reader *
+sr_dump_read_open(const char *fname)
+{
+        struct sr_dump_reader *rd;
+        FILE *fp;
+        long size;
+        uint32_t magic;
+
+        if ((fp = fopen(fname, "r")) == NULL) {
+                fprintf(stderr, "sr_dump_read_open: can't open %s\n", fname);
+                return (NULL);
+        }
+        if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+            fseek(fp, 0, SEEK_SET) != 0) {
+                fprintf(stderr, "sr_dump_read_open: can't size %s\n", fname);
+                fclose(fp);
+                return (NULL);
+        }
+
+        rd = calloc(1, sizeof(*rd));
+        if (rd == NULL || (rd->buf = malloc(size ? size : 1)) == NULL ||
+            fread(rd->buf, 1, size, fp) != (size_t)size) {
+                fprintf(stderr, "sr_dump_read_open: can't read %s\n", fname);
+                fclose(fp);
+                sr_dump_read_close(rd);
+                return (NULL);
+        }
+        fclose(fp);
+        rd->size = size;
+
+        if (rd->size < sizeof(uint32_t))
+                goto bad;
+        memcpy(&magic, rd->buf, sizeof(magic));
+
+        if (magic == PCAPNG_SHB_TYPE) {
+                rd->ng = 1;
+                return rd;
+        }
+
+        /* -- legacy pcap, the magic also gives byte order and resolution -- */
+        if (rd->size < sizeof(struct pcap_file_header))
+                goto bad;
+        if (rd_u32(rd, rd->buf) != TCPDUMP_MAGIC &&
+            rd_u32(rd, rd->buf) != TCPDUMP_NSEC_MAGIC)
+                rd->swapped = 1;
+        magic = rd_u32(rd, rd->buf);
+        if (magic == TCPDUMP_MAGIC)
+                rd->units = 1000000;
+        else if (magic == TCPDUMP_NSEC_MAGIC)
+                rd->units = 1000000000;
+        else
+                goto bad;
+        if (rd_u32(rd, rd->buf + 20) != LINKTYPE_ETHERNET) {
+                fprintf(stderr, "sr_dump_read_open: %s is not ethernet\n",
+                    fname);
+                sr_dump_read_close(rd);
+                return (NULL);
+        }
+        rd->off = sizeof(struct pcap_file_header);
+        return rd;
+
+bad:
+        fprintf(stderr, "sr_dump_read_open: %s is not a capture file\n",
+            fname);
+        sr_dump_read_close(rd);
+        return (NULL);
+}
+
+int
+sr_dump_read(struct sr_dump_reader *rd, struct sr_dump_record *rec)
+{
+        return rd->ng ? ng_read(rd, rec) : sf_read(rd, rec);
+}
+
+const char *
+sr_dump_read_ifname(struct sr_dump_reader *rd, uint32_t ifid)
+{
+        if (!rd->ng || ifid >= rd->nifs || ifid >= PCAPNG_MAX_IFACES ||
+            rd->ifs[ifid].name[0] == '\0')
+                return (NULL);
+        return rd->ifs[ifid].name;
+}
+
+void
+sr_dump_read_close(struct sr_dump_reader *rd)
+{
+        if (rd == NULL)
+                return;
+        free(rd->buf);
+        free(rd);
+}
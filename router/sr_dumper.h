@@ -3,6 +3,10 @@
  * format as well as a set of operations for logging.
  */
 
+#ifndef SR_DUMPER_H
+#define SR_DUMPER_H
+
+#include <stdio.h>
 
 #ifdef _LINUX_
 #include <stdint.h>
@@ -77,3 +81,87 @@ void sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp);
  * Close the file
  */
 void sr_dump_close(FILE *fp);
+
+/*
+ * pcapng output.  Unlike the legacy format above, pcapng records which
+ * interface a frame was seen on, its direction, and nanosecond
+ * timestamps.  A file is a Section Header Block followed by one
+ * Interface Description Block per interface and Enhanced Packet Blocks
+ * that refer to interfaces by the order their IDBs were written.
+ */
+
+#define PCAPNG_SHB_TYPE      0x0A0D0D0A
+#define PCAPNG_IDB_TYPE      0x00000001
+#define PCAPNG_EPB_TYPE      0x00000006
+#define PCAPNG_BYTE_ORDER    0x1A2B3C4D
+
+#define PCAPNG_OPT_END       0
+#define PCAPNG_OPT_IF_NAME   2
+#define PCAPNG_OPT_IF_MAC    6
+#define PCAPNG_OPT_IF_TSRES  9
+#define PCAPNG_OPT_EPB_FLAGS 2
+
+/* epb_flags direction bits */
+#define PCAPNG_DIR_IN        1
+#define PCAPNG_DIR_OUT       2
+
+/**
+ * Open a pcapng file and write the section header.
+ */
+FILE* sr_dump_ng_open(const char *fname);
+
+/**
+ * Describe an interface.  Its id in later packet blocks is the number of
+ * interfaces described before it.
+ */
+void sr_dump_ng_interface(FILE *fp, const char *name,
+                          const unsigned char *mac, int snaplen);
+
+/**
+ * Write one packet seen on interface ifid at ts_ns (ns since the epoch),
+ * dir is PCAPNG_DIR_IN, PCAPNG_DIR_OUT or 0 if unknown.
+ */
+void sr_dump_ng(FILE *fp, uint32_t ifid, uint64_t ts_ns, uint32_t caplen,
+                uint32_t len, int dir, const unsigned char *sp);
+
+/*
+ * Reading.  Legacy pcap in either byte order at micro- or nanosecond
+ * resolution, and pcapng with any number of sections and interfaces,
+ * are read back as ethernet frames.  The whole file is loaded when it is
+ * opened so records point straight into memory.
+ */
+
+#define TCPDUMP_NSEC_MAGIC   0xa1b23c4d
+#define PCAPNG_SPB_TYPE      0x00000003
+#define PCAPNG_MAX_IFACES    64
+
+struct sr_dump_record {
+  uint64_t ts_ns;             /* ns since the epoch */
+  uint32_t ifid;              /* pcapng interface id, 0 for legacy pcap */
+  uint32_t caplen;
+  uint32_t len;
+  int dir;                    /* PCAPNG_DIR_IN, PCAPNG_DIR_OUT or 0 */
+  const unsigned char *data;  /* caplen bytes, owned by the reader */
+};
+
+struct sr_dump_reader;
+
+/**
+ * Load a pcap or pcapng file, NULL on error.
+ */
+struct sr_dump_reader *sr_dump_read_open(const char *fname);
+
+/**
+ * Next ethernet frame; 1 if rec was filled in, 0 at the end of the
+ * file and -1 if the file is corrupt.
+ */
+int sr_dump_read(struct sr_dump_reader *rd, struct sr_dump_record *rec);
+
+/**
+ * Name pcapng gave interface ifid in the current section, or NULL.
+ */
+const char *sr_dump_read_ifname(struct sr_dump_reader *rd, uint32_t ifid);
+
+void sr_dump_read_close(struct sr_dump_reader *rd);
+
+#endif /* -- SR_DUMPER_H -- */
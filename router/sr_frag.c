@@ -0,0 +1,127 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_frag.c
+ *
+ * Description:
+ *
+ * IPv4 fragmentation on output, see sr_frag.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include "sr_frag.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+
+#define SR_FRAG_OPT_COPIED 0x80     /* option type: copy into fragments */
+
+/* -- the options of len bytes at opt that go into every fragment, into
+ *    out, padded to a 32-bit boundary; returns their length -- */
+static unsigned int sr_frag_copied_options(const uint8_t* opt,
+                                           unsigned int len, uint8_t* out)
+{
+    unsigned int i = 0, n = 0;
+
+    while(i < len && opt[i] != 0)           /* end of option list */
+    {
+        if(opt[i] == 1)                     /* no-op, not copied */
+        { i++; continue; }
+        if(i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len)
+        { break; }                          /* malformed: keep what we have */
+        if(opt[i] & SR_FRAG_OPT_COPIED)
+        {
+            memcpy(out + n, opt + i, opt[i + 1]);
+            n += opt[i + 1];
+        }
+        i += opt[i + 1];
+    }
+    while(n & 3)
+    { out[n++] = 0; }
+    return n;
+} /* -- sr_frag_copied_options -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_frag_send(..)
+ *
+ * Send the IP datagram in frame, Ethernet header already addressed, out
+ * iface in fragments of at most iface->mtu bytes.  Fragmenting a
+ * fragment works: offsets are relative to the original datagram and MF
+ * stays set on the last piece if it was set on the whole.  Returns 0 if
+ * every fragment was sent.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_frag_send(struct sr_instance* sr, uint8_t* frame, unsigned int len,
+                 struct sr_if* iface)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    uint8_t hdr[sizeof(sr_ethernet_hdr_t) + 60];
+    sr_ip_hdr_t* fip = (sr_ip_hdr_t*)(hdr + sizeof(sr_ethernet_hdr_t));
+    uint8_t* payload;
+    struct iovec iov[2];
+    unsigned int hl = ip->ip_hl * 4, ip_len = ntohs(ip->ip_len);
+    unsigned int plen, off = 0, chunk, max, hlen;
+    uint16_t base = ntohs(ip->ip_off) & IP_OFFMASK;
+    uint16_t mf = ntohs(ip->ip_off) & IP_MF;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iface);
+    assert(ip_len > iface->mtu);
+    assert(len >= sizeof(sr_ethernet_hdr_t) + ip_len);
+
+    if(iface->mtu < hl + 8)
+    {
+        LogDebug("%u byte header, MTU %u: cannot fragment\n", hl,
+                 iface->mtu);
+        sr_stats_drop(sr, sr_drop_frag_needed, frame, len);
+        return -1;
+    }
+
+    /* -- first fragment: the original header, options and all -- */
+    memcpy(hdr, frame, sizeof(sr_ethernet_hdr_t) + hl);
+    payload = (uint8_t*)ip + hl;
+    plen = ip_len - hl;
+    hlen = hl;
+    sr_stats_count(sr, sr_cnt_frag_datagrams);
+
+    while(off < plen)
+    {
+        max = (iface->mtu - hlen) & ~7u;
+        chunk = plen - off > max ? max : plen - off;
+
+        fip->ip_hl = hlen / 4;
+        fip->ip_len = htons(hlen + chunk);
+        fip->ip_off = htons((base + off / 8) |
+                            (off + chunk < plen || mf ? IP_MF : 0));
+        fip->ip_sum = 0;
+        fip->ip_sum = cksum(fip, hlen);
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = sizeof(sr_ethernet_hdr_t) + hlen;
+        iov[1].iov_base = payload + off;
+        iov[1].iov_len = chunk;
+        if(sr_send_packet_iov(sr, iov, 2, iface) != 0)
+        { return -1; }
+        sr_stats_count(sr, sr_cnt_frag_fragments);
+
+        /* -- later fragments: only the options marked for copying -- */
+        if(off == 0 && hl > sizeof(sr_ip_hdr_t))
+        {
+            hlen = sizeof(sr_ip_hdr_t) +
+                sr_frag_copied_options((uint8_t*)(ip + 1),
+                        hl - sizeof(sr_ip_hdr_t), (uint8_t*)(fip + 1));
+        }
+        off += chunk;
+    }
+    return 0;
+} /* -- sr_frag_send -- */
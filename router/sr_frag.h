@@ -0,0 +1,33 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_frag.h
+ *
+ * Description:
+ *
+ * IPv4 fragmentation on output (RFC 791, section 3.2) for datagrams the
+ * outgoing interface's MTU cannot carry.  Datagrams with DF set never
+ * get here: the forwarding path answers them with fragmentation needed
+ * instead.
+ *
+ * Each fragment goes out as two pieces through sr_send_packet_iov(..):
+ * an Ethernet and IP header built on the stack, and a slice of the
+ * original payload where it lies.  The router itself copies no payload;
+ * the backend copies each slice once, into wherever it transmits from.
+ * The first fragment keeps all the IP options, the rest only those with
+ * the copied flag.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FRAG_H
+#define SR_FRAG_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+struct sr_instance;
+struct sr_if;
+
+int sr_frag_send(struct sr_instance* sr, uint8_t* frame, unsigned int len,
+                 struct sr_if* iface);
+
+#endif /* -- SR_FRAG_H -- */
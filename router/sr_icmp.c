@@ -0,0 +1,320 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.c
+ *
+ * Description:
+ *
+ * Rate limits on originated ICMP errors and the replies themselves, see
+ * sr_icmp.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+
+#include "sr_icmp.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+
+void sr_icmp_default_limits(struct sr_icmp_limits* limits)
+{
+    limits->rate = SR_ICMP_RATE;
+    limits->burst = SR_ICMP_BURST;
+    limits->src_rate = SR_ICMP_SRC_RATE;
+    limits->src_burst = SR_ICMP_SRC_BURST;
+} /* -- sr_icmp_default_limits -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_parse_rate(..)
+ *
+ * "rate" or "rate/burst".  Without a burst, one second's worth but at
+ * least 1.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_icmp_parse_rate(const char* arg, double* rate, double* burst)
+{
+    char* end;
+
+    *rate = strtod(arg, &end);
+    if(end == arg || *rate < 0)
+    { return -1; }
+    if(*end == '\0')
+    {
+        *burst = *rate < 1 ? 1 : *rate;
+        return 0;
+    }
+    if(*end != '/')
+    { return -1; }
+    arg = end + 1;
+    *burst = strtod(arg, &end);
+    return end == arg || *end != '\0' || *burst < 1 ? -1 : 0;
+} /* -- sr_icmp_parse_rate -- */
+
+static uint64_t sr_icmp_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_icmp_now -- */
+
+/* -- refill b for the time since its last refill, then take a token if
+ *    there is one; 1 if taken -- */
+static int sr_icmp_take(struct sr_icmp_bucket* b, double rate, double burst,
+                        uint64_t now)
+{
+    if(rate == 0)
+    { return 1; }
+    if(now > b->last_ns)
+    {
+        b->tokens += (now - b->last_ns) * 1e-9 * rate;
+        if(b->tokens > burst)
+        { b->tokens = burst; }
+        b->last_ns = now;
+    }
+    if(b->tokens < 1)
+    { return 0; }
+    b->tokens -= 1;
+    return 1;
+} /* -- sr_icmp_take -- */
+
+void sr_icmp_open(struct sr_instance* sr, const struct sr_icmp_limits* limits)
+{
+    struct sr_icmp* icmp;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(limits);
+
+    icmp = (struct sr_icmp*)calloc(1, sizeof(struct sr_icmp));
+    assert(icmp);
+    icmp->limits = *limits;
+    pthread_mutex_init(&icmp->lock, 0);
+    icmp->global.tokens = limits->burst;
+    icmp->global.last_ns = sr_icmp_now();
+    sr->icmp = icmp;
+
+    LogInfo("icmp: errors limited to %g/s burst %g, %g/s burst %g per "
+            "source /24 (0: no limit)\n", limits->rate, limits->burst,
+            limits->src_rate, limits->src_burst);
+} /* -- sr_icmp_open -- */
+
+/* -- broadcast, multicast (and the reserved class E) or zero -- */
+static int sr_icmp_not_unicast(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    uint32_t ip = ntohl(ip_nbo);
+
+    return ip == 0 || ip >> 28 >= 0xe ||
+        sr_local_addr_lookup(sr, ip_nbo, 0) == sr_local_broadcast;
+} /* -- sr_icmp_not_unicast -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_error_wanted(..)
+ *
+ * May an ICMP error be sent about orig, of which len bytes are at hand,
+ * at all?  No for an ICMP error (or ICMP too short to tell), a fragment
+ * past the first, and a datagram from or to anything but a unicast
+ * address.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_icmp_error_wanted(struct sr_instance* sr, const sr_ip_hdr_t* orig,
+                         unsigned int len)
+{
+    const sr_icmp_hdr_t* icmp;
+    unsigned int hl = orig->ip_hl * 4;
+
+    if(ntohs(orig->ip_off) & IP_OFFMASK)
+    { return 0; }
+    if(sr_icmp_not_unicast(sr, orig->ip_src) ||
+            sr_icmp_not_unicast(sr, orig->ip_dst))
+    { return 0; }
+    if(orig->ip_p != ip_protocol_icmp)
+    { return 1; }
+
+    /* -- only queries are answered with errors -- */
+    if(len < hl + sizeof(sr_icmp_hdr_t))
+    { return 0; }
+    icmp = (const sr_icmp_hdr_t*)((const uint8_t*)orig + hl);
+    switch(icmp->icmp_type)
+    {
+        case icmp_type_echo_reply:
+        case icmp_type_echo_request:
+        case 13: case 14:       /* timestamp */
+        case 15: case 16:       /* information */
+        case 17: case 18:       /* address mask */
+            return 1;
+    }
+    return 0;
+} /* -- sr_icmp_error_wanted -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_error_allowed(..)
+ *
+ * May we send an ICMP error to src_nbo?  Takes a token from both buckets
+ * if so; counts the refusal if not.  Without sr_icmp_open(..) everything
+ * is allowed.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_icmp_error_allowed(struct sr_instance* sr, uint32_t src_nbo)
+{
+    struct sr_icmp* icmp = sr->icmp;
+    const struct sr_icmp_limits* l;
+    struct sr_icmp_bucket* b;
+    uint32_t key = (ntohl(src_nbo) & 0xffffff00) | 1;  /* never 0 */
+    uint64_t now;
+    int ok;
+
+    if(!icmp)
+    { return 1; }
+    l = &icmp->limits;
+
+    pthread_mutex_lock(&icmp->lock);
+    now = sr_icmp_now();
+    b = &icmp->src[(key * 2654435761u) >> 24 & (SR_ICMP_SRC_SLOTS - 1)];
+    if(b->key != key)
+    {
+        b->key = key;
+        b->tokens = l->src_burst;
+        b->last_ns = now;
+    }
+
+    /* -- the source first: one noisy /24 should not drain the global
+     *    bucket for everybody else -- */
+    if(!sr_icmp_take(b, l->src_rate, l->src_burst, now))
+    {
+        pthread_mutex_unlock(&icmp->lock);
+        sr_stats_count(sr, sr_cnt_icmp_limited_source);
+        return 0;
+    }
+    if(!(ok = sr_icmp_take(&icmp->global, l->rate, l->burst, now)) &&
+            l->src_rate)
+    { b->tokens += 1; }     /* not sent, so not spent */
+    pthread_mutex_unlock(&icmp->lock);
+
+    if(!ok)
+    { sr_stats_count(sr, sr_cnt_icmp_limited_global); }
+    return ok;
+} /* -- sr_icmp_error_allowed -- */
+
+void sr_icmp_close(struct sr_instance* sr)
+{
+    if(!sr->icmp)
+    { return; }
+    pthread_mutex_destroy(&sr->icmp->lock);
+    free(sr->icmp);
+    sr->icmp = 0;
+} /* -- sr_icmp_close -- */
+
+static void sr_icmp_build_template(struct sr_if* iface)
+{
+    struct sr_icmp_tmpl* t = &iface->icmp;
+
+    memset(t, 0, sizeof(*t));
+    t->ip.ip_v = 4;
+    t->ip.ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    t->ip.ip_len = htons(sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t));
+    t->ip.ip_off = htons(IP_DF);
+    t->ip.ip_ttl = INIT_TTL;
+    t->ip.ip_p = ip_protocol_icmp;
+    t->ip.ip_src = iface->ip;
+    t->ip_sum = cksum_add(0, &t->ip, sizeof(sr_ip_hdr_t));
+    t->src = iface->ip;
+} /* -- sr_icmp_build_template -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_build_templates(..)
+ *
+ * (Re)build every interface's error template, once the interfaces have
+ * their addresses.  sr_icmp_error_frame(..) rebuilds a stale one itself.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_icmp_build_templates(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+
+    for(i = 0; i < sr->num_ifaces; i++)
+    { sr_icmp_build_template(sr->if_table[i]); }
+} /* -- sr_icmp_build_templates -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_error_frame(..)
+ *
+ * Write into frame (SR_ICMP_ERROR_FRAME bytes) an ICMP error about orig,
+ * of which quoted bytes are available, from src_if's address back to
+ * orig's source.  next_mtu is for fragmentation needed, 0 otherwise.
+ * The Ethernet header is left for sr_send_ip_frame(..).  Returns the
+ * frame length.
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_icmp_error_frame(uint8_t* frame, struct sr_if* src_if,
+                                 const sr_ip_hdr_t* orig, unsigned int quoted,
+                                 uint8_t type, uint8_t code, uint16_t next_mtu)
+{
+    struct sr_icmp_tmpl* t = &src_if->icmp;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_t3_hdr_t* icmp = (sr_icmp_t3_hdr_t*)(ip + 1);
+    uint32_t dst = ntohl(orig->ip_src);
+
+    if(t->ip.ip_v != 4 || t->src != src_if->ip)
+    { sr_icmp_build_template(src_if); }
+
+    memset(frame, 0, sizeof(sr_ethernet_hdr_t));
+    memcpy(ip, &t->ip, sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t3_hdr_t));
+    ip->ip_dst = orig->ip_src;
+    ip->ip_sum = cksum_fold(t->ip_sum + (dst >> 16) + (dst & 0xffff));
+
+    icmp->icmp_type = type;
+    icmp->icmp_code = code;
+    icmp->next_mtu = htons(next_mtu);
+    memcpy(icmp->data, orig,
+           quoted < ICMP_DATA_SIZE ? quoted : ICMP_DATA_SIZE);
+    icmp->icmp_sum = cksum_fold(cksum_add((type << 8 | code) + next_mtu,
+                                          icmp->data, ICMP_DATA_SIZE));
+    return SR_ICMP_ERROR_FRAME;
+} /* -- sr_icmp_error_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_icmp_echo_reply_in_place(..)
+ *
+ * Turn the echo request in packet, already checked for length, into the
+ * reply.  Returns the frame length without any Ethernet padding.
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_icmp_echo_reply_in_place(uint8_t* packet)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*)((uint8_t*)ip + ip->ip_hl * 4);
+    uint32_t src = ip->ip_src;
+    uint16_t old;
+
+    /* -- same words, other order: the sum stands -- */
+    ip->ip_src = ip->ip_dst;
+    ip->ip_dst = src;
+
+    old = htons(ip->ip_ttl << 8 | ip->ip_p);
+    ip->ip_ttl = INIT_TTL;
+    ip->ip_sum = cksum_update(ip->ip_sum, old, htons(INIT_TTL << 8 | ip->ip_p));
+
+    old = htons(icmp->icmp_type << 8 | icmp->icmp_code);
+    icmp->icmp_type = icmp_type_echo_reply;
+    icmp->icmp_sum = cksum_update(icmp->icmp_sum, old,
+                                  htons(icmp_type_echo_reply << 8 |
+                                        icmp->icmp_code));
+    return sizeof(sr_ethernet_hdr_t) + ntohs(ip->ip_len);
+} /* -- sr_icmp_echo_reply_in_place -- */
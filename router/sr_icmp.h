@@ -0,0 +1,108 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_icmp.h
+ *
+ * Description:
+ *
+ * Rate limits on the ICMP errors the router originates (unreachables and
+ * time exceeded, from forwarding and from ARP timeouts), so that a
+ * traceroute storm or a scan cannot keep it busy building replies.  Two
+ * token buckets stand in front of every error: one for the router as a
+ * whole and one for the /24 the offending packet came from, the latter
+ * in a small direct-mapped table where a new /24 takes over the slot of
+ * an old one with a full bucket.  An error goes out only if both have a
+ * token; the rest are counted (icmp_limited_global, icmp_limited_source)
+ * and dropped.
+ *
+ *   --icmp-rate=rate[/burst]      whole router, default 1000/50
+ *   --icmp-src-rate=rate[/burst]  per source /24, default 50/20
+ *
+ * Rates are per second; 0 turns a bucket off.  Echo replies are not
+ * limited.
+ *
+ * Before any of that, sr_icmp_error_wanted(..) applies RFC 1122 3.2.2 and
+ * RFC 1812 4.3.2.7: no error about an ICMP error, about a fragment other
+ * than the first, or about a datagram from or to a broadcast, multicast
+ * or zero address.  Errors then never beget errors.
+ *
+ * It also builds the replies.  Each interface carries a template of the
+ * IP and ICMP headers of an error sourced from its address, with the
+ * checksum of the IP fields that never change already summed, so an
+ * error is a copy, a patch of the destination, type, code and quote, and
+ * a fold.  Echo replies are made in the request's own buffer: swapping
+ * the addresses leaves the IP checksum alone, and the TTL and type
+ * changes are applied to both checksums incrementally.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ICMP_H
+#define SR_ICMP_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_protocol.h"
+
+#define SR_ICMP_RATE        1000
+#define SR_ICMP_BURST       50
+#define SR_ICMP_SRC_RATE    50
+#define SR_ICMP_SRC_BURST   20
+#define SR_ICMP_SRC_SLOTS   256     /* source /24s tracked at once, 2^n */
+
+/* -- Ethernet, IP and type 3/11 ICMP: every error we send -- */
+#define SR_ICMP_ERROR_FRAME (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                             sizeof(sr_icmp_t3_hdr_t))
+
+struct sr_instance;
+struct sr_if;
+
+/* -- per interface, in struct sr_if -- */
+struct sr_icmp_tmpl
+{
+    sr_ip_hdr_t ip;             /* ip_dst and ip_sum left 0 */
+    sr_icmp_t3_hdr_t icmp;      /* all 0 */
+    uint32_t ip_sum;            /* cksum_add(..) of ip, unfolded */
+    uint32_t src;               /* the address it was built for */
+};
+
+struct sr_icmp_bucket
+{
+    uint32_t key;               /* source /24, host order; 0 if unused */
+    double tokens;
+    uint64_t last_ns;           /* of the last refill */
+};
+
+struct sr_icmp_limits
+{
+    double rate;                /* tokens a second, 0 for no limit */
+    double burst;
+    double src_rate;
+    double src_burst;
+};
+
+struct sr_icmp
+{
+    struct sr_icmp_limits limits;
+    pthread_mutex_t lock;       /* main loop and ARP sweeper both send */
+    struct sr_icmp_bucket global;
+    struct sr_icmp_bucket src[SR_ICMP_SRC_SLOTS];
+};
+
+void sr_icmp_default_limits(struct sr_icmp_limits* limits);
+int  sr_icmp_parse_rate(const char* arg, double* rate, double* burst);
+void sr_icmp_open(struct sr_instance* sr, const struct sr_icmp_limits* limits);
+int  sr_icmp_error_wanted(struct sr_instance* sr, const sr_ip_hdr_t* orig,
+                          unsigned int len);
+int  sr_icmp_error_allowed(struct sr_instance* sr, uint32_t src_nbo);
+void sr_icmp_close(struct sr_instance* sr);
+
+void sr_icmp_build_templates(struct sr_instance* sr);
+unsigned int sr_icmp_error_frame(uint8_t* frame, struct sr_if* src_if,
+                                 const sr_ip_hdr_t* orig, unsigned int quoted,
+                                 uint8_t type, uint8_t code,
+                                 uint16_t next_mtu);
+unsigned int sr_icmp_echo_reply_in_place(uint8_t* packet);
+
+#endif /* -- SR_ICMP_H -- */
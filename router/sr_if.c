@@ -24,36 +24,86 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_utils.h"
+#include "sr_log.h"
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_if_name_hash
+ * Scope: Local
+ *
+ * FNV-1a over at most sr_IFACE_NAMELEN characters of an interface name,
+ * so two names that strncmp equal always hash equal.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_if_name_hash(const char* name)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    for(i = 0; i < sr_IFACE_NAMELEN && name[i]; i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+
+    return h;
+} /* -- sr_if_name_hash -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
  * Scope: Global
  *
  * Given an interface name return the interface record or 0 if it doesn't
- * exist.
+ * exist.  This is meant for resolving names that come off the wire or out
+ * of config files; anything on the forwarding path should hold on to the
+ * returned record (or its ifindex) instead of looking it up again.
  *
  *---------------------------------------------------------------------*/
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 {
-    struct sr_if* if_walker = 0;
+    struct sr_if* iface = 0;
+    uint32_t h;
+    unsigned int i;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
 
-    if_walker = sr->if_list;
+    h = sr_if_name_hash(name);
 
-    while(if_walker)
+    for(i = 0; i < sr->num_ifaces; i++)
     {
-       if(!strncmp(if_walker->name,name,sr_IFACE_NAMELEN))
-        { return if_walker; }
-        if_walker = if_walker->next;
+        iface = sr->if_table[i];
+        if(iface->name_hash == h &&
+           !strncmp(iface->name,name,sr_IFACE_NAMELEN))
+        { return iface; }
     }
 
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Return the interface interned at ifindex or 0 if out of range.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr,
+                                        unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= sr->num_ifaces)
+    { return 0; }
+
+    return sr->if_table[ifindex];
+} /* -- sr_get_interface_by_index -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
@@ -65,31 +115,32 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 void sr_add_interface(struct sr_instance* sr, const char* name)
 {
     struct sr_if* if_walker = 0;
+    struct sr_if* iface = 0;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
+    assert(sr->num_ifaces < SR_MAX_IFACES);
+
+    iface = (struct sr_if*)calloc(1, sizeof(struct sr_if));
+    assert(iface);
+    strncpy(iface->name,name,sr_IFACE_NAMELEN - 1);
+    iface->name_hash = sr_if_name_hash(iface->name);
+    iface->ifindex = sr->num_ifaces;
+    iface->next = 0;
 
     /* -- empty list special case -- */
     if(sr->if_list == 0)
+    { sr->if_list = iface; }
+    else
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
-        assert(sr->if_list);
-        sr->if_list->next = 0;
-        strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
-        return;
+        /* -- the tail of the list is the last interned interface -- */
+        if_walker = sr->if_table[sr->num_ifaces - 1];
+        if_walker->next = iface;
     }
 
-    /* -- find the end of the list -- */
-    if_walker = sr->if_list;
-    while(if_walker->next)
-    {if_walker = if_walker->next; }
-
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
-    assert(if_walker->next);
-    if_walker = if_walker->next;
-    strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
-    if_walker->next = 0;
+    /* -- intern into the dense table -- */
+    sr->if_table[sr->num_ifaces++] = iface;
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -106,10 +157,9 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
 
     /* -- REQUIRES -- */
     assert(sr->if_list);
-    
-    if_walker = sr->if_list;
-    while(if_walker->next)
-    {if_walker = if_walker->next; }
+    assert(sr->num_ifaces > 0);
+
+    if_walker = sr->if_table[sr->num_ifaces - 1];
 
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
@@ -130,16 +180,165 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- REQUIRES -- */
     assert(sr->if_list);
-    
-    if_walker = sr->if_list;
-    while(if_walker->next)
-    {if_walker = if_walker->next; }
+    assert(sr->num_ifaces > 0);
+
+    if_walker = sr->if_table[sr->num_ifaces - 1];
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
 
 } /* -- sr_set_ether_ip -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_mask(..)
+ * Scope: Global
+ *
+ * set the subnet mask of the LAST interface in the interface list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_mask(struct sr_instance* sr, uint32_t mask_nbo)
+{
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+    assert(sr->num_ifaces > 0);
+
+    sr->if_table[sr->num_ifaces - 1]->mask = mask_nbo;
+} /* -- sr_set_ether_mask -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_mtu(..)
+ * Scope: Global
+ *
+ * set the MTU of the LAST interface in the interface list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_mtu(struct sr_instance* sr, unsigned int mtu)
+{
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+    assert(sr->num_ifaces > 0);
+
+    sr->if_table[sr->num_ifaces - 1]->mtu = mtu;
+} /* -- sr_set_ether_mtu -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_resolve_mtus(..)
+ * Scope: Global
+ *
+ * Give interfaces nobody told us the MTU of the largest the frame limit
+ * (-j, or the VNS server's) allows, and bring the rest within it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_resolve_mtus(struct sr_instance* sr)
+{
+    unsigned int i, max;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    max = sr->max_frame - sizeof(sr_ethernet_hdr_t);
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        struct sr_if* iface = sr->if_table[i];
+
+        if(iface->mtu == 0)
+        { iface->mtu = max; }
+        else if(iface->mtu > max)
+        {
+            LogWarn("%s: MTU %u is more than a %u byte frame holds, "
+                    "using %u\n", iface->name, iface->mtu, sr->max_frame,
+                    max);
+            iface->mtu = max;
+        }
+        if(iface->mtu < SR_IF_MTU_MIN)
+        {
+            LogWarn("%s: MTU %u is below the IPv4 minimum, using %d\n",
+                    iface->name, iface->mtu, SR_IF_MTU_MIN);
+            iface->mtu = SR_IF_MTU_MIN;
+        }
+    }
+} /* -- sr_resolve_mtus -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_load_if_config(..)
+ * Scope: Global
+ *
+ * Read interfaces from a file instead of a VNS hwinfo message, for
+ * backends that have no server to ask.  One entry per line:
+ *
+ *   name  ip  mask  mac [mtu]  an interface, in ifindex order
+ *   arp   ip  mac              a permanent ARP cache entry
+ *
+ * Blank lines and lines starting with # are ignored.  The ARP cache must
+ * already be initialised (sr_init).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_load_if_config(struct sr_instance* sr, const char* filename)
+{
+    FILE* fp;
+    char  line[BUFSIZ];
+    char  name[32], ip[32], mask[32], mac[32];
+    struct in_addr ip_addr, mask_addr;
+    unsigned char mac_addr[ETHER_ADDR_LEN];
+    unsigned int mtu;
+    int   fields, lineno = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(filename);
+
+    if((fp = fopen(filename,"r")) == 0)
+    {
+        perror(filename);
+        return -1;
+    }
+
+    while( fgets(line,BUFSIZ,fp) != 0)
+    {
+        lineno++;
+        mtu = 0;
+        fields = sscanf(line,"%31s %31s %31s %31s %u",name,ip,mask,mac,&mtu);
+        if(fields <= 0 || name[0] == '#')
+        { continue; }
+
+        if(strcmp(name, "arp") == 0)
+        {
+            if(fields != 3 || inet_aton(ip,&ip_addr) == 0 ||
+                    parse_addr_eth(mask, mac_addr) != 0 ||
+                    sr_arpcache_insert_static(&sr->cache, mac_addr,
+                        ip_addr.s_addr) != 0)
+            { goto bad; }
+            continue;
+        }
+
+        if(fields < 4 || (fields == 5 && mtu < SR_IF_MTU_MIN) ||
+                inet_aton(ip,&ip_addr) == 0 ||
+                inet_aton(mask,&mask_addr) == 0 ||
+                parse_addr_eth(mac, mac_addr) != 0 ||
+                sr->num_ifaces >= SR_MAX_IFACES ||
+                sr_get_interface(sr, name) != 0)
+        { goto bad; }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_ip(sr, ip_addr.s_addr);
+        sr_set_ether_mask(sr, mask_addr.s_addr);
+        sr_set_ether_addr(sr, mac_addr);
+        sr_set_ether_mtu(sr, mtu);
+    } /* -- while -- */
+
+    fclose(fp);
+    return 0;
+
+bad:
+    fprintf(stderr, "%s:%d: bad interface entry: %s", filename, lineno, line);
+    fclose(fp);
+    return -1;
+} /* -- sr_load_if_config -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -170,34 +369,176 @@ void sr_print_if_list(struct sr_instance* sr)
 } /* -- sr_print_if_list -- */
 
 /*--------------------------------------------------------------------- 
- * Method: sr_list_contains(..)
+ * Method: sr_local_addr_slot(..)
+ * Scope: Local
+ *
+ * Multiplicative hash of ip into the table built by sr_build_local_addrs
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_local_addr_slot(const struct sr_local_table* t,
+                                       uint32_t ip)
+{
+    return ((uint32_t)(ip * t->seed) >> t->shift) & t->mask;
+} /* -- sr_local_addr_slot -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_local_addr_try(..)
+ * Scope: Local
+ *
+ * Lay out addrs with the given seed and size using linear probing.
+ * Returns the longest probe sequence needed.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_local_addr_try(struct sr_local_table* t,
+                                      const struct sr_local_addr* addrs,
+                                      int n, uint32_t seed,
+                                      unsigned int bits)
+{
+    unsigned int worst = 0, probe, slot;
+    int i;
+
+    t->seed = seed;
+    t->shift = 32 - bits;
+    t->mask = (1u << bits) - 1;
+    memset(t->slots, 0, sizeof(t->slots));
+
+    for(i = 0; i < n; i++)
+    {
+        slot = sr_local_addr_slot(t, addrs[i].ip);
+        for(probe = 0; t->slots[(slot + probe) & t->mask].kind; probe++)
+        {
+            /* -- same address twice, first owner wins -- */
+            if(t->slots[(slot + probe) & t->mask].ip == addrs[i].ip)
+            { break; }
+        }
+        if(t->slots[(slot + probe) & t->mask].kind == sr_local_none)
+        { t->slots[(slot + probe) & t->mask] = addrs[i]; }
+        if(probe > worst)
+        { worst = probe; }
+    }
+
+    return worst;
+} /* -- sr_local_addr_try -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_build_local_addrs(..)
  * Scope: Global
  *
- * print out the list of interfaces to stdout
+ * (Re)build the local address table from the interface list.  Called
+ * once the hardware info is in.  Searches for a multiplier that places
+ * every address in its home slot, growing the table if the set is too
+ * dense, and settles for the shortest probe sequence seen otherwise.
  *
  *---------------------------------------------------------------------*/
 
-int sr_if_list_contains_ip(struct sr_instance* sr, uint32_t ip_addr)
+void sr_build_local_addrs(struct sr_instance* sr)
 {
-    struct sr_if* if_walker = 0;
+    struct sr_local_addr addrs[2 * SR_MAX_IFACES + 1];
+    struct sr_local_table* t = 0;
+    uint32_t seed = 0x9e3779b1u, best_seed = 0;
+    unsigned int bits, best_bits = 0, best = ~0u, worst, max_bits;
+    unsigned int i, attempt;
+    int n = 0;
 
-    if(sr->if_list == 0)
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    t = &(sr->local_addrs);
+
+    for(i = 0; i < sr->num_ifaces; i++)
     {
-        return 0;
+        struct sr_if* iface = sr->if_table[i];
+
+        addrs[n].ip = iface->ip;
+        addrs[n].kind = sr_local_unicast;
+        addrs[n].ifindex = iface->ifindex;
+        n++;
+
+        /* -- subnet-directed broadcast, meaningless for /31 and /32 -- */
+        if(iface->mask && (ntohl(iface->mask) & 3) == 0)
+        {
+            addrs[n].ip = iface->ip | ~iface->mask;
+            addrs[n].kind = sr_local_broadcast;
+            addrs[n].ifindex = iface->ifindex;
+            n++;
+        }
     }
 
-    if_walker = sr->if_list;
-    
-    if (if_walker->ip == ip_addr) return 1;
-    while(if_walker->next)
+    addrs[n].ip = 0xffffffffu;
+    addrs[n].kind = sr_local_broadcast;
+    addrs[n].ifindex = 0;
+    n++;
+
+    for(max_bits = 0; (1u << max_bits) < SR_LOCAL_ADDR_SLOTS; max_bits++);
+    for(bits = 4; (1u << bits) < 2u * n && bits < max_bits; bits++);
+
+    for(; bits <= max_bits && best; bits++)
     {
-        if_walker = if_walker->next; 
-        if (if_walker->ip == ip_addr) return 1;
+        for(attempt = 0; attempt < 64; attempt++)
+        {
+            worst = sr_local_addr_try(t, addrs, n, seed, bits);
+            if(worst < best)
+            {
+                best = worst;
+                best_seed = seed;
+                best_bits = bits;
+            }
+            if(best == 0)
+            { break; }
+            /* -- next odd multiplier -- */
+            seed = (seed * 1664525u + 1013904223u) | 1u;
+        }
     }
 
-    return 0;
+    sr_local_addr_try(t, addrs, n, best_seed, best_bits);
+    t->max_probe = best;
+} /* -- sr_build_local_addrs -- */
 
-} /* -- sr_print_if_list -- */
+/*--------------------------------------------------------------------- 
+ * Method: sr_local_addr_lookup(..)
+ * Scope: Global
+ *
+ * Is ip (network byte order) one of ours?  Returns an sr_local_kind and,
+ * if owner is non-null, the interface the address belongs to.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_local_addr_lookup(struct sr_instance* sr, uint32_t ip_nbo,
+                         struct sr_if** owner)
+{
+    const struct sr_local_table* t = &(sr->local_addrs);
+    const struct sr_local_addr* a = 0;
+    unsigned int slot = sr_local_addr_slot(t, ip_nbo);
+    unsigned int probe;
+
+    for(probe = 0; probe <= t->max_probe; probe++)
+    {
+        a = &(t->slots[(slot + probe) & t->mask]);
+        if(a->kind && a->ip == ip_nbo)
+        {
+            if(owner)
+            { *owner = sr->if_table[a->ifindex]; }
+            return a->kind;
+        }
+    }
+
+    return sr_local_none;
+} /* -- sr_local_addr_lookup -- */
+
+/*--------------------------------------------------------------------- 
+ * Method: sr_if_list_contains_ip(..)
+ * Scope: Global
+ *
+ * Is ip_addr the unicast address of one of our interfaces?
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_if_list_contains_ip(struct sr_instance* sr, uint32_t ip_addr)
+{
+    return sr_local_addr_lookup(sr, ip_addr, 0) == sr_local_unicast;
+} /* -- sr_if_list_contains_ip -- */
 
 
 /*--------------------------------------------------------------------- 
@@ -217,9 +558,11 @@ void sr_print_if(struct sr_if* iface)
     assert(iface->name);
 
     ip_addr.s_addr = iface->ip;
+    (void)ip_addr;      /* only for Debug(..), which may compile away */
 
     Debug("%s\tHWaddr",iface->name);
     DebugMAC(iface->addr);
     Debug("\n");
-    Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
+    Debug("\tinet addr %s",inet_ntoa(ip_addr));
+    Debug("  mtu %u\n",iface->mtu);
 } /* -- sr_print_if -- */
@@ -25,6 +25,18 @@
 #endif
 
 #include "sr_protocol.h"
+#include "sr_icmp.h"
+
+/* upper bound on ifindex, interfaces are interned into sr->if_table */
+#define SR_MAX_IFACES 32
+
+/* smallest MTU an IPv4 link may have (RFC 791): a full header and 8
+ * bytes of payload in every fragment */
+#define SR_IF_MTU_MIN 68
+
+/* slots in the local address table, a power of two comfortably above the
+ * 2*SR_MAX_IFACES+1 addresses it can hold */
+#define SR_LOCAL_ADDR_SLOTS 1024
 
 struct sr_instance;
 
@@ -40,14 +52,61 @@ struct sr_if
   char name[sr_IFACE_NAMELEN];
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
+  uint32_t mask;
   uint32_t speed;
+  unsigned int mtu;      /* largest IP datagram sent unfragmented, 0 until
+                            known; sr_resolve_mtus fills in the rest */
+  unsigned int ifindex;  /* slot in sr->if_table, stable for the session */
+  uint32_t name_hash;    /* cheap pre-check before comparing names */
+  struct sr_icmp_tmpl icmp; /* headers of errors sourced here */
   struct sr_if* next;
 };
 
+/* ----------------------------------------------------------------------------
+ * struct sr_local_table
+ *
+ * Addresses the router accepts for local delivery (interface addresses,
+ * subnet-directed broadcasts and 255.255.255.255), hashed with a
+ * multiplier chosen at build time so that lookups take at most max_probe
+ * extra probes -- normally none.
+ *
+ * -------------------------------------------------------------------------- */
+
+enum sr_local_kind {
+  sr_local_none = 0,
+  sr_local_unicast = 1,
+  sr_local_broadcast = 2,
+};
+
+struct sr_local_addr
+{
+  uint32_t ip;            /* network byte order */
+  uint16_t kind;          /* enum sr_local_kind, 0 marks an empty slot */
+  uint16_t ifindex;
+};
+
+struct sr_local_table
+{
+  uint32_t seed;          /* odd multiplier */
+  unsigned int shift;     /* 32 - log2(size) */
+  unsigned int mask;      /* size - 1 */
+  unsigned int max_probe;
+  struct sr_local_addr slots[SR_LOCAL_ADDR_SLOTS];
+};
+
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr,
+                                        unsigned int ifindex);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
+void sr_set_ether_mask(struct sr_instance*, uint32_t mask_nbo);
+void sr_set_ether_mtu(struct sr_instance*, unsigned int mtu);
+void sr_resolve_mtus(struct sr_instance*);
+int sr_load_if_config(struct sr_instance*, const char* filename);
+void sr_build_local_addrs(struct sr_instance*);
+int sr_local_addr_lookup(struct sr_instance*, uint32_t ip_nbo,
+                         struct sr_if** owner);
 void sr_print_if_list(struct sr_instance*);
 int sr_if_list_contains_ip(struct sr_instance* sr, uint32_t ip_addr);
 void sr_print_if(struct sr_if*);
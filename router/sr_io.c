@@ -0,0 +1,303 @@
+/*-----------------------------------------------------------------------------
+ * File: sr_io.c
+ *
+ * Description:
+ *
+ * The part of packet I/O every backend shares: sanity checks and packet
+ * logging on the way out, logging and dispatch to the router on the way
+ * in, and finishing interface setup once a backend knows its interfaces.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_capture.h"
+#include "sr_dumper.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_protocol.h"
+#include "sr_stats.h"
+#include "sr_icmp.h"
+#include "sr_log.h"
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_ether_addrs_match_interface(..)
+ * Scope: Local
+ *
+ * Make sure ethernet addresses are sane so we don't muck uo the system.
+ *
+ *----------------------------------------------------------------------------*/
+
+static int
+sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
+                                uint8_t* buf, /* borrowed */
+                                struct sr_if* iface /* borrowed */ )
+{
+    struct sr_ethernet_hdr* ether_hdr = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    ether_hdr = (struct sr_ethernet_hdr*)buf;
+
+    if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
+        LogWarn("** Error, source address does not match interface\n");
+        return 0;
+    }
+
+    /* TODO */
+    /* Check destination, hardware address.  If it is private (i.e. destined
+     * to a virtual interface) ensure it is going to the correct topology
+     * Note: This check should really be done server side ...
+     */
+
+    return 1;
+
+} /* -- sr_ether_addrs_match_interface -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet(..)
+ * Scope: Global
+ *
+ * Send a packet (ethernet header included!) of length 'len' to the server
+ * to be injected onto the wire.  Resolves the interface by name and hands
+ * off to sr_send_packet_if(..); the router itself should call that directly
+ * with the interface it already holds.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed */)
+{
+    struct sr_if* if_rec = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iface);
+
+    if_rec = sr_get_interface(sr, iface);
+    if ( if_rec == 0 ){
+        LogWarn("** Error, interface %s, does not exist\n", iface);
+        return -1;
+    }
+
+    return sr_send_packet_if(sr, buf, len, if_rec);
+} /* -- sr_send_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_if(..)
+ * Scope: Global
+ *
+ * Send a packet (ethernet header included!) of length 'len' out of the
+ * given interface through the installed backend.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_if(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         struct sr_if* iface /* borrowed */)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+    assert(sr->io);
+
+    /* don't waste my time ... */
+    if ( len < sizeof(struct sr_ethernet_hdr) ){
+        LogWarn("** Error: packet is wayy to short \n");
+        return -1;
+    }
+    if ( len > sr->max_frame ){
+        LogWarn("** Error: %u byte frame, max is %u (-j)\n",
+                len, sr->max_frame);
+        return -1;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len,iface,PCAPNG_DIR_OUT);
+
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
+        LogWarn("*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    if ( sr->io->send(sr, buf, len, iface) != 0 ){
+        sr_stats_drop(sr, sr_drop_queue_full, buf, len);
+        return -1;
+    }
+    sr_stats_tx(sr, iface, len);
+    return 0;
+} /* -- sr_send_packet_if -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_iov(..)
+ * Scope: Global
+ *
+ * sr_send_packet_if(..) for a frame in pieces, the first of which holds
+ * at least the Ethernet header.  Backends with sendv copy the pieces
+ * once, into wherever they transmit from; for the others, and when the
+ * packet log wants the whole frame, they are gathered here first.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_iov(struct sr_instance* sr /* borrowed */,
+                       const struct iovec* iov /* borrowed */,
+                       int iovcnt,
+                       struct sr_if* iface /* borrowed */)
+{
+    uint8_t frame[SR_MAX_FRAME_JUMBO];
+    unsigned int len = 0;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(iov);
+    assert(iovcnt > 0);
+    assert(iface);
+    assert(sr->io);
+    assert(iov[0].iov_len >= sizeof(struct sr_ethernet_hdr));
+
+    for(i = 0; i < iovcnt; i++)
+    { len += iov[i].iov_len; }
+    if ( len > sr->max_frame ){
+        LogWarn("** Error: %u byte frame, max is %u (-j)\n",
+                len, sr->max_frame);
+        return -1;
+    }
+
+    if ( !sr->io->sendv || sr->capture ){
+        for(i = 0, len = 0; i < iovcnt; i++)
+        {
+            memcpy(frame + len, iov[i].iov_base, iov[i].iov_len);
+            len += iov[i].iov_len;
+        }
+        return sr_send_packet_if(sr, frame, len, iface);
+    }
+
+    if ( ! sr_ether_addrs_match_interface( sr, iov[0].iov_base, iface) ){
+        LogWarn("*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    if ( sr->io->sendv(sr, iov, iovcnt, len, iface) != 0 ){
+        sr_stats_drop(sr, sr_drop_queue_full, iov[0].iov_base,
+                      iov[0].iov_len);
+        return -1;
+    }
+    sr_stats_tx(sr, iface, len);
+    return 0;
+} /* -- sr_send_packet_iov -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_io_receive(..)
+ * Scope: Global
+ *
+ * A backend received a frame on iface; log it and let the router have it.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_io_receive(struct sr_instance* sr /* borrowed */,
+                   uint8_t* buf /* lent */,
+                   unsigned int len,
+                   struct sr_if* iface /* borrowed */)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    /* -- log and count packet -- */
+    sr_log_packet(sr, buf, len, iface, PCAPNG_DIR_IN);
+    sr_stats_rx(sr, iface, len);
+
+    /* -- pass to router, student's code should take over here -- */
+    sr_handlepacket(sr, buf, len, iface);
+    sr_stats_rx_done();
+} /* -- sr_io_receive -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_io_interfaces_ready(..)
+ * Scope: Global
+ *
+ * Called by a backend once every interface has been added and addressed.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_io_interfaces_ready(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+
+    /* -- MTUs neither the config nor the device gave -- */
+    sr_resolve_mtus(sr);
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+
+    /* -- bind routes loaded before the interfaces were known -- */
+    sr_rt_resolve_interfaces(sr);
+
+    /* -- addresses we accept for local delivery -- */
+    sr_build_local_addrs(sr);
+    sr_icmp_build_templates(sr);
+
+    /* -- name the interfaces for srstat -- */
+    sr_stats_interfaces(sr);
+
+    /* -- name the interfaces in the packet log -- */
+    for ( i=0; i<sr->num_ifaces; i++ )
+    {
+        sr_capture_interface(sr->capture, sr->if_table[i]->ifindex,
+                sr->if_table[i]->name, sr->if_table[i]->addr);
+    }
+} /* -- sr_io_interfaces_ready -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_io_close(..)
+ * Scope: Global
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_io_close(struct sr_instance* sr)
+{
+    /* REQUIRES */
+    assert(sr);
+
+    if(sr->io && sr->io->close)
+    { sr->io->close(sr); }
+} /* -- sr_io_close -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_packet()
+ * Scope: Global
+ *
+ * Hand the packet to the capture ring; the disk write happens on the
+ * capture writer thread.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   struct sr_if* iface, int dir )
+{
+    /* REQUIRES */
+    assert(sr);
+
+    if(!sr->capture)
+    {return; }
+
+    sr_capture_packet(sr->capture, buf, len,
+            iface ? (int)iface->ifindex : -1, dir);
+} /* -- sr_log_packet -- */
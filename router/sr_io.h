@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------
+ * File: sr_io.h
+ *
+ * Description:
+ *
+ * Packet I/O backends.  The router core only ever sees frames handed to
+ * sr_handlepacket(..) and calls sr_send_packet_if(..) to put frames on
+ * the wire; where those frames come from and go to is up to the backend
+ * installed in sr->io.  The VNS connection (sr_vns_comm.c) is one
+ * backend, pcap replay (sr_replay.c) another.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_IO_H
+#define SR_IO_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <sys/uio.h>
+
+struct sr_instance;
+struct sr_if;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_io_ops
+ *
+ * poll  : receive what is available and hand it to sr_io_receive(..).
+ *         Returns 1 to be called again, 0 when the source is done and
+ *         -1 on error.  Runs on the main thread only.
+ * send  : transmit one complete ethernet frame.  May be called from the
+ *         main thread and the ARP sweeper at the same time.  Returns 0 on
+ *         success, -1 on error.
+ * close : release backend state, called once from sr_io_close(..).
+ *         The ARP sweeper may still call send afterwards; the backend
+ *         must drop such frames rather than crash.
+ * sendv : optional, send for a frame in pieces (fragments: a header and
+ *         a slice of the original payload), copied once into wherever
+ *         the backend transmits from.  Without it sr_send_packet_iov(..)
+ *         gathers the pieces and calls send.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_io_ops
+{
+    const char* name;
+    int  (*poll)(struct sr_instance* sr);
+    int  (*send)(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                 struct sr_if* iface);
+    void (*close)(struct sr_instance* sr);
+    int  (*sendv)(struct sr_instance* sr, const struct iovec* iov, int iovcnt,
+                  unsigned int len, struct sr_if* iface);
+};
+
+/* -- sr_vns_comm.c -- */
+extern const struct sr_io_ops sr_vns_io;
+
+/* -- sr_io.c -- */
+void sr_io_receive(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                   struct sr_if* iface);
+void sr_io_interfaces_ready(struct sr_instance* sr);
+void sr_io_close(struct sr_instance* sr);
+void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                   struct sr_if* iface, int dir);
+
+#endif /* -- SR_IO_H -- */
@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.c
+ *
+ * Description:
+ *
+ * Runtime side of the leveled logging macros in sr_log.h
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+#include "sr_log.h"
+
+int sr_log_level = SR_LOG_INFO;
+
+static const char* sr_log_names[] =
+{ "none", "error", "warn", "info", "debug", "trace" };
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_printf(..)
+ *
+ * Only reached once a macro has decided the level is enabled.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_log_printf(int level, const char* fmt, ...)
+{
+    va_list ap;
+    FILE* out = (level <= SR_LOG_WARN) ? stderr : stdout;
+
+    va_start(ap, fmt);
+    vfprintf(out, fmt, ap);
+    va_end(ap);
+} /* -- sr_log_printf -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_log_level_parse(..)
+ *
+ * Accepts a level name or number, returns -1 if it is neither.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_log_level_parse(const char* name)
+{
+    char* end = 0;
+    long n;
+    int i;
+
+    for(i = SR_LOG_NONE; i <= SR_LOG_TRACE; i++)
+    {
+        if(strcasecmp(name, sr_log_names[i]) == 0)
+        { return i; }
+    }
+
+    n = strtol(name, &end, 10);
+    if(end != name && *end == '\0' && n >= SR_LOG_NONE && n <= SR_LOG_TRACE)
+    { return (int)n; }
+
+    return -1;
+} /* -- sr_log_level_parse -- */
+
+const char* sr_log_level_name(int level)
+{
+    if(level < SR_LOG_NONE || level > SR_LOG_TRACE)
+    { return "?"; }
+    return sr_log_names[level];
+} /* -- sr_log_level_name -- */
@@ -0,0 +1,75 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_log.h
+ *
+ * Description:
+ *
+ * Leveled logging.  Each level has its own macro; levels above the
+ * compile time SR_LOG_LEVEL expand to nothing, so a build with
+ * -DSR_LOG_LEVEL=SR_LOG_WARN does no formatting at all for per-packet
+ * traces.  Levels that are compiled in are further gated by the runtime
+ * sr_log_level (set with -L or over the control surface).
+ *
+ * Errors and warnings go to stderr, everything else to stdout.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_LOG_H
+#define SR_LOG_H
+
+#define SR_LOG_NONE   0
+#define SR_LOG_ERROR  1
+#define SR_LOG_WARN   2
+#define SR_LOG_INFO   3
+#define SR_LOG_DEBUG  4
+#define SR_LOG_TRACE  5
+
+#ifndef SR_LOG_LEVEL
+#define SR_LOG_LEVEL SR_LOG_TRACE
+#endif
+
+extern int sr_log_level;
+
+void sr_log_printf(int level, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+int  sr_log_level_parse(const char* name);
+const char* sr_log_level_name(int level);
+
+/* true if a statement at 'level' would be printed; folds to 0 at compile
+ * time for levels that are compiled out, use it to guard dumps */
+#define LogEnabled(level) \
+  ((level) <= SR_LOG_LEVEL && (level) <= sr_log_level)
+
+#define SR_LOG_AT(level, x, args...) \
+  do { if ((level) <= sr_log_level) sr_log_printf(level, x, ## args); } while (0)
+
+#if SR_LOG_LEVEL >= SR_LOG_ERROR
+#define LogError(x, args...) SR_LOG_AT(SR_LOG_ERROR, x, ## args)
+#else
+#define LogError(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_WARN
+#define LogWarn(x, args...) SR_LOG_AT(SR_LOG_WARN, x, ## args)
+#else
+#define LogWarn(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_INFO
+#define LogInfo(x, args...) SR_LOG_AT(SR_LOG_INFO, x, ## args)
+#else
+#define LogInfo(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_DEBUG
+#define LogDebug(x, args...) SR_LOG_AT(SR_LOG_DEBUG, x, ## args)
+#else
+#define LogDebug(x, args...) do{}while(0)
+#endif
+
+#if SR_LOG_LEVEL >= SR_LOG_TRACE
+#define LogTrace(x, args...) SR_LOG_AT(SR_LOG_TRACE, x, ## args)
+#else
+#define LogTrace(x, args...) do{}while(0)
+#endif
+
+#endif /* -- SR_LOG_H -- */
@@ -22,6 +22,8 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 #include <pwd.h>
 #include <sys/types.h>
 
@@ -29,9 +31,22 @@
 #include <getopt.h>
 #endif /* _LINUX_ */
 
-#include "sr_dumper.h"
+#include "sr_capture.h"
+#include "sr_io.h"
+#include "sr_replay.h"
+#include "sr_afpacket.h"
+#include "sr_afxdp.h"
+#include "sr_vns_uring.h"
+#include "sr_vns_shm.h"
+#include "sr_busy.h"
+#include "sr_stats.h"
+#include "sr_ctl.h"
+#include "sr_metrics.h"
+#include "sr_perf.h"
+#include "sr_icmp.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_log.h"
 
 extern char* optarg;
 
@@ -45,7 +60,21 @@ extern char* optarg;
 #define DEFAULT_RTABLE "rtable"
 #define DEFAULT_TOPO 0
 
+#define SR_OPT_PERF 256     /* long options only, past any short one */
+#define SR_OPT_ICMP_RATE 257
+#define SR_OPT_ICMP_SRC_RATE 258
+
+static const struct option long_opts[] =
+{
+    { "perf", optional_argument, 0, SR_OPT_PERF },
+    { "icmp-rate", required_argument, 0, SR_OPT_ICMP_RATE },
+    { "icmp-src-rate", required_argument, 0, SR_OPT_ICMP_SRC_RATE },
+    { 0, 0, 0, 0 }
+};
+
 static void usage(char* );
+static int  sr_parse_uint(const char* arg, unsigned long min,
+                          unsigned long max, unsigned int* value);
 static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
@@ -65,11 +94,37 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    struct sr_capture_opts capture_opts;
+    struct sr_replay_opts replay_opts;
+    int afpacket = 0;
+    char *xdp_mode = 0;
+    int use_uring = 0;
+    char *shm_path = 0;
+    unsigned int max_frame = SR_MAX_FRAME_DEFAULT;
+    int busy_cpu = -1;
+    char *stats_path = 0;
+    char *ctl_path = 0;
+    char *metrics_at = 0;
+    int perf_interval = -1;
+    struct sr_icmp_limits icmp_limits;
+    int log_level;
+    unsigned int snaplen, value;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    capture_opts.snaplen = PACKET_DUMP_SIZE;
+    capture_opts.sample = 1;
+    capture_opts.filter = 0;
+    capture_opts.pcapng = 0;
+
+    sr_icmp_default_limits(&icmp_limits);
+
+    memset(&replay_opts, 0, sizeof(replay_opts));
+
+    while ((c = getopt_long(argc, argv,
+                    "hs:v:p:u:t:r:l:T:L:S:N:F:GR:I:O:Pn:AX:UM:j:b:K:C:H:",
+                    long_opts, 0)) != EOF)
     {
         switch (c)
         {
@@ -95,18 +150,180 @@ int main(int argc, char **argv)
             case 'l':
                 logfile = optarg;
                 break;
+            case 'S':
+                if(sr_parse_uint(optarg, 1, UINT_MAX,
+                            &capture_opts.sample) != 0)
+                {
+                    fprintf(stderr, "Bad sample rate %s, 1 in N for N >= 1\n",
+                            optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'N':
+                if(sr_parse_uint(optarg, 1, 65535, &snaplen) != 0)
+                {
+                    fprintf(stderr, "Bad snaplen %s, 1 to 65535\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                capture_opts.snaplen = snaplen;
+                break;
+            case 'F':
+                capture_opts.filter = optarg;
+                break;
+            case 'G':
+                capture_opts.pcapng = 1;
+                break;
+            case 'R':
+                replay_opts.input = optarg;
+                break;
+            case 'I':
+                replay_opts.ifconfig = optarg;
+                break;
+            case 'O':
+                replay_opts.output = optarg;
+                break;
+            case 'P':
+                replay_opts.paced = 1;
+                break;
+            case 'n':
+                if(sr_parse_uint(optarg, 1, UINT_MAX, &replay_opts.loops) != 0)
+                {
+                    fprintf(stderr, "Bad replay passes %s, 1 or more\n",
+                            optarg);
+                    exit(1);
+                }
+                break;
+            case 'A':
+                afpacket = 1;
+                break;
+            case 'X':
+                xdp_mode = optarg;
+                break;
+            case 'U':
+                use_uring = 1;
+                break;
+            case 'M':
+                shm_path = optarg;
+                break;
+            case 'b':
+                if(sr_parse_uint(optarg, 0, INT_MAX, &value) != 0)
+                {
+                    fprintf(stderr, "Bad busy-poll cpu %s\n", optarg);
+                    exit(1);
+                }
+                busy_cpu = value;
+                break;
+            case 'H':
+                metrics_at = optarg;
+                break;
+            case 'C':
+                ctl_path = optarg;
+                break;
+            case 'K':
+                stats_path = optarg;
+                break;
+            case SR_OPT_PERF:
+                value = SR_PERF_INTERVAL;
+                if(optarg && sr_parse_uint(optarg, 0, INT_MAX, &value) != 0)
+                {
+                    fprintf(stderr, "Bad perf report interval %s\n", optarg);
+                    exit(1);
+                }
+                perf_interval = value;
+                break;
+            case SR_OPT_ICMP_RATE:
+                if(sr_icmp_parse_rate(optarg, &icmp_limits.rate,
+                            &icmp_limits.burst) != 0)
+                {
+                    fprintf(stderr, "Bad ICMP rate %s, rate[/burst]\n", optarg);
+                    exit(1);
+                }
+                break;
+            case SR_OPT_ICMP_SRC_RATE:
+                if(sr_icmp_parse_rate(optarg, &icmp_limits.src_rate,
+                            &icmp_limits.src_burst) != 0)
+                {
+                    fprintf(stderr, "Bad ICMP rate %s, rate[/burst]\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'j':
+                if(sr_parse_uint(optarg, sizeof(struct sr_ethernet_hdr),
+                            SR_MAX_FRAME_JUMBO, &max_frame) != 0)
+                {
+                    fprintf(stderr, "Bad max frame size %s, %u to %d\n",
+                            optarg,
+                            (unsigned int)sizeof(struct sr_ethernet_hdr),
+                            SR_MAX_FRAME_JUMBO);
+                    exit(1);
+                }
+                break;
             case 'r':
                 rtable = optarg;
                 break;
             case 'T':
                 template = optarg;
                 break;
+            case 'L':
+                if((log_level = sr_log_level_parse(optarg)) < 0)
+                {
+                    fprintf(stderr, "Unknown log level %s\n", optarg);
+                    usage(argv[0]);
+                    exit(1);
+                }
+                if(log_level > SR_LOG_LEVEL)
+                {
+                    fprintf(stderr, "Log level %s not compiled in (max %s)\n",
+                            optarg, sr_log_level_name(SR_LOG_LEVEL));
+                }
+                sr_log_level = log_level;
+                break;
         } /* switch */
     } /* -- while -- */
 
+    if(replay_opts.input && (!replay_opts.ifconfig || template))
+    {
+        fprintf(stderr, "Replay (-R) needs an interface config (-I) "
+                "and a local routing table\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(afpacket && (!replay_opts.ifconfig || template || replay_opts.input))
+    {
+        fprintf(stderr, "AF_PACKET (-A) needs an interface config (-I) "
+                "and a local routing table, and excludes -R\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(xdp_mode && (!replay_opts.ifconfig || template || replay_opts.input ||
+                afpacket))
+    {
+        fprintf(stderr, "AF_XDP (-X) needs an interface config (-I) "
+                "and a local routing table, and excludes -R and -A\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
+    if(shm_path && template)
+    {
+        fprintf(stderr, "Shared memory (-M) needs a local routing table\n");
+        usage(argv[0]);
+        exit(1);
+    }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
 
+    /* -- counters are there from the first packet on -- */
+    if(sr_stats_open(&sr, stats_path) != 0)
+    {
+        return 1;
+    }
+
     /* -- set up routing table from file -- */
     if(template == NULL) {
         sr.template[0] = '\0';
@@ -116,6 +333,7 @@ int main(int argc, char **argv)
         strncpy(sr.template, template, 30);
 
     sr.topo_id = topo;
+    sr.max_frame = max_frame;
     strncpy(sr.host,host,32);
 
     if(! user )
@@ -126,8 +344,11 @@ int main(int argc, char **argv)
     /* -- set up file pointer for logging of raw packets -- */
     if(logfile != 0)
     {
-        sr.logfile = sr_dump_open(logfile,0,PACKET_DUMP_SIZE);
-        if(!sr.logfile)
+        /* -- the ring holds snaplen bytes a slot; no frame is over -j -- */
+        if(capture_opts.snaplen > (int)sr.max_frame)
+        { capture_opts.snaplen = sr.max_frame; }
+        sr.capture = sr_capture_open(logfile,&capture_opts);
+        if(!sr.capture)
         {
             fprintf(stderr,"Error opening up dump file %s\n",
                     logfile);
@@ -135,32 +356,99 @@ int main(int argc, char **argv)
         }
     }
 
-    Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
-    if(template)
-        Debug("Requesting topology template %s\n", template);
-    else
-        Debug("Requesting topology %d\n", topo);
+    if(replay_opts.input == 0 && afpacket == 0 && xdp_mode == 0)
+    {
+        Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
+        if(template)
+            Debug("Requesting topology template %s\n", template);
+        else
+            Debug("Requesting topology %d\n", topo);
+
+        /* connect to server and negotiate session */
+        if(shm_path)
+        {
+            if(sr_vns_shm_connect(&sr, shm_path) == -1)
+            {
+                return 1;
+            }
+        }
+        else if(sr_connect_to_server(&sr,port,server) == -1)
+        {
+            return 1;
+        }
+
+        if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
+            Debug("Connected to new instantiation of topology template %s\n", template);
+            sr_load_rt_wrap(&sr, "rtable.vrhost");
+        }
+        else {
+          /* Read from specified routing table */
+          sr_load_rt_wrap(&sr, rtable);
+        }
+    }
 
-    /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    /* -- before sr_init, which leaves the ARP sweep to the main loop -- */
+    if(busy_cpu >= 0 && sr_busy_open(&sr, busy_cpu) != 0)
     {
         return 1;
     }
 
-    if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
-        Debug("Connected to new instantiation of topology template %s\n", template);
-        sr_load_rt_wrap(&sr, "rtable.vrhost");
-    }
-    else {
-      /* Read from specified routing table */
-      sr_load_rt_wrap(&sr, rtable);
-    }
+    /* -- before sr_init starts the ARP sweeper, which sends errors too -- */
+    sr_icmp_open(&sr, &icmp_limits);
 
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
 
+    if(ctl_path && sr_ctl_open(&sr, ctl_path) != 0)
+    {
+        return 1;
+    }
+    if(metrics_at && sr_metrics_open(&sr, metrics_at) != 0)
+    {
+        return 1;
+    }
+    /* -- counts the calling thread, the one that runs the main loop -- */
+    if(perf_interval >= 0 && sr_perf_open(&sr, perf_interval) != 0)
+    {
+        return 1;
+    }
+
+    /* -- replay, AF_PACKET and AF_XDP bring their own interfaces, VNS
+     *    sends them as hwinfo -- */
+    if(replay_opts.input && sr_replay_open(&sr, &replay_opts) != 0)
+    {
+        return 1;
+    }
+    if(afpacket && sr_afpacket_open(&sr, replay_opts.ifconfig) != 0)
+    {
+        return 1;
+    }
+    if(xdp_mode && sr_afxdp_open(&sr, replay_opts.ifconfig, xdp_mode) != 0)
+    {
+        return 1;
+    }
+
+    /* -- same VNS session, fewer syscalls -- */
+    if(use_uring && sr.io == &sr_vns_io && sr_vns_uring_open(&sr) != 0)
+    {
+        fprintf(stderr, "io_uring unavailable, staying on the blocking "
+                "VNS transport\n");
+    }
+
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    if(sr.busy)
+    {
+        while( sr.io->poll(&sr) == 1)
+        {
+            sr_busy_tick(&sr);
+            sr_ctl_reap(&sr);
+        }
+    }
+    else
+    {
+        while( sr.io->poll(&sr) == 1)
+        { sr_ctl_reap(&sr); }
+    }
 
     sr_destroy_instance(&sr);
 
@@ -178,11 +466,62 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-S sample 1 in N] [-N snaplen] \n");
+    printf("           [-F capture filter] [-G (pcapng log)] \n");
+    printf("           [-L log level] \n");
+    printf("           [-R replay pcap -I interface config [-O out pcap]\n");
+    printf("            [-P (keep capture pacing)] [-n passes]] \n");
+    printf("           [-A (AF_PACKET on the Linux interfaces in -I)] \n");
+    printf("           [-X native|generic|auto (AF_XDP on the same)] \n");
+    printf("           [-U (io_uring VNS transport)] \n");
+    printf("           [-M socket (VNS over shared memory from a local "
+           "source)] \n");
+    printf("           [-j max frame bytes (default %d, jumbo up to %d)] \n",
+            SR_MAX_FRAME_DEFAULT, SR_MAX_FRAME_JUMBO);
+    printf("           [-b cpu (busy-poll pinned to cpu, never block)] \n");
+    printf("           [-K file (counters for srstat, e.g. in /dev/shm)] \n");
+    printf("           [-C socket (control: stats, routes, arp, log)] \n");
+    printf("           [-H [host:]port or socket (Prometheus /metrics)] \n");
+    printf("           [--perf[=secs] (CPU counters per frame, logged every "
+           "secs, default %d)] \n", SR_PERF_INTERVAL);
+    printf("           [--icmp-rate=rate[/burst] (ICMP errors a second, "
+           "default %d/%d, 0 off)] \n", SR_ICMP_RATE, SR_ICMP_BURST);
+    printf("           [--icmp-src-rate=rate[/burst] (the same per source "
+           "/24, default %d/%d)] \n", SR_ICMP_SRC_RATE, SR_ICMP_SRC_BURST);
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
+    printf("   log levels none|error|warn|info|debug|trace (default %s)\n",
+            sr_log_level_name(sr_log_level));
 } /* -- usage -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_parse_uint(..)
+ * Scope: local
+ *
+ * A whole decimal number from min to max into value; returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_parse_uint(const char* arg, unsigned long min,
+                         unsigned long max, unsigned int* value)
+{
+    char* end;
+    unsigned long n;
+
+    /* -- strtoul takes "-1" as ULONG_MAX -- */
+    while(*arg == ' ' || *arg == '\t')
+    { arg++; }
+    if(*arg < '0' || *arg > '9')
+    { return -1; }
+
+    errno = 0;
+    n = strtoul(arg, &end, 10);
+    if(errno != 0 || *end != '\0' || n < min || n > max)
+    { return -1; }
+    *value = (unsigned int)n;
+    return 0;
+} /* -- sr_parse_uint -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_set_user(..)
  * Scope: local
@@ -220,9 +559,17 @@ static void sr_destroy_instance(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    if(sr->logfile)
+    sr_perf_close(sr);
+    sr_metrics_close(sr);
+    sr_ctl_close(sr);
+    sr_io_close(sr);
+    sr_icmp_close(sr);
+    sr_busy_close(sr);
+    sr_stats_close(sr);
+
+    if(sr->capture)
     {
-        sr_dump_close(sr->logfile);
+        sr_capture_close(sr->capture);
     }
 
     /*
@@ -247,8 +594,20 @@ static void sr_init_instance(struct sr_instance* sr)
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
+    sr->num_ifaces = 0;
+    memset(&(sr->local_addrs), 0, sizeof(sr->local_addrs));
     sr->routing_table = 0;
-    sr->logfile = 0;
+    sr->capture = 0;
+    sr->io = 0;
+    sr->io_state = 0;
+    sr->max_frame = SR_MAX_FRAME_DEFAULT;
+    sr->vns_batch = 0;
+    sr->busy = 0;
+    sr->stats = 0;
+    sr->ctl = 0;
+    sr->metrics = 0;
+    sr->perf = 0;
+    sr->icmp = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -269,7 +628,6 @@ static void sr_init_instance(struct sr_instance* sr)
 int sr_verify_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
-    struct sr_if* if_walker = 0;
     int ret = 0;
 
     /* -- REQUIRES --*/
@@ -284,16 +642,8 @@ int sr_verify_routing_table(struct sr_instance* sr)
 
     while(rt_walker)
     {
-        /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
-        {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
-        }
-        if(if_walker == 0)
+        /* -- bound by sr_rt_resolve_interfaces when hwinfo arrived -- */
+        if(rt_walker->iface == 0)
         { ret++; } /* -- interface not found! -- */
 
         rt_walker = rt_walker->next;
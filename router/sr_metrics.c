@@ -0,0 +1,528 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_metrics.c
+ *
+ * Description:
+ *
+ * Prometheus endpoint, see sr_metrics.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_metrics.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+
+struct sr_metrics_buf
+{
+    char* buf;
+    size_t len;
+    size_t cap;
+};
+
+static void sr_metrics_printf(struct sr_metrics_buf* b, const char* fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+static void sr_metrics_printf(struct sr_metrics_buf* b, const char* fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for(;;)
+    {
+        va_start(ap, fmt);
+        n = vsnprintf(b->buf + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if(n >= 0 && b->len + n < b->cap)
+        { break; }
+        b->cap = b->cap * 2 + n;
+        b->buf = (char*)realloc(b->buf, b->cap);
+        assert(b->buf);
+    }
+    b->len += n;
+} /* -- sr_metrics_printf -- */
+
+static void sr_metrics_head(struct sr_metrics_buf* b, const char* name,
+                            const char* type, const char* help)
+{
+    sr_metrics_printf(b, "# HELP %s %s\n# TYPE %s %s\n",
+            name, help, name, type);
+} /* -- sr_metrics_head -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_latency(..)
+ *
+ * The fine histograms folded into a Prometheus one, with a bucket edge
+ * counted if the fine bucket ends at or below it, and the percentiles as
+ * gauges for dashboards that want them ready made.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_metrics_latency(const struct sr_stats_seg* seg,
+                               const struct sr_stats_slot* sum,
+                               struct sr_metrics_buf* b)
+{
+    static const double le[] =
+    { 250e-9, 500e-9, 1e-6, 2e-6, 5e-6, 10e-6, 20e-6, 50e-6, 100e-6,
+      200e-6, 500e-6, 1e-3, 2e-3, 5e-3, 10e-3, 100e-3, 1 };
+    static const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+    const uint64_t* h;
+    uint64_t count, edge;
+    unsigned int p, i, k;
+    double hz = seg->tsc_hz;
+
+    sr_metrics_head(b, "sr_forward_latency_seconds", "histogram",
+            "Receipt to send, by ARP fast path and queued path.");
+    for(p = 0; p < SR_LAT_PATHS; p++)
+    {
+        h = sum->lat[p];
+        for(k = 0, i = 0, count = 0; k < sizeof(le) / sizeof(le[0]); k++)
+        {
+            edge = (uint64_t)(le[k] * hz);
+            for(; i < SR_LAT_BUCKETS && sr_stats_lat_lower(i + 1) - 1 <= edge;
+                    i++)
+            { count += h[i]; }
+            sr_metrics_printf(b, "sr_forward_latency_seconds_bucket"
+                    "{path=\"%s\",le=\"%g\"} %llu\n", sr_lat_path_names[p],
+                    le[k], (unsigned long long)count);
+        }
+        for(; i < SR_LAT_BUCKETS; i++)
+        { count += h[i]; }
+        sr_metrics_printf(b, "sr_forward_latency_seconds_bucket"
+                "{path=\"%s\",le=\"+Inf\"} %llu\n", sr_lat_path_names[p],
+                (unsigned long long)count);
+        sr_metrics_printf(b, "sr_forward_latency_seconds_sum{path=\"%s\"} "
+                "%.9f\n", sr_lat_path_names[p], sum->lat_sum[p] / hz);
+        sr_metrics_printf(b, "sr_forward_latency_seconds_count{path=\"%s\"} "
+                "%llu\n", sr_lat_path_names[p], (unsigned long long)count);
+    }
+
+    sr_metrics_head(b, "sr_forward_latency_quantile_seconds", "gauge",
+            "Receipt to send percentiles since start, to within 6%.");
+    for(p = 0; p < SR_LAT_PATHS; p++)
+    {
+        for(k = 0; k < sizeof(q) / sizeof(q[0]); k++)
+        {
+            sr_metrics_printf(b, "sr_forward_latency_quantile_seconds"
+                    "{path=\"%s\",quantile=\"%g\"} %.9f\n",
+                    sr_lat_path_names[p], q[k],
+                    sr_stats_percentile(sum->lat[p], q[k], seg->tsc_hz) / 1e9);
+        }
+    }
+} /* -- sr_metrics_latency -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_render(..)
+ *
+ * The /metrics page.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_metrics_render(struct sr_instance* sr, struct sr_metrics_buf* b)
+{
+    static const char* if_names[4] =
+    { "sr_rx_packets_total", "sr_rx_bytes_total",
+      "sr_tx_packets_total", "sr_tx_bytes_total" };
+    static const char* if_help[4] =
+    { "Frames received.", "Bytes received.",
+      "Frames sent.", "Bytes sent." };
+    struct sr_stats_seg* seg = sr->stats;
+    struct sr_stats_slot sum;
+    const uint64_t* c;
+    struct sr_arpreq* req;
+    struct sr_packet* pkt;
+    unsigned int i, k, r, p, n;
+    unsigned int entries = 0, reqs = 0, queued = 0;
+
+    sr_stats_sum(seg, &sum);
+    n = __atomic_load_n(&seg->num_ifaces, __ATOMIC_ACQUIRE);
+
+    for(k = 0; k < 4; k++)
+    {
+        sr_metrics_head(b, if_names[k], "counter", if_help[k]);
+        for(i = 0; i < n; i++)
+        {
+            c = (const uint64_t*)&sum.ifs[i];
+            sr_metrics_printf(b, "%s{interface=\"%.*s\"} %llu\n",
+                    if_names[k], sr_IFACE_NAMELEN, seg->ifname[i],
+                    (unsigned long long)c[k]);
+        }
+    }
+
+    sr_metrics_head(b, "sr_drops_total", "counter",
+            "Frames dropped, by reason and protocol.");
+    for(r = 0; r < SR_DROP_REASONS; r++)
+    {
+        for(p = 0; p < SR_STATS_PROTOS; p++)
+        {
+            sr_metrics_printf(b,
+                    "sr_drops_total{reason=\"%s\",protocol=\"%s\"} %llu\n",
+                    sr_drop_reason_names[r], sr_stats_proto_names[p],
+                    (unsigned long long)sum.drops[r][p]);
+        }
+    }
+
+    sr_metrics_head(b, "sr_fib_routes", "gauge", "Routes in the table.");
+    sr_metrics_printf(b, "sr_fib_routes %llu\n",
+            (unsigned long long)__atomic_load_n(&seg->fib_routes,
+                __ATOMIC_RELAXED));
+    sr_metrics_head(b, "sr_fib_lookups_total", "counter",
+            "Longest prefix match lookups.");
+    sr_metrics_printf(b, "sr_fib_lookups_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_fib_lookups]);
+    sr_metrics_head(b, "sr_fib_misses_total", "counter",
+            "Lookups that matched no route.");
+    sr_metrics_printf(b, "sr_fib_misses_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_fib_misses]);
+
+    /* -- gauges off the cache itself, under its lock -- */
+    pthread_mutex_lock(&sr->cache.lock);
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    { entries += sr->cache.entries[i].valid != 0; }
+    for(req = sr->cache.requests; req; req = req->next)
+    {
+        reqs++;
+        for(pkt = req->packets; pkt; pkt = pkt->next)
+        { queued++; }
+    }
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    sr_metrics_head(b, "sr_arp_entries", "gauge", "Valid ARP cache entries.");
+    sr_metrics_printf(b, "sr_arp_entries %u\n", entries);
+    sr_metrics_head(b, "sr_arp_capacity", "gauge", "ARP cache slots.");
+    sr_metrics_printf(b, "sr_arp_capacity %d\n", SR_ARPCACHE_SZ);
+    sr_metrics_head(b, "sr_arp_lookups_total", "counter",
+            "ARP cache lookups for outgoing frames.");
+    sr_metrics_printf(b, "sr_arp_lookups_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_arp_lookups]);
+    sr_metrics_head(b, "sr_arp_misses_total", "counter",
+            "ARP cache lookups that queued the frame.");
+    sr_metrics_printf(b, "sr_arp_misses_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_arp_misses]);
+    sr_metrics_head(b, "sr_arp_pending_requests", "gauge",
+            "ARP requests awaiting a reply.");
+    sr_metrics_printf(b, "sr_arp_pending_requests %u\n", reqs);
+    sr_metrics_head(b, "sr_arp_queued_packets", "gauge",
+            "Frames waiting on ARP replies.");
+    sr_metrics_printf(b, "sr_arp_queued_packets %u\n", queued);
+
+    sr_metrics_head(b, "sr_icmp_errors_total", "counter",
+            "ICMP errors sent.");
+    sr_metrics_printf(b, "sr_icmp_errors_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_icmp_errors]);
+    sr_metrics_head(b, "sr_icmp_errors_suppressed_total", "counter",
+            "ICMP errors not sent, by the rate limit that refused them.");
+    sr_metrics_printf(b, "sr_icmp_errors_suppressed_total{limit=\"global\"} "
+            "%llu\n",
+            (unsigned long long)sum.counters[sr_cnt_icmp_limited_global]);
+    sr_metrics_printf(b, "sr_icmp_errors_suppressed_total{limit=\"source\"} "
+            "%llu\n",
+            (unsigned long long)sum.counters[sr_cnt_icmp_limited_source]);
+
+    sr_metrics_head(b, "sr_frag_datagrams_total", "counter",
+            "Datagrams fragmented to fit the outgoing MTU.");
+    sr_metrics_printf(b, "sr_frag_datagrams_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_frag_datagrams]);
+    sr_metrics_head(b, "sr_frag_fragments_total", "counter",
+            "Fragments sent.");
+    sr_metrics_printf(b, "sr_frag_fragments_total %llu\n",
+            (unsigned long long)sum.counters[sr_cnt_frag_fragments]);
+
+    sr_metrics_latency(seg, &sum, b);
+
+    sr_metrics_head(b, "sr_start_time_seconds", "gauge",
+            "Unix time the router started.");
+    sr_metrics_printf(b, "sr_start_time_seconds %llu\n",
+            (unsigned long long)seg->started);
+} /* -- sr_metrics_render -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_respond(..)
+ *
+ * The request head is in: queue the whole response.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_metrics_respond(struct sr_instance* sr,
+                               struct sr_metrics_client* cl)
+{
+    struct sr_metrics_buf body, resp;
+    const char* status = "200 OK";
+
+    body.cap = 8192;
+    body.len = 0;
+    body.buf = (char*)malloc(body.cap);
+    assert(body.buf);
+
+    if(strncmp(cl->in, "GET /metrics ", 13) == 0 ||
+            strncmp(cl->in, "GET /metrics?", 13) == 0)
+    {
+        sr_metrics_render(sr, &body);
+        sr->metrics->scrapes++;
+    }
+    else if(strncmp(cl->in, "GET ", 4) == 0)
+    {
+        status = "404 Not Found";
+        sr_metrics_printf(&body, "try /metrics\n");
+    }
+    else
+    {
+        status = "405 Method Not Allowed";
+        sr_metrics_printf(&body, "GET only\n");
+    }
+
+    resp.cap = body.len + 256;
+    resp.len = 0;
+    resp.buf = (char*)malloc(resp.cap);
+    assert(resp.buf);
+    sr_metrics_printf(&resp, "HTTP/1.0 %s\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %lu\r\n"
+            "Connection: close\r\n\r\n", status, (unsigned long)body.len);
+    sr_metrics_printf(&resp, "%.*s", (int)body.len, body.buf);
+    free(body.buf);
+
+    cl->out = resp.buf;
+    cl->out_len = resp.len;
+    cl->out_off = 0;
+} /* -- sr_metrics_respond -- */
+
+static void sr_metrics_drop(struct sr_metrics_client* cl)
+{
+    close(cl->fd);
+    free(cl->out);
+    cl->fd = -1;
+    cl->out = 0;
+    cl->in_len = 0;
+} /* -- sr_metrics_drop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_io(..)
+ *
+ * Read a request head, or write more of the response, whichever the
+ * client is up to.  Returns -1 when the client is done with.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_metrics_io(struct sr_instance* sr, struct sr_metrics_client* cl)
+{
+    ssize_t n;
+
+    if(!cl->out)
+    {
+        n = read(cl->fd, cl->in + cl->in_len, sizeof(cl->in) - 1 - cl->in_len);
+        if(n < 0 && (errno == EAGAIN || errno == EINTR))
+        { return 0; }
+        if(n <= 0)
+        { return -1; }
+        cl->in_len += n;
+        cl->in[cl->in_len] = 0;
+        if(!strstr(cl->in, "\r\n\r\n") && !strstr(cl->in, "\n\n"))
+        { return cl->in_len == sizeof(cl->in) - 1 ? -1 : 0; }
+        sr_metrics_respond(sr, cl);
+    }
+
+    n = send(cl->fd, cl->out + cl->out_off, cl->out_len - cl->out_off,
+            MSG_NOSIGNAL | MSG_DONTWAIT);
+    if(n < 0 && (errno == EAGAIN || errno == EINTR))
+    { return 0; }
+    if(n < 0)
+    { return -1; }
+    cl->out_off += n;
+    return cl->out_off == cl->out_len ? -1 : 0;
+} /* -- sr_metrics_io -- */
+
+static void* sr_metrics_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct sr_metrics* m = sr->metrics;
+    struct sr_metrics_client* cl;
+    struct pollfd pfd[SR_METRICS_CLIENTS + 1];
+    int map[SR_METRICS_CLIENTS + 1];
+    int i, n, fd;
+    time_t now;
+
+    for(;;)
+    {
+        pfd[0].fd = m->fd;
+        pfd[0].events = POLLIN;
+        for(i = 0, n = 1; i < SR_METRICS_CLIENTS; i++)
+        {
+            cl = &m->clients[i];
+            if(cl->fd < 0)
+            { continue; }
+            pfd[n].fd = cl->fd;
+            pfd[n].events = cl->out ? POLLOUT : POLLIN;
+            map[n++] = i;
+        }
+
+        if(poll(pfd, n, 1000) < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            perror("metrics: poll");
+            break;
+        }
+        now = time(NULL);
+
+        for(i = 1; i < n; i++)
+        {
+            cl = &m->clients[map[i]];
+            if(((pfd[i].revents && sr_metrics_io(sr, cl) != 0)) ||
+                    now - cl->since > SR_METRICS_TIMEOUT)
+            { sr_metrics_drop(cl); }
+        }
+
+        if(pfd[0].revents & POLLIN)
+        {
+            fd = accept4(m->fd, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0)
+            {
+                if(errno == EINVAL || errno == EBADF)
+                { break; }      /* -- shut down -- */
+                continue;
+            }
+            for(i = 0; i < SR_METRICS_CLIENTS && m->clients[i].fd >= 0; i++);
+            if(i == SR_METRICS_CLIENTS)
+            { close(fd); continue; }
+            m->clients[i].fd = fd;
+            m->clients[i].since = now;
+        }
+        else if(pfd[0].revents)
+        { break; }
+    }
+    return 0;
+} /* -- sr_metrics_thread -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_listen(..)
+ *
+ * A non-blocking listening socket on where, "/path" or "[host:]port".
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_metrics_listen(struct sr_metrics* m, const char* where)
+{
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    char host[64] = "127.0.0.1";
+    const char* colon;
+    int fd, one = 1;
+
+    if(where[0] == '/')
+    {
+        if(strlen(where) >= sizeof(un.sun_path))
+        { fprintf(stderr, "Metrics socket path too long\n"); return -1; }
+        memset(&un, 0, sizeof(un));
+        un.sun_family = AF_UNIX;
+        strncpy(un.sun_path, where, sizeof(un.sun_path) - 1);
+        if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0)) < 0)
+        { perror("socket(AF_UNIX)"); return -1; }
+        unlink(where);
+        if(bind(fd, (struct sockaddr*)&un, sizeof(un)) != 0)
+        { perror(where); close(fd); return -1; }
+        strncpy(m->path, where, sizeof(m->path) - 1);
+    }
+    else
+    {
+        memset(&in, 0, sizeof(in));
+        in.sin_family = AF_INET;
+        if((colon = strrchr(where, ':')) != 0)
+        {
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - where), where);
+            where = colon + 1;
+        }
+        in.sin_port = htons(atoi(where));
+        if(in.sin_port == 0 || !inet_aton(host, &in.sin_addr))
+        { fprintf(stderr, "Bad metrics address %s:%s\n", host, where); return -1; }
+        if((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0)) < 0)
+        { perror("socket(AF_INET)"); return -1; }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(fd, (struct sockaddr*)&in, sizeof(in)) != 0)
+        { perror("metrics: bind"); close(fd); return -1; }
+    }
+
+    if(listen(fd, SR_METRICS_CLIENTS) != 0)
+    { perror("metrics: listen"); close(fd); return -1; }
+    m->fd = fd;
+    return 0;
+} /* -- sr_metrics_listen -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_open(..)
+ *
+ * Serve /metrics on where.  Call after sr_stats_open(..) and sr_init(..).
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_metrics_open(struct sr_instance* sr, const char* where)
+{
+    struct sr_metrics* m;
+    int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->stats);
+    assert(where);
+
+    m = (struct sr_metrics*)calloc(1, sizeof(struct sr_metrics));
+    assert(m);
+    for(i = 0; i < SR_METRICS_CLIENTS; i++)
+    { m->clients[i].fd = -1; }
+
+    if(sr_metrics_listen(m, where) != 0)
+    { free(m); return -1; }
+
+    sr->metrics = m;
+    if(pthread_create(&m->thread, 0, sr_metrics_thread, sr) != 0)
+    {
+        perror("pthread_create(..):sr_metrics_open");
+        close(m->fd);
+        if(m->path[0])
+        { unlink(m->path); }
+        sr->metrics = 0;
+        free(m);
+        return -1;
+    }
+    pthread_detach(m->thread);
+    return 0;
+} /* -- sr_metrics_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_metrics_close(..)
+ *
+ * Stop listening; a scrape in flight is cut off when we exit.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_metrics_close(struct sr_instance* sr)
+{
+    struct sr_metrics* m = sr->metrics;
+
+    if(!m)
+    { return; }
+
+    shutdown(m->fd, SHUT_RDWR);
+    if(m->path[0])
+    { unlink(m->path); }
+    LogInfo("metrics: %lu scrapes\n", m->scrapes);
+} /* -- sr_metrics_close -- */
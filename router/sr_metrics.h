@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_metrics.h
+ *
+ * Description:
+ *
+ * Prometheus endpoint (-H [host:]port or -H /unix/path): a minimal HTTP
+ * listener answering GET /metrics in the text exposition format.  TCP
+ * binds to 127.0.0.1 unless told otherwise.
+ *
+ * It runs on a thread of its own with non-blocking sockets, so a slow or
+ * stuck scraper holds up neither forwarding nor other scrapers.  Counters
+ * come from the stats segment (sr_stats.h), read without locks; the ARP
+ * gauges are counted under the cache lock, briefly.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_METRICS_H
+#define SR_METRICS_H
+
+#include <pthread.h>
+#include <time.h>
+
+#define SR_METRICS_CLIENTS  8       /* scrapers at once */
+#define SR_METRICS_REQUEST  2048    /* longest request head we read */
+#define SR_METRICS_TIMEOUT  5       /* seconds a scraper gets */
+
+struct sr_instance;
+
+struct sr_metrics_client
+{
+    int fd;                     /* -1 if free */
+    time_t since;
+    char in[SR_METRICS_REQUEST];
+    unsigned int in_len;
+    char* out;                  /* response, once the request is in */
+    size_t out_len;
+    size_t out_off;
+};
+
+struct sr_metrics
+{
+    int fd;                     /* listening */
+    char path[108];             /* unix socket to unlink, or empty */
+    pthread_t thread;
+    struct sr_metrics_client clients[SR_METRICS_CLIENTS];
+
+    unsigned long scrapes;
+};
+
+int  sr_metrics_open(struct sr_instance* sr, const char* where);
+void sr_metrics_close(struct sr_instance* sr);
+
+#endif /* -- SR_METRICS_H -- */
@@ -0,0 +1,301 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_perf.c
+ *
+ * Description:
+ *
+ * Hardware counter profile of the forwarding thread, see sr_perf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sr_perf.h"
+#include "sr_router.h"
+#include "sr_stats.h"
+#include "sr_log.h"
+
+const char* const sr_perf_event_names[SR_PERF_EVENTS] =
+{
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+    "task_ns"
+};
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} sr_perf_attrs[SR_PERF_EVENTS] =
+{
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+/* -- the calling thread, any CPU -- */
+static int sr_perf_event_open(enum sr_perf_event e, int user_only)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = sr_perf_attrs[e].type;
+    attr.config = sr_perf_attrs[e].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+            PERF_FLAG_FD_CLOEXEC);
+} /* -- sr_perf_event_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_perf_read(..)
+ *
+ * Current counts, scaled up for the time an event was multiplexed out,
+ * and frames received so far.  Callable from any thread.  Returns 0 on
+ * success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_perf_read(struct sr_instance* sr, struct sr_perf_sample* s)
+{
+    struct sr_perf* perf = sr->perf;
+    struct sr_stats_slot* sum;
+    uint64_t v[3];              /* value, time enabled, time running */
+    unsigned int i, n;
+
+    /* REQUIRES */
+    assert(perf);
+
+    memset(s, 0, sizeof(*s));
+    for(i = 0; i < SR_PERF_EVENTS; i++)
+    {
+        if(perf->fd[i] < 0)
+        { continue; }
+        if(read(perf->fd[i], v, sizeof(v)) != sizeof(v))
+        { return -1; }
+        s->count[i] = v[2] && v[2] < v[1] ?
+            (uint64_t)((double)v[0] * v[1] / v[2]) : v[0];
+    }
+
+    sum = (struct sr_stats_slot*)malloc(sizeof(struct sr_stats_slot));
+    assert(sum);
+    sr_stats_sum(sr->stats, sum);
+    n = __atomic_load_n(&sr->stats->num_ifaces, __ATOMIC_ACQUIRE);
+    for(i = 0; i < n && i < SR_MAX_IFACES; i++)
+    { s->packets += sum->ifs[i].rx_pkts; }
+    free(sum);
+    return 0;
+} /* -- sr_perf_read -- */
+
+/* -- average per frame received between prev and now, -1 if the event
+ *    is not counted -- */
+double sr_perf_per_packet(const struct sr_perf* perf,
+                          const struct sr_perf_sample* now,
+                          const struct sr_perf_sample* prev,
+                          enum sr_perf_event e)
+{
+    uint64_t pkts = now->packets - prev->packets;
+
+    if(perf->fd[e] < 0)
+    { return -1; }
+    return pkts ? (double)(now->count[e] - prev->count[e]) / pkts : 0;
+} /* -- sr_perf_per_packet -- */
+
+static void sr_perf_log(struct sr_instance* sr,
+                        const struct sr_perf_sample* now,
+                        const struct sr_perf_sample* prev)
+{
+    struct sr_perf* perf = sr->perf;
+    char line[512];
+    double v, cyc, ins;
+    size_t off;
+    unsigned int i;
+
+    off = snprintf(line, sizeof(line), "perf: %llu frames",
+            (unsigned long long)(now->packets - prev->packets));
+    for(i = 0; i < SR_PERF_EVENTS; i++)
+    {
+        if((v = sr_perf_per_packet(perf, now, prev, i)) >= 0)
+        {
+            off += snprintf(line + off, sizeof(line) - off, ", %s %.1f",
+                    sr_perf_event_names[i], v);
+        }
+    }
+    cyc = sr_perf_per_packet(perf, now, prev, sr_perf_cycles);
+    ins = sr_perf_per_packet(perf, now, prev, sr_perf_instructions);
+    if(cyc > 0 && ins >= 0)
+    { snprintf(line + off, sizeof(line) - off, ", ipc %.2f", ins / cyc); }
+    LogInfo("%s per frame\n", line);
+} /* -- sr_perf_log -- */
+
+static void* sr_perf_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct sr_perf* perf = sr->perf;
+    struct sr_perf_sample a, b;
+    struct sr_perf_sample *now = &a, *prev = &b, *t;
+    struct timespec ts;
+
+    *prev = perf->start;
+    ts.tv_sec = perf->interval;
+    ts.tv_nsec = 0;
+    for(;;)
+    {
+        nanosleep(&ts, 0);
+        if(sr_perf_read(sr, now) != 0)
+        { break; }
+        sr_perf_log(sr, now, prev);
+        perf->reports++;
+        t = prev; prev = now; now = t;
+    }
+    return 0;
+} /* -- sr_perf_thread -- */
+
+static void sr_perf_close_events(struct sr_perf* perf, unsigned int n)
+{
+    unsigned int i;
+
+    for(i = 0; i < n; i++)
+    {
+        if(perf->fd[i] >= 0)
+        { close(perf->fd[i]); }
+        perf->fd[i] = -1;
+    }
+} /* -- sr_perf_close_events -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_perf_open_events(..)
+ *
+ * Open every event, counting kernel time too unless perf->user_only.  If
+ * one is refused only because kernel counting is not allowed, close the
+ * rest and return -1, so that all are reopened in the same scope and
+ * stay comparable.  Otherwise returns 0, with err[i] the errno of each
+ * event that could not be opened.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_perf_open_events(struct sr_perf* perf, int* err)
+{
+    unsigned int i;
+
+    for(i = 0; i < SR_PERF_EVENTS; i++)
+    {
+        err[i] = 0;
+        if((perf->fd[i] = sr_perf_event_open(i, perf->user_only)) >= 0)
+        { continue; }
+        err[i] = errno;
+        if(!perf->user_only && (err[i] == EACCES || err[i] == EPERM))
+        {
+            sr_perf_close_events(perf, i);
+            return -1;
+        }
+    }
+    return 0;
+} /* -- sr_perf_open_events -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_perf_open(..)
+ *
+ * Start counting on the calling thread, which must be the one that runs
+ * the main loop, and report every interval seconds if not 0.  Call after
+ * sr_init(..).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_perf_open(struct sr_instance* sr, unsigned int interval)
+{
+    struct sr_perf* perf;
+    int err[SR_PERF_EVENTS];
+    unsigned int i, hw = 0;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->stats);
+
+    perf = (struct sr_perf*)calloc(1, sizeof(struct sr_perf));
+    assert(perf);
+    perf->interval = interval;
+    pthread_mutex_init(&perf->lock, 0);
+
+    /* -- perf_event_paranoid 2 and up: no kernel counting -- */
+    if(sr_perf_open_events(perf, err) != 0)
+    {
+        perf->user_only = 1;
+        sr_perf_open_events(perf, err);
+    }
+    for(i = 0; i < SR_PERF_EVENTS; i++)
+    {
+        if(perf->fd[i] < 0)
+        {
+            LogWarn("perf: no %s counter: %s\n", sr_perf_event_names[i],
+                    strerror(err[i]));
+        }
+        else if(sr_perf_attrs[i].type != PERF_TYPE_SOFTWARE)
+        { hw++; }
+    }
+    if(perf->fd[sr_perf_task_ns] < 0)
+    {
+        fprintf(stderr, "perf_event_open is not available\n");
+        sr_perf_close_events(perf, SR_PERF_EVENTS);
+        free(perf);
+        return -1;
+    }
+    if(hw == 0)
+    { LogWarn("perf: no hardware counters here, on-CPU time only\n"); }
+
+    sr->perf = perf;
+    sr_perf_read(sr, &perf->start);
+    perf->polled = perf->start;
+
+    if(interval)
+    {
+        if(pthread_create(&perf->thread, 0, sr_perf_thread, sr) != 0)
+        {
+            perror("pthread_create(..):sr_perf_open");
+            sr_perf_close_events(perf, SR_PERF_EVENTS);
+            sr->perf = 0;
+            free(perf);
+            return -1;
+        }
+        pthread_detach(perf->thread);
+    }
+    LogInfo("perf: counting %s%s, %s\n",
+            perf->user_only ? "user space only" : "user and kernel",
+            hw ? "" : " (software only)",
+            interval ? "reporting periodically" : "on demand only");
+    return 0;
+} /* -- sr_perf_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_perf_close(..)
+ *
+ * Log the averages over the whole run.  The counters stay open for a
+ * report still in flight; they go when we exit.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_perf_close(struct sr_instance* sr)
+{
+    struct sr_perf_sample now;
+
+    if(!sr->perf)
+    { return; }
+
+    if(sr_perf_read(sr, &now) == 0)
+    { sr_perf_log(sr, &now, &sr->perf->start); }
+} /* -- sr_perf_close -- */
@@ -0,0 +1,78 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_perf.h
+ *
+ * Description:
+ *
+ * Hardware counter profile of the forwarding thread (--perf[=secs]):
+ * cycles, instructions, L1D read misses, LLC misses and branch misses
+ * from perf_event_open, plus on-CPU time, divided by the frames received
+ * over the same span.  Logged every secs (default 10, 0 for never) and
+ * on demand with the control socket's "perf" command.
+ *
+ * The counters follow the main thread only, which is where every backend
+ * receives and forwards, and run all the time; they are read, never
+ * stopped, so the packet path pays nothing.  A blocked thread counts
+ * nothing, but with -b the empty polls between frames are counted too,
+ * so per-frame figures from a lightly loaded busy-poll router overstate
+ * the real cost.  Kernel time (the backends' syscalls) is included when
+ * perf_event_paranoid allows, user space only otherwise.
+ *
+ * An event the CPU or hypervisor does not offer is left out; on-CPU time
+ * is a software event and always there.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PERF_H
+#define SR_PERF_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#define SR_PERF_INTERVAL  10    /* seconds between reports by default */
+
+enum sr_perf_event
+{
+    sr_perf_cycles,
+    sr_perf_instructions,
+    sr_perf_l1d_misses,
+    sr_perf_llc_misses,
+    sr_perf_branch_misses,
+    sr_perf_task_ns,
+    SR_PERF_EVENTS
+};
+
+extern const char* const sr_perf_event_names[SR_PERF_EVENTS];
+
+struct sr_instance;
+
+struct sr_perf_sample
+{
+    uint64_t count[SR_PERF_EVENTS]; /* scaled for multiplexing */
+    uint64_t packets;               /* frames received, all interfaces */
+};
+
+struct sr_perf
+{
+    int fd[SR_PERF_EVENTS];     /* -1 if the event is not available */
+    int user_only;              /* kernel time not allowed */
+    unsigned int interval;
+    pthread_t thread;
+    pthread_mutex_t lock;       /* polled, between ctl clients */
+    struct sr_perf_sample start;
+    struct sr_perf_sample polled;   /* at the last ctl "perf" */
+
+    uint64_t reports;
+};
+
+int  sr_perf_open(struct sr_instance* sr, unsigned int interval);
+int  sr_perf_read(struct sr_instance* sr, struct sr_perf_sample* s);
+double sr_perf_per_packet(const struct sr_perf* perf,
+                          const struct sr_perf_sample* now,
+                          const struct sr_perf_sample* prev,
+                          enum sr_perf_event e);
+void sr_perf_close(struct sr_instance* sr);
+
+#endif /* -- SR_PERF_H -- */
@@ -0,0 +1,405 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.c
+ *
+ * Description:
+ *
+ * pcap replay backend.  The capture is loaded and every frame resolved
+ * to the interface it arrives on before the clock starts, so a run
+ * measures the router and not the disk:
+ *
+ *   - pcapng interface names (as written by -l with -G) are looked up
+ *     directly and frames the capture saw leaving are skipped;
+ *   - otherwise the interface is the one whose MAC the frame is addressed
+ *     to, or for broadcast ARP the one whose IP is the target.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "sr_replay.h"
+#include "sr_dumper.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_log.h"
+#include "sr_stats.h"
+
+#define SR_REPLAY_OUTBUF (1 << 20)
+
+static int  sr_replay_poll(struct sr_instance* sr);
+static int  sr_replay_send(struct sr_instance* sr, uint8_t* buf,
+                           unsigned int len, struct sr_if* iface);
+static void sr_replay_close(struct sr_instance* sr);
+static int  sr_replay_sendv(struct sr_instance* sr, const struct iovec* iov,
+                            int iovcnt, unsigned int len, struct sr_if* iface);
+
+static const struct sr_io_ops sr_replay_io =
+{
+    "replay",
+    sr_replay_poll,
+    sr_replay_send,
+    sr_replay_close,
+    sr_replay_sendv
+};
+
+static uint64_t sr_replay_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_replay_now -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_ingress(..)
+ *
+ * The interface a captured frame would have been received on, 0 if none.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_if* sr_replay_ingress(struct sr_instance* sr,
+                                       struct sr_dump_reader* rd,
+                                       const struct sr_dump_record* rec)
+{
+    static const unsigned char bcast[ETHER_ADDR_LEN] =
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    const struct sr_ethernet_hdr* e_hdr;
+    const struct sr_arp_hdr* a_hdr;
+    const char* name;
+    struct sr_if* iface;
+    unsigned int i;
+
+    if((name = sr_dump_read_ifname(rd, rec->ifid)) != 0 &&
+            (iface = sr_get_interface(sr, name)) != 0)
+    { return iface; }
+
+    if(rec->caplen < sizeof(struct sr_ethernet_hdr))
+    { return 0; }
+    e_hdr = (const struct sr_ethernet_hdr*)rec->data;
+
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        if(memcmp(e_hdr->ether_dhost, sr->if_table[i]->addr,
+                    ETHER_ADDR_LEN) == 0)
+        { return sr->if_table[i]; }
+    }
+
+    if(memcmp(e_hdr->ether_dhost, bcast, ETHER_ADDR_LEN) == 0 &&
+            e_hdr->ether_type == htons(ethertype_arp) &&
+            rec->caplen >= sizeof(struct sr_ethernet_hdr) +
+                           sizeof(struct sr_arp_hdr))
+    {
+        a_hdr = (const struct sr_arp_hdr*)
+            (rec->data + sizeof(struct sr_ethernet_hdr));
+        for(i = 0; i < sr->num_ifaces; i++)
+        {
+            if(a_hdr->ar_tip == sr->if_table[i]->ip)
+            { return sr->if_table[i]; }
+        }
+    }
+
+    return 0;
+} /* -- sr_replay_ingress -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_load(..)
+ *
+ * Read every frame of the capture into rp->frames.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_replay_load(struct sr_instance* sr, struct sr_replay* rp)
+{
+    struct sr_dump_record rec;
+    unsigned int cap = 0, maxlen = 0;
+    struct sr_replay_frame* f;
+    int ret;
+
+    while((ret = sr_dump_read(rp->rd, &rec)) == 1)
+    {
+        if(rec.dir == PCAPNG_DIR_OUT)
+        { rp->skipped_out++; continue; }
+        if(rec.caplen < rec.len)
+        { rp->skipped_truncated++; continue; }
+
+        if(rp->nframes == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+            f = (struct sr_replay_frame*)realloc(rp->frames,
+                    cap * sizeof(struct sr_replay_frame));
+            assert(f);
+            rp->frames = f;
+        }
+
+        f = &rp->frames[rp->nframes];
+        if((f->iface = sr_replay_ingress(sr, rp->rd, &rec)) == 0)
+        { rp->skipped_unmapped++; continue; }
+        f->data = rec.data;
+        f->len = rec.caplen;
+        f->ts_ns = rec.ts_ns;
+        if(f->len > maxlen)
+        { maxlen = f->len; }
+        rp->nframes++;
+    }
+
+    if(ret < 0)
+    { return -1; }
+
+    rp->scratch = (uint8_t*)malloc(maxlen ? maxlen : 1);
+    assert(rp->scratch);
+    return 0;
+} /* -- sr_replay_load -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_open(..)
+ *
+ * Set up the interfaces from opts->ifconfig, load opts->input and install
+ * the replay backend.  Expects the routing table loaded and sr_init done.
+ * Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_replay_open(struct sr_instance* sr, const struct sr_replay_opts* opts)
+{
+    struct sr_replay* rp;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(opts);
+    assert(opts->input);
+    assert(opts->ifconfig);
+
+    if(sr_load_if_config(sr, opts->ifconfig) != 0)
+    { return -1; }
+    sr_io_interfaces_ready(sr);
+    if(sr_verify_routing_table(sr) != 0)
+    {
+        fprintf(stderr,"Routing table not consistent with %s\n",
+                opts->ifconfig);
+        return -1;
+    }
+
+    rp = (struct sr_replay*)calloc(1, sizeof(struct sr_replay));
+    assert(rp);
+    rp->paced = opts->paced;
+    rp->loops = opts->loops ? opts->loops : 1;
+    pthread_mutex_init(&rp->out_lock, 0);
+
+    if((rp->rd = sr_dump_read_open(opts->input)) == 0)
+    { free(rp); return -1; }
+
+    if(sr_replay_load(sr, rp) != 0)
+    {
+        fprintf(stderr, "Error reading %s, corrupt capture\n", opts->input);
+        sr_dump_read_close(rp->rd);
+        free(rp->frames);
+        free(rp);
+        return -1;
+    }
+
+    if(opts->output)
+    {
+        if((rp->out = sr_dump_open(opts->output, 0, 65535)) == 0)
+        {
+            sr_dump_read_close(rp->rd);
+            free(rp->frames);
+            free(rp->scratch);
+            free(rp);
+            return -1;
+        }
+        rp->out_buf = (char*)malloc(SR_REPLAY_OUTBUF);
+        assert(rp->out_buf);
+        setvbuf(rp->out, rp->out_buf, _IOFBF, SR_REPLAY_OUTBUF);
+    }
+
+    LogInfo("replay: %u frames from %s, skipped %u outbound, "
+            "%u unmapped, %u truncated\n", rp->nframes, opts->input,
+            rp->skipped_out, rp->skipped_unmapped, rp->skipped_truncated);
+
+    sr->io = &sr_replay_io;
+    sr->io_state = rp;
+    return 0;
+} /* -- sr_replay_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_poll(..)
+ *
+ * Hand the router the next batch of frames, waiting for each one's turn
+ * when paced.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_replay_poll(struct sr_instance* sr)
+{
+    struct sr_replay* rp = (struct sr_replay*)sr->io_state;
+    struct sr_replay_frame* f;
+    struct timespec due;
+    uint64_t at;
+    unsigned int n;
+
+    if(rp->loops == 0 || rp->nframes == 0)
+    { return 0; }
+
+    if(rp->t_start == 0)
+    { rp->t_start = rp->pass_start = sr_replay_now(); }
+
+    for(n = 0; n < SR_REPLAY_BATCH; n++)
+    {
+        if(rp->next == rp->nframes)
+        {
+            rp->next = 0;
+            if(--rp->loops == 0)
+            {
+                rp->t_end = sr_replay_now();
+                return 0;
+            }
+            rp->pass_start = sr_replay_now();
+        }
+
+        f = &rp->frames[rp->next++];
+
+        if(rp->paced)
+        {
+            at = rp->pass_start + (f->ts_ns - rp->frames[0].ts_ns);
+            due.tv_sec = at / 1000000000;
+            due.tv_nsec = at % 1000000000;
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                        &due, 0) != 0);
+        }
+
+        memcpy(rp->scratch, f->data, f->len);
+        sr_io_receive(sr, rp->scratch, f->len, f->iface);
+        rp->received++;
+    }
+
+    return 1;
+} /* -- sr_replay_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_send(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_replay_send(struct sr_instance* sr, uint8_t* buf,
+                          unsigned int len, struct sr_if* iface)
+{
+    struct sr_replay* rp = (struct sr_replay*)sr->io_state;
+    struct pcap_pkthdr h;
+
+    __atomic_fetch_add(&rp->sent, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&rp->sent_bytes, len, __ATOMIC_RELAXED);
+
+    if(rp->out)
+    {
+        gettimeofday(&h.ts, 0);
+        h.caplen = len;
+        h.len = len;
+        pthread_mutex_lock(&rp->out_lock);
+        if(rp->out)
+        { sr_dump(rp->out, &h, buf); }
+        pthread_mutex_unlock(&rp->out_lock);
+    }
+
+    return 0;
+} /* -- sr_replay_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_sendv(..)
+ *
+ * Only counted, unless -O wants the frame written out whole.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_replay_sendv(struct sr_instance* sr, const struct iovec* iov,
+                           int iovcnt, unsigned int len, struct sr_if* iface)
+{
+    struct sr_replay* rp = (struct sr_replay*)sr->io_state;
+    uint8_t frame[SR_MAX_FRAME_JUMBO];
+    unsigned int off = 0;
+    int i;
+
+    if(!rp->out)
+    {
+        __atomic_fetch_add(&rp->sent, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&rp->sent_bytes, len, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    for(i = 0; i < iovcnt; i++)
+    {
+        memcpy(frame + off, iov[i].iov_base, iov[i].iov_len);
+        off += iov[i].iov_len;
+    }
+    return sr_replay_send(sr, frame, len, iface);
+} /* -- sr_replay_sendv -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_replay_close(..)
+ *
+ * Report throughput and latency and release everything.  Both go to
+ * stdout regardless of SR_LOG_LEVEL, srregress reads them from there.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_replay_close(struct sr_instance* sr)
+{
+    struct sr_replay* rp = (struct sr_replay*)sr->io_state;
+    struct sr_stats_slot sum;
+    uint64_t hz;
+    double secs;
+    int p;
+
+    if(rp->t_end == 0)
+    { rp->t_end = sr_replay_now(); }
+    secs = rp->t_start ? (rp->t_end - rp->t_start) / 1e9 : 0;
+
+    printf("replay: %llu frames in %.6f s, %.0f pkts/s, %.1f ns/pkt, "
+           "%llu sent (%llu bytes)\n",
+           (unsigned long long)rp->received, secs,
+           secs > 0 ? rp->received / secs : 0.0,
+           rp->received ? secs * 1e9 / rp->received : 0.0,
+           (unsigned long long)__atomic_load_n(&rp->sent, __ATOMIC_RELAXED),
+           (unsigned long long)__atomic_load_n(&rp->sent_bytes,
+               __ATOMIC_RELAXED));
+
+    if(sr->stats)
+    {
+        sr_stats_sum(sr->stats, &sum);
+        hz = sr->stats->tsc_hz;
+        for(p = 0; p < SR_LAT_PATHS; p++)
+        {
+            if(sum.lat_sum[p] == 0)
+            { continue; }
+            printf("replay: %s path latency us p50 %.2f p90 %.2f p99 %.2f "
+                   "p99.9 %.2f\n", sr_lat_path_names[p],
+                   sr_stats_percentile(sum.lat[p], 0.5, hz) / 1e3,
+                   sr_stats_percentile(sum.lat[p], 0.9, hz) / 1e3,
+                   sr_stats_percentile(sum.lat[p], 0.99, hz) / 1e3,
+                   sr_stats_percentile(sum.lat[p], 0.999, hz) / 1e3);
+        }
+    }
+    fflush(stdout);
+
+    pthread_mutex_lock(&rp->out_lock);
+    if(rp->out)
+    { sr_dump_close(rp->out); }
+    rp->out = 0;
+    pthread_mutex_unlock(&rp->out_lock);
+
+    /* -- the ARP sweeper may still send, keep rp itself around -- */
+    free(rp->out_buf);
+    rp->out_buf = 0;
+    sr_dump_read_close(rp->rd);
+    rp->rd = 0;
+    free(rp->frames);
+    rp->frames = 0;
+    free(rp->scratch);
+    rp->scratch = 0;
+} /* -- sr_replay_close -- */
@@ -0,0 +1,82 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_replay.h
+ *
+ * Description:
+ *
+ * Offline I/O backend: frames are read from a pcap or pcapng file and
+ * fed to the router, as fast as possible or at the capture's own pacing,
+ * and what the router sends is discarded or written to a pcap.  Together
+ * with a fixed interface config (sr_load_if_config) and rtable this runs
+ * the forwarding path deterministically without a VNS server.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_REPLAY_H
+#define SR_REPLAY_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* frames handed to the router per poll, so the main loop stays responsive */
+#define SR_REPLAY_BATCH 256
+
+struct sr_instance;
+struct sr_if;
+struct sr_dump_reader;
+
+struct sr_replay_opts
+{
+    const char* input;          /* pcap/pcapng of frames to receive */
+    const char* ifconfig;       /* interfaces and static ARP entries */
+    const char* output;         /* pcap of sent frames, 0 discards them */
+    int paced;                  /* keep the capture's inter-frame gaps */
+    unsigned int loops;         /* passes over the input, 0 means 1 */
+};
+
+/* a received frame, resolved to its interface when the file is loaded */
+struct sr_replay_frame
+{
+    const unsigned char* data;  /* owned by the reader */
+    unsigned int len;
+    struct sr_if* iface;
+    uint64_t ts_ns;
+};
+
+struct sr_replay
+{
+    struct sr_dump_reader* rd;
+    struct sr_replay_frame* frames;
+    unsigned int nframes;
+    unsigned int next;          /* next frame of the current pass */
+    unsigned int loops;         /* passes left, including the current one */
+    int paced;
+
+    uint8_t* scratch;           /* the router rewrites frames in place */
+
+    uint64_t pass_start;        /* CLOCK_MONOTONIC ns */
+    uint64_t t_start;
+    uint64_t t_end;
+
+    uint64_t received;          /* frames handed to the router */
+    uint64_t sent;              /* frames the router sent (atomic) */
+    uint64_t sent_bytes;        /* (atomic) */
+    unsigned int skipped_out;       /* frames the capture saw leaving */
+    unsigned int skipped_unmapped;  /* no interface would have received it */
+    unsigned int skipped_truncated; /* cut short by the capture's snaplen */
+
+    FILE* out;                  /* 0 when sent frames are discarded */
+    char* out_buf;
+    pthread_mutex_t out_lock;   /* the ARP sweeper sends too */
+};
+
+int sr_replay_open(struct sr_instance* sr, const struct sr_replay_opts* opts);
+
+#endif /* -- SR_REPLAY_H -- */
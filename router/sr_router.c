@@ -12,6 +12,9 @@
  **********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <assert.h>
 
 
@@ -21,6 +24,10 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_icmp.h"
+#include "sr_frag.h"
+#include "sr_log.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -44,204 +51,546 @@ void sr_init(struct sr_instance* sr)
     pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
     pthread_t thread;
 
-    pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
+    /* -- busy polling sweeps from the main loop -- */
+    if(!sr->busy)
+    { pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr); }
     
     /* Add initialization code here! */
 
 } /* -- sr_init -- */
 
 /*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
+ * Method: sr_handlepacket(uint8_t* p,struct sr_if* iface)
  * Scope:  Global
  *
  * This method is called each time the router receives a packet on the
  * interface.  The packet buffer, the packet length and the receiving
  * interface are passed in as parameters. The packet is complete with
- * ethernet headers.
+ * ethernet headers.  The interface has already been resolved from the
+ * name on the wire, so nothing below needs to look it up again.
  *
- * Note: Both the packet buffer and the character's memory are handled
- * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
- * packet instead if you intend to keep it around beyond the scope of
- * the method call.
+ * Note: Both the packet buffer and the interface record are owned by
+ * sr_vns_comm.c / sr_if.c, that means do NOT delete either.  Make a copy
+ * of the packet instead if you intend to keep it around beyond the
+ * scope of the method call.
  *
  *---------------------------------------------------------------------*/
 
+static void sr_handle_arp(struct sr_instance* , uint8_t* , unsigned int ,
+                          struct sr_if* );
+static void sr_handle_ip(struct sr_instance* , uint8_t* , unsigned int ,
+                         struct sr_if* );
+static void sr_send_ip_frame(struct sr_instance* , uint8_t* , unsigned int ,
+                             struct sr_if* , uint32_t );
+static void sr_send_icmp_echo_reply(struct sr_instance* , uint8_t* ,
+                                    unsigned int );
+static void sr_send_icmp_error(struct sr_instance* , uint8_t* ,
+                               unsigned int , struct sr_if* ,
+                               uint8_t , uint8_t , uint16_t );
+static int sr_send_ip_out(struct sr_instance* , uint8_t* , unsigned int ,
+                          struct sr_if* );
+
 void sr_handlepacket(struct sr_instance* sr,
         uint8_t * packet/* lent */,
         unsigned int len,
-        char* interface/* lent */)
+        struct sr_if* iface/* lent */)
 {
   /* REQUIRES */
   assert(sr);
   assert(packet);
-  assert(interface);
-  printf("*** -> Received packet of length %d \n",len);
-
-
-
-  printf("~*~*~*~ Printing Packet Headers. ~*~*~*~\n\n");
-  print_hdrs(packet, len);
-	printf("~*~*~*~ Header finished, Starting printing packet processing. ~*~*~*~\n\n");
+  assert(iface);
+  LogTrace("*** -> Received packet of length %d on %s\n", len, iface->name);
 
+  /* per-packet header dumps only when tracing */
+  if (LogEnabled(SR_LOG_TRACE)) {
+    print_hdrs(packet, len);
+  }
 
   /* Ethernet */
-  int minlength = sizeof(sr_ethernet_hdr_t);
-  if (len < minlength) {
-    printf("Failed ETHERNET header, insufficient length\n");
+  if (len < sizeof(sr_ethernet_hdr_t)) {
+    LogDebug("Failed ETHERNET header, insufficient length\n");
+    sr_stats_drop(sr, sr_drop_truncated, packet, len);
     return;
   }
 
   uint16_t ethtype = ethertype(packet);
-	if (ethtype == ethertype_ip) { /* If this is an IP packet */
+  if (ethtype == ethertype_ip) { /* If this is an IP packet */
+    sr_handle_ip(sr, packet, len, iface);
+  } else if (ethtype == ethertype_arp) { /* If this is an ARP packet */
+    sr_handle_arp(sr, packet, len, iface);
+  } else {
+    LogDebug("Unrecognized Ethernet Type: %d\n", ethtype);
+  }
 
-    printf ("This is an IP Packet!\n");
-    sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
-		
-    if (sr_if_list_contains_ip(sr, ip_hdr->ip_dst)) { /* If the packet is for the router */
-      printf ("The IP packet is for me!\n");
+}/* end sr_ForwardPacket */
 
-      /* Check the ip_protocol */
-      uint8_t ip_proto = ip_protocol((uint8_t *)ip_hdr);
+/*---------------------------------------------------------------------
+ * Method: sr_handle_arp(..)
+ * Scope:  Local
+ *
+ * Answer ARP requests for the receiving interface, and on a reply cache
+ * the mapping and flush whatever was queued behind it.
+ *
+ *---------------------------------------------------------------------*/
 
-      if (ip_proto == ip_protocol_icmp) { /* ICMP */
-      minlength += sizeof(sr_icmp_hdr_t);
-      if (len < minlength)
-        fprintf(stderr, "Failed to print ICMP header, insufficient length\n");
-        return;
-      }
-      
-      /* If it's ICMP echo req, send echo reply. */
-      sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)); 
-      if (icmp_hdr->icmp_type == 8 && icmp_hdr->icmp_code == 0) { /* If this is an echo request */
-        /* fill in code here */
-        printf ("This is an ICMP Echo request!\n");
-      }
+static void sr_handle_arp(struct sr_instance* sr,
+        uint8_t* packet /* lent */,
+        unsigned int len,
+        struct sr_if* iface /* lent */)
+{
+  LogTrace("This is an ARP Packet!\n");
 
-      /* Else if it's TCP/UDP, send ICMP port unreachable */
-        /* fill in code here */
+  if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)) {
+    LogDebug("Failed ARP header, insufficient length\n");
+    sr_stats_drop(sr, sr_drop_truncated, packet, len);
+    return;
+  }
 
-		} else { /* If the packet is not for the router */
-			printf ("This IP packet is not for me!\n");
+  sr_arp_hdr_t *arp_hdr = (sr_arp_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  if (ntohs(arp_hdr->ar_hrd) != arp_hrd_ethernet ||
+      ntohs(arp_hdr->ar_pro) != ethertype_ip) {
+    LogDebug("ARP is not Ethernet/IPv4, dropping\n");
+    return;
+  }
 
-      /* Check if the IP header has not been truncated  */
-      minlength += sizeof(sr_ip_hdr_t);
-      if (len < minlength) {
-        fprintf(stderr, "Failed IP header, insufficient length\n");
-        return;
-      }
+  if (arp_hdr->ar_tip != iface->ip) {
+    LogTrace("ARP is not for this interface\n");
+    return;
+  }
 
-      /* Perform checksums */
-      if (!ip_hdr_checksum_valid(ip_hdr)) {
-        fprintf(stderr, "Checksum is not valid -- Packet is probably corrupt\n");
-        return;
+  if (ntohs(arp_hdr->ar_op) == arp_op_request) {
+    /* Construct an ARP reply and send it back out the same interface */
+    uint8_t reply[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t *reth = (sr_ethernet_hdr_t *)reply;
+    sr_arp_hdr_t *rarp = (sr_arp_hdr_t *)(reply + sizeof(sr_ethernet_hdr_t));
+
+    memcpy(reth->ether_dhost, arp_hdr->ar_sha, ETHER_ADDR_LEN);
+    memcpy(reth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    reth->ether_type = htons(ethertype_arp);
+
+    rarp->ar_hrd = htons(arp_hrd_ethernet);
+    rarp->ar_pro = htons(ethertype_ip);
+    rarp->ar_hln = ETHER_ADDR_LEN;
+    rarp->ar_pln = sizeof(uint32_t);
+    rarp->ar_op = htons(arp_op_reply);
+    memcpy(rarp->ar_sha, iface->addr, ETHER_ADDR_LEN);
+    rarp->ar_sip = iface->ip;
+    memcpy(rarp->ar_tha, arp_hdr->ar_sha, ETHER_ADDR_LEN);
+    rarp->ar_tip = arp_hdr->ar_sip;
+
+    LogTrace("Sending ARP reply\n");
+    sr_send_packet_if(sr, reply, sizeof(reply), iface);
+  } else if (ntohs(arp_hdr->ar_op) == arp_op_reply) {
+    /* Cache it, go through my request queue and send outstanding packets.
+       sr_arpcache_insert takes req off the queue, and the (recursive)
+       cache lock keeps the sweeper out until it is drained and freed */
+    pthread_mutex_lock(&sr->cache.lock);
+    struct sr_arpreq *req = sr_arpcache_insert(&sr->cache, arp_hdr->ar_sha,
+                                               arp_hdr->ar_sip);
+    if (req) {
+      struct sr_packet *pkt;
+      for (pkt = req->packets; pkt; pkt = pkt->next) {
+        sr_ethernet_hdr_t *eth = (sr_ethernet_hdr_t *)pkt->buf;
+        memcpy(eth->ether_dhost, arp_hdr->ar_sha, ETHER_ADDR_LEN);
+        memcpy(eth->ether_shost, pkt->iface->addr, ETHER_ADDR_LEN);
+        if (sr_send_ip_out(sr, pkt->buf, pkt->len, pkt->iface) == 0)
+          sr_stats_latency(sr, sr_lat_queued, pkt->rx_tsc);
       }
+      sr_arpreq_destroy(&sr->cache, req);
+    }
+    pthread_mutex_unlock(&sr->cache.lock);
+  }
+} /* -- sr_handle_arp -- */
 
-      /* If the packet is not for the router, check routing table, perform LPM */
-      uint32_t next_ip = sr_routing_table_lpm_forwarding(sr, ip_hdr->ip_dst);
+/*---------------------------------------------------------------------
+ * Method: sr_handle_ip(..)
+ * Scope:  Local
+ *
+ * Sanity check an IP datagram, then either answer it (if it is for one
+ * of our interfaces) or forward it toward the next hop.
+ *
+ *---------------------------------------------------------------------*/
 
-      if (next_ip == -1) {
-        /* If no match, send ICMP net unreachable */
-      } else {
-        /* Else check ARP Cache */
+static void sr_handle_ip(struct sr_instance* sr,
+        uint8_t* packet /* lent */,
+        unsigned int len,
+        struct sr_if* iface /* lent */)
+{
+  LogTrace("This is an IP Packet!\n");
+
+  /* Check if the IP header has not been truncated  */
+  if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t)) {
+    LogDebug("Failed IP header, insufficient length\n");
+    sr_stats_drop(sr, sr_drop_truncated, packet, len);
+    return;
+  }
+
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
+  unsigned int ip_len = ntohs(ip_hdr->ip_len);
+  if (ip_hdr->ip_v != 4 || ip_hdr->ip_hl < 5 ||
+      ip_len < ip_hdr->ip_hl * 4 ||
+      len - sizeof(sr_ethernet_hdr_t) < ip_len) {
+    LogDebug("Failed IP header, bad version or length\n");
+    sr_stats_drop(sr, sr_drop_truncated, packet, len);
+    return;
+  }
+
+  /* Perform checksums */
+  if (!ip_hdr_checksum_valid(ip_hdr)) {
+    LogDebug("Checksum is not valid -- Packet is probably corrupt\n");
+    sr_stats_drop(sr, sr_drop_bad_cksum, packet, len);
+    return;
+  }
+
+  int local = sr_local_addr_lookup(sr, ip_hdr->ip_dst, NULL);
+  if (local == sr_local_broadcast) {
+    /* Broadcasts are ours but never answered or forwarded */
+    LogTrace("The IP packet is a broadcast, dropping\n");
+    return;
+  }
+
+  if (local == sr_local_unicast) { /* If the packet is for the router */
+    LogTrace("The IP packet is for me!\n");
+
+    /* Check the ip_protocol */
+    uint8_t ip_proto = ip_protocol((uint8_t *)ip_hdr);
+
+    if (ip_proto == ip_protocol_icmp) { /* ICMP */
+      if (ip_len < ip_hdr->ip_hl * 4 + sizeof(sr_icmp_hdr_t)) {
+        LogDebug("Failed ICMP header, insufficient length\n");
+        sr_stats_drop(sr, sr_drop_truncated, packet, len);
+        return;
       }
-      
-      struct sr_arpentry *arp_entry = sr_arpcache_lookup(&sr->cache, next_ip);
-      if (arp_entry == NULL) { /* We have an ARP Cache Miss! */
-        /* Send ARP Request */
-        /* Resent > 5 times */
-        /* ICMP host unreachable */
-      } else { /* We have an ARP Cache Hit! */
-        /* Send frame to next hope */
+
+      /* If it's ICMP echo req, send echo reply. */
+      sr_icmp_hdr_t *icmp_hdr = (sr_icmp_hdr_t *)((uint8_t *)ip_hdr + ip_hdr->ip_hl * 4);
+      if (icmp_hdr->icmp_type == icmp_type_echo_request && icmp_hdr->icmp_code == 0) {
+        LogTrace("This is an ICMP Echo request!\n");
+        sr_send_icmp_echo_reply(sr, packet, len);
       }
-      free(arp_entry);
-		}
-	} else if (ethtype == ethertype_arp) { /* If this is an ARP packet */
-    printf ("This is an ARP Packet!\n");
-
-    minlength += sizeof(sr_arp_hdr_t);
-    if (len < minlength) {
-      fprintf(stderr, "Failed to print ARP header, insufficient length\n");
-      return;
+    } else if (ip_proto == ip_protocol_tcp || ip_proto == ip_protocol_udp) {
+      /* Else if it's TCP/UDP, send ICMP port unreachable */
+      sr_send_icmp_error(sr, packet, len, iface,
+                         icmp_type_dest_unreach, icmp_code_port_unreach, 0);
     }
-    /* If it's a reply to me: Cache it, go through my request queue and send outstanding packets */
-      /* fill in code here */
+    return;
+  }
 
-    /* If it's a request to me: Construct an ARP reply and send it back */
-      /* fill in code here */
-  } else {
-    fprintf(stderr, "Unrecognized Ethernet Type: %d\n", ethtype);
+  /* If the packet is not for the router */
+  LogTrace("This IP packet is not for me!\n");
+
+  if (ip_hdr->ip_ttl <= 1) {
+    sr_stats_drop(sr, sr_drop_ttl, packet, len);
+    sr_send_icmp_error(sr, packet, len, iface, icmp_type_time_exceeded, 0, 0);
+    return;
   }
 
-  printf("~*~*~*~ Finished printing packet processing. ~*~*~*~\n\n");
+  /* If the packet is not for the router, check routing table, perform LPM */
+  struct sr_rt *rt = sr_routing_table_lpm_forwarding(sr, ip_hdr->ip_dst);
+  if (rt == NULL || rt->iface == NULL) {
+    /* If no match, send ICMP net unreachable */
+    sr_stats_drop(sr, sr_drop_no_route, packet, len);
+    sr_send_icmp_error(sr, packet, len, iface,
+                       icmp_type_dest_unreach, icmp_code_net_unreach, 0);
+    return;
+  }
 
-}/* end sr_ForwardPacket */
+  /* Too big for the way out and not to be fragmented */
+  if (ip_len > rt->iface->mtu && (ntohs(ip_hdr->ip_off) & IP_DF)) {
+    sr_stats_drop(sr, sr_drop_frag_needed, packet, len);
+    sr_send_icmp_error(sr, packet, len, iface, icmp_type_dest_unreach,
+                       icmp_code_frag_needed, rt->iface->mtu);
+    return;
+  }
 
-int ip_hdr_checksum_valid (sr_ip_hdr_t *ip_hdr) {
-  printf("Checking if checksum is valid...\n\n");
-  uint16_t initial_checksum = ip_hdr->ip_sum;
+  ip_hdr->ip_ttl--;
   ip_hdr->ip_sum = 0;
-  if (cksum(ip_hdr, sizeof(sr_ip_hdr_t)) == initial_checksum) {
-    printf("Checksum is valid!\n\n");
-    return 1;
+  ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+
+  sr_send_ip_frame(sr, packet, len, rt->iface,
+                   rt->gw.s_addr ? rt->gw.s_addr : ip_hdr->ip_dst);
+} /* -- sr_handle_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_send_ip_frame(..)
+ * Scope:  Local
+ *
+ * Send an IP frame out iface toward next_hop (network byte order),
+ * filling in the Ethernet addresses from the ARP cache.  On a miss the
+ * frame is queued on the ARP request, and if the request is new the
+ * first ARP request goes out; the sweeper retries and times out the
+ * rest, so this never re-enters the timeout path of sr_handle_arpreq.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_send_ip_frame(struct sr_instance* sr,
+        uint8_t* frame /* borrowed */,
+        unsigned int len,
+        struct sr_if* iface /* borrowed */,
+        uint32_t next_hop)
+{
+  sr_ethernet_hdr_t *eth = (sr_ethernet_hdr_t *)frame;
+
+  memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+  eth->ether_type = htons(ethertype_ip);
+
+  struct sr_arpentry *arp_entry = sr_arpcache_lookup(&sr->cache, next_hop);
+  sr_stats_count(sr, sr_cnt_arp_lookups);
+  if (arp_entry == NULL) { /* We have an ARP Cache Miss! */
+    sr_stats_count(sr, sr_cnt_arp_misses);
+    LogTrace("ARP cache miss, queueing\n");
+    /* under the lock, so the sweeper cannot time req out meanwhile */
+    pthread_mutex_lock(&sr->cache.lock);
+    struct sr_arpreq *req = sr_arpcache_queuereq(&sr->cache, next_hop,
+                                                 frame, len, iface);
+    if (req->times_sent == 0)
+      sr_handle_arpreq(sr, req);
+    pthread_mutex_unlock(&sr->cache.lock);
+  } else { /* We have an ARP Cache Hit! */
+    memcpy(eth->ether_dhost, arp_entry->mac, ETHER_ADDR_LEN);
+    if (sr_send_ip_out(sr, frame, len, iface) == 0)
+      sr_stats_latency(sr, sr_lat_fast, sr_stats_rx_started());
+    free(arp_entry);
   }
-  printf("Checksum is NOT valid...\n\n");
-  return 0;
-}
+} /* -- sr_send_ip_frame -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_send_ip_out(..)
+ * Scope:  Local
+ *
+ * Put an addressed IP frame on the wire, in fragments if it is over
+ * iface's MTU.  Anything past the datagram in a frame that would not
+ * fit is left behind.
+ *
+ *---------------------------------------------------------------------*/
 
-struct in_addr sr_routing_table_lpm_forwarding(struct sr_instance* sr, uint32_t ip_addr)
+static int sr_send_ip_out(struct sr_instance* sr,
+        uint8_t* frame /* borrowed */,
+        unsigned int len,
+        struct sr_if* iface /* borrowed */)
 {
-  printf("~*~*~*~ Starting Routing Table LPM Forwarding with the following rtable on IP == ");
-  print_addr_ip_int(ntohl(ip_addr));
-  printf(" ~*~*~*~\n\n");
-  sr_print_routing_table(sr);
-  printf("~*~*~*~\n\n");
-  struct sr_rt* rt_walker = 0;
+  if (len - sizeof(sr_ethernet_hdr_t) > iface->mtu) {
+    sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(frame + sizeof(sr_ethernet_hdr_t));
+    unsigned int ip_len = ntohs(ip_hdr->ip_len);
 
-  if(sr->routing_table == 0)
-  {
-    printf(" *warning* Routing table empty \n");
-    return nll;
+    if (ip_len > iface->mtu)
+      return sr_frag_send(sr, frame, len, iface);
+    len = sizeof(sr_ethernet_hdr_t) + ip_len;
+  }
+  return sr_send_packet_if(sr, frame, len, iface);
+} /* -- sr_send_ip_out -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handle_arpreq(..)
+ * Scope:  Global
+ *
+ * (Re)send the ARP request for req once a second; after five tries give
+ * up and send host unreachable for every packet waiting on it.  The
+ * request is destroyed and its packets detached first: an error whose
+ * way back is through the same dead next hop then starts a new request
+ * instead of landing on this one.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handle_arpreq(struct sr_instance* sr, struct sr_arpreq* req)
+{
+  time_t now = time(NULL);
+
+  /* REQUIRES */
+  assert(sr);
+  assert(req);
+
+  if (req->sent != 0 && difftime(now, req->sent) < 1.0) {
+    return;
+  }
+
+  if (req->times_sent >= 5) {
+    struct sr_packet *pkt, *next;
+
+    pthread_mutex_lock(&sr->cache.lock);
+    pkt = req->packets;
+    req->packets = NULL;
+    sr_arpreq_destroy(&sr->cache, req);
+    pthread_mutex_unlock(&sr->cache.lock);
+
+    for (; pkt; pkt = next) {
+      next = pkt->next;
+      sr_stats_drop(sr, sr_drop_arp_timeout, pkt->buf, pkt->len);
+      sr_send_icmp_error(sr, pkt->buf, pkt->len, NULL,
+                         icmp_type_dest_unreach, icmp_code_host_unreach, 0);
+      free(pkt->buf);
+      free(pkt);
+    }
+    return;
+  }
+
+  if (req->packets == NULL) {
+    return;
+  }
+
+  struct sr_if *iface = req->packets->iface;
+  uint8_t request[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+  sr_ethernet_hdr_t *eth = (sr_ethernet_hdr_t *)request;
+  sr_arp_hdr_t *arp = (sr_arp_hdr_t *)(request + sizeof(sr_ethernet_hdr_t));
+
+  memset(eth->ether_dhost, 0xff, ETHER_ADDR_LEN);
+  memcpy(eth->ether_shost, iface->addr, ETHER_ADDR_LEN);
+  eth->ether_type = htons(ethertype_arp);
+
+  arp->ar_hrd = htons(arp_hrd_ethernet);
+  arp->ar_pro = htons(ethertype_ip);
+  arp->ar_hln = ETHER_ADDR_LEN;
+  arp->ar_pln = sizeof(uint32_t);
+  arp->ar_op = htons(arp_op_request);
+  memcpy(arp->ar_sha, iface->addr, ETHER_ADDR_LEN);
+  arp->ar_sip = iface->ip;
+  memset(arp->ar_tha, 0, ETHER_ADDR_LEN);
+  arp->ar_tip = req->ip;
+
+  sr_send_packet_if(sr, request, sizeof(request), iface);
+  req->sent = now;
+  req->times_sent++;
+} /* -- sr_handle_arpreq -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_send_icmp_echo_reply(..)
+ * Scope:  Local
+ *
+ * Turn an echo request addressed to us into an echo reply, in the
+ * request's own buffer.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_send_icmp_echo_reply(struct sr_instance* sr,
+        uint8_t* packet /* lent */,
+        unsigned int len)
+{
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+
+  struct sr_rt *rt = sr_routing_table_lpm_forwarding(sr, ip_hdr->ip_src);
+  if (rt == NULL || rt->iface == NULL) {
+    LogDebug("No route back to echo requester\n");
+    sr_stats_drop(sr, sr_drop_no_route, packet, len);
+    return;
   }
 
-  /* Traverse the routing table searching for the gateway address with the greatest match */
-  rt_walker = sr->routing_table;
+  unsigned int frame_len = sr_icmp_echo_reply_in_place(packet);
+  sr_send_ip_frame(sr, packet, frame_len, rt->iface,
+                   rt->gw.s_addr ? rt->gw.s_addr : ip_hdr->ip_dst);
+} /* -- sr_send_icmp_echo_reply -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_send_icmp_error(..)
+ * Scope:  Local
+ *
+ * Send an ICMP error (type 3 or 11) about the IP frame in packet back to
+ * its source.  The error is sourced from in_iface if given (so traceroute
+ * sees the hop it came through), else from the interface routing back.
+ * next_mtu is for fragmentation needed, 0 otherwise.
+ *
+ *---------------------------------------------------------------------*/
 
-  struct in_addr next_gw = rt_walker->gw;
-  uint32_t longest_mask = rt_walker->mask.s_addr;
+static void sr_send_icmp_error(struct sr_instance* sr,
+        uint8_t* packet /* lent */,
+        unsigned int len,
+        struct sr_if* in_iface /* lent, may be NULL */,
+        uint8_t type,
+        uint8_t code,
+        uint16_t next_mtu)
+{
+  sr_ip_hdr_t *ip_hdr = (sr_ip_hdr_t *)(packet + sizeof(sr_ethernet_hdr_t));
+  uint8_t reply[SR_ICMP_ERROR_FRAME];
 
-  printf("LPM: The first routing entry is as follows and has mask == %x: \n\t", rt_walker->mask.s_addr);
-  sr_print_routing_entry(rt_walker);
-  printf("\tAfter applying the subnet mask we have ip&mask == %x\n", rt_walker->mask.s_addr & ip_addr);
-  uint32_t masked_ip = rt_walker->mask.s_addr & ip_addr;
-  if (masked_ip == rt_walker->dest.s_addr) {
-    printf("\twe have an initial match with \n\t\t");
-    sr_print_routing_entry(rt_walker);
+  if (!sr_icmp_error_wanted(sr, ip_hdr, len - sizeof(sr_ethernet_hdr_t))) {
+    LogDebug("No ICMP error about an error, a fragment or a broadcast\n");
+    return;
   }
 
-  while(rt_walker->next)
+  if (!sr_icmp_error_allowed(sr, ip_hdr->ip_src)) {
+    LogDebug("ICMP error rate limited\n");
+    return;
+  }
+
+  struct sr_rt *rt = sr_routing_table_lpm_forwarding(sr, ip_hdr->ip_src);
+  if (rt == NULL || rt->iface == NULL) {
+    LogDebug("No route back to source for ICMP error\n");
+    return;
+  }
+
+  /* copy of the source interface's template, patched */
+  unsigned int frame_len = sr_icmp_error_frame(reply,
+                               in_iface ? in_iface : rt->iface, ip_hdr,
+                               len - sizeof(sr_ethernet_hdr_t), type, code,
+                               next_mtu);
+  sr_send_ip_frame(sr, reply, frame_len, rt->iface,
+                   rt->gw.s_addr ? rt->gw.s_addr : ip_hdr->ip_src);
+  sr_stats_count(sr, sr_cnt_icmp_errors);
+} /* -- sr_send_icmp_error -- */
+
+/*---------------------------------------------------------------------
+ * Method: ip_hdr_checksum_valid(..)
+ * Scope:  Global
+ *
+ * Verify the header checksum, leaving the header as it was found.
+ * cksum() reports a zero checksum as 0xffff, but senders put 0x0000
+ * on the wire for it; both are the same ones' complement zero.
+ *
+ *---------------------------------------------------------------------*/
+
+int ip_hdr_checksum_valid (sr_ip_hdr_t *ip_hdr) {
+  uint16_t initial_checksum = ip_hdr->ip_sum;
+  ip_hdr->ip_sum = 0;
+  uint16_t computed = cksum(ip_hdr, ip_hdr->ip_hl * 4);
+  ip_hdr->ip_sum = initial_checksum;
+  return computed == initial_checksum ||
+         (computed == 0xffff && initial_checksum == 0);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_routing_table_lpm_forwarding(..)
+ * Scope:  Global
+ *
+ * Longest prefix match of ip_addr (network byte order) against the
+ * routing table.  Returns the matching entry, whose iface is already
+ * bound, or NULL if nothing matches.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_routing_table_lpm_forwarding(struct sr_instance* sr, uint32_t ip_addr)
+{
+  struct sr_rt* rt_walker = 0;
+  struct sr_rt* best = 0;
+  uint32_t longest_mask = 0;
+
+  /* Traverse the routing table searching for the gateway address with the greatest match;
+     the control socket swaps in whole new tables, so load the head once */
+  for (rt_walker = __atomic_load_n(&sr->routing_table, __ATOMIC_ACQUIRE);
+       rt_walker; rt_walker = rt_walker->next)
   {
-    rt_walker = rt_walker->next; 
-    /* do something */
-    printf("LPM: The next routing entry is as follows and has mask == %x: \n\t", rt_walker->mask.s_addr);
-    sr_print_routing_entry(rt_walker);
-    printf("\tAfter applying the subnet mask we have ip&mask == %x\n", rt_walker->mask.s_addr & ip_addr);
-    masked_ip = rt_walker->mask.s_addr & ip_addr;
+    uint32_t masked_ip = rt_walker->mask.s_addr & ip_addr;
     if (masked_ip == rt_walker->dest.s_addr) {
-      printf("\twe have a match with \n\t\t");
-      sr_print_routing_entry(rt_walker);
-      if (rt_walker->mask.s_addr > longest_mask) {
-        printf("\t\t *** we have a new longest match! *** \n");
-        next_gw = rt_walker->gw;
-        longest_mask = rt_walker->mask.s_addr;
+      /* compare in host order so a longer mask is a larger number */
+      if (best == 0 || ntohl(rt_walker->mask.s_addr) > longest_mask) {
+        best = rt_walker;
+        longest_mask = ntohl(rt_walker->mask.s_addr);
       }
     }
   }
-  printf("The Next gateway_addr is %s\n", inet_ntoa(next_gw));
-  printf("~*~*~*~ Finished with Routing Table LPM Forwarding ~*~*~*~\n\n");
-  return next_gw;
+
+  sr_stats_count(sr, sr_cnt_fib_lookups);
+  if (best == 0)
+    sr_stats_count(sr, sr_cnt_fib_misses);
+
+#if SR_LOG_LEVEL >= SR_LOG_TRACE
+  if (LogEnabled(SR_LOG_TRACE)) {
+    struct in_addr dst;
+    dst.s_addr = ip_addr;
+    LogTrace("LPM %s -> ", inet_ntoa(dst));
+    if (best)
+      LogTrace("%s via %s\n", inet_ntoa(best->gw), best->interface);
+    else
+      LogTrace("no route\n");
+  }
+#endif
+  return best;
 }
- 
-/* Check TTL, ARP, etc and the stub functions kurt talked about and add these in your function. */
-/* Check if your minlength calculations are working out, especially around ARP but it should be since it won't add anything else if it's ARP */
-/* Check if you need to see if the datagram has been truncated to < than length specified in IP hdr */
\ No newline at end of file
@@ -11,6 +11,7 @@
 
 #include <netinet/in.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <stdio.h>
 
 #include "sr_protocol.h"
@@ -30,9 +31,20 @@
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
 
+#define SR_MAX_FRAME_DEFAULT 1514   /* 1500 byte MTU */
+#define SR_MAX_FRAME_JUMBO   9216
+
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_capture;
+struct sr_io_ops;
+struct sr_busy;
+struct sr_stats_seg;
+struct sr_ctl;
+struct sr_metrics;
+struct sr_perf;
+struct sr_icmp;
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -50,30 +62,56 @@ struct sr_instance
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if* if_table[SR_MAX_IFACES]; /* interfaces by ifindex */
+    unsigned int num_ifaces;
+    struct sr_local_table local_addrs; /* "is this packet for me" */
     struct sr_rt* routing_table; /* routing table */
     struct sr_arpcache cache;   /* ARP cache */
     pthread_attr_t attr;
-    FILE* logfile;
+    struct sr_capture* capture; /* -l packet log, 0 if off */
+    const struct sr_io_ops* io; /* packet source and sink */
+    void* io_state;             /* owned by the backend */
+    unsigned int max_frame;     /* -j, lowered by the VNS server's caps */
+    int vns_batch;              /* VNS server takes VNSPACKET_BATCH */
+    struct sr_busy* busy;       /* -b: the main thread never blocks */
+    struct sr_stats_seg* stats; /* counters, -K to share them */
+    struct sr_ctl* ctl;         /* -C control socket, 0 if off */
+    struct sr_metrics* metrics; /* -H Prometheus endpoint, 0 if off */
+    struct sr_perf* perf;       /* --perf counters, 0 if off */
+    struct sr_icmp* icmp;       /* ICMP error rate limits, 0 for none */
 };
 
 /* -- sr_main.c -- */
 int sr_verify_routing_table(struct sr_instance* sr);
 
-/* -- sr_vns_comm.c -- */
+/* -- sr_io.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_iov(struct sr_instance* , const struct iovec* , int ,
+                       struct sr_if* );
+int sr_send_packet_if(struct sr_instance* , uint8_t* , unsigned int ,
+                      struct sr_if* );
+
+/* -- sr_vns_comm.c -- */
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+int sr_vns_dispatch(struct sr_instance* , uint8_t* , int , int );
+unsigned int sr_vns_batch_add(uint8_t* , unsigned int , unsigned int ,
+                              const uint8_t* , unsigned int , const char* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int ,
+                     struct sr_if* );
+void sr_handle_arpreq(struct sr_instance* , struct sr_arpreq* );
+int ip_hdr_checksum_valid (sr_ip_hdr_t *ip_hdr);
+struct sr_rt* sr_routing_table_lpm_forwarding(struct sr_instance* sr,
+                                              uint32_t ip_addr);
 
 /* -- sr_if.c -- */
 void sr_add_interface(struct sr_instance* , const char* );
 void sr_set_ether_ip(struct sr_instance* , uint32_t );
 void sr_set_ether_addr(struct sr_instance* , const unsigned char* );
+void sr_set_ether_mtu(struct sr_instance* , unsigned int );
 void sr_print_if_list(struct sr_instance* );
-int ip_hdr_checksum_valid (sr_ip_hdr_t *ip_hdr);
-struct in_addr sr_routing_table_lpm_forwarding(struct sr_instance* sr, uint32_t ip_addr);
 
 #endif /* SR_ROUTER_H */
@@ -22,9 +22,36 @@
 #include "sr_rt.h"
 #include "sr_router.h"
 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_new(..)
+ *
+ * One unlinked route.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* sr_rt_new(struct sr_instance* sr, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask, const char* if_name)
+{
+    struct sr_rt* rt = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+
+    assert(rt);
+    rt->next = 0;
+    rt->dest = dest;
+    rt->gw   = gw;
+    rt->mask = mask;
+    strncpy(rt->interface,if_name,sr_IFACE_NAMELEN - 1);
+    rt->interface[sr_IFACE_NAMELEN - 1] = '\0';
+    rt->iface = sr_get_interface(sr, if_name);
+    return rt;
+} /* -- sr_rt_new -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
+ * Routes are appended in file order through a tail pointer, so a full
+ * Internet table (~1M lines) loads in linear time.  Blank lines and
+ * lines starting with # are skipped.
+ *
  *---------------------------------------------------------------------*/
 
 int sr_load_rt(struct sr_instance* sr,const char* filename)
@@ -38,6 +65,7 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     struct in_addr dest_addr;
     struct in_addr gw_addr;
     struct in_addr mask_addr;
+    struct sr_rt** tail = 0;
     int clear_routing_table = 0;
 
     /* -- REQUIRES -- */
@@ -52,12 +80,15 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
 
     while( fgets(line,BUFSIZ,fp) != 0)
     {
-        sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
+        if(sscanf(line,"%31s %31s %31s %31s",dest,gw,mask,iface) < 4 ||
+                dest[0] == '#')
+        { continue; }
         if(inet_aton(dest,&dest_addr) == 0)
         { 
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     dest);
+            fclose(fp);
             return -1; 
         }
         if(inet_aton(gw,&gw_addr) == 0)
@@ -65,6 +96,7 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     gw);
+            fclose(fp);
             return -1; 
         }
         if(inet_aton(mask,&mask_addr) == 0)
@@ -72,16 +104,20 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     mask);
+            fclose(fp);
             return -1; 
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
             sr->routing_table = 0;
+            tail = &sr->routing_table;
             clear_routing_table = 1;
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
+        *tail = sr_rt_new(sr,dest_addr,gw_addr,mask_addr,iface);
+        tail = &(*tail)->next;
     } /* -- while -- */
 
+    fclose(fp);
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
 
@@ -93,43 +129,80 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
 struct in_addr gw, struct in_addr mask,char* if_name)
 {
-    struct sr_rt* rt_walker = 0;
+    struct sr_rt** tail;
 
     /* -- REQUIRES -- */
     assert(if_name);
     assert(sr);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
-    {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+    /* -- find the end of the list -- */
+    for(tail = &sr->routing_table; *tail; tail = &(*tail)->next);
 
-        return;
-    }
+    *tail = sr_rt_new(sr,dest,gw,mask,if_name);
+} /* -- sr_add_entry -- */
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+/*---------------------------------------------------------------------
+ * Method: sr_rt_resolve_interfaces(..)
+ *
+ * Bind every route to its interface record.  Routes are normally loaded
+ * before the hardware info arrives, so this is run again once the
+ * interfaces are known.  Returns the number of routes whose interface
+ * does not exist.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_resolve_interfaces(struct sr_instance* sr)
+{
+    struct sr_rt* rt_walker = 0;
+    int unresolved = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    for(rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+    {
+        rt_walker->iface = sr_get_interface(sr, rt_walker->interface);
+        if(rt_walker->iface == 0)
+        { unresolved++; }
     }
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+    return unresolved;
+} /* -- sr_rt_resolve_interfaces -- */
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+/*---------------------------------------------------------------------
+ * Method: sr_rt_copy(..)
+ *
+ * A private copy of the route list at head, for building a new table
+ * while the router still forwards on the old one.
+ *
+ *---------------------------------------------------------------------*/
 
-} /* -- sr_add_entry -- */
+struct sr_rt* sr_rt_copy(const struct sr_rt* head)
+{
+    struct sr_rt* copy = 0;
+    struct sr_rt** tail = &copy;
+
+    for(; head; head = head->next)
+    {
+        *tail = (struct sr_rt*)malloc(sizeof(struct sr_rt));
+        assert(*tail);
+        memcpy(*tail, head, sizeof(struct sr_rt));
+        (*tail)->next = 0;
+        tail = &(*tail)->next;
+    }
+    return copy;
+} /* -- sr_rt_copy -- */
+
+void sr_rt_free(struct sr_rt* head)
+{
+    struct sr_rt* next;
+
+    for(; head; head = next)
+    {
+        next = head->next;
+        free(head);
+    }
+} /* -- sr_rt_free -- */
 
 /*---------------------------------------------------------------------
  * Method:
@@ -139,6 +212,7 @@ struct in_addr gw, struct in_addr mask,char* if_name)
 void sr_print_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
+    unsigned int shown = 0, more = 0;
 
     if(sr->routing_table == 0)
     {
@@ -148,14 +222,17 @@ void sr_print_routing_table(struct sr_instance* sr)
 
     printf("Destination\tGateway\t\tMask\tIface\n");
 
-    rt_walker = sr->routing_table;
-    
-    sr_print_routing_entry(rt_walker);
-    while(rt_walker->next)
+    /* -- a full table would be a million lines of startup output -- */
+    for(rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
     {
-        rt_walker = rt_walker->next; 
+        if(shown++ == SR_RT_PRINT_MAX)
+        { break; }
         sr_print_routing_entry(rt_walker);
     }
+    for(; rt_walker; rt_walker = rt_walker->next)
+    { more++; }
+    if(more)
+    { printf("... and %u more\n", more); }
 
 } /* -- sr_print_routing_table -- */
 
@@ -20,6 +20,8 @@
 
 #include "sr_if.h"
 
+#define SR_RT_PRINT_MAX 64  /* routes sr_print_routing_table(..) lists */
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -33,6 +35,7 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    struct sr_if* iface; /* interface resolved from name, 0 until known */
     struct sr_rt* next;
 };
 
@@ -40,6 +43,9 @@ struct sr_rt
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, char*);
+int sr_rt_resolve_interfaces(struct sr_instance* sr);
+struct sr_rt* sr_rt_copy(const struct sr_rt* head);
+void sr_rt_free(struct sr_rt* head);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
 
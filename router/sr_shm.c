@@ -0,0 +1,287 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.c
+ *
+ * Description:
+ *
+ * Shared memory message rings, see sr_shm.h.  No router state in here:
+ * vnsload links this file as well.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+
+#include "sr_shm.h"
+
+#define SR_SHM_MASK     (SR_SHM_RING_BYTES - 1)
+#define SR_SHM_PAD(len) (((len) + SR_SHM_ALIGN - 1) & ~(SR_SHM_ALIGN - 1))
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_reserve(..)
+ *
+ * Room for a len byte message, or 0 if the ring is too full.  *total is
+ * what sr_shm_commit(..) must publish, wrap padding included.
+ *
+ *---------------------------------------------------------------------------*/
+
+uint8_t* sr_shm_reserve(struct sr_shm_ring* ring, uint32_t len,
+                        uint32_t* total)
+{
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t pos = head & SR_SHM_MASK;
+    uint32_t need = SR_SHM_PAD(len), skip = 0;
+
+    if(len < 8 || need > SR_SHM_RING_BYTES / 2)
+    { return 0; }
+    if(pos + need > SR_SHM_RING_BYTES)
+    { skip = SR_SHM_RING_BYTES - pos; }
+    if(SR_SHM_RING_BYTES - (head - tail) < skip + need)
+    { return 0; }
+
+    if(skip)
+    {
+        /* -- zero length: the consumer jumps to the start -- */
+        memset(ring->data + pos, 0, 4);
+        pos = 0;
+    }
+    *total = skip + need;
+    return ring->data + pos;
+} /* -- sr_shm_reserve -- */
+
+int sr_shm_commit(struct sr_shm_ring* ring, uint32_t total)
+{
+    uint32_t head = ring->head;
+
+    __atomic_store_n(&ring->head, head + total, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    /* -- consumer had caught up: it may be asleep -- */
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head;
+} /* -- sr_shm_commit -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_peek(..)
+ *
+ * Point *msg at the next message, which stays in the ring, writable,
+ * until sr_shm_release(..).  Returns 1, 0 if the ring is empty or -1 if
+ * the ring holds garbage.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_peek(struct sr_shm_ring* ring, uint8_t** msg, uint32_t* len)
+{
+    uint32_t tail = ring->tail, head, pos, mlen;
+
+    for(;;)
+    {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if(head == tail)
+        { return 0; }
+
+        pos = tail & SR_SHM_MASK;
+        memcpy(&mlen, ring->data + pos, 4);
+        mlen = ntohl(mlen);
+        if(mlen != 0)
+        { break; }
+
+        tail += SR_SHM_RING_BYTES - pos;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    /* -- the other side is another process: trust nothing -- */
+    if(mlen < 8 || pos + mlen > SR_SHM_RING_BYTES || mlen > head - tail)
+    {
+        fprintf(stderr, "shm: bad message length %u\n", mlen);
+        return -1;
+    }
+    *msg = ring->data + pos;
+    *len = mlen;
+    return 1;
+} /* -- sr_shm_peek -- */
+
+void sr_shm_release(struct sr_shm_ring* ring, uint32_t len)
+{
+    __atomic_store_n(&ring->tail, ring->tail + SR_SHM_PAD(len),
+            __ATOMIC_RELEASE);
+} /* -- sr_shm_release -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_empty(..)
+ *
+ * Call before sleeping on the doorbell: pairs with the fence in
+ * sr_shm_commit(..), so a message committed after this says empty has
+ * its producer ring the bell.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_empty(struct sr_shm_ring* ring)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+} /* -- sr_shm_empty -- */
+
+void sr_shm_ring_bell(int bell)
+{
+    uint64_t one = 1;
+
+    if(write(bell, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    { perror("shm: doorbell"); }
+} /* -- sr_shm_ring_bell -- */
+
+void sr_shm_clear_bell(int bell)
+{
+    uint64_t count;
+
+    if(read(bell, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    { perror("shm: doorbell"); }
+} /* -- sr_shm_clear_bell -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_create(..)
+ *
+ * New segment with both rings empty.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_create(struct sr_shm* shm)
+{
+    size_t size = 2 * sizeof(struct sr_shm_ring);
+
+    memset(shm, 0, sizeof(*shm));
+    shm->bell[0] = shm->bell[1] = -1;
+
+    if((shm->memfd = memfd_create("sr-shm", MFD_CLOEXEC)) < 0)
+    { perror("memfd_create"); return -1; }
+    if(ftruncate(shm->memfd, size) != 0)
+    { perror("ftruncate"); sr_shm_destroy(shm); return -1; }
+
+    shm->rings = (struct sr_shm_ring*)mmap(0, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, shm->memfd, 0);
+    if(shm->rings == MAP_FAILED)
+    { shm->rings = 0; perror("mmap"); sr_shm_destroy(shm); return -1; }
+
+    if((shm->bell[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 ||
+            (shm->bell[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    { perror("eventfd"); sr_shm_destroy(shm); return -1; }
+
+    return 0;
+} /* -- sr_shm_create -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_shm_send(..) / sr_shm_recv(..)
+ *
+ * Pass the segment and doorbells over a connected unix socket.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_shm_send(int sock, const struct sr_shm* shm)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    uint32_t hello[2];
+    int fds[3];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctl;
+
+    hello[0] = htonl(SR_SHM_MAGIC);
+    hello[1] = htonl(SR_SHM_RING_BYTES);
+    fds[0] = shm->memfd;
+    fds[1] = shm->bell[0];
+    fds[2] = shm->bell[1];
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&ctl, 0, sizeof(ctl));
+    iov.iov_base = hello;
+    iov.iov_len = sizeof(hello);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if(sendmsg(sock, &msg, MSG_NOSIGNAL) != sizeof(hello))
+    { perror("shm: sendmsg"); return -1; }
+    return 0;
+} /* -- sr_shm_send -- */
+
+int sr_shm_recv(int sock, struct sr_shm* shm)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    uint32_t hello[2];
+    int fds[3];
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } ctl;
+
+    memset(shm, 0, sizeof(*shm));
+    shm->memfd = shm->bell[0] = shm->bell[1] = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = hello;
+    iov.iov_len = sizeof(hello);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = sizeof(ctl.buf);
+
+    if(recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(hello))
+    { perror("shm: recvmsg"); return -1; }
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if(!cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    { fprintf(stderr, "shm: no segment passed\n"); return -1; }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    shm->memfd = fds[0];
+    shm->bell[0] = fds[1];
+    shm->bell[1] = fds[2];
+
+    if(ntohl(hello[0]) != SR_SHM_MAGIC ||
+            ntohl(hello[1]) != SR_SHM_RING_BYTES)
+    {
+        fprintf(stderr, "shm: segment layout does not match\n");
+        sr_shm_destroy(shm);
+        return -1;
+    }
+
+    shm->rings = (struct sr_shm_ring*)mmap(0, 2 * sizeof(struct sr_shm_ring),
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, shm->memfd, 0);
+    if(shm->rings == MAP_FAILED)
+    { shm->rings = 0; perror("mmap"); sr_shm_destroy(shm); return -1; }
+    return 0;
+} /* -- sr_shm_recv -- */
+
+void sr_shm_destroy(struct sr_shm* shm)
+{
+    if(shm->rings)
+    { munmap(shm->rings, 2 * sizeof(struct sr_shm_ring)); }
+    if(shm->memfd >= 0)
+    { close(shm->memfd); }
+    if(shm->bell[0] >= 0)
+    { close(shm->bell[0]); }
+    if(shm->bell[1] >= 0)
+    { close(shm->bell[1]); }
+    shm->rings = 0;
+    shm->memfd = shm->bell[0] = shm->bell[1] = -1;
+} /* -- sr_shm_destroy -- */
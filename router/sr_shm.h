@@ -0,0 +1,72 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.h
+ *
+ * Description:
+ *
+ * Shared memory message rings for a packet source on the same host as the
+ * router (sr -M, vnsload -M).  A segment is a memfd holding two single
+ * producer, single consumer byte rings, one per direction.  Each record is
+ * one whole VNS message (c_base header and all, so VNSPACKET framing is
+ * unchanged) padded to 8 bytes; a record never wraps, a zero mLen marks
+ * the unused end of the ring.
+ *
+ * A producer rings the consumer's eventfd doorbell only when its commit
+ * takes the ring from empty to non-empty; a consumer only sleeps on the
+ * doorbell after seeing the ring empty.  The seq_cst fences on both sides
+ * make sure one of the two sees the other.
+ *
+ * The segment and both doorbells are handed from the source to the
+ * router over a unix socket, which then stays open so either side sees
+ * the other go away.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SHM_H
+#define SR_SHM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#define SR_SHM_MAGIC       0x53524d31u  /* "SRM1" */
+#define SR_SHM_RING_BYTES  (1 << 20)    /* power of 2 */
+#define SR_SHM_ALIGN       8
+
+/* -- which ring of the segment -- */
+#define SR_SHM_TO_ROUTER   0
+#define SR_SHM_TO_SOURCE   1
+
+struct sr_shm_ring
+{
+    uint32_t head __attribute__ ((aligned (64)));  /* producer's */
+    uint32_t tail __attribute__ ((aligned (64)));  /* consumer's */
+    uint8_t data[SR_SHM_RING_BYTES] __attribute__ ((aligned (64)));
+};
+
+struct sr_shm
+{
+    struct sr_shm_ring* rings;  /* both directions, mapped */
+    int memfd;
+    int bell[2];                /* eventfd per ring, rung by its producer */
+};
+
+/* -- producer: reserve, fill in, commit; commit is 1 if bell is due -- */
+uint8_t* sr_shm_reserve(struct sr_shm_ring* ring, uint32_t len,
+                        uint32_t* total);
+int      sr_shm_commit(struct sr_shm_ring* ring, uint32_t total);
+
+/* -- consumer: peek at the next message, release it when done -- */
+int      sr_shm_peek(struct sr_shm_ring* ring, uint8_t** msg, uint32_t* len);
+void     sr_shm_release(struct sr_shm_ring* ring, uint32_t len);
+int      sr_shm_empty(struct sr_shm_ring* ring);
+
+void sr_shm_ring_bell(int bell);
+void sr_shm_clear_bell(int bell);
+
+/* -- setup -- */
+int  sr_shm_create(struct sr_shm* shm);
+int  sr_shm_send(int sock, const struct sr_shm* shm);
+int  sr_shm_recv(int sock, struct sr_shm* shm);
+void sr_shm_destroy(struct sr_shm* shm);
+
+#endif /* -- SR_SHM_H -- */
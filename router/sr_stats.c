@@ -0,0 +1,470 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.c
+ *
+ * Description:
+ *
+ * Forwarding counters, see sr_stats.h.  srstat links this file too, for
+ * sr_stats_sum(..) and the names.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <arpa/inet.h>
+
+#include "sr_stats.h"
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_protocol.h"
+#include "sr_log.h"
+
+/* -- single writer per slot: the relaxed store only keeps a reader in
+ *    another process from seeing a torn value.  Writers to the last slot,
+ *    which threads past the others share, add atomically instead -- */
+#define SR_STATS_ADD(c, n) \
+    do { \
+        if(sr_stats_shared) \
+        { __atomic_fetch_add(&(c), (n), __ATOMIC_RELAXED); } \
+        else \
+        { __atomic_store_n(&(c), (c) + (n), __ATOMIC_RELAXED); } \
+    } while(0)
+
+const char* sr_drop_reason_names[SR_DROP_REASONS] =
+{ "truncated", "bad_cksum", "ttl_expired", "no_route", "arp_timeout",
+  "queue_full", "frag_needed" };
+
+const char* sr_stats_proto_names[SR_STATS_PROTOS] =
+{ "arp", "icmp", "tcp", "udp", "other" };
+
+const char* sr_stats_counter_names[SR_STATS_COUNTERS] =
+{ "fib_lookups", "fib_misses", "arp_lookups", "arp_misses", "icmp_errors",
+  "icmp_limited_global", "icmp_limited_source", "frag_datagrams",
+  "frag_fragments" };
+
+const char* sr_lat_path_names[SR_LAT_PATHS] =
+{ "fast", "queued" };
+
+#define SR_STATS_CALIBRATE_NS  20000000  /* against CLOCK_MONOTONIC_RAW */
+
+static __thread struct sr_stats_slot* sr_stats_mine;
+static __thread int sr_stats_shared;      /* sr_stats_mine is the last slot */
+static __thread uint64_t sr_stats_start;  /* TSC at receipt, 0 outside */
+static unsigned int sr_stats_claimed;
+
+static uint64_t sr_stats_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sr_stats_ns -- */
+
+/* -- cheap enough to read per packet; elsewhere fall back to the clock -- */
+uint64_t sr_stats_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#else
+    return sr_stats_ns();
+#endif
+} /* -- sr_stats_tsc -- */
+
+static uint64_t sr_stats_calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t0, t1, c0, c1;
+
+    t0 = sr_stats_ns();
+    c0 = sr_stats_tsc();
+    do
+    { t1 = sr_stats_ns(); } while(t1 - t0 < SR_STATS_CALIBRATE_NS);
+    c1 = sr_stats_tsc();
+    return (uint64_t)((double)(c1 - c0) * 1e9 / (t1 - t0));
+#else
+    return 1000000000;
+#endif
+} /* -- sr_stats_calibrate -- */
+
+static struct sr_stats_slot* sr_stats_local(struct sr_instance* sr)
+{
+    unsigned int i;
+
+    if(sr_stats_mine)
+    { return sr_stats_mine; }
+
+    i = __atomic_fetch_add(&sr_stats_claimed, 1, __ATOMIC_RELAXED);
+    if(i >= SR_STATS_SLOTS - 1)
+    {
+        if(i >= SR_STATS_SLOTS)
+        {
+            LogWarn("stats: more than %d counting threads, sharing a slot\n",
+                    SR_STATS_SLOTS);
+        }
+        i = SR_STATS_SLOTS - 1;
+        sr_stats_shared = 1;
+    }
+    sr_stats_mine = &sr->stats->slot[i];
+    return sr_stats_mine;
+} /* -- sr_stats_local -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_open(..)
+ *
+ * Map the counters, in a file at path or anonymously if path is 0.  Call
+ * before sr_init(..) starts the ARP sweeper.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_stats_open(struct sr_instance* sr, const char* path)
+{
+    struct sr_stats_seg* seg;
+    int fd = -1;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if(path)
+    {
+        if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644)) < 0)
+        { perror(path); return -1; }
+        if(ftruncate(fd, sizeof(struct sr_stats_seg)) != 0)
+        { perror("ftruncate"); close(fd); return -1; }
+        seg = (struct sr_stats_seg*)mmap(0, sizeof(struct sr_stats_seg),
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    else
+    {
+        seg = (struct sr_stats_seg*)mmap(0, sizeof(struct sr_stats_seg),
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if(seg == MAP_FAILED)
+    { perror("mmap"); return -1; }
+
+    seg->version = SR_STATS_VERSION;
+    seg->slots = SR_STATS_SLOTS;
+    seg->started = time(NULL);
+    seg->tsc_hz = sr_stats_calibrate();
+    /* -- last: a reader that sees the magic sees the rest -- */
+    __atomic_store_n(&seg->magic, SR_STATS_MAGIC, __ATOMIC_RELEASE);
+
+    sr->stats = seg;
+    return 0;
+} /* -- sr_stats_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_interfaces(..)
+ *
+ * Name the interfaces for readers, once the backend knows them.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_interfaces(struct sr_instance* sr)
+{
+    struct sr_stats_seg* seg = sr->stats;
+    unsigned int i;
+
+    if(!seg)
+    { return; }
+
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        if(sr->if_table[i])
+        {
+            memcpy(seg->ifname[i], sr->if_table[i]->name,
+                   sr_IFACE_NAMELEN);
+        }
+    }
+    __atomic_store_n(&seg->num_ifaces, sr->num_ifaces, __ATOMIC_RELEASE);
+    sr_stats_fib_routes(sr);
+} /* -- sr_stats_interfaces -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_fib_routes(..)
+ *
+ * Publish the size of the routing table; whoever just installed it calls
+ * this, so the list is not going anywhere.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_fib_routes(struct sr_instance* sr)
+{
+    struct sr_rt* rt;
+    uint64_t n = 0;
+
+    if(!sr->stats)
+    { return; }
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    { n++; }
+    __atomic_store_n(&sr->stats->fib_routes, n, __ATOMIC_RELAXED);
+} /* -- sr_stats_fib_routes -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_rx(..) / sr_stats_tx(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_rx(struct sr_instance* sr, struct sr_if* iface,
+                 unsigned int len)
+{
+    struct sr_stats_if* c;
+
+    if(!sr->stats)
+    { return; }
+    sr_stats_start = sr_stats_tsc();
+    c = &sr_stats_local(sr)->ifs[iface->ifindex];
+    SR_STATS_ADD(c->rx_pkts, 1);
+    SR_STATS_ADD(c->rx_bytes, len);
+} /* -- sr_stats_rx -- */
+
+/* -- the router is done with the frame sr_stats_rx(..) saw -- */
+void sr_stats_rx_done(void)
+{ sr_stats_start = 0; }
+
+/* -- when the frame being handled arrived, 0 if none is -- */
+uint64_t sr_stats_rx_started(void)
+{ return sr_stats_start; }
+
+void sr_stats_tx(struct sr_instance* sr, struct sr_if* iface,
+                 unsigned int len)
+{
+    struct sr_stats_if* c;
+
+    if(!sr->stats)
+    { return; }
+    c = &sr_stats_local(sr)->ifs[iface->ifindex];
+    SR_STATS_ADD(c->tx_pkts, 1);
+    SR_STATS_ADD(c->tx_bytes, len);
+} /* -- sr_stats_tx -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_drop(..)
+ *
+ * Count frame as dropped for reason, under whatever protocol it carries
+ * as far as len lets us see.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_drop(struct sr_instance* sr, enum sr_drop_reason reason,
+                   const uint8_t* frame, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)frame;
+    const sr_ip_hdr_t* ip;
+    int proto = sr_stats_other;
+    uint64_t* c;
+
+    if(!sr->stats)
+    { return; }
+
+    if(len >= sizeof(sr_ethernet_hdr_t) &&
+            ntohs(eth->ether_type) == ethertype_arp)
+    { proto = sr_stats_arp; }
+    else if(len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) &&
+            ntohs(eth->ether_type) == ethertype_ip)
+    {
+        ip = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+        switch(ip->ip_p)
+        {
+            case ip_protocol_icmp: proto = sr_stats_icmp; break;
+            case ip_protocol_tcp:  proto = sr_stats_tcp;  break;
+            case ip_protocol_udp:  proto = sr_stats_udp;  break;
+        }
+    }
+
+    c = &sr_stats_local(sr)->drops[reason][proto];
+    SR_STATS_ADD(*c, 1);
+} /* -- sr_stats_drop -- */
+
+void sr_stats_count(struct sr_instance* sr, enum sr_stats_counter counter)
+{
+    uint64_t* c;
+
+    if(!sr->stats)
+    { return; }
+    c = &sr_stats_local(sr)->counters[counter];
+    SR_STATS_ADD(*c, 1);
+} /* -- sr_stats_count -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_latency(..)
+ *
+ * A frame that arrived at TSC start (0: not one we timed) has been sent.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_latency(struct sr_instance* sr, enum sr_lat_path path,
+                      uint64_t start)
+{
+    struct sr_stats_slot* s;
+    uint64_t d;
+    unsigned int e, idx;
+
+    if(!sr->stats || start == 0)
+    { return; }
+
+    d = sr_stats_tsc() - start;
+    if(d < SR_LAT_SUB)
+    { idx = d; }
+    else
+    {
+        e = 63 - __builtin_clzll(d);
+        if(e > SR_LAT_MAX_EXP)
+        { idx = SR_LAT_BUCKETS - 1; }
+        else
+        {
+            idx = (e - SR_LAT_SUB_BITS + 1) * SR_LAT_SUB +
+                ((d >> (e - SR_LAT_SUB_BITS)) & (SR_LAT_SUB - 1));
+        }
+    }
+
+    s = sr_stats_local(sr);
+    SR_STATS_ADD(s->lat[path][idx], 1);
+    SR_STATS_ADD(s->lat_sum[path], d);
+} /* -- sr_stats_latency -- */
+
+/* -- smallest tick count in bucket idx; SR_LAT_BUCKETS gives the end -- */
+uint64_t sr_stats_lat_lower(unsigned int idx)
+{
+    unsigned int e;
+
+    if(idx < SR_LAT_SUB)
+    { return idx; }
+    e = idx / SR_LAT_SUB + SR_LAT_SUB_BITS - 1;
+    return (uint64_t)(SR_LAT_SUB + idx % SR_LAT_SUB) << (e - SR_LAT_SUB_BITS);
+} /* -- sr_stats_lat_lower -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_percentile(..)
+ *
+ * The q (0..1) quantile of a latency histogram, in nanoseconds, to
+ * within a bucket; 0 if it is empty.
+ *
+ *---------------------------------------------------------------------------*/
+
+double sr_stats_percentile(const uint64_t* hist, double q, uint64_t tsc_hz)
+{
+    uint64_t total = 0, seen = 0, target;
+    unsigned int i;
+
+    for(i = 0; i < SR_LAT_BUCKETS; i++)
+    { total += hist[i]; }
+    if(total == 0 || tsc_hz == 0)
+    { return 0; }
+
+    target = (uint64_t)(q * total + 0.5);
+    if(target < 1)
+    { target = 1; }
+    for(i = 0; i < SR_LAT_BUCKETS - 1; i++)
+    {
+        seen += hist[i];
+        if(seen >= target)
+        { break; }
+    }
+    return (sr_stats_lat_lower(i) + sr_stats_lat_lower(i + 1) - 1) / 2.0 *
+        1e9 / tsc_hz;
+} /* -- sr_stats_percentile -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_sum(..)
+ *
+ * Add the slots of a live segment up into sum.  Each counter is read
+ * once, untorn; the totals are not a snapshot of one instant.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_sum(const struct sr_stats_seg* seg, struct sr_stats_slot* sum)
+{
+    const uint64_t* in;
+    uint64_t* out = (uint64_t*)sum;
+    unsigned int s, i, n = sizeof(struct sr_stats_slot) / sizeof(uint64_t);
+
+    memset(sum, 0, sizeof(*sum));
+    for(s = 0; s < SR_STATS_SLOTS; s++)
+    {
+        in = (const uint64_t*)&seg->slot[s];
+        for(i = 0; i < n; i++)
+        { out[i] += __atomic_load_n(&in[i], __ATOMIC_RELAXED); }
+    }
+} /* -- sr_stats_sum -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stats_close(..)
+ *
+ * Log the totals.  The segment stays mapped, and a -K file stays behind
+ * for a last look with srstat; the ARP sweeper may still count.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_stats_close(struct sr_instance* sr)
+{
+    struct sr_stats_slot sum;
+    unsigned int i, r, p;
+
+    if(!sr->stats)
+    { return; }
+
+    sr_stats_sum(sr->stats, &sum);
+    for(i = 0; i < sr->num_ifaces; i++)
+    {
+        LogInfo("stats: %s rx %llu pkts %llu bytes, tx %llu pkts %llu "
+                "bytes\n", sr->stats->ifname[i],
+                (unsigned long long)sum.ifs[i].rx_pkts,
+                (unsigned long long)sum.ifs[i].rx_bytes,
+                (unsigned long long)sum.ifs[i].tx_pkts,
+                (unsigned long long)sum.ifs[i].tx_bytes);
+    }
+    for(r = 0; r < SR_DROP_REASONS; r++)
+    {
+        for(p = 0; p < SR_STATS_PROTOS; p++)
+        {
+            if(sum.drops[r][p])
+            {
+                LogInfo("stats: dropped %llu %s, %s\n",
+                        (unsigned long long)sum.drops[r][p],
+                        sr_stats_proto_names[p], sr_drop_reason_names[r]);
+            }
+        }
+    }
+    LogInfo("stats: %llu routes, %llu lookups, %llu missed; "
+            "%llu ARP lookups, %llu missed\n",
+            (unsigned long long)sr->stats->fib_routes,
+            (unsigned long long)sum.counters[sr_cnt_fib_lookups],
+            (unsigned long long)sum.counters[sr_cnt_fib_misses],
+            (unsigned long long)sum.counters[sr_cnt_arp_lookups],
+            (unsigned long long)sum.counters[sr_cnt_arp_misses]);
+    LogInfo("stats: %llu ICMP errors sent, %llu suppressed by the global "
+            "limit, %llu by the per-source limit\n",
+            (unsigned long long)sum.counters[sr_cnt_icmp_errors],
+            (unsigned long long)sum.counters[sr_cnt_icmp_limited_global],
+            (unsigned long long)sum.counters[sr_cnt_icmp_limited_source]);
+    if(sum.counters[sr_cnt_frag_datagrams])
+    {
+        LogInfo("stats: %llu datagrams fragmented into %llu fragments\n",
+                (unsigned long long)sum.counters[sr_cnt_frag_datagrams],
+                (unsigned long long)sum.counters[sr_cnt_frag_fragments]);
+    }
+    for(p = 0; p < SR_LAT_PATHS; p++)
+    {
+        if(sum.lat_sum[p] == 0)
+        { continue; }
+        LogInfo("stats: %s path latency us p50 %.2f p90 %.2f p99 %.2f "
+                "p99.9 %.2f\n", sr_lat_path_names[p],
+                sr_stats_percentile(sum.lat[p], 0.5, sr->stats->tsc_hz) / 1e3,
+                sr_stats_percentile(sum.lat[p], 0.9, sr->stats->tsc_hz) / 1e3,
+                sr_stats_percentile(sum.lat[p], 0.99, sr->stats->tsc_hz) / 1e3,
+                sr_stats_percentile(sum.lat[p], 0.999, sr->stats->tsc_hz) / 1e3);
+    }
+} /* -- sr_stats_close -- */
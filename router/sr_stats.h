@@ -0,0 +1,144 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_stats.h
+ *
+ * Description:
+ *
+ * Forwarding counters: packets and bytes in and out of each interface,
+ * drops by reason and protocol, route and ARP lookups, and forwarding
+ * latency from receipt to send, ARP hits and queued frames apart.  Every
+ * thread that counts claims a slot of its own, cacheline aligned, and is
+ * its only writer, so nothing on the forwarding path takes a lock or a
+ * locked instruction; readers add the slots up.  The last slot is the
+ * exception: any threads beyond the others share it and add to it with
+ * locked instructions.  Latency is timed with the TSC, calibrated at
+ * open.
+ *
+ * The slots live in a mapped segment.  With -K path it is a file (put it
+ * on /dev/shm) that srstat, or anything else, maps read only and reads
+ * while the router runs; without it the segment is anonymous and only
+ * the summary at exit sees it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_STATS_H
+#define SR_STATS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_if.h"
+
+#define SR_STATS_MAGIC    0x53525354  /* "SRST" */
+#define SR_STATS_VERSION  5
+#define SR_STATS_SLOTS    4     /* counting threads: main loop, ARP sweeper,
+                                   room to spare; later ones share the last,
+                                   atomically */
+
+enum sr_drop_reason {
+  sr_drop_truncated = 0,
+  sr_drop_bad_cksum,
+  sr_drop_ttl,
+  sr_drop_no_route,
+  sr_drop_arp_timeout,
+  sr_drop_queue_full,       /* the backend had no room to send */
+  sr_drop_frag_needed,      /* over the MTU with DF set */
+  SR_DROP_REASONS
+};
+
+enum sr_stats_proto {
+  sr_stats_arp = 0,
+  sr_stats_icmp,
+  sr_stats_tcp,
+  sr_stats_udp,
+  sr_stats_other,
+  SR_STATS_PROTOS
+};
+
+enum sr_stats_counter {
+  sr_cnt_fib_lookups = 0,
+  sr_cnt_fib_misses,
+  sr_cnt_arp_lookups,
+  sr_cnt_arp_misses,
+  sr_cnt_icmp_errors,         /* sent */
+  sr_cnt_icmp_limited_global, /* suppressed, see sr_icmp.h */
+  sr_cnt_icmp_limited_source,
+  sr_cnt_frag_datagrams,      /* fragmented on output, see sr_frag.h */
+  sr_cnt_frag_fragments,      /* and the fragments they made */
+  SR_STATS_COUNTERS
+};
+
+/* -- latency: frames whose next hop was in the ARP cache, and frames that
+ *    waited for a reply -- */
+enum sr_lat_path {
+  sr_lat_fast = 0,
+  sr_lat_queued,
+  SR_LAT_PATHS
+};
+
+/* -- log buckets in TSC ticks, HDR style: exact below 16, then 16 per
+ *    power of two (about 6%), up to 2^40 ticks -- */
+#define SR_LAT_SUB_BITS  4
+#define SR_LAT_SUB       (1 << SR_LAT_SUB_BITS)
+#define SR_LAT_MAX_EXP   40
+#define SR_LAT_BUCKETS   ((SR_LAT_MAX_EXP - SR_LAT_SUB_BITS + 2) * SR_LAT_SUB)
+
+struct sr_stats_if
+{
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    uint64_t tx_pkts;
+    uint64_t tx_bytes;
+};
+
+struct sr_stats_slot
+{
+    struct sr_stats_if ifs[SR_MAX_IFACES];
+    uint64_t drops[SR_DROP_REASONS][SR_STATS_PROTOS];
+    uint64_t counters[SR_STATS_COUNTERS];
+    uint64_t lat[SR_LAT_PATHS][SR_LAT_BUCKETS];
+    uint64_t lat_sum[SR_LAT_PATHS];     /* ticks */
+} __attribute__ ((aligned (64)));
+
+/* -- the segment as mapped, by the router and by readers -- */
+struct sr_stats_seg
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t num_ifaces;
+    uint64_t started;           /* time(NULL) at open */
+    uint64_t fib_routes;        /* gauge, set when the table changes */
+    uint64_t tsc_hz;            /* latency ticks per second */
+    char ifname[SR_MAX_IFACES][sr_IFACE_NAMELEN];   /* by ifindex */
+    struct sr_stats_slot slot[SR_STATS_SLOTS];
+};
+
+struct sr_instance;
+
+int  sr_stats_open(struct sr_instance* sr, const char* path);
+void sr_stats_interfaces(struct sr_instance* sr);
+void sr_stats_rx(struct sr_instance* sr, struct sr_if* iface,
+                 unsigned int len);
+void sr_stats_tx(struct sr_instance* sr, struct sr_if* iface,
+                 unsigned int len);
+void sr_stats_drop(struct sr_instance* sr, enum sr_drop_reason reason,
+                   const uint8_t* frame, unsigned int len);
+void sr_stats_count(struct sr_instance* sr, enum sr_stats_counter counter);
+void sr_stats_rx_done(void);
+uint64_t sr_stats_rx_started(void);
+void sr_stats_latency(struct sr_instance* sr, enum sr_lat_path path,
+                      uint64_t start);
+uint64_t sr_stats_tsc(void);
+uint64_t sr_stats_lat_lower(unsigned int idx);
+double sr_stats_percentile(const uint64_t* hist, double q, uint64_t tsc_hz);
+void sr_stats_fib_routes(struct sr_instance* sr);
+void sr_stats_sum(const struct sr_stats_seg* seg, struct sr_stats_slot* sum);
+void sr_stats_close(struct sr_instance* sr);
+
+extern const char* sr_drop_reason_names[SR_DROP_REASONS];
+extern const char* sr_stats_proto_names[SR_STATS_PROTOS];
+extern const char* sr_stats_counter_names[SR_STATS_COUNTERS];
+extern const char* sr_lat_path_names[SR_LAT_PATHS];
+
+#endif /* -- SR_STATS_H -- */
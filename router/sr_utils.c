@@ -19,6 +19,36 @@ uint16_t cksum (const void *_data, int len) {
   return sum ? sum : 0xffff;
 }
 
+/* Unfolded one's complement sum of len bytes added to sum, for checksums
+ * built up in pieces; finish with cksum_fold. */
+uint32_t cksum_add (uint32_t sum, const void *_data, int len) {
+  const uint8_t *data = _data;
+
+  for (;len >= 2; data += 2, len -= 2)
+    sum += data[0] << 8 | data[1];
+  if (len > 0)
+    sum += data[0] << 8;
+  return sum;
+}
+
+/* The checksum field (network byte order) for a sum from cksum_add. */
+uint16_t cksum_fold (uint32_t sum) {
+  while (sum > 0xffff)
+    sum = (sum >> 16) + (sum & 0xffff);
+  sum = htons (~sum);
+  return sum ? sum : 0xffff;
+}
+
+/* Checksum field after one 16-bit word of the data changed from old to
+ * new, all in network byte order (RFC 1624, eqn. 3). */
+uint16_t cksum_update (uint16_t sum, uint16_t old, uint16_t new) {
+  uint32_t s = (uint16_t)~ntohs(sum) + (uint16_t)~ntohs(old) + ntohs(new);
+
+  while (s > 0xffff)
+    s = (s >> 16) + (s & 0xffff);
+  return htons (~s);
+}
+
 
 uint16_t ethertype(uint8_t *buf) {
   sr_ethernet_hdr_t *ehdr = (sr_ethernet_hdr_t *)buf;
@@ -44,6 +74,23 @@ void print_addr_eth(uint8_t *addr) {
   fprintf(stderr, "\n");
 }
 
+/* Parses a formatted Ethernet address, e.g. 00:11:22:33:44:55, into addr;
+ * returns 0 on success */
+int parse_addr_eth(const char *str, uint8_t *addr) {
+  unsigned int b[ETHER_ADDR_LEN];
+  int pos;
+
+  if (sscanf(str, "%x:%x:%x:%x:%x:%x",
+             &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != ETHER_ADDR_LEN)
+    return -1;
+  for (pos = 0; pos < ETHER_ADDR_LEN; pos++) {
+    if (b[pos] > 0xff)
+      return -1;
+    addr[pos] = (uint8_t)b[pos];
+  }
+  return 0;
+}
+
 /* Prints out IP address as a string from in_addr */
 void print_addr_ip(struct in_addr address) {
   char buf[INET_ADDRSTRLEN];
@@ -29,11 +29,15 @@
 #define SR_UTILS_H
 
 uint16_t cksum(const void *_data, int len);
+uint32_t cksum_add(uint32_t sum, const void *_data, int len);
+uint16_t cksum_fold(uint32_t sum);
+uint16_t cksum_update(uint16_t sum, uint16_t old, uint16_t new);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
 
 void print_addr_eth(uint8_t *addr);
+int parse_addr_eth(const char *str, uint8_t *addr);
 void print_addr_ip(struct in_addr address);
 void print_addr_ip_int(uint32_t ip);
 
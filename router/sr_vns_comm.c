@@ -30,6 +30,7 @@
 #include <unistd.h>
 #include <netdb.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -37,18 +38,34 @@
 #include <sys/time.h>
 
 #include "sr_dumper.h"
+#include "sr_io.h"
 #include "sr_router.h"
 #include "sr_if.h"
+#include "sr_rt.h"
 #include "sr_protocol.h"
+#include "sr_log.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
-static void sr_log_packet(struct sr_instance* , uint8_t* , int );
+/* -- blocking transport, once the server takes VNSPACKET_BATCH: what the
+ *    main thread sends while handling one command goes out as one -- */
+struct sr_vns_batch
+{
+    pthread_mutex_t lock;       /* the ARP sweeper writes too */
+    pthread_t main_thread;
+    uint8_t buf[VNS_MAX_COMMAND];
+    unsigned int len;           /* 0 when none is open */
+};
+
+static int  sr_vns_poll(struct sr_instance* sr);
+static int  sr_vns_send(struct sr_instance* sr, uint8_t* buf,
+                        unsigned int len, struct sr_if* iface);
+static void sr_vns_close(struct sr_instance* sr);
 static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   uint8_t * packet /* lent */,
                                   unsigned int len,
-                                  char* interface  /* lent */);
+                                  struct sr_if* iface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
 
 /*-----------------------------------------------------------------------------
@@ -89,6 +106,8 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
     /* purify UMR be gone ! */
     memset((void*)&command,0,sizeof(c_open));
 
+    sr->io = &sr_vns_io;
+
     /* zero out server address struct */
     memset(&(sr->sr_addr),0,sizeof(struct sockaddr_in));
 
@@ -142,6 +161,7 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         command.mLen   = htonl(sizeof(c_open));
         command.mType  = htonl(VNSOPEN);
         command.topoID = htons(sr->topo_id);
+        command.mMaxFrame = htons(sr->max_frame);
         strncpy( command.mVirtualHostID, sr->host,  IDSIZE);
         strncpy( command.mUID, sr->user, IDSIZE);
 
@@ -170,6 +190,8 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
  *
  *
  * Read, from the server, the hardware information for the reserved host.
+ * Interfaces past SR_MAX_IFACES are ignored, and with them the entries
+ * that describe them.
  *
  *---------------------------------------------------------------------------*/
 
@@ -177,6 +199,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 {
     int num_entries;
     int i = 0;
+    unsigned int ignored = 0;
 
     /* REQUIRES */
     assert(sr);
@@ -188,6 +211,13 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 
     for ( i=0; i<num_entries; i++ )
     {
+        /* -- the entries after an ignored interface are about it -- */
+        if(ntohl(hwinfo->mHWInfo[i].mKey) == HWINTERFACE &&
+                sr->num_ifaces >= SR_MAX_IFACES)
+        { ignored++; }
+        if(ignored)
+        { continue; }
+
         switch( ntohl(hwinfo->mHWInfo[i].mKey))
         {
             case HWFIXEDIP:
@@ -209,6 +239,7 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWMASK:
                 /* Debug("Mask: %s\n",inet_ntoa(
                             *((struct in_addr*)(hwinfo->mHWInfo[i].value)))); */
+                sr_set_ether_mask(sr,*((uint32_t*)hwinfo->mHWInfo[i].value));
                 break;
             case HWETHIP:
                 /*Debug("IP: %s\n",inet_ntoa(
@@ -226,8 +257,13 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
         } /* -- switch -- */
     } /* -- for -- */
 
-    printf("Router interfaces:\n");
-    sr_print_if_list(sr);
+    if(ignored)
+    {
+        LogWarn("hwinfo: %u interfaces past the first %u ignored\n",
+                ignored, SR_MAX_IFACES);
+    }
+
+    sr_io_interfaces_ready(sr);
 
     return num_entries;
 } /* -- sr_handle_hwinfo -- */
@@ -318,6 +354,112 @@ int sr_handle_auth_status(struct sr_instance* sr, c_auth_status* status) {
     return status->auth_ok;
 }
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_caps(..)
+ * Scope: Local
+ *
+ * The server speaks VNS_CAPS: keep to its frame size and batch if it
+ * does.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_handle_caps(struct sr_instance* sr, c_caps* caps)
+{
+    struct sr_vns_batch* b;
+    unsigned int max_frame = ntohl(caps->mMaxFrame);
+
+    if(max_frame >= sizeof(struct sr_ethernet_hdr) &&
+            max_frame < sr->max_frame)
+    { sr->max_frame = max_frame; }
+    sr->vns_batch = (ntohl(caps->mFlags) & VNS_CAP_BATCH) != 0;
+    LogInfo("VNS server caps: frames up to %u bytes%s\n", sr->max_frame,
+            sr->vns_batch ? ", batched" : "");
+
+    /* -- the other transports batch in their own send -- */
+    if(sr->vns_batch && sr->io == &sr_vns_io && sr->io_state == 0)
+    {
+        b = (struct sr_vns_batch*)calloc(1, sizeof(struct sr_vns_batch));
+        assert(b);
+        pthread_mutex_init(&b->lock, 0);
+        b->main_thread = pthread_self();
+        __atomic_store_n(&sr->io_state, b, __ATOMIC_RELEASE);
+    }
+} /* -- sr_handle_caps -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_receive(..)
+ * Scope: Local
+ *
+ * One frame out of a VNSPACKET or VNSPACKET_BATCH, name as on the wire.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_receive(struct sr_instance* sr, const char* name,
+                           uint8_t* frame, unsigned int len)
+{
+    struct sr_if* iface;
+    char if_name[sr_IFACE_NAMELEN];
+
+    /* -- resolve the interface name once for the whole packet -- */
+    memset(if_name, 0, sizeof(if_name));
+    memcpy(if_name, name, 16);
+    iface = sr_get_interface(sr, if_name);
+    if ( iface == 0 )
+    {
+        LogWarn("** Error, packet on unknown interface %s\n", if_name);
+        return;
+    }
+    if ( len > sr->max_frame )
+    {
+        LogWarn("** Error, %u byte frame on %s, max is %u (-j)\n",
+                len, if_name, sr->max_frame);
+        return;
+    }
+
+    /* -- check if it is an ARP to another router if so drop   -- */
+    if ( sr_arp_req_not_for_us(sr, frame, len, iface) )
+    { return; }
+
+    sr_io_receive(sr, frame, len, iface);
+} /* -- sr_vns_receive -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_batch_add(..)
+ * Scope: global
+ *
+ * Append a frame to the VNSPACKET_BATCH at batch, len bytes long so far
+ * (0 starts it).  Returns the new length, or 0 if that would be more
+ * than room bytes.
+ *
+ *---------------------------------------------------------------------------*/
+
+unsigned int sr_vns_batch_add(uint8_t* batch, unsigned int len,
+                              unsigned int room, const uint8_t* frame,
+                              unsigned int frame_len, const char* ifname)
+{
+    c_packet_batch* hdr = (c_packet_batch*)batch;
+    c_packet_entry* e;
+    unsigned int start = len ? len : sizeof(c_packet_batch);
+    unsigned int end = start + sizeof(c_packet_entry) + frame_len;
+
+    if(end > room || end > VNS_MAX_COMMAND)
+    { return 0; }
+    if(len == 0)
+    {
+        hdr->mType = htonl(VNSPACKET_BATCH);
+        hdr->mCount = 0;
+    }
+
+    e = (c_packet_entry*)(batch + start);
+    e->mFrameLen = htonl(frame_len);
+    strncpy(e->mInterfaceName, ifname, sizeof(e->mInterfaceName));
+    memcpy(e + 1, frame, frame_len);
+
+    hdr->mLen = htonl(end);
+    hdr->mCount = htonl(ntohl(hdr->mCount) + 1);
+    return end;
+} /* -- sr_vns_batch_add -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_read_from_server(..)
  * Scope: global
@@ -333,9 +475,8 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
 {
-    int command, len;
+    int len;
     unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
     int ret = 0, bytes_read = 0;
 
     /* REQUIRES */
@@ -369,7 +510,7 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
 
     len = ntohl(len);
 
-    if ( len > 10000 || len < 0 )
+    if ( len > VNS_MAX_COMMAND || len < 0 )
     {
         fprintf(stderr,"Error: command length to large %d\n",len);
         close(sr->sockfd);
@@ -406,6 +547,37 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         } while (errno == EINTR); /* be mindful of signals */
     }
 
+    ret = sr_vns_dispatch(sr, buf, len, expected_cmd);
+
+    free(buf);
+    return ret;
+}/* -- sr_read_from_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_dispatch(..)
+ * Scope: global
+ *
+ * Act on one complete command of len bytes, as read off the wire.  buf is
+ * modified in place.  Returns 1 to carry on, 0 if the server closed the
+ * session and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_vns_dispatch(struct sr_instance* sr /* borrowed */,
+                    uint8_t* buf /* lent */, int len, int expected_cmd)
+{
+    int command;
+    c_packet_header* sr_pkt = 0;
+    c_packet_entry* entry;
+    uint8_t* end = buf + len;
+    uint32_t count, frame_len;
+    unsigned int left;
+    int ret;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+
     /* My entry for most unreadable line of code - guido */
     /* ... you win - mc                                  */
     command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
@@ -424,27 +596,43 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         /* -------------        VNSPACKET     -------------------- */
 
         case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
+            sr_pkt = (c_packet_header *)buf;
+            if ( len < sizeof(c_packet_ethernet_header) )
             { break; }
+            sr_vns_receive(sr, sr_pkt->mInterfaceName,
+                    buf + sizeof(c_packet_header),
+                    len - sizeof(c_packet_header));
+            break;
+
+            /* -------------    VNSPACKET_BATCH   -------------------- */
 
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
+        case VNSPACKET_BATCH:
+            if ( len < sizeof(c_packet_batch) )
+            { return -1; }
+            count = ntohl(((c_packet_batch*)buf)->mCount);
+            buf += sizeof(c_packet_batch);
+            for ( ; count > 0; count-- )
+            {
+                entry = (c_packet_entry*)buf;
+                left = end - buf;
+                if ( left < sizeof(c_packet_entry) ||
+                        (frame_len = ntohl(entry->mFrameLen)) >
+                        left - sizeof(c_packet_entry) )
+                {
+                    fprintf(stderr,"Error: truncated packet batch\n");
+                    return -1;
+                }
+                buf += sizeof(c_packet_entry);
+                sr_vns_receive(sr, entry->mInterfaceName, buf, frame_len);
+                buf += frame_len;
+            }
+            break;
 
-            /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+            /* -------------        VNS_CAPS      -------------------- */
 
+        case VNS_CAPS:
+            if ( len >= sizeof(c_caps) )
+            { sr_handle_caps(sr, (c_caps*)buf); }
             break;
 
             /* -------------        VNSCLOSE      -------------------- */
@@ -453,9 +641,6 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"VNS server closed session.\n");
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
-
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -496,86 +681,112 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             break;
 
         default:
-            Debug("unknown command: %d\n", command);
+            LogDebug("unknown command: %d\n", command);
             break;
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
-}/* -- sr_read_from_server -- */
+}/* -- sr_vns_dispatch -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_ether_addrs_match_interface(..)
+ * Method: sr_vns_flush(..)
  * Scope: Local
  *
- * Make sure ethernet addresses are sane so we don't muck uo the system.
+ * Write out the open VNSPACKET_BATCH, if any.
  *
- *----------------------------------------------------------------------------*/
+ *---------------------------------------------------------------------------*/
 
-static int
-sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
-                                uint8_t* buf, /* borrowed */
-                                const char* name /* borrowed */ )
+static int sr_vns_flush(struct sr_instance* sr, struct sr_vns_batch* b)
 {
-    struct sr_ethernet_hdr* ether_hdr = 0;
-    struct sr_if* iface = 0;
-
-    /* -- REQUIRES -- */
-    assert(sr);
-    assert(buf);
-    assert(name);
+    int ret = 0;
 
-    ether_hdr = (struct sr_ethernet_hdr*)buf;
-    iface = sr_get_interface(sr, name);
+    if(b->len == 0)
+    { return 0; }
 
-    if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
-        return 0;
+    pthread_mutex_lock(&b->lock);
+    if(sr->sockfd < 0 || write(sr->sockfd, b->buf, b->len) < b->len)
+    {
+        LogError("Error writing packet batch\n");
+        ret = -1;
     }
+    pthread_mutex_unlock(&b->lock);
+    b->len = 0;
+    return ret;
+} /* -- sr_vns_flush -- */
 
-    if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
-        fprintf( stderr, "** Error, source address does not match interface\n");
-        return 0;
-    }
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_poll(..)
+ * Scope: Local
+ *
+ * Replies to the last command go out before we block for the next, or
+ * in busy-poll mode look for it.
+ *
+ *---------------------------------------------------------------------------*/
 
-    /* TODO */
-    /* Check destination, hardware address.  If it is private (i.e. destined
-     * to a virtual interface) ensure it is going to the correct topology
-     * Note: This check should really be done server side ...
-     */
+static int sr_vns_poll(struct sr_instance* sr)
+{
+    uint8_t c;
+    int n;
 
-    return 1;
+    if(sr->io_state)
+    { sr_vns_flush(sr, (struct sr_vns_batch*)sr->io_state); }
 
-} /* -- sr_ether_addrs_match_interface -- */
+    /* -- busy polling: only read once a command has started arriving -- */
+    if(sr->busy)
+    {
+        n = recv(sr->sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                    errno == EINTR))
+        { return 1; }
+        if(n == 0)
+        {
+            fprintf(stderr,"VNS server closed the connection\n");
+            return 0;
+        }
+    }
+    return sr_read_from_server(sr);
+} /* -- sr_vns_poll -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_send_packet(..)
- * Scope: Global
+ * Method: sr_vns_send(..)
+ * Scope: Local
  *
- * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * Wrap the frame in a VNSPACKET and write it to the server, or, from the
+ * main thread once the server takes them, add it to the batch.
  *
  *---------------------------------------------------------------------------*/
 
-int sr_send_packet(struct sr_instance* sr /* borrowed */,
-                         uint8_t* buf /* borrowed */ ,
-                         unsigned int len,
-                         const char* iface /* borrowed */)
+static int sr_vns_send(struct sr_instance* sr /* borrowed */,
+                       uint8_t* buf /* borrowed */ ,
+                       unsigned int len,
+                       struct sr_if* iface /* borrowed */)
 {
     c_packet_header *sr_pkt;
     unsigned int total_len =  len + (sizeof(c_packet_header));
+    struct sr_vns_batch* b;
+    unsigned int blen;
+    int ret = 0;
 
     /* REQUIRES */
     assert(sr);
     assert(buf);
     assert(iface);
 
-    /* don't waste my time ... */
-    if ( len < sizeof(struct sr_ethernet_hdr) ){
-        fprintf(stderr , "** Error: packet is wayy to short \n");
-        return -1;
+    b = (struct sr_vns_batch*)__atomic_load_n(&sr->io_state, __ATOMIC_ACQUIRE);
+    if(b && pthread_equal(pthread_self(), b->main_thread))
+    {
+        blen = sr_vns_batch_add(b->buf, b->len, sizeof(b->buf), buf, len,
+                iface->name);
+        if(blen == 0)
+        {
+            if(sr_vns_flush(sr, b) != 0)
+            { return -1; }
+            blen = sr_vns_batch_add(b->buf, 0, sizeof(b->buf), buf, len,
+                    iface->name);
+        }
+        b->len = blen;
+        return blen ? 0 : -1;
     }
 
     /* Create packet */
@@ -584,56 +795,51 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
     assert(sr_pkt);
     sr_pkt->mLen  = htonl(total_len);
     sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
+    strncpy(sr_pkt->mInterfaceName,iface->name,16);
     memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
             buf,len);
 
-    /* -- log packet -- */
-    sr_log_packet(sr,buf,len);
-
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
-        return -1;
-    }
-
+    if(b)
+    { pthread_mutex_lock(&b->lock); }
     if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
-        return -1;
+        LogError("Error writing packet\n");
+        ret = -1;
     }
+    if(b)
+    { pthread_mutex_unlock(&b->lock); }
 
     free(sr_pkt);
 
-    return 0;
-} /* -- sr_send_packet -- */
+    return ret;
+} /* -- sr_vns_send -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_log_packet()
+ * Method: sr_vns_close(..)
  * Scope: Local
  *
  *---------------------------------------------------------------------------*/
 
-void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
+static void sr_vns_close(struct sr_instance* sr)
 {
-    struct pcap_pkthdr h;
-    int size;
-
     /* REQUIRES */
     assert(sr);
 
-    if(!sr->logfile)
-    {return; }
-
-    size = min(PACKET_DUMP_SIZE, len);
+    if(sr->io_state)
+    { sr_vns_flush(sr, (struct sr_vns_batch*)sr->io_state); }
 
-    gettimeofday(&h.ts, 0);
-    h.caplen = size;
-    h.len = (size < PACKET_DUMP_SIZE) ? size : PACKET_DUMP_SIZE;
+    if(sr->sockfd >= 0)
+    { close(sr->sockfd); }
+    sr->sockfd = -1;
+} /* -- sr_vns_close -- */
 
-    sr_dump(sr->logfile, &h, buf);
-    fflush(sr->logfile);
-} /* -- sr_log_packet -- */
+const struct sr_io_ops sr_vns_io =
+{
+    "vns",
+    sr_vns_poll,
+    sr_vns_send,
+    sr_vns_close,
+    0           /* no sendv: sr_io gathers */
+};
 
 /*-----------------------------------------------------------------------------
  * Method: sr_arp_req_not_for_us()
@@ -644,9 +850,8 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
 int  sr_arp_req_not_for_us(struct sr_instance* sr,
                            uint8_t * packet /* lent */,
                            unsigned int len,
-                           char* interface  /* lent */)
+                           struct sr_if* iface  /* lent */)
 {
-    struct sr_if* iface = sr_get_interface(sr, interface);
     struct sr_ethernet_hdr* e_hdr = 0;
     struct sr_arp_hdr*       a_hdr = 0;
 
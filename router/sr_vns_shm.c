@@ -0,0 +1,271 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_shm.c
+ *
+ * Description:
+ *
+ * VNS session over shared memory rings, see sr_vns_shm.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "sr_vns_shm.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+
+#include "vnscommand.h"
+
+static int  sr_vns_shm_poll(struct sr_instance* sr);
+static int  sr_vns_shm_send(struct sr_instance* sr, uint8_t* buf,
+                            unsigned int len, struct sr_if* iface);
+static void sr_vns_shm_close(struct sr_instance* sr);
+
+static const struct sr_io_ops sr_vns_shm_io =
+{
+    "vns-shm",
+    sr_vns_shm_poll,
+    sr_vns_shm_send,
+    sr_vns_shm_close,
+    0           /* no sendv: sr_io gathers */
+};
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_put(..)
+ *
+ * Write a message, header and body, to the source's ring.  Returns 0 on
+ * success, -1 if the ring is full or the session closed.  A doorbell due
+ * from the main thread is left for the end of the poll pass.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_shm_put(struct sr_vns_shm* s, const void* hdr,
+                          unsigned int hdr_len, const void* body,
+                          unsigned int body_len)
+{
+    struct sr_shm_ring* ring = &s->shm.rings[SR_SHM_TO_SOURCE];
+    uint8_t* p;
+    uint32_t total;
+    int bell;
+
+    pthread_mutex_lock(&s->tx_lock);
+    if(s->closed ||
+            (p = sr_shm_reserve(ring, hdr_len + body_len, &total)) == 0)
+    {
+        s->tx_full += !s->closed;
+        pthread_mutex_unlock(&s->tx_lock);
+        return -1;
+    }
+    memcpy(p, hdr, hdr_len);
+    if(body_len)
+    { memcpy(p + hdr_len, body, body_len); }
+    bell = sr_shm_commit(ring, total);
+    if(bell && pthread_equal(pthread_self(), s->main_thread))
+    {
+        s->bell_due = 1;
+        bell = 0;
+    }
+    s->bells_out += bell;
+
+    /* -- under the lock: once closed, the bell fds may already be gone -- */
+    if(bell)
+    { sr_shm_ring_bell(s->shm.bell[SR_SHM_TO_SOURCE]); }
+    pthread_mutex_unlock(&s->tx_lock);
+    return 0;
+} /* -- sr_vns_shm_put -- */
+
+static void sr_vns_shm_kick(struct sr_vns_shm* s)
+{
+    int bell;
+
+    pthread_mutex_lock(&s->tx_lock);
+    bell = s->bell_due && !s->closed;
+    s->bell_due = 0;
+    s->bells_out += bell;
+    if(bell)
+    { sr_shm_ring_bell(s->shm.bell[SR_SHM_TO_SOURCE]); }
+    pthread_mutex_unlock(&s->tx_lock);
+} /* -- sr_vns_shm_kick -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_connect(..)
+ *
+ * Take the segment from the source listening on path and ask it for the
+ * topology, as sr_connect_to_server(..) does.  The hardware info arrives
+ * through the main loop.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_vns_shm_connect(struct sr_instance* sr, const char* path)
+{
+    struct sockaddr_un addr;
+    struct sr_vns_shm* s;
+    c_open command;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if((sr->sockfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    { perror("socket(AF_UNIX)"); return -1; }
+    if(connect(sr->sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror(path);
+        close(sr->sockfd);
+        sr->sockfd = -1;
+        return -1;
+    }
+
+    s = (struct sr_vns_shm*)calloc(1, sizeof(struct sr_vns_shm));
+    assert(s);
+    pthread_mutex_init(&s->tx_lock, 0);
+    s->main_thread = pthread_self();
+    if(sr_shm_recv(sr->sockfd, &s->shm) != 0)
+    {
+        free(s);
+        close(sr->sockfd);
+        sr->sockfd = -1;
+        return -1;
+    }
+
+    sr->io = &sr_vns_shm_io;
+    sr->io_state = s;
+
+    memset(&command, 0, sizeof(command));
+    command.mLen   = htonl(sizeof(c_open));
+    command.mType  = htonl(VNSOPEN);
+    command.topoID = htons(sr->topo_id);
+    command.mMaxFrame = htons(sr->max_frame);
+    strncpy(command.mVirtualHostID, sr->host, IDSIZE);
+    strncpy(command.mUID, sr->user, IDSIZE);
+
+    return sr_vns_shm_put(s, &command, sizeof(command), 0, 0);
+} /* -- sr_vns_shm_connect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_poll(..)
+ *
+ * Dispatch what is in the ring and ring the source's doorbell once for
+ * all the replies; with nothing there, sleep on our doorbell until the
+ * source rings it or hangs up.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_shm_poll(struct sr_instance* sr)
+{
+    struct sr_vns_shm* s = (struct sr_vns_shm*)sr->io_state;
+    struct sr_shm_ring* ring = &s->shm.rings[SR_SHM_TO_ROUTER];
+    struct pollfd pfd[2];
+    uint8_t* msg;
+    uint32_t len;
+    int n = 0, r = 0, ret = 1;
+
+    while(n < SR_SHM_BATCH && (r = sr_shm_peek(ring, &msg, &len)) == 1)
+    {
+        ret = sr_vns_dispatch(sr, msg, len, 0);
+        sr_shm_release(ring, len);
+        s->msgs_in++;
+        n++;
+        if(ret != 1)
+        { break; }
+    }
+    sr_vns_shm_kick(s);
+    if(n > 0 && ret != 1)
+    { return ret; }
+    if(n < SR_SHM_BATCH && r < 0)
+    { return -1; }
+
+    if(n == 0 && sr_shm_empty(ring))
+    {
+        /* -- busy polling: spin on the ring, look for a hangup now and
+         *    then -- */
+        if(sr->busy && (++s->idle & SR_SHM_IDLE_MASK))
+        { return 1; }
+
+        pfd[0].fd = s->shm.bell[SR_SHM_TO_ROUTER];
+        pfd[0].events = POLLIN;
+        pfd[1].fd = sr->sockfd;
+        pfd[1].events = POLLIN;
+        if(poll(pfd, 2, sr->busy ? 0 : -1) < 0 && errno != EINTR)
+        { perror("poll"); return -1; }
+
+        /* -- the source never writes to the socket after the handover -- */
+        if(pfd[1].revents)
+        {
+            fprintf(stderr,"Packet source closed the session.\n");
+            return 0;
+        }
+        if(pfd[0].revents & POLLIN)
+        {
+            sr_shm_clear_bell(s->shm.bell[SR_SHM_TO_ROUTER]);
+            s->wakeups++;
+        }
+    }
+    return 1;
+} /* -- sr_vns_shm_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_send(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_shm_send(struct sr_instance* sr, uint8_t* buf,
+                           unsigned int len, struct sr_if* iface)
+{
+    struct sr_vns_shm* s = (struct sr_vns_shm*)sr->io_state;
+    c_packet_header hdr;
+
+    hdr.mLen  = htonl(sizeof(hdr) + len);
+    hdr.mType = htonl(VNSPACKET);
+    strncpy(hdr.mInterfaceName, iface->name, sizeof(hdr.mInterfaceName));
+
+    if(sr_vns_shm_put(s, &hdr, sizeof(hdr), buf, len) != 0)
+    { return -1; }
+    __atomic_fetch_add(&s->pkts_out, 1, __ATOMIC_RELAXED);
+    return 0;
+} /* -- sr_vns_shm_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_shm_close(..)
+ *
+ * Unmap the segment.  The state stays, so a late send from the ARP
+ * sweeper finds the session closed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_shm_close(struct sr_instance* sr)
+{
+    struct sr_vns_shm* s = (struct sr_vns_shm*)sr->io_state;
+
+    pthread_mutex_lock(&s->tx_lock);
+    s->closed = 1;
+    pthread_mutex_unlock(&s->tx_lock);
+
+    LogInfo("vns-shm: %llu messages in, %llu doorbell wakeups; "
+            "%llu packets out, %llu doorbells rung, %llu ring full\n",
+            (unsigned long long)s->msgs_in, (unsigned long long)s->wakeups,
+            (unsigned long long)s->pkts_out,
+            (unsigned long long)s->bells_out,
+            (unsigned long long)s->tx_full);
+
+    sr_shm_destroy(&s->shm);
+    if(sr->sockfd >= 0)
+    { close(sr->sockfd); }
+    sr->sockfd = -1;
+} /* -- sr_vns_shm_close -- */
@@ -0,0 +1,49 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_shm.h
+ *
+ * Description:
+ *
+ * VNS over shared memory rings (-M socket path) for a packet source on
+ * the same host.  The source hands over the segment (sr_shm.h) on a unix
+ * socket; from then on the VNS messages, VNSOPEN, VNSHWINFO and
+ * VNSPACKET alike, travel through the rings with no auth exchange, and
+ * incoming messages are dispatched in place.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_VNS_SHM_H
+#define SR_VNS_SHM_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_shm.h"
+
+#define SR_SHM_BATCH      256   /* messages per poll pass */
+#define SR_SHM_IDLE_MASK  1023  /* busy polling: empty passes per hangup
+                                   check, less one */
+
+struct sr_instance;
+
+struct sr_vns_shm
+{
+    struct sr_shm shm;
+    pthread_mutex_t tx_lock;    /* the ARP sweeper sends too */
+    int closed;
+    pthread_t main_thread;      /* its doorbells wait for the poll pass */
+    int bell_due;
+    unsigned int idle;          /* empty passes, busy polling */
+
+    uint64_t msgs_in;
+    uint64_t wakeups;           /* doorbells we slept on */
+    uint64_t pkts_out;
+    uint64_t bells_out;
+    uint64_t tx_full;
+};
+
+int sr_vns_shm_connect(struct sr_instance* sr, const char* path);
+
+#endif /* -- SR_VNS_SHM_H -- */
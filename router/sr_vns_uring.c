@@ -0,0 +1,638 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_uring.c
+ *
+ * Description:
+ *
+ * io_uring VNS transport, on raw syscalls (no liburing).  Only the main
+ * thread touches the rings (IORING_SETUP_SINGLE_ISSUER); the ARP sweeper
+ * appends to the TX batch under tx_lock and pokes an eventfd the ring
+ * keeps a read armed on, so the main thread wakes up and sends it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+#include "sr_vns_uring.h"
+#include "sr_io.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_log.h"
+
+#include "vnscommand.h"
+
+#define SR_URING_BGID     1
+
+/* -- user_data of each kind of request -- */
+#define SR_URING_RECV     1
+#define SR_URING_SEND     2
+#define SR_URING_WAKE     3
+
+static int  sr_vns_uring_poll(struct sr_instance* sr);
+static int  sr_vns_uring_send(struct sr_instance* sr, uint8_t* buf,
+                              unsigned int len, struct sr_if* iface);
+static void sr_vns_uring_close(struct sr_instance* sr);
+
+static const struct sr_io_ops sr_vns_uring_io =
+{
+    "vns-uring",
+    sr_vns_uring_poll,
+    sr_vns_uring_send,
+    sr_vns_uring_close,
+    0           /* no sendv: sr_io gathers */
+};
+
+static int sr_uring_enter(int fd, unsigned int to_submit,
+                          unsigned int min_complete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+            0, 0);
+} /* -- sr_uring_enter -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_get_sqe(..)
+ *
+ * Next free SQE, cleared and queued for the next io_uring_enter.  At most
+ * three requests are ever outstanding, so the SQ never fills.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct io_uring_sqe* sr_uring_get_sqe(struct sr_vns_uring* u,
+                                             uint64_t user_data)
+{
+    struct io_uring_sqe* sqe;
+    uint32_t tail = *u->sq_tail;
+
+    if(tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    { return 0; }
+
+    sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+} /* -- sr_uring_get_sqe -- */
+
+static void sr_uring_arm_recv(struct sr_instance* sr, struct sr_vns_uring* u)
+{
+    struct io_uring_sqe* sqe;
+
+    if((sqe = sr_uring_get_sqe(u, SR_URING_RECV)) == 0)
+    { return; }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sr->sockfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SR_URING_BGID;
+    u->recv_armed = 1;
+} /* -- sr_uring_arm_recv -- */
+
+static void sr_uring_arm_wake(struct sr_vns_uring* u)
+{
+    struct io_uring_sqe* sqe;
+
+    if((sqe = sr_uring_get_sqe(u, SR_URING_WAKE)) == 0)
+    { return; }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = u->efd;
+    sqe->addr = (uint64_t)(unsigned long)&u->efd_val;
+    sqe->len = sizeof(u->efd_val);
+    u->wake_armed = 1;
+} /* -- sr_uring_arm_wake -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_recycle(..)
+ *
+ * Give receive buffer bid back to the kernel.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_uring_recycle(struct sr_vns_uring* u, uint16_t bid)
+{
+    struct io_uring_buf* b;
+    uint16_t tail = u->br->tail;
+
+    b = &u->br->bufs[tail & (SR_URING_NBUFS - 1)];
+    b->addr = (uint64_t)(unsigned long)(u->bufs + (size_t)bid * SR_URING_BUFSZ);
+    b->len = SR_URING_BUFSZ;
+    b->bid = bid;
+    __atomic_store_n(&u->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+} /* -- sr_uring_recycle -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_flush_tx(..)
+ *
+ * If no send is in flight, make the filled batch the one being sent.
+ * Queue a send for whatever of it has not gone out yet.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_uring_flush_tx(struct sr_instance* sr, struct sr_vns_uring* u)
+{
+    struct io_uring_sqe* sqe;
+
+    pthread_mutex_lock(&u->tx_lock);
+    if(u->busy_len == 0 && u->fill_len)
+    {
+        u->busy_len = u->fill_len;
+        u->busy_off = 0;
+        u->busy_queued = 0;
+        u->fill ^= 1;
+        u->fill_len = 0;
+        u->batch_len = 0;
+    }
+    if(u->busy_len && !u->busy_queued &&
+            (sqe = sr_uring_get_sqe(u, SR_URING_SEND)) != 0)
+    {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = sr->sockfd;
+        sqe->addr = (uint64_t)(unsigned long)
+            (u->txbuf[u->fill ^ 1] + u->busy_off);
+        sqe->len = u->busy_len - u->busy_off;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        u->busy_queued = 1;
+        u->sends++;
+    }
+    pthread_mutex_unlock(&u->tx_lock);
+} /* -- sr_uring_flush_tx -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_parse(..)
+ *
+ * Dispatch every command in n received bytes.  Whole commands are handled
+ * in the receive buffer; one cut by the buffer's end is gathered in
+ * u->cmd.  Returns as sr_vns_dispatch(..).
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_uring_parse(struct sr_instance* sr, struct sr_vns_uring* u,
+                          uint8_t* p, unsigned int n)
+{
+    uint32_t len;
+    unsigned int take;
+    int ret = 1;
+
+    while(n > 0 && ret == 1)
+    {
+        if(u->cmd_len == 0 && n >= 4)
+        {
+            memcpy(&len, p, 4);
+            len = ntohl(len);
+            if(len < 8 || len > SR_URING_MAXCMD)
+            {
+                fprintf(stderr,"Error: bad command length %u\n",len);
+                return -1;
+            }
+            if(len <= n)
+            {
+                ret = sr_vns_dispatch(sr, p, len, 0);
+                u->cmds++;
+                p += len;
+                n -= len;
+                continue;
+            }
+        }
+
+        /* -- gather: the length first, then the rest of the command -- */
+        if(u->cmd_len < 4)
+        {
+            take = 4 - u->cmd_len < n ? 4 - u->cmd_len : n;
+            memcpy(u->cmd + u->cmd_len, p, take);
+            u->cmd_len += take;
+            p += take;
+            n -= take;
+            if(u->cmd_len < 4)
+            { break; }
+        }
+
+        memcpy(&len, u->cmd, 4);
+        len = ntohl(len);
+        if(len < 8 || len > SR_URING_MAXCMD)
+        {
+            fprintf(stderr,"Error: bad command length %u\n",len);
+            return -1;
+        }
+        take = len - u->cmd_len < n ? len - u->cmd_len : n;
+        memcpy(u->cmd + u->cmd_len, p, take);
+        u->cmd_len += take;
+        p += take;
+        n -= take;
+        if(u->cmd_len == len)
+        {
+            u->cmd_len = 0;
+            ret = sr_vns_dispatch(sr, u->cmd, len, 0);
+            u->cmds++;
+        }
+    }
+    return ret;
+} /* -- sr_uring_parse -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_reap(..)
+ *
+ * Take every CQE off the ring.  Send and wake completions are handled
+ * here; receives are queued on u->rxq for sr_uring_receive(..), so that
+ * reaping from inside a send never re-enters the parser.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_uring_reap(struct sr_vns_uring* u)
+{
+    struct io_uring_cqe* cqe;
+    uint32_t head, tail;
+    unsigned int slot;
+
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++)
+    {
+        cqe = &u->cqes[head & u->cq_mask];
+        switch(cqe->user_data)
+        {
+            case SR_URING_RECV:
+                if(!(cqe->flags & IORING_CQE_F_MORE))
+                { u->recv_armed = 0; }
+                /* -- out of buffers: re-armed once they are back -- */
+                if(cqe->res == -ENOBUFS || cqe->res == -EINTR)
+                { break; }
+                assert(u->rxq_tail - u->rxq_head < SR_URING_RXQ);
+                slot = u->rxq_tail++ & (SR_URING_RXQ - 1);
+                u->rxq[slot].res = cqe->res;
+                u->rxq[slot].bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                break;
+
+            case SR_URING_SEND:
+                pthread_mutex_lock(&u->tx_lock);
+                u->busy_queued = 0;
+                if(cqe->res < 0 && cqe->res != -EINTR && cqe->res != -EAGAIN)
+                {
+                    LogError("Error writing packet: %s\n",
+                             strerror(-cqe->res));
+                    u->tx_error = 1;
+                }
+                else if(cqe->res > 0)
+                {
+                    u->busy_off += cqe->res;
+                    if(u->busy_off == u->busy_len)
+                    { u->busy_len = 0; }
+                }
+                pthread_mutex_unlock(&u->tx_lock);
+                break;
+
+            case SR_URING_WAKE:
+                u->wake_armed = 0;
+                break;
+        }
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+} /* -- sr_uring_reap -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_receive(..)
+ *
+ * Handle one queued receive.  Returns 1 to carry on, 0 when the session
+ * is over and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_uring_receive(struct sr_instance* sr, struct sr_vns_uring* u,
+                            int res, uint16_t bid)
+{
+    int ret;
+
+    if(res == 0)
+    {
+        fprintf(stderr,"VNS server closed the connection\n");
+        return 0;
+    }
+    if(res < 0)
+    {
+        fprintf(stderr,"recv(..):sr_vns_uring: %s\n", strerror(-res));
+        return -1;
+    }
+    u->recvs++;
+    ret = sr_uring_parse(sr, u, u->bufs + (size_t)bid * SR_URING_BUFSZ, res);
+    sr_uring_recycle(u, bid);
+    return ret;
+} /* -- sr_uring_receive -- */
+
+static int sr_uring_submit(struct sr_vns_uring* u, unsigned int min_complete)
+{
+    u->enters++;
+    if(sr_uring_enter(u->fd,
+                *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE),
+                min_complete, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+    { perror("io_uring_enter"); return -1; }
+    return 0;
+} /* -- sr_uring_submit -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_uring_wait_tx(..)
+ *
+ * On the main thread, when the batch being filled has no room for len
+ * more bytes: send batches until it has.  Returns 0 then, -1 if the
+ * session failed or closed meanwhile.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_uring_wait_tx(struct sr_instance* sr, struct sr_vns_uring* u,
+                            unsigned int len)
+{
+    int room;
+
+    u->tx_waits++;
+    for(;;)
+    {
+        sr_uring_flush_tx(sr, u);
+        pthread_mutex_lock(&u->tx_lock);
+        room = u->closed || u->tx_error ? -1 : u->fill_len + len <= u->txcap;
+        pthread_mutex_unlock(&u->tx_lock);
+        if(room)
+        { return room > 0 ? 0 : -1; }
+        if(sr_uring_submit(u, 1) < 0)
+        { return -1; }
+        sr_uring_reap(u);
+    }
+} /* -- sr_uring_wait_tx -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_uring_poll(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_uring_poll(struct sr_instance* sr)
+{
+    struct sr_vns_uring* u = (struct sr_vns_uring*)sr->io_state;
+    unsigned int slot;
+    int ret = 1;
+
+    sr_uring_flush_tx(sr, u);
+    if(!u->recv_armed && u->rxq_head == u->rxq_tail)
+    { sr_uring_arm_recv(sr, u); }
+    if(!u->wake_armed)
+    { sr_uring_arm_wake(u); }
+
+    /* -- submit everything the kernel has not consumed, then wait,
+     *    unless busy polling -- */
+    if(sr_uring_submit(u, sr->busy ? 0 : 1) < 0)
+    { return -1; }
+    sr_uring_reap(u);
+
+    /* -- a send from the parser may reap, and queue, more -- */
+    while(ret == 1 && u->rxq_head != u->rxq_tail)
+    {
+        slot = u->rxq_head++ & (SR_URING_RXQ - 1);
+        ret = sr_uring_receive(sr, u, u->rxq[slot].res, u->rxq[slot].bid);
+    }
+    return u->tx_error ? -1 : ret;
+} /* -- sr_vns_uring_poll -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_uring_send(..)
+ *
+ * Append a VNSPACKET to the batch being filled, or the frame to the
+ * VNSPACKET_BATCH open in it if the server takes those.  On the main
+ * thread a full batch is waited out; elsewhere the frame is dropped.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_uring_send(struct sr_instance* sr, uint8_t* buf,
+                             unsigned int len, struct sr_if* iface)
+{
+    struct sr_vns_uring* u = (struct sr_vns_uring*)sr->io_state;
+    c_packet_header* sr_pkt;
+    unsigned int total_len = len + sizeof(c_packet_header), blen = 0;
+    uint64_t one = 1;
+    int main_thread = pthread_equal(pthread_self(), u->main_thread);
+
+    pthread_mutex_lock(&u->tx_lock);
+    while(main_thread && !u->closed && u->fill_len + total_len > u->txcap)
+    {
+        pthread_mutex_unlock(&u->tx_lock);
+        if(sr_uring_wait_tx(sr, u, total_len) < 0)
+        {
+            pthread_mutex_lock(&u->tx_lock);
+            break;
+        }
+        pthread_mutex_lock(&u->tx_lock);
+    }
+
+    if(sr->vns_batch && !u->closed)
+    {
+        if(u->batch_len == 0)
+        { u->batch_off = u->fill_len; }
+        blen = sr_vns_batch_add(u->txbuf[u->fill] + u->batch_off,
+                u->batch_len, u->txcap - u->batch_off, buf, len,
+                iface->name);
+        if(blen == 0 && u->batch_len)
+        {
+            u->batch_off = u->fill_len;
+            blen = sr_vns_batch_add(u->txbuf[u->fill] + u->batch_off, 0,
+                    u->txcap - u->batch_off, buf, len, iface->name);
+        }
+    }
+
+    if(blen)
+    {
+        u->batch_len = blen;
+        u->fill_len = u->batch_off + blen;
+    }
+    else if(u->closed || u->fill_len + total_len > u->txcap)
+    {
+        u->tx_full += !u->closed;
+        pthread_mutex_unlock(&u->tx_lock);
+        return -1;
+    }
+    else
+    {
+        sr_pkt = (c_packet_header*)(u->txbuf[u->fill] + u->fill_len);
+        sr_pkt->mLen  = htonl(total_len);
+        sr_pkt->mType = htonl(VNSPACKET);
+        strncpy(sr_pkt->mInterfaceName,iface->name,16);
+        memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header), buf, len);
+        u->fill_len += total_len;
+        u->batch_len = 0;
+    }
+    u->pkts_out++;
+
+    /* -- under the lock: once closed, efd may already be gone -- */
+    if(!main_thread && write(u->efd, &one, sizeof(one)) < 0)
+    { LogWarn("eventfd: %s\n", strerror(errno)); }
+    pthread_mutex_unlock(&u->tx_lock);
+
+    return 0;
+} /* -- sr_vns_uring_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_uring_free(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_uring_free(struct sr_vns_uring* u)
+{
+    if(u->fd >= 0)
+    { close(u->fd); }
+    if(u->ring_map)
+    { munmap(u->ring_map, u->ring_map_len); }
+    if(u->sqes)
+    { munmap(u->sqes, u->sqes_len); }
+    if(u->br)
+    { munmap(u->br, u->br_len); }
+    if(u->efd >= 0)
+    { close(u->efd); }
+    u->fd = u->efd = -1;
+    u->ring_map = 0;
+    u->sqes = 0;
+    u->br = 0;
+    free(u->bufs);
+    u->bufs = 0;
+} /* -- sr_vns_uring_free -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_uring_open(..)
+ *
+ * Move a connected VNS session onto io_uring.  Returns 0 on success; on
+ * failure the blocking transport stays installed.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_vns_uring_open(struct sr_instance* sr)
+{
+    struct sr_vns_uring* u;
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    size_t sq_len, cq_len;
+    unsigned int i;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->io == &sr_vns_io);
+
+    u = (struct sr_vns_uring*)calloc(1, sizeof(struct sr_vns_uring));
+    assert(u);
+    u->efd = -1;
+    u->main_thread = pthread_self();
+    pthread_mutex_init(&u->tx_lock, 0);
+
+    /* -- defer completion work to our io_uring_enter where supported -- */
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    u->fd = syscall(__NR_io_uring_setup, SR_URING_ENTRIES, &p);
+    if(u->fd < 0 && errno == EINVAL)
+    {
+        memset(&p, 0, sizeof(p));
+        u->fd = syscall(__NR_io_uring_setup, SR_URING_ENTRIES, &p);
+    }
+    if(u->fd < 0)
+    { perror("io_uring_setup"); goto fail; }
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP))
+    { fprintf(stderr,"io_uring: kernel too old\n"); goto fail; }
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_map_len = sq_len > cq_len ? sq_len : cq_len;
+    u->ring_map = (uint8_t*)mmap(0, u->ring_map_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->ring_map == MAP_FAILED)
+    { u->ring_map = 0; perror("mmap(io_uring)"); goto fail; }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe*)mmap(0, u->sqes_len,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+            IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED)
+    { u->sqes = 0; perror("mmap(io_uring sqes)"); goto fail; }
+
+    u->sq_head = (uint32_t*)(u->ring_map + p.sq_off.head);
+    u->sq_tail = (uint32_t*)(u->ring_map + p.sq_off.tail);
+    u->sq_array = (uint32_t*)(u->ring_map + p.sq_off.array);
+    u->sq_mask = *(uint32_t*)(u->ring_map + p.sq_off.ring_mask);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (uint32_t*)(u->ring_map + p.cq_off.head);
+    u->cq_tail = (uint32_t*)(u->ring_map + p.cq_off.tail);
+    u->cq_mask = *(uint32_t*)(u->ring_map + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)(u->ring_map + p.cq_off.cqes);
+
+    /* -- provided buffer ring for the multishot recv -- */
+    u->br_len = SR_URING_NBUFS * sizeof(struct io_uring_buf);
+    u->br = (struct io_uring_buf_ring*)mmap(0, u->br_len,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(u->br == MAP_FAILED)
+    { u->br = 0; perror("mmap(buffer ring)"); goto fail; }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(unsigned long)u->br;
+    reg.ring_entries = SR_URING_NBUFS;
+    reg.bgid = SR_URING_BGID;
+    if(syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0)
+    { perror("IORING_REGISTER_PBUF_RING"); goto fail; }
+
+    u->bufs = (uint8_t*)malloc((size_t)SR_URING_NBUFS * SR_URING_BUFSZ);
+    assert(u->bufs);
+    for(i = 0; i < SR_URING_NBUFS; i++)
+    { sr_uring_recycle(u, i); }
+
+    if((u->efd = eventfd(0, EFD_CLOEXEC)) < 0)
+    { perror("eventfd"); goto fail; }
+
+    /* -- room for SR_URING_TXFRAMES of the largest frame, jumbo too -- */
+    u->txcap = SR_URING_TXFRAMES * (sr->max_frame + sizeof(c_packet_header));
+    if(u->txcap < SR_URING_TXBUF)
+    { u->txcap = SR_URING_TXBUF; }
+    u->txbuf[0] = (uint8_t*)malloc(u->txcap);
+    u->txbuf[1] = (uint8_t*)malloc(u->txcap);
+    assert(u->txbuf[0] && u->txbuf[1]);
+
+    sr->io = &sr_vns_uring_io;
+    sr->io_state = u;
+    LogInfo("VNS transport: io_uring, %u byte send batches\n", u->txcap);
+    return 0;
+
+fail:
+    sr_vns_uring_free(u);
+    free(u);
+    return -1;
+} /* -- sr_vns_uring_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_uring_close(..)
+ *
+ * Tear the rings down.  The state itself stays, so a late send from the
+ * ARP sweeper finds it closed.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_uring_close(struct sr_instance* sr)
+{
+    struct sr_vns_uring* u = (struct sr_vns_uring*)sr->io_state;
+
+    pthread_mutex_lock(&u->tx_lock);
+    u->closed = 1;
+    pthread_mutex_unlock(&u->tx_lock);
+
+    LogInfo("vns-uring: %llu commands in %llu receives, %llu packets out "
+            "in %llu sends, %llu waits for room, %llu dropped; %llu "
+            "io_uring_enter calls, %.3f per packet\n",
+            (unsigned long long)u->cmds, (unsigned long long)u->recvs,
+            (unsigned long long)u->pkts_out, (unsigned long long)u->sends,
+            (unsigned long long)u->tx_waits, (unsigned long long)u->tx_full, (unsigned long long)u->enters,
+            u->cmds + u->pkts_out ?
+            (double)u->enters / (u->cmds + u->pkts_out) : 0.0);
+
+    sr_vns_uring_free(u);
+    if(sr->sockfd >= 0)
+    { close(sr->sockfd); }
+    sr->sockfd = -1;
+} /* -- sr_vns_uring_close -- */
@@ -0,0 +1,119 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_vns_uring.h
+ *
+ * Description:
+ *
+ * io_uring transport for an established VNS session (-U).  Replaces the
+ * blocking recv/read per command and write per frame of sr_vns_comm.c:
+ *
+ *  - one multishot recv fills buffers from a provided buffer ring, and
+ *    every command in a buffer is dispatched where it lies, so a buffer
+ *    full of VNSPACKETs costs one completion;
+ *  - outgoing VNSPACKETs are appended to a batch and each batch goes out
+ *    in a single send while the next one fills; with a server that takes
+ *    VNSPACKET_BATCH the frames are packed into those instead.  Each
+ *    batch holds SR_URING_TXFRAMES frames of the session's max_frame.
+ *
+ * The session is reliable, so a full batch is not a reason to drop a
+ * frame the main thread forwards: it waits for the send in flight, and
+ * receives that complete meanwhile are queued, not handled, until it is
+ * done.  No recv is re-armed while any are queued, so a router that
+ * cannot keep up holds the server back through TCP.  Only the ARP
+ * sweeper, which must not wait on the main thread, drops (tx_full).
+ *
+ * A poll pass is one io_uring_enter that both submits and waits.  The
+ * handshake still uses the blocking path; the switch happens between
+ * commands, and if io_uring is unavailable the router stays on the
+ * blocking path.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_VNS_URING_H
+#define SR_VNS_URING_H
+
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#define SR_URING_ENTRIES  64
+#define SR_URING_NBUFS    64        /* provided receive buffers, power of 2 */
+#define SR_URING_BUFSZ    16384
+#define SR_URING_MAXCMD   65536     /* VNS_MAX_COMMAND */
+#define SR_URING_TXFRAMES 64        /* per send batch, of max_frame */
+#define SR_URING_TXBUF    (1 << 18) /* per send batch, at least */
+#define SR_URING_RXQ      (2 * SR_URING_NBUFS)
+
+struct sr_instance;
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+struct sr_vns_uring
+{
+    int fd;
+    uint8_t* ring_map;          /* SQ and CQ rings, one mapping */
+    size_t ring_map_len;
+    struct io_uring_sqe* sqes;
+    size_t sqes_len;
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+
+    struct io_uring_buf_ring* br;
+    size_t br_len;
+    uint8_t* bufs;
+    int recv_armed;
+
+    /* -- receives completed while waiting for TX room, to be handled -- */
+    struct
+    {
+        int res;
+        uint16_t bid;
+    } rxq[SR_URING_RXQ];
+    unsigned int rxq_head;
+    unsigned int rxq_tail;
+
+    /* -- a command split across receive buffers is put together here -- */
+    uint8_t cmd[SR_URING_MAXCMD];
+    unsigned int cmd_len;
+
+    /* -- TX: frames go into txbuf[fill] while txbuf[!fill] is sent -- */
+    pthread_mutex_t tx_lock;
+    uint8_t* txbuf[2];
+    unsigned int txcap;         /* bytes in each */
+    unsigned int fill;
+    unsigned int fill_len;
+    unsigned int batch_off;     /* VNSPACKET_BATCH open in txbuf[fill] */
+    unsigned int batch_len;     /* 0 when none is */
+    unsigned int busy_len;      /* 0 when no send in flight */
+    unsigned int busy_off;
+    int busy_queued;            /* remainder has an SQE */
+    int tx_error;
+    int closed;
+
+    /* -- sends from the ARP sweeper wake the main thread -- */
+    pthread_t main_thread;
+    int efd;
+    uint64_t efd_val;
+    int wake_armed;
+
+    uint64_t enters;
+    uint64_t recvs;
+    uint64_t cmds;
+    uint64_t pkts_out;
+    uint64_t sends;
+    uint64_t tx_waits;          /* main thread waited for room */
+    uint64_t tx_full;           /* dropped, ARP sweeper found no room */
+};
+
+int sr_vns_uring_open(struct sr_instance* sr);
+
+#endif /* -- SR_VNS_URING_H -- */
@@ -0,0 +1,916 @@
+/*-----------------------------------------------------------------------------
+ * file:  srbench.c
+ *
+ * Description:
+ *
+ * Microbenchmarks for the forwarding path, linked against the router's
+ * own objects: longest prefix match on synthetic tables of 1k to 900k
+ * prefixes, ARP cache lookups and inserts (contended too), cksum, and
+ * sr_handlepacket(..) on canned frames through a sink backend, jumbo
+ * frames fragmented for a 1500 byte MTU among them.
+ *
+ * Each benchmark grows its iteration count until a run takes -t
+ * seconds, then repeats -n times; the median run is reported, in JSON
+ * on stdout (or -o file) and as a table on stderr.  Tables and traffic
+ * come from a fixed seed, so runs are comparable across builds.
+ *
+ *   make bench                    everything, into bench.json
+ *   ./srbench -q -f lpm           just the LPM tables up to 100k
+ *   ./srbench -f file -r rtable.900k -T trace.pcap
+ *                                 LPM on an rtgen table and Zipf trace
+ *
+ * The Makefile builds it, and the router objects it links, with
+ * BENCH_CFLAGS (-O2, traces compiled out); the flags are recorded in the
+ * JSON so results from other builds can be told apart.
+ *
+ * Cycles are TSC ticks, which on current x86 count at a fixed rate
+ * rather than the core clock.
+ *
+ * New LPM implementations go in sb_lpms[] so the tables run against
+ * each.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/utsname.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_io.h"
+#include "sr_arpcache.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_icmp.h"
+#include "sr_log.h"
+#include "sr_dumper.h"
+
+#define SB_MAX_RESULTS  64
+#define SB_DSTS         4096    /* lookup addresses cycled through, 2^n */
+#define SB_ARP_HOSTS    64      /* ARP entries for the cache benchmarks */
+#define SB_SEED         0x5eed5eed5eedULL
+
+#ifndef SB_CFLAGS
+#define SB_CFLAGS       "unknown"
+#endif
+
+struct sb_result
+{
+    char name[64];
+    uint64_t ops;               /* in the median run */
+    double ns;                  /* per op, median run */
+    double ns_min;              /* per op, best run */
+    double cycles;              /* TSC ticks per op, median run */
+};
+
+struct sb_state
+{
+    double min_secs;
+    int runs;
+    const char* filter;
+    struct sb_result results[SB_MAX_RESULTS];
+    int nresults;
+    uint64_t tsc_hz;
+};
+
+typedef void (*sb_fn)(void* ctx, uint64_t n);
+
+static volatile uint64_t sb_sink;   /* keeps results from being optimized out */
+static uint64_t sb_rng_state = SB_SEED;
+static uint64_t sb_sent;
+
+/* -- xorshift64*, fixed seed: same tables and traffic every run -- */
+static uint64_t sb_rand(void)
+{
+    sb_rng_state ^= sb_rng_state >> 12;
+    sb_rng_state ^= sb_rng_state << 25;
+    sb_rng_state ^= sb_rng_state >> 27;
+    return sb_rng_state * 2685821657736338717ULL;
+} /* -- sb_rand -- */
+
+static uint64_t sb_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- sb_ns -- */
+
+static int sb_cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+} /* -- sb_cmp_double -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sb_run(..)
+ *
+ * Time fn: double n until one call takes min_secs, then run that n
+ * state->runs times and keep the median.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sb_run(struct sb_state* st, const char* name, sb_fn fn,
+                   void* ctx)
+{
+    struct sb_result* r;
+    double ns[32], cyc[32], sorted[32];
+    uint64_t n = 1, t0, t1, c0, c1;
+    int i, mid;
+
+    if(st->filter && strstr(name, st->filter) == 0)
+    { return; }
+    assert(st->nresults < SB_MAX_RESULTS);
+
+    for(;;)
+    {
+        t0 = sb_ns();
+        fn(ctx, n);
+        t1 = sb_ns();
+        if(t1 - t0 >= st->min_secs * 1e9 || n >= ((uint64_t)1 << 40))
+        { break; }
+        n = t1 - t0 < st->min_secs * 1e8 ? n * 8 : n * 2;
+    }
+
+    for(i = 0; i < st->runs; i++)
+    {
+        t0 = sb_ns();
+        c0 = sr_stats_tsc();
+        fn(ctx, n);
+        c1 = sr_stats_tsc();
+        t1 = sb_ns();
+        ns[i] = (double)(t1 - t0) / n;
+        cyc[i] = (double)(c1 - c0) / n;
+    }
+
+    memcpy(sorted, ns, st->runs * sizeof(double));
+    qsort(sorted, st->runs, sizeof(double), sb_cmp_double);
+    mid = 0;
+    for(i = 0; i < st->runs; i++)
+    {
+        if(ns[i] == sorted[st->runs / 2])
+        { mid = i; break; }
+    }
+
+    r = &st->results[st->nresults++];
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->ops = n;
+    r->ns = ns[mid];
+    r->ns_min = sorted[0];
+    r->cycles = cyc[mid];
+    fprintf(stderr, "%-32s %12.1f ns/op %12.1f cycles/op %14.0f ops/s\n",
+            r->name, r->ns, r->cycles, 1e9 / r->ns);
+} /* -- sb_run -- */
+
+/*-----------------------------------------------------------------------------
+ * The router under test: three interfaces, a sink backend, static ARP
+ * for every next hop the canned frames need.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sb_sink_poll(struct sr_instance* sr)
+{ return 0; }
+
+static int sb_sink_send(struct sr_instance* sr, uint8_t* buf,
+                        unsigned int len, struct sr_if* iface)
+{
+    sb_sent++;
+    return 0;
+} /* -- sb_sink_send -- */
+
+/* -- takes the pieces as they are, where a real backend would copy them
+ *    into its ring once -- */
+static int sb_sink_sendv(struct sr_instance* sr, const struct iovec* iov,
+                         int iovcnt, unsigned int len, struct sr_if* iface)
+{
+    sb_sent++;
+    return 0;
+} /* -- sb_sink_sendv -- */
+
+static const struct sr_io_ops sb_sink_io =
+{
+    "bench-sink",
+    sb_sink_poll,
+    sb_sink_send,
+    0,
+    sb_sink_sendv
+};
+
+/* -- the same without sendv: sr_io gathers fragments into one buffer -- */
+static const struct sr_io_ops sb_sink_flat_io =
+{
+    "bench-sink-flat",
+    sb_sink_poll,
+    sb_sink_send,
+    0,
+    0
+};
+
+static uint32_t sb_ip(const char* s)
+{
+    struct in_addr a;
+
+    inet_aton(s, &a);
+    return a.s_addr;
+} /* -- sb_ip -- */
+
+static void sb_add_if(struct sr_instance* sr, const char* name,
+                      const char* ip, unsigned char last)
+{
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+
+    mac[5] = last;
+    sr_add_interface(sr, name);
+    sr_set_ether_ip(sr, sb_ip(ip));
+    sr_set_ether_mask(sr, sb_ip("255.255.255.0"));
+    sr_set_ether_addr(sr, mac);
+} /* -- sb_add_if -- */
+
+static void sb_add_route(struct sr_instance* sr, const char* dest,
+                         const char* gw, const char* mask, char* iface)
+{
+    struct in_addr d, g, m;
+
+    inet_aton(dest, &d);
+    inet_aton(gw, &g);
+    inet_aton(mask, &m);
+    sr_add_rt_entry(sr, d, g, m, iface);
+} /* -- sb_add_route -- */
+
+static void sb_router(struct sr_instance* sr)
+{
+    static const unsigned char mac[ETHER_ADDR_LEN] =
+    { 0x02, 0, 0, 0, 0x10, 0x01 };
+
+    memset(sr, 0, sizeof(*sr));
+    sr->sockfd = -1;
+    sr->max_frame = SR_MAX_FRAME_JUMBO;
+    sr->io = &sb_sink_io;
+    sr_arpcache_init(&sr->cache);
+    if(sr_stats_open(sr, 0) != 0)
+    { exit(1); }
+
+    sb_add_if(sr, "eth1", "10.0.1.1", 1);
+    sb_add_if(sr, "eth2", "10.0.2.1", 2);
+    sb_add_if(sr, "eth3", "10.0.3.1", 3);
+
+    sb_add_route(sr, "10.0.1.0", "0.0.0.0", "255.255.255.0", "eth1");
+    sb_add_route(sr, "10.0.2.0", "0.0.0.0", "255.255.255.0", "eth2");
+    sb_add_route(sr, "192.168.0.0", "10.0.3.2", "255.255.0.0", "eth3");
+    sr_rt_resolve_interfaces(sr);
+    sr_resolve_mtus(sr);
+    sr_build_local_addrs(sr);
+    sr_icmp_build_templates(sr);
+    sr_stats_interfaces(sr);
+
+    sr_arpcache_insert_static(&sr->cache, mac, sb_ip("10.0.1.100"));
+    sr_arpcache_insert_static(&sr->cache, mac, sb_ip("10.0.2.100"));
+    sr_arpcache_insert_static(&sr->cache, mac, sb_ip("10.0.3.2"));
+} /* -- sb_router -- */
+
+/*-----------------------------------------------------------------------------
+ * LPM
+ *
+ *---------------------------------------------------------------------------*/
+
+typedef struct sr_rt* (*sb_lpm_fn)(struct sr_instance* sr, uint32_t ip);
+
+static const struct
+{
+    const char* name;
+    sb_lpm_fn lookup;
+} sb_lpms[] =
+{
+    { "linear", sr_routing_table_lpm_forwarding },
+};
+
+struct sb_lpm_ctx
+{
+    struct sr_instance* sr;
+    sb_lpm_fn lookup;
+    uint32_t dsts[SB_DSTS];
+    uint32_t* trace;            /* -T destinations, in order, if any */
+    unsigned int ntrace;
+};
+
+/* -- roughly the shape of a BGP table: mostly /24, a fair number of /16
+ *    to /23, a few short and a few host routes -- */
+static unsigned int sb_prefix_len(void)
+{
+    unsigned int r = sb_rand() % 1000;
+
+    if(r < 580) return 24;
+    if(r < 700) return 23;
+    if(r < 800) return 22;
+    if(r < 860) return 21;
+    if(r < 900) return 20;
+    if(r < 960) return 16 + (unsigned int)(sb_rand() % 4);
+    if(r < 975) return 8 + (unsigned int)(sb_rand() % 8);
+    return 25 + (unsigned int)(sb_rand() % 8);
+} /* -- sb_prefix_len -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sb_table(..)
+ *
+ * n random prefixes over the three interfaces, built directly rather than
+ * through sr_add_rt_entry(..), which walks the list for every insert.
+ * Three quarters of dsts fall inside some prefix, the rest anywhere.
+ *
+ *---------------------------------------------------------------------------*/
+
+static struct sr_rt* sb_table(struct sr_instance* sr, unsigned int n,
+                              uint32_t* dsts)
+{
+    struct sr_rt *head = 0, **tail = &head, *rt;
+    uint32_t* bases;
+    uint32_t mask;
+    unsigned int i, len;
+
+    bases = (uint32_t*)malloc(n * sizeof(uint32_t));
+    assert(bases);
+    for(i = 0; i < n; i++)
+    {
+        len = sb_prefix_len();
+        mask = len ? 0xffffffffu << (32 - len) : 0;
+        bases[i] = (uint32_t)sb_rand() & mask;
+
+        rt = (struct sr_rt*)calloc(1, sizeof(struct sr_rt));
+        assert(rt);
+        rt->dest.s_addr = htonl(bases[i]);
+        rt->mask.s_addr = htonl(mask);
+        rt->gw.s_addr = htonl(0x0a000002 | ((i % 3 + 1) << 8));
+        rt->iface = sr->if_table[i % 3];
+        memcpy(rt->interface, rt->iface->name, sr_IFACE_NAMELEN);
+        *tail = rt;
+        tail = &rt->next;
+
+        /* -- keep the host bits for the destinations -- */
+        bases[i] |= ~mask & (uint32_t)sb_rand();
+    }
+
+    for(i = 0; i < SB_DSTS; i++)
+    {
+        dsts[i] = htonl(i % 4 ? bases[sb_rand() % n] : (uint32_t)sb_rand());
+    }
+    free(bases);
+    return head;
+} /* -- sb_table -- */
+
+static void sb_lpm(void* arg, uint64_t n)
+{
+    struct sb_lpm_ctx* c = (struct sb_lpm_ctx*)arg;
+    uint64_t i, hits = 0;
+
+    for(i = 0; i < n; i++)
+    { hits += c->lookup(c->sr, c->dsts[i & (SB_DSTS - 1)]) != 0; }
+    sb_sink += hits;
+} /* -- sb_lpm -- */
+
+/* -- through the trace in order, keeping its locality -- */
+static void sb_lpm_trace(void* arg, uint64_t n)
+{
+    struct sb_lpm_ctx* c = (struct sb_lpm_ctx*)arg;
+    uint64_t i, hits = 0;
+    unsigned int j = 0;
+
+    for(i = 0; i < n; i++)
+    {
+        hits += c->lookup(c->sr, c->trace[j]) != 0;
+        if(++j == c->ntrace)
+        { j = 0; }
+    }
+    sb_sink += hits;
+} /* -- sb_lpm_trace -- */
+
+/* -- IPv4 destinations of a pcap, e.g. from rtgen -T -- */
+static uint32_t* sb_read_trace(const char* path, unsigned int* count)
+{
+    struct sr_dump_reader* rd;
+    struct sr_dump_record rec;
+    const sr_ethernet_hdr_t* eth;
+    const sr_ip_hdr_t* ip;
+    uint32_t* dsts = 0;
+    unsigned int n = 0, cap = 0;
+
+    if((rd = sr_dump_read_open(path)) == 0)
+    { return 0; }
+    while(sr_dump_read(rd, &rec) == 1)
+    {
+        eth = (const sr_ethernet_hdr_t*)rec.data;
+        ip = (const sr_ip_hdr_t*)(rec.data + sizeof(sr_ethernet_hdr_t));
+        if(rec.caplen < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+                eth->ether_type != htons(ethertype_ip))
+        { continue; }
+        if(n == cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            dsts = (uint32_t*)realloc(dsts, cap * sizeof(uint32_t));
+            assert(dsts);
+        }
+        dsts[n++] = ip->ip_dst;
+    }
+    sr_dump_read_close(rd);
+    *count = n;
+    return dsts;
+} /* -- sb_read_trace -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sb_lpm_file(..)
+ *
+ * LPM on an rtable from disk (rtgen -o), looking up the destinations of
+ * trace (rtgen -T) in order if given, else hosts of random routes from
+ * the table itself.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sb_lpm_file(struct sb_state* st, struct sr_instance* sr,
+                       const char* rtable, const char* trace)
+{
+    struct sb_lpm_ctx* c;
+    struct sr_rt* small = sr->routing_table;
+    struct sr_rt** routes;
+    struct sr_rt* rt;
+    char name[64];
+    unsigned int l, n = 0, i;
+    int saved, ret;
+
+    /* -- sr_load_rt(..) talks on stdout, where the JSON goes -- */
+    fflush(stdout);
+    saved = dup(1);
+    dup2(2, 1);
+    sr->routing_table = 0;
+    ret = sr_load_rt(sr, rtable);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    if(ret != 0 || sr->routing_table == 0)
+    {
+        fprintf(stderr, "%s: no routes\n", rtable);
+        sr->routing_table = small;
+        return -1;
+    }
+
+    c = (struct sb_lpm_ctx*)calloc(1, sizeof(*c));
+    assert(c);
+    c->sr = sr;
+    if(trace && (c->trace = sb_read_trace(trace, &c->ntrace)) == 0)
+    {
+        fprintf(stderr, "%s: no IPv4 frames\n", trace);
+        sr_rt_free(sr->routing_table);
+        sr->routing_table = small;
+        free(c);
+        return -1;
+    }
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    { n++; }
+    routes = (struct sr_rt**)malloc(n * sizeof(struct sr_rt*));
+    assert(routes);
+    for(rt = sr->routing_table, i = 0; rt; rt = rt->next)
+    { routes[i++] = rt; }
+    for(i = 0; i < SB_DSTS; i++)
+    {
+        rt = routes[sb_rand() % n];
+        c->dsts[i] = rt->dest.s_addr | (~rt->mask.s_addr & (uint32_t)sb_rand());
+    }
+    free(routes);
+
+    fprintf(stderr, "%s: %u routes, %s%u destinations\n", rtable, n,
+            c->trace ? "trace of " : "", c->trace ? c->ntrace : SB_DSTS);
+    for(l = 0; l < sizeof(sb_lpms) / sizeof(sb_lpms[0]); l++)
+    {
+        snprintf(name, sizeof(name), "lpm/%s/file", sb_lpms[l].name);
+        c->lookup = sb_lpms[l].lookup;
+        sb_run(st, name, c->trace ? sb_lpm_trace : sb_lpm, c);
+    }
+
+    sr_rt_free(sr->routing_table);
+    sr->routing_table = small;
+    free(c->trace);
+    free(c);
+    return 0;
+} /* -- sb_lpm_file -- */
+
+static void sb_lpm_tables(struct sb_state* st, struct sr_instance* sr,
+                          int quick)
+{
+    static const unsigned int sizes[] = { 1000, 10000, 100000, 900000 };
+    static const char* labels[] = { "1k", "10k", "100k", "900k" };
+    struct sb_lpm_ctx* c;
+    struct sr_rt* small = sr->routing_table;
+    struct sr_rt* table;
+    char name[64];
+    unsigned int s, l;
+    int want;
+
+    c = (struct sb_lpm_ctx*)calloc(1, sizeof(*c));
+    assert(c);
+    c->sr = sr;
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        if(quick && sizes[s] > 100000)
+        { break; }
+        /* -- a 900k table takes a while to build; skip unwanted ones -- */
+        for(l = 0, want = 0; l < sizeof(sb_lpms) / sizeof(sb_lpms[0]); l++)
+        {
+            snprintf(name, sizeof(name), "lpm/%s/%s", sb_lpms[l].name,
+                    labels[s]);
+            want |= !st->filter || strstr(name, st->filter) != 0;
+        }
+        if(!want)
+        { continue; }
+
+        table = sb_table(sr, sizes[s], c->dsts);
+        sr->routing_table = table;
+        for(l = 0; l < sizeof(sb_lpms) / sizeof(sb_lpms[0]); l++)
+        {
+            snprintf(name, sizeof(name), "lpm/%s/%s", sb_lpms[l].name,
+                    labels[s]);
+            c->lookup = sb_lpms[l].lookup;
+            sb_run(st, name, sb_lpm, c);
+        }
+        sr->routing_table = small;
+        sr_rt_free(table);
+    }
+    free(c);
+} /* -- sb_lpm_tables -- */
+
+/*-----------------------------------------------------------------------------
+ * ARP cache
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sb_arp_ctx
+{
+    struct sr_instance* sr;
+    uint32_t ips[SB_ARP_HOSTS];
+    int threads;
+};
+
+static void sb_arp_fill(struct sb_arp_ctx* c)
+{
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0x20, 0 };
+    struct sr_arpreq* req;
+    int i;
+
+    for(i = 0; i < SB_ARP_HOSTS; i++)
+    {
+        c->ips[i] = htonl(0x0a010000 + i);
+        mac[5] = i;
+        req = sr_arpcache_insert(&c->sr->cache, mac, c->ips[i]);
+        assert(req == 0);
+    }
+} /* -- sb_arp_fill -- */
+
+/* -- learned entries only; the statics the frames need stay -- */
+static void sb_arp_clear(struct sr_instance* sr)
+{
+    int i;
+
+    pthread_mutex_lock(&sr->cache.lock);
+    for(i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        if(!sr->cache.entries[i].permanent)
+        { sr->cache.entries[i].valid = 0; }
+    }
+    pthread_mutex_unlock(&sr->cache.lock);
+} /* -- sb_arp_clear -- */
+
+static void sb_arp_lookup(void* arg, uint64_t n)
+{
+    struct sb_arp_ctx* c = (struct sb_arp_ctx*)arg;
+    struct sr_arpentry* e;
+    uint64_t i, hits = 0;
+
+    for(i = 0; i < n; i++)
+    {
+        e = sr_arpcache_lookup(&c->sr->cache, c->ips[i % SB_ARP_HOSTS]);
+        if(e)
+        { hits++; free(e); }
+    }
+    sb_sink += hits;
+} /* -- sb_arp_lookup -- */
+
+static void sb_arp_insert(void* arg, uint64_t n)
+{
+    struct sb_arp_ctx* c = (struct sb_arp_ctx*)arg;
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0x20, 0 };
+    uint64_t i;
+
+    /* -- insert takes a free slot, so clear each time the hosts are in;
+     *    the clear is timed too, once per SB_ARP_HOSTS inserts -- */
+    for(i = 0; i < n; i++)
+    {
+        if(i % SB_ARP_HOSTS == 0)
+        { sb_arp_clear(c->sr); }
+        mac[5] = i;
+        sr_arpcache_insert(&c->sr->cache, mac, c->ips[i % SB_ARP_HOSTS]);
+    }
+} /* -- sb_arp_insert -- */
+
+struct sb_arp_worker
+{
+    struct sb_arp_ctx* c;
+    uint64_t n;
+};
+
+static void* sb_arp_thread(void* arg)
+{
+    struct sb_arp_worker* w = (struct sb_arp_worker*)arg;
+
+    sb_arp_lookup(w->c, w->n);
+    return 0;
+} /* -- sb_arp_thread -- */
+
+/* -- n lookups split over c->threads threads: per op is aggregate -- */
+static void sb_arp_contended(void* arg, uint64_t n)
+{
+    struct sb_arp_ctx* c = (struct sb_arp_ctx*)arg;
+    struct sb_arp_worker w[16];
+    pthread_t t[16];
+    int i;
+
+    for(i = 0; i < c->threads; i++)
+    {
+        w[i].c = c;
+        w[i].n = n / c->threads;
+        pthread_create(&t[i], 0, sb_arp_thread, &w[i]);
+    }
+    for(i = 0; i < c->threads; i++)
+    { pthread_join(t[i], 0); }
+} /* -- sb_arp_contended -- */
+
+static void sb_arp(struct sb_state* st, struct sr_instance* sr)
+{
+    struct sb_arp_ctx c;
+    char name[64];
+    int threads;
+
+    c.sr = sr;
+    sb_arp_fill(&c);
+    sb_run(st, "arp/lookup", sb_arp_lookup, &c);
+    for(threads = 2; threads <= 8; threads *= 2)
+    {
+        c.threads = threads;
+        snprintf(name, sizeof(name), "arp/lookup/%dthreads", threads);
+        sb_run(st, name, sb_arp_contended, &c);
+    }
+    sb_run(st, "arp/insert", sb_arp_insert, &c);
+    sb_arp_clear(sr);
+} /* -- sb_arp -- */
+
+/*-----------------------------------------------------------------------------
+ * cksum
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sb_cksum_ctx
+{
+    uint8_t buf[SR_MAX_FRAME_JUMBO];
+    int len;
+};
+
+static void sb_cksum(void* arg, uint64_t n)
+{
+    struct sb_cksum_ctx* c = (struct sb_cksum_ctx*)arg;
+    uint64_t i, sum = 0;
+
+    for(i = 0; i < n; i++)
+    {
+        c->buf[0] = (uint8_t)i;
+        sum += cksum(c->buf, c->len);
+    }
+    sb_sink += sum;
+} /* -- sb_cksum -- */
+
+static void sb_cksums(struct sb_state* st)
+{
+    static const int lens[] = { 20, 64, 1500, 9000 };
+    struct sb_cksum_ctx* c;
+    char name[64];
+    unsigned int i;
+
+    c = (struct sb_cksum_ctx*)malloc(sizeof(*c));
+    assert(c);
+    for(i = 0; i < sizeof(c->buf); i++)
+    { c->buf[i] = (uint8_t)sb_rand(); }
+    for(i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+    {
+        c->len = lens[i];
+        snprintf(name, sizeof(name), "cksum/%d", lens[i]);
+        sb_run(st, name, sb_cksum, c);
+    }
+    free(c);
+} /* -- sb_cksums -- */
+
+/*-----------------------------------------------------------------------------
+ * sr_handlepacket on canned frames
+ *
+ *---------------------------------------------------------------------------*/
+
+struct sb_frame_ctx
+{
+    struct sr_instance* sr;
+    struct sr_if* iface;
+    uint8_t frame[SR_MAX_FRAME_JUMBO];
+    uint8_t work[SR_MAX_FRAME_JUMBO];
+    unsigned int len;
+};
+
+static void sb_frame(struct sb_frame_ctx* c, const char* src,
+                     const char* dst, uint8_t proto, uint8_t ttl,
+                     unsigned int len)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)c->frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(c->frame + sizeof(sr_ethernet_hdr_t));
+    sr_icmp_hdr_t* icmp = (sr_icmp_hdr_t*)(ip + 1);
+    unsigned int ip_len = len - sizeof(sr_ethernet_hdr_t);
+
+    memset(c->frame, 0, sizeof(c->frame));
+    memcpy(eth->ether_dhost, c->iface->addr, ETHER_ADDR_LEN);
+    eth->ether_shost[0] = 0x02;
+    eth->ether_shost[5] = 0x99;
+    eth->ether_type = htons(ethertype_ip);
+
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(ip_len);
+    ip->ip_ttl = ttl;
+    ip->ip_p = proto;
+    ip->ip_src = sb_ip(src);
+    ip->ip_dst = sb_ip(dst);
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+    if(proto == ip_protocol_icmp)
+    {
+        icmp->icmp_type = icmp_type_echo_request;
+        icmp->icmp_sum = cksum(icmp, ip_len - sizeof(sr_ip_hdr_t));
+    }
+    c->len = len;
+} /* -- sb_frame -- */
+
+/* -- the router rewrites the frame, so each pass gets a fresh copy, as
+ *    a receive buffer would be -- */
+static void sb_handle(void* arg, uint64_t n)
+{
+    struct sb_frame_ctx* c = (struct sb_frame_ctx*)arg;
+    uint64_t i;
+
+    for(i = 0; i < n; i++)
+    {
+        memcpy(c->work, c->frame, c->len);
+        sr_io_receive(c->sr, c->work, c->len, c->iface);
+    }
+} /* -- sb_handle -- */
+
+static void sb_handlepacket(struct sb_state* st, struct sr_instance* sr)
+{
+    struct sb_frame_ctx* c;
+    unsigned int mtu;
+
+    c = (struct sb_frame_ctx*)malloc(sizeof(*c));
+    assert(c);
+    c->sr = sr;
+    c->iface = sr->if_table[0];
+
+    sb_frame(c, "10.0.1.100", "192.168.5.5", ip_protocol_udp, 64, 64);
+    sb_run(st, "handlepacket/forward/64", sb_handle, c);
+    sb_frame(c, "10.0.1.100", "192.168.5.5", ip_protocol_udp, 64, 1514);
+    sb_run(st, "handlepacket/forward/1514", sb_handle, c);
+    sb_frame(c, "10.0.1.100", "10.0.1.1", ip_protocol_icmp, 64, 98);
+    sb_run(st, "handlepacket/echo/98", sb_handle, c);
+    sb_frame(c, "10.0.1.100", "192.168.5.5", ip_protocol_udp, 1, 64);
+    sb_run(st, "handlepacket/ttl_expired/64", sb_handle, c);
+    sb_frame(c, "10.0.1.100", "8.8.8.8", ip_protocol_udp, 64, 64);
+    sb_run(st, "handlepacket/no_route/64", sb_handle, c);
+
+    /* -- jumbo in, out eth3 as is and cut down to a 1500 byte MTU -- */
+    sb_frame(c, "10.0.1.100", "192.168.5.5", ip_protocol_udp, 64, 9014);
+    sb_run(st, "handlepacket/forward/9014", sb_handle, c);
+    mtu = sr->if_table[2]->mtu;
+    sr->if_table[2]->mtu = 1500;
+    sb_run(st, "handlepacket/frag/9014to1500", sb_handle, c);
+    sr->io = &sb_sink_flat_io;
+    sb_run(st, "handlepacket/frag/9014to1500/flat", sb_handle, c);
+    sr->io = &sb_sink_io;
+    sr->if_table[2]->mtu = mtu;
+    free(c);
+} /* -- sb_handlepacket -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sb_json(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sb_json(FILE* out, struct sb_state* st)
+{
+    struct utsname u;
+    int i;
+
+    uname(&u);
+    fprintf(out, "{\n  \"host\": \"%s\",\n  \"kernel\": \"%s\",\n"
+            "  \"cflags\": \"%s\",\n"
+            "  \"tsc_hz\": %llu,\n  \"min_secs\": %g,\n  \"runs\": %d,\n"
+            "  \"results\": [\n", u.nodename, u.release, SB_CFLAGS,
+            (unsigned long long)st->tsc_hz, st->min_secs, st->runs);
+    for(i = 0; i < st->nresults; i++)
+    {
+        fprintf(out, "    {\"name\": \"%s\", \"ops\": %llu, "
+                "\"ns_per_op\": %.3f, \"ns_per_op_min\": %.3f, "
+                "\"cycles_per_op\": %.1f, \"ops_per_sec\": %.0f}%s\n",
+                st->results[i].name,
+                (unsigned long long)st->results[i].ops, st->results[i].ns,
+                st->results[i].ns_min, st->results[i].cycles,
+                1e9 / st->results[i].ns, i + 1 < st->nresults ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+} /* -- sb_json -- */
+
+static void usage(const char* argv0)
+{
+    printf("Forwarding path microbenchmarks\n");
+    printf("Format: %s [-h] [-q] [-t secs] [-n runs] [-f filter] "
+           "[-c cpu] [-o out.json]\n"
+           "          [-r rtable [-T trace.pcap]]\n", argv0);
+    printf("   -q skips the 900k prefix table\n");
+    printf("   -t is the length of one run (default 0.2s), -n the runs "
+           "per benchmark (default 5)\n");
+    printf("   -f runs only benchmarks whose name contains filter\n");
+    printf("   -r adds lpm/*/file on an rtable (see rtgen), -T looks up "
+           "the destinations of a pcap trace against it in order\n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct sb_state st;
+    struct sr_instance* sr;
+    const char *out_path = 0, *rtable = 0, *trace = 0;
+    FILE* out = stdout;
+    cpu_set_t set;
+    int c, quick = 0, cpu = -1;
+
+    memset(&st, 0, sizeof(st));
+    st.min_secs = 0.2;
+    st.runs = 5;
+
+    while((c = getopt(argc, argv, "hqt:n:f:c:o:r:T:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'q': quick = 1; break;
+            case 't': st.min_secs = atof(optarg); break;
+            case 'n': st.runs = atoi(optarg); break;
+            case 'f': st.filter = optarg; break;
+            case 'c': cpu = atoi(optarg); break;
+            case 'o': out_path = optarg; break;
+            case 'r': rtable = optarg; break;
+            case 'T': trace = optarg; break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if(st.runs < 1 || st.runs > 32 || st.min_secs <= 0 || (trace && !rtable))
+    { usage(argv[0]); return 1; }
+
+    if(cpu >= 0)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if(sched_setaffinity(0, sizeof(set), &set) != 0)
+        { perror("sched_setaffinity"); return 1; }
+    }
+
+    sr_log_level = SR_LOG_ERROR;
+    sr = (struct sr_instance*)malloc(sizeof(struct sr_instance));
+    assert(sr);
+    sb_router(sr);
+    st.tsc_hz = sr->stats->tsc_hz;
+
+    sb_lpm_tables(&st, sr, quick);
+    if(rtable && sb_lpm_file(&st, sr, rtable, trace) != 0)
+    { return 1; }
+    sb_arp(&st, sr);
+    sb_cksums(&st);
+    sb_handlepacket(&st, sr);
+
+    if(out_path && (out = fopen(out_path, "w")) == 0)
+    { perror(out_path); return 1; }
+    sb_json(out, &st);
+    if(out != stdout)
+    { fclose(out); }
+    fprintf(stderr, "%llu frames to the sink\n", (unsigned long long)sb_sent);
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,695 @@
+/*-----------------------------------------------------------------------------
+ * file:  srcheck.c
+ *
+ * Description:
+ *
+ * Behaviour checks of the forwarding path, linked against the router's
+ * own objects like srbench: canned frames go through sr_io_receive(..)
+ * into a router with a capturing sink backend, and what comes out is
+ * taken apart.
+ *
+ *   fragments   offsets, MF and 8 byte payload alignment, the options
+ *               each fragment carries, the payload end to end; through
+ *               sendv and through the flat send both
+ *   frag needed DF over the MTU: one error with the next-hop MTU
+ *   errors      type and code, quote, and that the IP and ICMP checksums
+ *               of the template-built errors verify with cksum()
+ *   echo        replies made in place: addresses, type, and both
+ *               incrementally updated checksums
+ *   suppressed  no error about an ICMP error, a later fragment, or a
+ *               broadcast, multicast or zero source (RFC 1122, 1812)
+ *   arp timeout host unreachable for what waited, the request gone; an
+ *               error that itself times out is dropped quietly
+ *
+ * Failures go to stderr one per line; the exit status is 1 if there were
+ * any.
+ *
+ *   make check
+ *   ./srcheck -v                  with the router's debug log
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <arpa/inet.h>
+#include <sys/uio.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_io.h"
+#include "sr_arpcache.h"
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "sr_stats.h"
+#include "sr_icmp.h"
+#include "sr_log.h"
+
+#define SC_MAX_OUT      16      /* frames one input may produce */
+
+struct sc_out
+{
+    struct sr_if* iface;
+    unsigned int len;
+    uint8_t frame[SR_MAX_FRAME_JUMBO];
+};
+
+static struct sc_out sc_out[SC_MAX_OUT];
+static unsigned int sc_nout;
+static char sc_test[96];        /* what the next checks are about */
+static int sc_checks, sc_failed;
+
+static void sc_check(int ok, const char* what)
+{
+    sc_checks++;
+    if(!ok)
+    {
+        sc_failed++;
+        fprintf(stderr, "FAIL %s: %s\n", sc_test, what);
+    }
+} /* -- sc_check -- */
+
+/* -- a header or message with its checksum in place sums to zero -- */
+static int sc_cksum_ok(const void* data, unsigned int len)
+{ return cksum(data, len) == 0xffff; }
+
+/*-----------------------------------------------------------------------------
+ * The router under test: as in srbench, three interfaces and static ARP
+ * for every next hop, but the sink keeps what it is given.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sc_sink_poll(struct sr_instance* sr)
+{ return 0; }
+
+static int sc_sink_send(struct sr_instance* sr, uint8_t* buf,
+                        unsigned int len, struct sr_if* iface)
+{
+    if(sc_nout == SC_MAX_OUT || len > SR_MAX_FRAME_JUMBO)
+    { return -1; }
+    sc_out[sc_nout].iface = iface;
+    sc_out[sc_nout].len = len;
+    memcpy(sc_out[sc_nout].frame, buf, len);
+    sc_nout++;
+    return 0;
+} /* -- sc_sink_send -- */
+
+static int sc_sink_sendv(struct sr_instance* sr, const struct iovec* iov,
+                         int iovcnt, unsigned int len, struct sr_if* iface)
+{
+    uint8_t frame[SR_MAX_FRAME_JUMBO];
+    unsigned int n = 0;
+    int i;
+
+    for(i = 0; i < iovcnt; i++)
+    {
+        memcpy(frame + n, iov[i].iov_base, iov[i].iov_len);
+        n += iov[i].iov_len;
+    }
+    sc_check(n == len, "sendv length is the sum of the pieces");
+    return sc_sink_send(sr, frame, n, iface);
+} /* -- sc_sink_sendv -- */
+
+static const struct sr_io_ops sc_sink_io =
+{
+    "check-sink",
+    sc_sink_poll,
+    sc_sink_send,
+    0,
+    sc_sink_sendv
+};
+
+/* -- without sendv: sr_io gathers fragments into one buffer -- */
+static const struct sr_io_ops sc_sink_flat_io =
+{
+    "check-sink-flat",
+    sc_sink_poll,
+    sc_sink_send,
+    0,
+    0
+};
+
+static uint32_t sc_ip(const char* s)
+{
+    struct in_addr a;
+
+    inet_aton(s, &a);
+    return a.s_addr;
+} /* -- sc_ip -- */
+
+static void sc_add_if(struct sr_instance* sr, const char* name,
+                      const char* ip, unsigned char last)
+{
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+
+    mac[5] = last;
+    sr_add_interface(sr, name);
+    sr_set_ether_ip(sr, sc_ip(ip));
+    sr_set_ether_mask(sr, sc_ip("255.255.255.0"));
+    sr_set_ether_addr(sr, mac);
+} /* -- sc_add_if -- */
+
+static void sc_add_route(struct sr_instance* sr, const char* dest,
+                         const char* gw, const char* mask, char* iface)
+{
+    struct in_addr d, g, m;
+
+    inet_aton(dest, &d);
+    inet_aton(gw, &g);
+    inet_aton(mask, &m);
+    sr_add_rt_entry(sr, d, g, m, iface);
+} /* -- sc_add_route -- */
+
+static void sc_router(struct sr_instance* sr)
+{
+    static const unsigned char mac[ETHER_ADDR_LEN] =
+    { 0x02, 0, 0, 0, 0x10, 0x01 };
+
+    memset(sr, 0, sizeof(*sr));
+    sr->sockfd = -1;
+    sr->max_frame = SR_MAX_FRAME_JUMBO;
+    sr->io = &sc_sink_io;
+    sr_arpcache_init(&sr->cache);
+    if(sr_stats_open(sr, 0) != 0)
+    { exit(2); }
+
+    sc_add_if(sr, "eth1", "10.0.1.1", 1);
+    sc_add_if(sr, "eth2", "10.0.2.1", 2);
+    sc_add_if(sr, "eth3", "10.0.3.1", 3);
+
+    sc_add_route(sr, "10.0.1.0", "0.0.0.0", "255.255.255.0", "eth1");
+    sc_add_route(sr, "10.0.2.0", "0.0.0.0", "255.255.255.0", "eth2");
+    sc_add_route(sr, "192.168.0.0", "10.0.3.2", "255.255.0.0", "eth3");
+    sr_rt_resolve_interfaces(sr);
+    sr_resolve_mtus(sr);
+    sr_build_local_addrs(sr);
+    sr_icmp_build_templates(sr);
+    sr_stats_interfaces(sr);
+
+    sr_arpcache_insert_static(&sr->cache, mac, sc_ip("10.0.1.100"));
+    sr_arpcache_insert_static(&sr->cache, mac, sc_ip("10.0.2.100"));
+    sr_arpcache_insert_static(&sr->cache, mac, sc_ip("10.0.3.2"));
+} /* -- sc_router -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sc_frame(..)
+ *
+ * An IP datagram of plen payload bytes after optlen bytes of options,
+ * addressed to iface's MAC, into frame; an ICMP payload starts as an
+ * echo request.  Returns the frame length.
+ *
+ *---------------------------------------------------------------------------*/
+
+static unsigned int sc_frame(uint8_t* frame, struct sr_if* iface,
+                             const char* src, const char* dst, uint8_t proto,
+                             uint8_t ttl, uint16_t off, const uint8_t* opt,
+                             unsigned int optlen, unsigned int plen)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    unsigned int hl = sizeof(sr_ip_hdr_t) + optlen, i;
+    uint8_t* payload = (uint8_t*)ip + hl;
+    uint16_t sum;
+
+    assert(optlen % 4 == 0 && hl <= 60);
+    memset(frame, 0, sizeof(sr_ethernet_hdr_t) + hl);
+    memcpy(eth->ether_dhost, iface->addr, ETHER_ADDR_LEN);
+    eth->ether_shost[0] = 0x02;
+    eth->ether_shost[5] = 0x99;
+    eth->ether_type = htons(ethertype_ip);
+
+    ip->ip_v = 4;
+    ip->ip_hl = hl / 4;
+    ip->ip_len = htons(hl + plen);
+    ip->ip_id = htons(0x5eed);
+    ip->ip_off = htons(off);
+    ip->ip_ttl = ttl;
+    ip->ip_p = proto;
+    ip->ip_src = sc_ip(src);
+    ip->ip_dst = sc_ip(dst);
+    if(optlen)
+    { memcpy(ip + 1, opt, optlen); }
+    ip->ip_sum = cksum(ip, hl);
+
+    for(i = 0; i < plen; i++)
+    { payload[i] = (uint8_t)(i * 7 + 3); }
+    if(proto == ip_protocol_icmp)
+    {
+        payload[0] = icmp_type_echo_request;
+        payload[1] = 0;
+        payload[2] = payload[3] = 0;
+        sum = cksum(payload, plen);
+        memcpy(payload + 2, &sum, 2);
+    }
+    return sizeof(sr_ethernet_hdr_t) + hl + plen;
+} /* -- sc_frame -- */
+
+/* -- the router rewrites what it is handed, so it gets a copy -- */
+static void sc_receive(struct sr_instance* sr, const uint8_t* frame,
+                       unsigned int len, struct sr_if* iface)
+{
+    static uint8_t work[SR_MAX_FRAME_JUMBO];
+
+    sc_nout = 0;
+    memcpy(work, frame, len);
+    sr_io_receive(sr, work, len, iface);
+} /* -- sc_receive -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sc_frags(..)
+ *
+ * What came out for orig, forwarded out iface and cut to its MTU: every
+ * fragment fits, offsets run on from each other (and from orig's own),
+ * all but the last carry a multiple of 8 bytes and MF, the last MF only
+ * if orig had it, the first every option and the rest just copied.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sc_frags(const char* name, const uint8_t* orig,
+                     struct sr_if* iface, const uint8_t* copied,
+                     unsigned int ncopied)
+{
+    const sr_ip_hdr_t* oip =
+        (const sr_ip_hdr_t*)(orig + sizeof(sr_ethernet_hdr_t));
+    const sr_ip_hdr_t* ip;
+    unsigned int ohl = oip->ip_hl * 4, plen = ntohs(oip->ip_len) - ohl;
+    unsigned int base = ntohs(oip->ip_off) & IP_OFFMASK;
+    unsigned int mf = ntohs(oip->ip_off) & IP_MF;
+    unsigned int i, hl, len, off = 0, ip_off;
+
+    snprintf(sc_test, sizeof(sc_test), "%s", name);
+    sc_check(sc_nout > 1, "datagram over the MTU is fragmented");
+
+    for(i = 0; i < sc_nout; i++)
+    {
+        snprintf(sc_test, sizeof(sc_test), "%s fragment %u", name, i);
+        ip = (const sr_ip_hdr_t*)(sc_out[i].frame +
+                sizeof(sr_ethernet_hdr_t));
+        hl = ip->ip_hl * 4;
+        len = ntohs(ip->ip_len) - hl;
+        ip_off = ntohs(ip->ip_off);
+
+        sc_check(sc_out[i].iface == iface, "sent out the route's interface");
+        sc_check(sc_out[i].len == sizeof(sr_ethernet_hdr_t) + hl + len,
+                 "frame holds just the fragment");
+        sc_check(hl + len <= iface->mtu, "fits the MTU");
+        sc_check(sc_cksum_ok(ip, hl), "IP checksum verifies");
+        sc_check((ip_off & IP_OFFMASK) == base + off / 8,
+                 "offset follows on from the previous fragment");
+        sc_check(!(ip_off & IP_DF), "DF clear");
+        if(i + 1 < sc_nout)
+        {
+            sc_check(len % 8 == 0, "payload a multiple of 8 bytes");
+            sc_check(ip_off & IP_MF, "MF set");
+        }
+        else
+        { sc_check((ip_off & IP_MF) == mf, "MF on the last as on the whole"); }
+        sc_check(ip->ip_ttl == oip->ip_ttl - 1, "TTL decremented");
+        sc_check(ip->ip_id == oip->ip_id && ip->ip_p == oip->ip_p &&
+                 ip->ip_src == oip->ip_src && ip->ip_dst == oip->ip_dst,
+                 "id, protocol and addresses kept");
+        if(i == 0)
+        {
+            sc_check(hl == ohl && memcmp(ip + 1, oip + 1, ohl -
+                        sizeof(sr_ip_hdr_t)) == 0,
+                     "first fragment keeps every option");
+        }
+        else
+        {
+            sc_check(hl == sizeof(sr_ip_hdr_t) + ncopied &&
+                     memcmp(ip + 1, copied, ncopied) == 0,
+                     "later fragments keep only the copied options");
+        }
+        sc_check(off + len <= plen &&
+                 memcmp((const uint8_t*)ip + hl,
+                        (const uint8_t*)oip + ohl + off, len) == 0,
+                 "payload is the original's at that offset");
+        off += len;
+    }
+    snprintf(sc_test, sizeof(sc_test), "%s", name);
+    sc_check(off == plen, "fragments add up to the payload");
+} /* -- sc_frags -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sc_error(..)
+ *
+ * The one ICMP error orig should have drawn, sourced from from and sent
+ * back out it.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sc_error(const uint8_t* orig, struct sr_if* from, uint8_t type,
+                     uint8_t code, uint16_t next_mtu)
+{
+    const sr_ip_hdr_t* oip =
+        (const sr_ip_hdr_t*)(orig + sizeof(sr_ethernet_hdr_t));
+    const sr_ip_hdr_t* ip;
+    const sr_icmp_t3_hdr_t* icmp;
+
+    sc_check(sc_nout == 1, "one ICMP error sent");
+    if(sc_nout != 1)
+    { return; }
+    ip = (const sr_ip_hdr_t*)(sc_out[0].frame + sizeof(sr_ethernet_hdr_t));
+    icmp = (const sr_icmp_t3_hdr_t*)(ip + 1);
+
+    sc_check(sc_out[0].iface == from && sc_out[0].len == SR_ICMP_ERROR_FRAME,
+             "error frame out the interface the datagram came in on");
+    sc_check(ip->ip_src == from->ip && ip->ip_dst == oip->ip_src,
+             "from that interface's address to the datagram's source");
+    sc_check(ip->ip_p == ip_protocol_icmp && ip->ip_hl == 5 &&
+             ntohs(ip->ip_len) == sizeof(sr_ip_hdr_t) +
+             sizeof(sr_icmp_t3_hdr_t), "ICMP datagram of the error's length");
+    sc_check(sc_cksum_ok(ip, sizeof(sr_ip_hdr_t)),
+             "IP checksum from the template verifies");
+    sc_check(icmp->icmp_type == type && icmp->icmp_code == code,
+             "type and code");
+    sc_check(ntohs(icmp->next_mtu) == next_mtu, "next-hop MTU");
+    sc_check(sc_cksum_ok(icmp, sizeof(sr_icmp_t3_hdr_t)),
+             "ICMP checksum verifies");
+    sc_check(memcmp(icmp->data, oip, ICMP_DATA_SIZE) == 0,
+             "quotes the header and the first 8 bytes");
+} /* -- sc_error -- */
+
+/*-----------------------------------------------------------------------------
+ * The checks
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sc_fragments(struct sr_instance* sr)
+{
+    /* -- no-op, record route (not copied), router alert (copied) -- */
+    static const uint8_t opts[12] =
+    { 1, 7, 7, 4, 0, 0, 0, 0, 0x94, 4, 0, 0 };
+    static const uint8_t copied[4] = { 0x94, 4, 0, 0 };
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    struct sr_if* in = sr->if_table[0];
+    struct sr_if* out = sr->if_table[2];
+    unsigned int len, mtu = out->mtu;
+    int flat;
+
+    for(flat = 0; flat < 2; flat++)
+    {
+        sr->io = flat ? &sc_sink_flat_io : &sc_sink_io;
+        out->mtu = 1500;
+
+        len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5",
+                ip_protocol_udp, 64, 0, opts, sizeof(opts), 4000);
+        sc_receive(sr, frame, len, in);
+        sc_frags(flat ? "frag/options/flat" : "frag/options", frame, out,
+                 copied, sizeof(copied));
+
+        /* -- an MTU that is not a multiple of 8 past the header -- */
+        out->mtu = 1003;
+        len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5",
+                ip_protocol_udp, 64, 0, 0, 0, 3000);
+        sc_receive(sr, frame, len, in);
+        sc_frags(flat ? "frag/odd_mtu/flat" : "frag/odd_mtu", frame, out,
+                 0, 0);
+
+        /* -- a middle fragment of something larger, cut again -- */
+        len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5",
+                ip_protocol_udp, 64, IP_MF | 100, 0, 0, 2000);
+        sc_receive(sr, frame, len, in);
+        sc_frags(flat ? "frag/refrag/flat" : "frag/refrag", frame, out,
+                 0, 0);
+    }
+    sr->io = &sc_sink_io;
+    out->mtu = mtu;
+} /* -- sc_fragments -- */
+
+static void sc_frag_needed(struct sr_instance* sr)
+{
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    struct sr_if* in = sr->if_table[0];
+    struct sr_if* out = sr->if_table[2];
+    unsigned int len, mtu = out->mtu;
+
+    out->mtu = 1500;
+    snprintf(sc_test, sizeof(sc_test), "frag_needed");
+    len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5", ip_protocol_udp,
+            64, IP_DF, 0, 0, 2000);
+    sc_receive(sr, frame, len, in);
+    sc_error(frame, in, icmp_type_dest_unreach, icmp_code_frag_needed, 1500);
+
+    /* -- DF at or under the MTU is simply forwarded -- */
+    snprintf(sc_test, sizeof(sc_test), "frag_needed/fits");
+    len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5", ip_protocol_udp,
+            64, IP_DF, 0, 0, 1500 - sizeof(sr_ip_hdr_t));
+    sc_receive(sr, frame, len, in);
+    sc_check(sc_nout == 1 && sc_out[0].iface == out &&
+             sc_out[0].len == len, "forwarded whole");
+    out->mtu = mtu;
+} /* -- sc_frag_needed -- */
+
+static void sc_errors(struct sr_instance* sr)
+{
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    static const char* src[2] = { "10.0.1.100", "10.0.2.100" };
+    struct sr_if* in;
+    unsigned int len;
+    int i;
+
+    /* -- from two sources, so the template's patched sum is tried twice -- */
+    for(i = 0; i < 2; i++)
+    {
+        in = sr->if_table[i];
+
+        snprintf(sc_test, sizeof(sc_test), "error/ttl_expired/%s", in->name);
+        len = sc_frame(frame, in, src[i], "192.168.5.5", ip_protocol_udp,
+                1, 0, 0, 0, 64);
+        sc_receive(sr, frame, len, in);
+        sc_error(frame, in, icmp_type_time_exceeded, 0, 0);
+
+        snprintf(sc_test, sizeof(sc_test), "error/net_unreach/%s", in->name);
+        len = sc_frame(frame, in, src[i], "8.8.8.8", ip_protocol_udp,
+                64, 0, 0, 0, 64);
+        sc_receive(sr, frame, len, in);
+        sc_error(frame, in, icmp_type_dest_unreach, icmp_code_net_unreach,
+                 0);
+
+        snprintf(sc_test, sizeof(sc_test), "error/port_unreach/%s",
+                 in->name);
+        len = sc_frame(frame, in, src[i], "10.0.3.1", ip_protocol_udp,
+                64, 0, 0, 0, 64);
+        sc_receive(sr, frame, len, in);
+        sc_error(frame, in, icmp_type_dest_unreach, icmp_code_port_unreach,
+                 0);
+    }
+} /* -- sc_errors -- */
+
+static void sc_echo(struct sr_instance* sr)
+{
+    static const uint8_t opts[4] = { 0x94, 4, 0, 0 };
+    static const unsigned int plens[4] = { 8, 56, 57, 1472 };
+    static const uint8_t ttls[2] = { 64, 1 };
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    struct sr_if* in = sr->if_table[0];
+    const sr_ip_hdr_t *ip, *oip;
+    const uint8_t *icmp, *oicmp;
+    unsigned int len, optlen, hl, plen;
+    int i, t, o;
+
+    oip = (const sr_ip_hdr_t*)(frame + sizeof(sr_ethernet_hdr_t));
+    for(o = 0; o < 2; o++)
+    for(t = 0; t < 2; t++)
+    for(i = 0; i < 4; i++)
+    {
+        optlen = o ? sizeof(opts) : 0;
+        hl = sizeof(sr_ip_hdr_t) + optlen;
+        plen = plens[i];
+        snprintf(sc_test, sizeof(sc_test), "echo/%u%s/ttl%d", plen,
+                 o ? "/options" : "", ttls[t]);
+
+        /* -- to each of the router's addresses in turn -- */
+        len = sc_frame(frame, in, "10.0.1.100",
+                i % 3 == 0 ? "10.0.1.1" : i % 3 == 1 ? "10.0.2.1" :
+                "10.0.3.1", ip_protocol_icmp, ttls[t], 0, opts, optlen,
+                plen);
+        sc_receive(sr, frame, len, in);
+
+        sc_check(sc_nout == 1, "one reply");
+        if(sc_nout != 1)
+        { continue; }
+        ip = (const sr_ip_hdr_t*)(sc_out[0].frame +
+                sizeof(sr_ethernet_hdr_t));
+        icmp = (const uint8_t*)ip + hl;
+        oicmp = (const uint8_t*)oip + hl;
+
+        sc_check(sc_out[0].iface == in && sc_out[0].len == len,
+                 "same length back out the way it came");
+        sc_check(ip->ip_src == oip->ip_dst && ip->ip_dst == oip->ip_src,
+                 "addresses swapped");
+        sc_check(ip->ip_hl * 4 == hl && memcmp(ip + 1, oip + 1, optlen) == 0,
+                 "options kept");
+        sc_check(sc_cksum_ok(ip, hl), "incremental IP checksum verifies");
+        sc_check(icmp[0] == icmp_type_echo_reply && icmp[1] == 0,
+                 "echo reply");
+        sc_check(sc_cksum_ok(icmp, plen),
+                 "incremental ICMP checksum verifies");
+        sc_check(memcmp(icmp + 4, oicmp + 4, plen - 4) == 0,
+                 "identifier, sequence and data echoed");
+    }
+} /* -- sc_echo -- */
+
+static void sc_suppressed(struct sr_instance* sr)
+{
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    static const struct
+    {
+        const char* name;
+        const char* src;
+        uint16_t off;
+    } cases[5] =
+    {
+        { "suppress/later_fragment", "10.0.1.100", 100 },
+        { "suppress/broadcast_src", "10.0.1.255", 0 },
+        { "suppress/limited_broadcast_src", "255.255.255.255", 0 },
+        { "suppress/multicast_src", "224.0.0.5", 0 },
+        { "suppress/zero_src", "0.0.0.0", 0 },
+    };
+    struct sr_if* in = sr->if_table[0];
+    uint8_t* icmp;
+    uint16_t sum;
+    unsigned int len;
+    int i;
+
+    for(i = 0; i < 5; i++)
+    {
+        snprintf(sc_test, sizeof(sc_test), "%s", cases[i].name);
+        len = sc_frame(frame, in, cases[i].src, "192.168.5.5",
+                ip_protocol_udp, 1, cases[i].off, 0, 0, 64);
+        sc_receive(sr, frame, len, in);
+        sc_check(sc_nout == 0, "no ICMP error");
+    }
+
+    /* -- an error about an error: the TTL of a port unreachable runs out -- */
+    snprintf(sc_test, sizeof(sc_test), "suppress/icmp_error");
+    len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5", ip_protocol_icmp,
+            1, 0, 0, 0, 36);
+    icmp = frame + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t);
+    icmp[0] = icmp_type_dest_unreach;
+    icmp[1] = icmp_code_port_unreach;
+    icmp[2] = icmp[3] = 0;
+    sum = cksum(icmp, 36);
+    memcpy(icmp + 2, &sum, 2);
+    sc_receive(sr, frame, len, in);
+    sc_check(sc_nout == 0, "no ICMP error");
+
+    /* -- but queries and first fragments still get theirs -- */
+    snprintf(sc_test, sizeof(sc_test), "suppress/not_echo");
+    len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5", ip_protocol_icmp,
+            1, 0, 0, 0, 36);
+    sc_receive(sr, frame, len, in);
+    sc_error(frame, in, icmp_type_time_exceeded, 0, 0);
+
+    snprintf(sc_test, sizeof(sc_test), "suppress/not_first_fragment");
+    len = sc_frame(frame, in, "10.0.1.100", "192.168.5.5", ip_protocol_udp,
+            1, IP_MF, 0, 0, 64);
+    sc_receive(sr, frame, len, in);
+    sc_error(frame, in, icmp_type_time_exceeded, 0, 0);
+} /* -- sc_suppressed -- */
+
+/* -- every ARP request out of tries and due: the next tick times it out -- */
+static void sc_arp_expire(struct sr_instance* sr)
+{
+    struct sr_arpreq* req;
+
+    for(req = sr->cache.requests; req; req = req->next)
+    {
+        req->times_sent = 5;
+        req->sent = time(0) - 2;
+    }
+    sc_nout = 0;
+    sr_arpcache_tick(sr);
+} /* -- sc_arp_expire -- */
+
+static void sc_arp_timeout(struct sr_instance* sr)
+{
+    static uint8_t frame[SR_MAX_FRAME_JUMBO];
+    static uint8_t quoted[SR_MAX_FRAME_JUMBO];
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(quoted + sizeof(sr_ethernet_hdr_t));
+    struct sr_if* in = sr->if_table[0];
+    struct sr_if* dead = sr->if_table[1];
+    unsigned int len;
+
+    snprintf(sc_test, sizeof(sc_test), "arp_timeout");
+    len = sc_frame(frame, in, "10.0.1.100", "10.0.2.50", ip_protocol_udp,
+            64, 0, 0, 0, 64);
+    sc_receive(sr, frame, len, in);
+    sc_check(sc_nout == 1 && sc_out[0].iface == dead &&
+             ethertype(sc_out[0].frame) == ethertype_arp,
+             "ARP request out the route's interface");
+    sc_check(sr->cache.requests != 0, "datagram queued");
+
+    /* -- the error quotes the datagram as it waited, TTL decremented -- */
+    memcpy(quoted, frame, len);
+    ip->ip_ttl--;
+    ip->ip_sum = 0;
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+    sc_arp_expire(sr);
+    sc_error(quoted, in, icmp_type_dest_unreach, icmp_code_host_unreach, 0);
+    sc_check(sr->cache.requests == 0, "request destroyed");
+
+    /* -- the source is behind the same dead link: its error waits on a
+     *    new request, which times out without an error of its own -- */
+    snprintf(sc_test, sizeof(sc_test), "arp_timeout/dead_source");
+    len = sc_frame(frame, dead, "10.0.2.60", "10.0.1.50", ip_protocol_udp,
+            64, 0, 0, 0, 64);
+    sc_receive(sr, frame, len, dead);
+    sc_check(sc_nout == 1 && sc_out[0].iface == in &&
+             ethertype(sc_out[0].frame) == ethertype_arp,
+             "ARP request for the destination");
+    sc_arp_expire(sr);
+    sc_check(sc_nout == 1 && sc_out[0].iface == dead &&
+             ethertype(sc_out[0].frame) == ethertype_arp,
+             "ARP request for the source, the error queued on it");
+    sc_check(sr->cache.requests != 0 && sr->cache.requests->next == 0,
+             "only the source's request left");
+    sc_arp_expire(sr);
+    sc_check(sc_nout == 0, "no error about the error");
+    sc_check(sr->cache.requests == 0, "request destroyed");
+} /* -- sc_arp_timeout -- */
+
+static void usage(const char* argv0)
+{
+    printf("Forwarding path behaviour checks\n");
+    printf("Format: %s [-h] [-v]\n", argv0);
+    printf("   -v logs what the router does at debug level\n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_instance* sr;
+    int c;
+
+    sr_log_level = SR_LOG_ERROR;
+    while((c = getopt(argc, argv, "hv")) != EOF)
+    {
+        switch(c)
+        {
+            case 'v': sr_log_level = SR_LOG_DEBUG; break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 2;
+        }
+    }
+
+    sr = (struct sr_instance*)malloc(sizeof(struct sr_instance));
+    assert(sr);
+    sc_router(sr);
+
+    sc_fragments(sr);
+    sc_frag_needed(sr);
+    sc_errors(sr);
+    sc_echo(sr);
+    sc_suppressed(sr);
+    sc_arp_timeout(sr);
+
+    printf("srcheck: %d checks, %d failed\n", sc_checks, sc_failed);
+    return sc_failed ? 1 : 0;
+} /* -- main -- */
@@ -0,0 +1,347 @@
+/*-----------------------------------------------------------------------------
+ * file:  srregress.c
+ *
+ * Description:
+ *
+ * Throughput regression check between two sr binaries on the same
+ * offline workload.  Each is run through the replay backend (-R) on the
+ * same rtable, interface config and pcap, one warm-up run each and then
+ * -n runs in alternation, so drift in the machine (thermal, a neighbour)
+ * lands on both alike.  From every run we take what sr itself reports:
+ *
+ *   replay: ... frames in T s, P pkts/s, N ns/pkt, ...
+ *   replay: fast path latency us p50 A p90 B p99 C p99.9 D
+ *
+ * (builds older than the second line say it as "stats: ..." at -L info)
+ * and compare the medians.  A run that leaves any of these out fails.  A difference counts only if it is also
+ * significant: two-sided Mann-Whitney U, normal approximation with tie
+ * correction, which needs no assumption about the shape of the noise.
+ *
+ * Exit status is 1 if the second binary's packets/s median is more than
+ * -t percent below the first's and p < -a, 2 if a run failed, else 0.
+ * A table goes to stderr and JSON to stdout or -o.
+ *
+ *   ./srregress -n 10 -r rtable -I if.conf -R trace.pcap old/sr new/sr
+ *
+ * regress.sh builds the two binaries from git revisions and makes the
+ * workload with rtgen.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sched.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SG_MAX_RUNS 64
+
+enum sg_metric
+{
+    sg_pps,
+    sg_ns_per_pkt,
+    sg_p50_us,
+    sg_p99_us,
+    sg_p999_us,
+    SG_METRICS
+};
+
+static const struct
+{
+    const char* name;
+    int higher_is_better;
+} sg_metrics[SG_METRICS] =
+{
+    { "pkts_per_sec", 1 },
+    { "ns_per_pkt", 0 },
+    { "latency_p50_us", 0 },
+    { "latency_p99_us", 0 },
+    { "latency_p99.9_us", 0 },
+};
+
+struct sg_build
+{
+    const char* sr;
+    double v[SG_METRICS][SG_MAX_RUNS];
+    int runs;
+};
+
+struct sg_opts
+{
+    const char* rtable;
+    const char* ifconfig;
+    const char* pcap;
+    const char* passes;
+    int cpu;
+};
+
+/*-----------------------------------------------------------------------------
+ * Method: sg_run(..)
+ *
+ * One replay of the workload through b->sr, metrics into run slot i (or
+ * nowhere for the warm-up, i < 0).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sg_run(const struct sg_opts* o, struct sg_build* b, int i)
+{
+    char line[1024], code[16];
+    const char* in;
+    double got[SG_METRICS], p90;
+    cpu_set_t set;
+    FILE* fp;
+    pid_t pid;
+    int pfd[2], status, k, replayed = 0;
+
+    for(k = 0; k < SG_METRICS; k++)
+    { got[k] = -1; }
+
+    if(pipe(pfd) != 0)
+    { perror("pipe"); return -1; }
+    if((pid = fork()) < 0)
+    { perror("fork"); return -1; }
+    if(pid == 0)
+    {
+        dup2(pfd[1], 1);
+        dup2(pfd[1], 2);
+        close(pfd[0]);
+        close(pfd[1]);
+        if(o->cpu >= 0)
+        {
+            CPU_ZERO(&set);
+            CPU_SET(o->cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+        }
+        execl(b->sr, b->sr, "-r", o->rtable, "-I", o->ifconfig, "-R",
+                o->pcap, "-n", o->passes, "-L", "info", (char*)0);
+        perror(b->sr);
+        _exit(127);
+    }
+    close(pfd[1]);
+
+    fp = fdopen(pfd[0], "r");
+    while(fgets(line, sizeof(line), fp) != 0)
+    {
+        if(strncmp(line, "replay: ", 8) == 0 &&
+                (in = strstr(line, " frames in ")) != 0 &&
+                sscanf(in, " frames in %*f s, %lf pkts/s, %lf",
+                    &got[sg_pps], &got[sg_ns_per_pkt]) == 2)
+        { replayed = 1; }
+        /* -- replay: from sr_replay.c, stats: from builds at -L info -- */
+        if((strncmp(line, "replay: ", 8) == 0 ||
+                    strncmp(line, "stats: ", 7) == 0) &&
+                (in = strstr(line, " fast path latency us ")) != 0)
+        {
+            sscanf(in, " fast path latency us p50 %lf p90 %lf p99 %lf "
+                    "p99.9 %lf", &got[sg_p50_us], &p90, &got[sg_p99_us],
+                    &got[sg_p999_us]);
+        }
+    }
+    fclose(fp);
+    waitpid(pid, &status, 0);
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !replayed)
+    {
+        snprintf(code, sizeof(code), "%d", WIFEXITED(status) ?
+                WEXITSTATUS(status) : -WTERMSIG(status));
+        fprintf(stderr, "%s: run failed (exit %s%s)\n", b->sr, code,
+                replayed ? "" : ", no replay summary");
+        return -1;
+    }
+    for(k = 0; k < SG_METRICS; k++)
+    {
+        if(got[k] < 0)
+        {
+            fprintf(stderr, "%s: run failed (no %s in the output)\n", b->sr,
+                    sg_metrics[k].name);
+            return -1;
+        }
+    }
+    if(i >= 0)
+    {
+        for(k = 0; k < SG_METRICS; k++)
+        { b->v[k][i] = got[k]; }
+        b->runs = i + 1;
+    }
+    return 0;
+} /* -- sg_run -- */
+
+static int sg_cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+} /* -- sg_cmp_double -- */
+
+static double sg_median(const double* v, int n)
+{
+    double s[SG_MAX_RUNS];
+
+    memcpy(s, v, n * sizeof(double));
+    qsort(s, n, sizeof(double), sg_cmp_double);
+    return n % 2 ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+} /* -- sg_median -- */
+
+static double sg_stdev(const double* v, int n)
+{
+    double mean = 0, ss = 0;
+    int i;
+
+    for(i = 0; i < n; i++)
+    { mean += v[i] / n; }
+    for(i = 0; i < n; i++)
+    { ss += (v[i] - mean) * (v[i] - mean); }
+    return n > 1 ? sqrt(ss / (n - 1)) : 0;
+} /* -- sg_stdev -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sg_mann_whitney(..)
+ *
+ * Two-sided p-value for a and b coming from the same distribution.  The
+ * normal approximation is fair from about 8 runs a side; below 4 no
+ * difference can reach p < 0.05 at all.
+ *
+ *---------------------------------------------------------------------------*/
+
+static double sg_mann_whitney(const double* a, int na, const double* b,
+                              int nb)
+{
+    double all[2 * SG_MAX_RUNS], rank_a = 0, u, mu, var, ties = 0, z;
+    int n = na + nb, i, j, k, t;
+
+    memcpy(all, a, na * sizeof(double));
+    memcpy(all + na, b, nb * sizeof(double));
+    qsort(all, n, sizeof(double), sg_cmp_double);
+
+    /* -- rank sum of a, tied values sharing their average rank -- */
+    for(i = 0; i < n; i = j)
+    {
+        for(j = i; j < n && all[j] == all[i]; j++);
+        t = j - i;
+        ties += (double)t * t * t - t;
+        for(k = 0; k < na; k++)
+        {
+            if(a[k] == all[i])
+            { rank_a += (i + 1 + j) / 2.0; }
+        }
+    }
+
+    u = rank_a - na * (na + 1) / 2.0;
+    mu = na * nb / 2.0;
+    var = na * nb / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if(var <= 0)
+    { return 1; }
+    z = (fabs(u - mu) - 0.5) / sqrt(var);    /* continuity corrected */
+    return z <= 0 ? 1 : erfc(z / sqrt(2));
+} /* -- sg_mann_whitney -- */
+
+static void usage(const char* argv0)
+{
+    printf("Compare two sr builds on a replayed workload\n");
+    printf("Format: %s [-h] [-n runs] [-p passes] [-t pct] [-a alpha] "
+           "[-c cpu] [-o out.json]\n"
+           "          -r rtable -I ifconfig -R pcap base_sr new_sr\n",
+           argv0);
+    printf("   -n runs of each (default 10), each replaying the pcap -p "
+           "times (default 5)\n");
+    printf("   fails if new_sr is -t percent (default 5) slower in "
+           "packets/s with p < -a (default 0.05)\n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    static struct sg_build b[2];
+    struct sg_opts o;
+    const char* out_path = 0;
+    double threshold = 5, alpha = 0.05, mb, mh, change, p;
+    double change_pct[SG_METRICS], pval[SG_METRICS];
+    int c, i, k, runs = 10, regressed = 0;
+    FILE* out = stdout;
+
+    memset(&o, 0, sizeof(o));
+    o.passes = "5";
+    o.cpu = -1;
+    while((c = getopt(argc, argv, "hn:p:t:a:c:o:r:I:R:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'n': runs = atoi(optarg); break;
+            case 'p': o.passes = optarg; break;
+            case 't': threshold = atof(optarg); break;
+            case 'a': alpha = atof(optarg); break;
+            case 'c': o.cpu = atoi(optarg); break;
+            case 'o': out_path = optarg; break;
+            case 'r': o.rtable = optarg; break;
+            case 'I': o.ifconfig = optarg; break;
+            case 'R': o.pcap = optarg; break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 2;
+        }
+    }
+    if(optind != argc - 2 || !o.rtable || !o.ifconfig || !o.pcap ||
+            runs < 2 || runs > SG_MAX_RUNS || atoi(o.passes) < 1)
+    { usage(argv[0]); return 2; }
+    b[0].sr = argv[optind];
+    b[1].sr = argv[optind + 1];
+
+    /* -- warm the page cache and the CPU, then alternate -- */
+    if(sg_run(&o, &b[0], -1) != 0 || sg_run(&o, &b[1], -1) != 0)
+    { return 2; }
+    for(i = 0; i < runs; i++)
+    {
+        fprintf(stderr, "\rrun %d/%d", i + 1, runs);
+        if(sg_run(&o, &b[i % 2], i) != 0 || sg_run(&o, &b[1 - i % 2], i) != 0)
+        { return 2; }
+    }
+    fprintf(stderr, "\r%-24s %14s %14s %9s %8s\n", "", "base median",
+            "new median", "change", "p");
+
+    for(k = 0; k < SG_METRICS; k++)
+    {
+        mb = sg_median(b[0].v[k], runs);
+        mh = sg_median(b[1].v[k], runs);
+        change = mb ? (mh - mb) / mb * 100 : 0;
+        p = sg_mann_whitney(b[0].v[k], runs, b[1].v[k], runs);
+        change_pct[k] = change;
+        pval[k] = p;
+        fprintf(stderr, "%-24s %14.2f %14.2f %+8.2f%% %8.4f%s\n",
+                sg_metrics[k].name, mb, mh, change, p,
+                p < alpha && (change > 0) == sg_metrics[k].higher_is_better ?
+                "  better" : p < alpha ? "  worse" : "");
+    }
+    regressed = change_pct[sg_pps] < -threshold &&
+                pval[sg_pps] < alpha;
+
+    if(out_path && (out = fopen(out_path, "w")) == 0)
+    { perror(out_path); return 2; }
+    fprintf(out, "{\n  \"base\": \"%s\",\n  \"new\": \"%s\",\n  \"runs\": %d,"
+            "\n  \"threshold_pct\": %g,\n  \"alpha\": %g,\n  \"metrics\": {",
+            b[0].sr, b[1].sr, runs, threshold, alpha);
+    for(k = 0, c = 0; k < SG_METRICS; k++)
+    {
+        fprintf(out, "%s\n    \"%s\": {\"base_median\": %.3f, "
+                "\"new_median\": %.3f, \"base_stdev\": %.3f, "
+                "\"new_stdev\": %.3f, \"change_pct\": %.3f, \"p\": %.5f}",
+                c++ ? "," : "", sg_metrics[k].name,
+                sg_median(b[0].v[k], runs), sg_median(b[1].v[k], runs),
+                sg_stdev(b[0].v[k], runs), sg_stdev(b[1].v[k], runs),
+                change_pct[k], pval[k]);
+    }
+    fprintf(out, "\n  },\n  \"regressed\": %s\n}\n",
+            regressed ? "true" : "false");
+    if(out != stdout)
+    { fclose(out); }
+
+    if(regressed)
+    {
+        fprintf(stderr, "REGRESSION: packets/s down %.2f%% (p %.4f), more "
+                "than %g%%\n", -change_pct[sg_pps], pval[sg_pps], threshold);
+    }
+    return regressed;
+} /* -- main -- */
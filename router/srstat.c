@@ -0,0 +1,196 @@
+/*-----------------------------------------------------------------------------
+ * file:  srstat.c
+ *
+ * Description:
+ *
+ * Read the counters of a running sr from its -K segment (sr_stats.h)
+ * without touching the router: the segment is mapped read only and the
+ * per-thread slots are added up here.
+ *
+ *   ./sr -K /dev/shm/sr.stats ... &
+ *   ./srstat /dev/shm/sr.stats          totals so far
+ *   ./srstat -i 1 /dev/shm/sr.stats     rates, once a second
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "sr_stats.h"
+
+static const struct sr_stats_seg* ss_map(const char* path)
+{
+    const struct sr_stats_seg* seg;
+    struct stat st;
+    int fd;
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    { perror(path); return 0; }
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*seg))
+    {
+        fprintf(stderr, "%s: not a stats segment (sr -K)\n", path);
+        close(fd);
+        return 0;
+    }
+    seg = (const struct sr_stats_seg*)mmap(0, sizeof(*seg), PROT_READ,
+            MAP_SHARED, fd, 0);
+    close(fd);
+    if(seg == MAP_FAILED)
+    { perror("mmap"); return 0; }
+
+    if(__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != SR_STATS_MAGIC ||
+            seg->version != SR_STATS_VERSION ||
+            seg->slots != SR_STATS_SLOTS)
+    {
+        fprintf(stderr, "%s: stats layout does not match this srstat\n",
+                path);
+        return 0;
+    }
+    return seg;
+} /* -- ss_map -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: ss_print(..)
+ *
+ * One table: totals if prev is 0, else what changed since prev, per
+ * second over secs.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void ss_print(const struct sr_stats_seg* seg,
+                     const struct sr_stats_slot* now,
+                     const struct sr_stats_slot* prev, double secs)
+{
+    const struct sr_stats_if *c, *p;
+    unsigned int i, r, k, n, any = 0;
+    double scale = prev ? 1.0 / secs : 1.0;
+    uint64_t d, lat[SR_LAT_BUCKETS];
+
+    n = __atomic_load_n(&seg->num_ifaces, __ATOMIC_ACQUIRE);
+    if(n > SR_MAX_IFACES)
+    { n = SR_MAX_IFACES; }
+
+    printf("%-12s %14s %16s %14s %16s\n", "interface",
+            prev ? "rx pkts/s" : "rx pkts", prev ? "rx bytes/s" : "rx bytes",
+            prev ? "tx pkts/s" : "tx pkts", prev ? "tx bytes/s" : "tx bytes");
+    for(i = 0; i < n; i++)
+    {
+        c = &now->ifs[i];
+        p = prev ? &prev->ifs[i] : 0;
+        printf("%-12.*s %14.0f %16.0f %14.0f %16.0f\n",
+                sr_IFACE_NAMELEN, seg->ifname[i],
+                (c->rx_pkts - (p ? p->rx_pkts : 0)) * scale,
+                (c->rx_bytes - (p ? p->rx_bytes : 0)) * scale,
+                (c->tx_pkts - (p ? p->tx_pkts : 0)) * scale,
+                (c->tx_bytes - (p ? p->tx_bytes : 0)) * scale);
+    }
+
+    for(r = 0; r < SR_DROP_REASONS; r++)
+    {
+        for(k = 0; k < SR_STATS_PROTOS; k++)
+        {
+            d = now->drops[r][k] - (prev ? prev->drops[r][k] : 0);
+            if(d == 0)
+            { continue; }
+            if(!any++)
+            { printf("drops%s:\n", prev ? " per second" : ""); }
+            printf("  %-12s %-6s %14.0f\n", sr_drop_reason_names[r],
+                    sr_stats_proto_names[k], d * scale);
+        }
+    }
+    printf("routes %llu", (unsigned long long)seg->fib_routes);
+    for(k = 0; k < SR_STATS_COUNTERS; k++)
+    {
+        d = now->counters[k] - (prev ? prev->counters[k] : 0);
+        printf(", %s %.0f", sr_stats_counter_names[k], d * scale);
+    }
+    printf("%s\n", prev ? " per second" : "");
+
+    for(k = 0; k < SR_LAT_PATHS; k++)
+    {
+        for(i = 0, d = 0; i < SR_LAT_BUCKETS; i++)
+        {
+            lat[i] = now->lat[k][i] - (prev ? prev->lat[k][i] : 0);
+            d += lat[i];
+        }
+        if(d == 0)
+        { continue; }
+        printf("latency %-6s %10llu frames, us p50 %.2f p90 %.2f p99 %.2f "
+                "p99.9 %.2f\n", sr_lat_path_names[k], (unsigned long long)d,
+                sr_stats_percentile(lat, 0.5, seg->tsc_hz) / 1e3,
+                sr_stats_percentile(lat, 0.9, seg->tsc_hz) / 1e3,
+                sr_stats_percentile(lat, 0.99, seg->tsc_hz) / 1e3,
+                sr_stats_percentile(lat, 0.999, seg->tsc_hz) / 1e3);
+    }
+    printf("\n");
+    fflush(stdout);
+} /* -- ss_print -- */
+
+static void usage(const char* argv0)
+{
+    printf("Read the counters of a running sr\n");
+    printf("Format: %s [-h] [-i seconds] [-c count] stats_file\n", argv0);
+    printf("   stats_file is what sr was given with -K\n");
+    printf("   -i prints rates every interval instead of the totals\n");
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    const struct sr_stats_seg* seg;
+    struct sr_stats_slot a, b;
+    struct sr_stats_slot *now = &a, *prev = &b, *t;
+    struct timespec ts;
+    double interval = 0;
+    int c, count = -1;
+
+    while((c = getopt(argc, argv, "hi:c:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'i':
+                interval = atof(optarg);
+                break;
+            case 'c':
+                count = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if(optind != argc - 1 || interval < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if((seg = ss_map(argv[optind])) == 0)
+    { return 1; }
+
+    sr_stats_sum(seg, now);
+    if(interval == 0)
+    {
+        printf("up %lds\n", (long)(time(NULL) - (time_t)seg->started));
+        ss_print(seg, now, 0, 0);
+        return 0;
+    }
+
+    ts.tv_sec = (time_t)interval;
+    ts.tv_nsec = (long)((interval - ts.tv_sec) * 1e9);
+    while(count < 0 || count-- > 0)
+    {
+        t = prev; prev = now; now = t;
+        nanosleep(&ts, 0);
+        sr_stats_sum(seg, now);
+        ss_print(seg, now, prev, interval);
+    }
+    return 0;
+} /* -- main -- */
@@ -40,7 +40,8 @@ typedef struct
     uint32_t mLen;
     uint32_t mType;        /* = VNSOPEN */
     uint16_t topoID;       /* Id of the topology we want to run on */
-    uint16_t pad;          /* unused */
+    uint16_t mMaxFrame;    /* largest frame the router takes; 0 (was pad)
+                              from routers that predate VNS_CAPS */
     char     mVirtualHostID[IDSIZE]; /* Id of the simulated router (e.g.
                                         'VNS-A'); */
     char     mUID[IDSIZE]; /* User id (e.g. "appenz"), for information only */
@@ -142,6 +143,8 @@ typedef struct
 #define VNS_AUTH_REQUEST 128
 #define VNS_AUTH_REPLY   256
 #define VNS_AUTH_STATUS  512
+#define VNSPACKET_BATCH 1024
+#define VNS_CAPS        2048
 
 /* rtable */
 typedef struct
@@ -197,4 +200,44 @@ typedef struct
 }__attribute__ ((__packed__)) c_auth_status;
 
 
+/*-----------------------------------------------------------------------------
+                          CAPS and PACKET BATCH
+
+  A server that sees a non-zero mMaxFrame in VNSOPEN may answer with
+  VNS_CAPS; either side then keeps to the smaller of the two frame sizes,
+  and with VNS_CAP_BATCH set on the server's side both may carry frames in
+  VNSPACKET_BATCH as well as VNSPACKET.  Nothing changes for peers that
+  never send mMaxFrame or VNS_CAPS.
+  ---------------------------------------------------------------------------*/
+
+#define VNS_MAX_FRAME    9216   /* jumbo, ethernet header included */
+#define VNS_MAX_COMMAND  65536  /* largest command either side sends */
+
+#define VNS_CAP_BATCH    1
+
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;        /* = VNS_CAPS */
+    uint32_t mMaxFrame;    /* largest frame the server sends or takes */
+    uint32_t mFlags;       /* VNS_CAP_* */
+
+}__attribute__ ((__packed__)) c_caps;
+
+typedef struct
+{
+    uint32_t mLen;
+    uint32_t mType;        /* = VNSPACKET_BATCH */
+    uint32_t mCount;       /* c_packet_entry's, each followed by its frame */
+
+}__attribute__ ((__packed__)) c_packet_batch;
+
+typedef struct
+{
+    uint32_t mFrameLen;
+    char     mInterfaceName[16];
+
+}__attribute__ ((__packed__)) c_packet_entry;
+
+
 #endif  /* __VNSCOMMAND_H */
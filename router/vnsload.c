@@ -0,0 +1,1199 @@
+/*-----------------------------------------------------------------------------
+ * file:  vnsload.c
+ *
+ * Description:
+ *
+ * Stand-in VNS server for load testing sr on localhost.  Accepts one
+ * router connection, runs the auth exchange, answers VNSOPEN (or
+ * VNS_OPEN_TEMPLATE, with a VNS_RTABLE) with hardware info for a fixed
+ * topology, and then plays the hosts on that topology: it answers the
+ * router's ARP requests and sends it timestamped traffic at a fixed rate
+ * (or with a fixed window outstanding), matching what comes back to
+ * report loss and round trip latency.
+ *
+ * Topology: the same file format as sr -I (sr_load_if_config), where
+ * "name ip mask mac" lines are router interfaces and "arp ip mac" lines
+ * are the hosts behind them.  Traffic goes from the first host to each
+ * of the others in turn (-m fwd), or as pings from the first host to the
+ * router interface it sits behind (-m echo).
+ *
+ *   ./vnsload -d 10 -r 20000 -s 64,512,1500 -W rtable.load &
+ *   ./sr -r rtable.load -L warn
+ *
+ * With -M path the router connects to a unix socket instead, takes a
+ * shared memory segment from us (sr_shm.h) and every message after that,
+ * VNSOPEN on, goes through its rings; there is no auth exchange.
+ *
+ * Routers that announce a frame size in VNSOPEN get VNS_CAPS; sizes past
+ * 1514 need sr -j, and -B packs frames into VNSPACKET_BATCH both ways.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_utils.h"
+#include "vnscommand.h"
+#include "sha1.h"
+#include "sr_shm.h"
+
+#define VL_MAX_IFACES   32
+#define VL_MAX_HOSTS    64
+#define VL_MAX_SIZES    16
+#define VL_MAX_MSG      VNS_MAX_COMMAND /* largest VNS message we accept */
+#define VL_OUT_HIGH     (4 << 20)   /* stop generating above this backlog */
+#define VL_MAGIC        0x564e534cu /* "VNSL" */
+#define VL_SALT_LEN     20
+#define VL_KEY_LEN      64          /* sr hashes exactly this much key */
+#define VL_UDP_SPORT    40000
+#define VL_UDP_DPORT    9
+#define VL_STALL_NS     100000000ull
+#define VL_SHM_RETRY_NS 50000ull    /* recheck a full ring this often */
+
+#define VL_DEFAULT_PORT 8888
+#define VL_DEFAULT_FRAME 1514       /* what routers without VNS_CAPS take */
+
+/* what rides after the UDP or ICMP header */
+struct vl_probe
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t ts_ns;
+} __attribute__ ((packed));
+
+struct vl_iface
+{
+    char name[sr_IFACE_NAMELEN];
+    uint32_t ip;                /* network byte order */
+    uint32_t mask;
+    unsigned char mac[ETHER_ADDR_LEN];
+};
+
+struct vl_host
+{
+    uint32_t ip;
+    unsigned char mac[ETHER_ADDR_LEN];
+    int iface;                  /* router interface the host sits behind */
+};
+
+struct vl_state
+{
+    int fd;
+    struct sr_shm* shm;         /* -M: messages go through its rings */
+    int echo;                   /* -m echo rather than forwarding */
+
+    struct vl_iface ifaces[VL_MAX_IFACES];
+    int nifaces;
+    struct vl_host hosts[VL_MAX_HOSTS];
+    int nhosts;
+
+    unsigned int sizes[VL_MAX_SIZES];
+    int nsizes;
+    unsigned int max_frame;     /* the router's, from VNSOPEN */
+    unsigned int batch;         /* -B frames per VNSPACKET_BATCH */
+
+    unsigned char* in;          /* partial message being read */
+    unsigned int in_len;
+    unsigned char* out;         /* bytes waiting for the socket or ring */
+    unsigned int out_len;
+    unsigned int out_cap;
+    unsigned int batch_off;     /* VNSPACKET_BATCH open in out */
+    unsigned int batch_count;   /* its frames, 0 when none is open */
+
+    uint32_t seq;               /* next probe sequence number */
+    uint32_t measure_from;      /* first probe that counts */
+    int next_dst;
+
+    uint64_t sent;              /* probes counted */
+    uint64_t sent_bytes;
+    uint64_t received;          /* of those, came back */
+    uint64_t outstanding;       /* closed loop window */
+    uint64_t last_rx_ns;
+    uint64_t stalls;            /* window reset after replies stopped */
+    uint64_t throttled;         /* sends skipped with the socket backed up */
+    uint64_t arp_replies;
+    uint64_t icmp_errors;
+    uint64_t unexpected;        /* frames we did not ask for */
+
+    uint64_t* rtt;              /* ns, one per received probe */
+    uint64_t rtt_len;
+    uint64_t rtt_cap;
+
+    int closed;                 /* router sent VNSCLOSE or hung up */
+};
+
+static const char* default_topology[] =
+{
+    "eth3 10.0.1.1 255.255.255.0 02:00:00:00:03:01",
+    "eth1 192.168.2.1 255.255.255.0 02:00:00:00:01:01",
+    "eth2 172.64.3.1 255.255.255.0 02:00:00:00:02:01",
+    "arp 10.0.1.100 02:00:00:00:03:64",
+    "arp 192.168.2.2 02:00:00:00:01:02",
+    "arp 172.64.3.10 02:00:00:00:02:0a",
+    0
+};
+
+/*-----------------------------------------------------------------------------
+ * Helpers
+ *---------------------------------------------------------------------------*/
+
+static uint64_t vl_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+} /* -- vl_now -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_topology_line(..)
+ *
+ * One line of topology, same format as sr_load_if_config.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vl_topology_line(struct vl_state* vl, const char* line)
+{
+    char name[32], ip[32], mask[32], mac[32];
+    struct in_addr a, m;
+    struct vl_iface* ifc;
+    struct vl_host* h;
+    int fields;
+
+    fields = sscanf(line, "%31s %31s %31s %31s", name, ip, mask, mac);
+    if(fields <= 0 || name[0] == '#')
+    { return 0; }
+
+    if(strcmp(name, "arp") == 0)
+    {
+        if(fields != 3 || vl->nhosts == VL_MAX_HOSTS ||
+                inet_aton(ip, &a) == 0)
+        { return -1; }
+        h = &vl->hosts[vl->nhosts];
+        if(parse_addr_eth(mask, h->mac) != 0)
+        { return -1; }
+        h->ip = a.s_addr;
+        h->iface = -1;
+        vl->nhosts++;
+        return 0;
+    }
+
+    if(fields != 4 || vl->nifaces == VL_MAX_IFACES ||
+            inet_aton(ip, &a) == 0 || inet_aton(mask, &m) == 0)
+    { return -1; }
+    ifc = &vl->ifaces[vl->nifaces];
+    if(parse_addr_eth(mac, ifc->mac) != 0)
+    { return -1; }
+    strncpy(ifc->name, name, sr_IFACE_NAMELEN - 1);
+    ifc->ip = a.s_addr;
+    ifc->mask = m.s_addr;
+    vl->nifaces++;
+    return 0;
+} /* -- vl_topology_line -- */
+
+static int vl_load_topology(struct vl_state* vl, const char* fname)
+{
+    char line[BUFSIZ];
+    FILE* fp;
+    int i, j;
+
+    if(fname)
+    {
+        if((fp = fopen(fname, "r")) == 0)
+        { perror(fname); return -1; }
+        while(fgets(line, sizeof(line), fp))
+        {
+            if(vl_topology_line(vl, line) != 0)
+            {
+                fprintf(stderr, "%s: bad entry: %s", fname, line);
+                fclose(fp);
+                return -1;
+            }
+        }
+        fclose(fp);
+    }
+    else
+    {
+        for(i = 0; default_topology[i]; i++)
+        { vl_topology_line(vl, default_topology[i]); }
+    }
+
+    /* -- each host sits behind the interface whose subnet holds it -- */
+    for(i = 0; i < vl->nhosts; i++)
+    {
+        for(j = 0; j < vl->nifaces; j++)
+        {
+            if((vl->hosts[i].ip & vl->ifaces[j].mask) ==
+                    (vl->ifaces[j].ip & vl->ifaces[j].mask))
+            { vl->hosts[i].iface = j; break; }
+        }
+        if(vl->hosts[i].iface < 0)
+        {
+            fprintf(stderr, "host %s is on no interface's subnet\n",
+                    inet_ntoa(*(struct in_addr*)&vl->hosts[i].ip));
+            return -1;
+        }
+    }
+
+    if(vl->nhosts < (vl->echo ? 1 : 2))
+    {
+        fprintf(stderr, "topology needs %d hosts for this mode\n",
+                vl->echo ? 1 : 2);
+        return -1;
+    }
+    return 0;
+} /* -- vl_load_topology -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_rtable(..)
+ *
+ * A routing table for the topology, a host route per host.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vl_rtable(struct vl_state* vl, char* buf, int size)
+{
+    char ip[INET_ADDRSTRLEN];
+    int i, n = 0;
+
+    for(i = 0; i < vl->nhosts && n < size; i++)
+    {
+        inet_ntop(AF_INET, &vl->hosts[i].ip, ip, sizeof(ip));
+        n += snprintf(buf + n, size - n, "%s %s 255.255.255.255 %s\n",
+                ip, ip, vl->ifaces[vl->hosts[i].iface].name);
+    }
+    return n < size ? n : size;
+} /* -- vl_rtable -- */
+
+/*-----------------------------------------------------------------------------
+ * Output: messages are queued and written when the socket takes them, so
+ * that a router blocked writing to us never deadlocks against us blocked
+ * writing to it.  A VNSPACKET_BATCH stays open for more frames until it
+ * is full or the queue is flushed.
+ *---------------------------------------------------------------------------*/
+
+static unsigned char* vl_reserve(struct vl_state* vl, unsigned int len)
+{
+    unsigned char* p;
+
+    if(vl->out_len + len > vl->out_cap)
+    {
+        vl->out_cap = (vl->out_len + len) * 2;
+        vl->out = (unsigned char*)realloc(vl->out, vl->out_cap);
+        assert(vl->out);
+    }
+    p = vl->out + vl->out_len;
+    vl->out_len += len;
+    memset(p, 0, len);
+    return p;
+} /* -- vl_reserve -- */
+
+static unsigned char* vl_queue(struct vl_state* vl, uint32_t type,
+                               unsigned int len)
+{
+    c_base* hdr = (c_base*)vl_reserve(vl, len);
+
+    hdr->mLen = htonl(len);
+    hdr->mType = htonl(type);
+    vl->batch_count = 0;
+    return (unsigned char*)hdr;
+} /* -- vl_queue -- */
+
+/* -- with -M, whole messages move to the ring while they fit -- */
+static int vl_flush_shm(struct vl_state* vl)
+{
+    struct sr_shm_ring* ring = &vl->shm->rings[SR_SHM_TO_ROUTER];
+    unsigned int off = 0;
+    uint32_t len, total;
+    uint8_t* p;
+    int bell = 0;
+
+    while(vl->out_len - off >= sizeof(c_base))
+    {
+        len = ntohl(((c_base*)(vl->out + off))->mLen);
+        if((p = sr_shm_reserve(ring, len, &total)) == 0)
+        { break; }
+        memcpy(p, vl->out + off, len);
+        bell |= sr_shm_commit(ring, total);
+        off += len;
+    }
+    if(bell)
+    { sr_shm_ring_bell(vl->shm->bell[SR_SHM_TO_ROUTER]); }
+
+    memmove(vl->out, vl->out + off, vl->out_len - off);
+    vl->out_len -= off;
+    return 0;
+} /* -- vl_flush_shm -- */
+
+static int vl_flush(struct vl_state* vl)
+{
+    ssize_t n;
+
+    vl->batch_count = 0;
+    if(vl->shm)
+    { return vl_flush_shm(vl); }
+
+    while(vl->out_len)
+    {
+        n = send(vl->fd, vl->out, vl->out_len, MSG_NOSIGNAL);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            { return 0; }
+            perror("send");
+            return -1;
+        }
+        memmove(vl->out, vl->out + n, vl->out_len - n);
+        vl->out_len -= n;
+    }
+    return 0;
+} /* -- vl_flush -- */
+
+static unsigned char* vl_queue_frame(struct vl_state* vl, int iface,
+                                     unsigned int len)
+{
+    c_packet_header* hdr;
+    c_packet_batch* batch;
+    c_packet_entry* e;
+    unsigned int need = sizeof(c_packet_entry) + len;
+
+    if(vl->batch > 1)
+    {
+        if(vl->batch_count == 0 || vl->batch_count == vl->batch ||
+                vl->out_len - vl->batch_off + need > VNS_MAX_COMMAND)
+        {
+            vl_queue(vl, VNSPACKET_BATCH, sizeof(c_packet_batch));
+            vl->batch_off = vl->out_len - sizeof(c_packet_batch);
+        }
+        e = (c_packet_entry*)vl_reserve(vl, need);
+        e->mFrameLen = htonl(len);
+        strncpy(e->mInterfaceName, vl->ifaces[iface].name,
+                sizeof(e->mInterfaceName));
+
+        batch = (c_packet_batch*)(vl->out + vl->batch_off);
+        batch->mLen = htonl(vl->out_len - vl->batch_off);
+        batch->mCount = htonl(++vl->batch_count);
+        return (unsigned char*)(e + 1);
+    }
+
+    hdr = (c_packet_header*)vl_queue(vl, VNSPACKET,
+            sizeof(c_packet_header) + len);
+    strncpy(hdr->mInterfaceName, vl->ifaces[iface].name,
+            sizeof(hdr->mInterfaceName));
+    return (unsigned char*)(hdr + 1);
+} /* -- vl_queue_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Input: blocking reads for the handshake, then vl_read/vl_next_msg.
+ *---------------------------------------------------------------------------*/
+
+static int vl_read_full(int fd, void* buf, unsigned int len)
+{
+    ssize_t n;
+    unsigned int got = 0;
+
+    while(got < len)
+    {
+        n = recv(fd, (char*)buf + got, len - got, 0);
+        if(n < 0 && errno == EINTR)
+        { continue; }
+        if(n <= 0)
+        { return -1; }
+        got += n;
+    }
+    return 0;
+} /* -- vl_read_full -- */
+
+/* -- with -M, wait on the doorbell for the next message in the ring -- */
+static unsigned char* vl_read_msg_shm(struct vl_state* vl, uint32_t* type,
+                                      uint32_t* len)
+{
+    struct sr_shm_ring* ring = &vl->shm->rings[SR_SHM_TO_SOURCE];
+    struct pollfd pfd[2];
+    unsigned char* buf;
+    uint8_t* msg;
+    int r;
+
+    while((r = sr_shm_peek(ring, &msg, len)) == 0)
+    {
+        if(!sr_shm_empty(ring))
+        { continue; }
+        pfd[0].fd = vl->fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = vl->shm->bell[SR_SHM_TO_SOURCE];
+        pfd[1].events = POLLIN;
+        if(poll(pfd, 2, -1) < 0 && errno != EINTR)
+        { return 0; }
+        if(pfd[0].revents)
+        { return 0; }
+        if(pfd[1].revents & POLLIN)
+        { sr_shm_clear_bell(pfd[1].fd); }
+    }
+    if(r < 0 || *len > VL_MAX_MSG)
+    { return 0; }
+
+    *type = ntohl(((c_base*)msg)->mType);
+    buf = (unsigned char*)malloc(*len);
+    assert(buf);
+    memcpy(buf, msg, *len);
+    sr_shm_release(ring, *len);
+    return buf;
+} /* -- vl_read_msg_shm -- */
+
+static unsigned char* vl_read_msg(struct vl_state* vl, uint32_t* type,
+                                  uint32_t* len)
+{
+    c_base hdr;
+    unsigned char* buf;
+
+    if(vl->shm)
+    { return vl_read_msg_shm(vl, type, len); }
+
+    if(vl_read_full(vl->fd, &hdr, sizeof(hdr)) != 0)
+    { return 0; }
+    *len = ntohl(hdr.mLen);
+    *type = ntohl(hdr.mType);
+    if(*len < sizeof(hdr) || *len > VL_MAX_MSG)
+    { return 0; }
+    buf = (unsigned char*)malloc(*len);
+    assert(buf);
+    memcpy(buf, &hdr, sizeof(hdr));
+    if(vl_read_full(vl->fd, buf + sizeof(hdr), *len - sizeof(hdr)) != 0)
+    { free(buf); return 0; }
+    return buf;
+} /* -- vl_read_msg -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_auth(..)
+ *
+ * With key set the router's reply must be the salted SHA1 of it, as the
+ * real server checks; otherwise anyone is let in, as POX does.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vl_auth(struct vl_state* vl, const char* key)
+{
+    unsigned char salt[VL_SALT_LEN];
+    unsigned char *msg, *p;
+    c_auth_reply* ar;
+    c_auth_status* st;
+    SHA1Context sha1;
+    char text[64];
+    uint32_t type, len, ulen;
+    int i, n, ok = 1;
+
+    for(i = 0; i < VL_SALT_LEN; i++)
+    { salt[i] = (unsigned char)rand(); }
+    p = vl_queue(vl, VNS_AUTH_REQUEST, sizeof(c_auth_request) + VL_SALT_LEN);
+    memcpy(((c_auth_request*)p)->salt, salt, VL_SALT_LEN);
+    vl_flush(vl);
+
+    if((msg = vl_read_msg(vl, &type, &len)) == 0 ||
+            type != VNS_AUTH_REPLY)
+    { fprintf(stderr, "expected auth reply\n"); free(msg); return -1; }
+    ar = (c_auth_reply*)msg;
+    ulen = ntohl(ar->usernameLen);
+    if(len < sizeof(c_auth_reply) || ulen > len - sizeof(c_auth_reply))
+    { free(msg); return -1; }
+    if(key)
+    {
+        SHA1Reset(&sha1);
+        SHA1Input(&sha1, salt, VL_SALT_LEN);
+        SHA1Input(&sha1, (const unsigned char*)key, VL_KEY_LEN);
+        SHA1Result(&sha1);
+        for(i = 0; i < 5; i++)
+        { sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]); }
+        ok = len - sizeof(c_auth_reply) - ulen == 20 &&
+            memcmp(ar->username + ulen, sha1.Message_Digest, 20) == 0;
+    }
+    printf("vnsload: %s %.*s\n", ok ? "authenticated" : "rejected",
+            (int)ulen, ar->username);
+    free(msg);
+
+    n = snprintf(text, sizeof(text), "%s", ok ? "welcome" : "bad key");
+    st = (c_auth_status*)vl_queue(vl, VNS_AUTH_STATUS,
+            sizeof(c_auth_status) + n + 1);
+    st->auth_ok = ok;
+    memcpy(st->msg, text, n);
+    vl_flush(vl);
+    return ok ? 0 : -1;
+} /* -- vl_auth -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_handshake(..)
+ *
+ * Auth (not over shared memory), open and hardware info.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vl_handshake(struct vl_state* vl, const char* key)
+{
+    unsigned char* msg;
+    c_hwinfo* hw;
+    c_rtable* rt;
+    c_caps* caps;
+    char text[8192];
+    char vhost[IDSIZE + 1];
+    uint32_t type, len, speed;
+    int i, n, caps_ok = 0;
+
+    if(!vl->shm && vl_auth(vl, key) != 0)
+    { return -1; }
+
+    if((msg = vl_read_msg(vl, &type, &len)) == 0 ||
+            (type != VNSOPEN && type != VNS_OPEN_TEMPLATE))
+    { fprintf(stderr, "expected open\n"); free(msg); return -1; }
+
+    /* -- a router that says how large a frame it takes speaks VNS_CAPS -- */
+    vl->max_frame = VL_DEFAULT_FRAME;
+    if(type == VNSOPEN && len >= sizeof(c_open) &&
+            ntohs(((c_open*)msg)->mMaxFrame) != 0)
+    {
+        vl->max_frame = ntohs(((c_open*)msg)->mMaxFrame);
+        caps_ok = 1;
+    }
+    for(i = 0; i < vl->nsizes; i++)
+    {
+        if(vl->sizes[i] > vl->max_frame)
+        {
+            fprintf(stderr, "router takes frames up to %u bytes (sr -j)\n",
+                    vl->max_frame);
+            free(msg);
+            return -1;
+        }
+    }
+
+    /* -- templates get their routing table from the server -- */
+    if(type == VNS_OPEN_TEMPLATE)
+    {
+        memset(vhost, 0, sizeof(vhost));
+        memcpy(vhost, ((c_open_template*)msg)->mVirtualHostID, IDSIZE);
+        n = vl_rtable(vl, text, sizeof(text));
+        rt = (c_rtable*)vl_queue(vl, VNS_RTABLE, sizeof(c_rtable) + n);
+        memcpy(rt->mVirtualHostID, vhost, IDSIZE);
+        memcpy(rt->rtable, text, n);
+    }
+    free(msg);
+
+    hw = (c_hwinfo*)vl_queue(vl, VNSHWINFO,
+            2 * sizeof(uint32_t) + 5 * vl->nifaces * sizeof(c_hw_entry));
+    speed = htonl(1000);
+    for(i = 0, n = 0; i < vl->nifaces; i++)
+    {
+        hw->mHWInfo[n].mKey = htonl(HWINTERFACE);
+        strncpy(hw->mHWInfo[n++].value, vl->ifaces[i].name, 31);
+        hw->mHWInfo[n].mKey = htonl(HWSPEED);
+        memcpy(hw->mHWInfo[n++].value, &speed, sizeof(speed));
+        hw->mHWInfo[n].mKey = htonl(HWETHER);
+        memcpy(hw->mHWInfo[n++].value, vl->ifaces[i].mac, ETHER_ADDR_LEN);
+        hw->mHWInfo[n].mKey = htonl(HWETHIP);
+        memcpy(hw->mHWInfo[n++].value, &vl->ifaces[i].ip, 4);
+        hw->mHWInfo[n].mKey = htonl(HWMASK);
+        memcpy(hw->mHWInfo[n++].value, &vl->ifaces[i].mask, 4);
+    }
+
+    if(caps_ok)
+    {
+        caps = (c_caps*)vl_queue(vl, VNS_CAPS, sizeof(c_caps));
+        caps->mMaxFrame = htonl(VNS_MAX_FRAME);
+        caps->mFlags = htonl(vl->batch > 1 ? VNS_CAP_BATCH : 0);
+    }
+    else
+    { vl->batch = 1; }
+    return vl_flush(vl);
+} /* -- vl_handshake -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_send_probe(..)
+ *
+ * One timestamped frame from the first host, as UDP to the next host in
+ * turn or as a ping to the router.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void vl_send_probe(struct vl_state* vl, int counted)
+{
+    struct vl_host* src = &vl->hosts[0];
+    struct vl_iface* ifc = &vl->ifaces[src->iface];
+    struct sr_ethernet_hdr* e;
+    struct sr_ip_hdr* ip;
+    struct sr_icmp_hdr* icmp;
+    struct vl_probe* probe;
+    unsigned char* l4;
+    unsigned int size, l4len, hdrlen = 8;
+    uint32_t dst;
+
+    size = vl->sizes[vl->seq % vl->nsizes];
+    if(vl->echo)
+    { dst = ifc->ip; }
+    else
+    {
+        dst = vl->hosts[1 + vl->next_dst].ip;
+        vl->next_dst = (vl->next_dst + 1) % (vl->nhosts - 1);
+    }
+
+    e = (struct sr_ethernet_hdr*)vl_queue_frame(vl, src->iface, size);
+    memcpy(e->ether_dhost, ifc->mac, ETHER_ADDR_LEN);
+    memcpy(e->ether_shost, src->mac, ETHER_ADDR_LEN);
+    e->ether_type = htons(ethertype_ip);
+
+    ip = (struct sr_ip_hdr*)(e + 1);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(size - sizeof(*e));
+    ip->ip_id = htons((uint16_t)vl->seq);
+    ip->ip_ttl = 64;
+    ip->ip_p = vl->echo ? ip_protocol_icmp : ip_protocol_udp;
+    ip->ip_src = src->ip;
+    ip->ip_dst = dst;
+    ip->ip_sum = cksum(ip, sizeof(*ip));
+
+    l4 = (unsigned char*)(ip + 1);
+    l4len = size - sizeof(*e) - sizeof(*ip);
+    probe = (struct vl_probe*)(l4 + hdrlen);
+    probe->magic = htonl(VL_MAGIC);
+    probe->seq = vl->seq;
+    probe->ts_ns = vl_now();
+
+    if(vl->echo)
+    {
+        icmp = (struct sr_icmp_hdr*)l4;
+        icmp->icmp_type = icmp_type_echo_request;
+        ((uint16_t*)l4)[2] = htons((uint16_t)getpid());
+        ((uint16_t*)l4)[3] = htons((uint16_t)vl->seq);
+        icmp->icmp_sum = cksum(l4, l4len);
+    }
+    else
+    {
+        ((uint16_t*)l4)[0] = htons(VL_UDP_SPORT);
+        ((uint16_t*)l4)[1] = htons(VL_UDP_DPORT);
+        ((uint16_t*)l4)[2] = htons(l4len);
+    }
+
+    vl->seq++;
+    vl->outstanding++;
+    if(counted)
+    {
+        vl->sent++;
+        vl->sent_bytes += size;
+    }
+} /* -- vl_send_probe -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_handle_frame(..)
+ *
+ *---------------------------------------------------------------------------*/
+
+static void vl_handle_frame(struct vl_state* vl, const char* ifname,
+                            unsigned char* frame, unsigned int len)
+{
+    struct sr_ethernet_hdr* e = (struct sr_ethernet_hdr*)frame;
+    struct sr_arp_hdr *a, *ra;
+    struct sr_ip_hdr* ip;
+    struct sr_ethernet_hdr* re;
+    struct vl_probe* probe;
+    unsigned char* l4;
+    unsigned int hl;
+    int i, iface = -1;
+
+    for(i = 0; i < vl->nifaces; i++)
+    {
+        if(strncmp(ifname, vl->ifaces[i].name, sr_IFACE_NAMELEN) == 0)
+        { iface = i; break; }
+    }
+    if(iface < 0 || len < sizeof(*e))
+    { vl->unexpected++; return; }
+
+    /* -- play the hosts for the router's ARP requests -- */
+    if(e->ether_type == htons(ethertype_arp))
+    {
+        a = (struct sr_arp_hdr*)(e + 1);
+        if(len < sizeof(*e) + sizeof(*a) || a->ar_op != htons(arp_op_request))
+        { return; }
+        for(i = 0; i < vl->nhosts; i++)
+        {
+            if(vl->hosts[i].ip == a->ar_tip && vl->hosts[i].iface == iface)
+            { break; }
+        }
+        if(i == vl->nhosts)
+        { return; }
+
+        re = (struct sr_ethernet_hdr*)vl_queue_frame(vl, iface,
+                sizeof(*re) + sizeof(*ra));
+        memcpy(re->ether_dhost, a->ar_sha, ETHER_ADDR_LEN);
+        memcpy(re->ether_shost, vl->hosts[i].mac, ETHER_ADDR_LEN);
+        re->ether_type = htons(ethertype_arp);
+        ra = (struct sr_arp_hdr*)(re + 1);
+        ra->ar_hrd = htons(arp_hrd_ethernet);
+        ra->ar_pro = htons(ethertype_ip);
+        ra->ar_hln = ETHER_ADDR_LEN;
+        ra->ar_pln = 4;
+        ra->ar_op = htons(arp_op_reply);
+        memcpy(ra->ar_sha, vl->hosts[i].mac, ETHER_ADDR_LEN);
+        ra->ar_sip = vl->hosts[i].ip;
+        memcpy(ra->ar_tha, a->ar_sha, ETHER_ADDR_LEN);
+        ra->ar_tip = a->ar_sip;
+        vl->arp_replies++;
+        return;
+    }
+
+    if(e->ether_type != htons(ethertype_ip) ||
+            len < sizeof(*e) + sizeof(*ip))
+    { vl->unexpected++; return; }
+
+    ip = (struct sr_ip_hdr*)(e + 1);
+    hl = ip->ip_hl * 4;
+    l4 = (unsigned char*)ip + hl;
+    if(len < sizeof(*e) + hl + 8 + sizeof(*probe))
+    { vl->unexpected++; return; }
+
+    if(ip->ip_p == ip_protocol_icmp &&
+            ((struct sr_icmp_hdr*)l4)->icmp_type != icmp_type_echo_reply)
+    { vl->icmp_errors++; return; }
+
+    probe = (struct vl_probe*)(l4 + 8);
+    if(probe->magic != htonl(VL_MAGIC))
+    { vl->unexpected++; return; }
+
+    vl->last_rx_ns = vl_now();
+    if(vl->outstanding)
+    { vl->outstanding--; }
+    if(probe->seq < vl->measure_from)
+    { return; }
+
+    vl->received++;
+    if(vl->rtt_len == vl->rtt_cap)
+    {
+        vl->rtt_cap = vl->rtt_cap ? vl->rtt_cap * 2 : 65536;
+        vl->rtt = (uint64_t*)realloc(vl->rtt, vl->rtt_cap * sizeof(uint64_t));
+        assert(vl->rtt);
+    }
+    vl->rtt[vl->rtt_len++] = vl->last_rx_ns - probe->ts_ns;
+} /* -- vl_handle_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_read(..)
+ *
+ * Take what the socket (or ring) has and dispatch every complete message.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void vl_dispatch(struct vl_state* vl, unsigned char* msg, uint32_t len)
+{
+    c_packet_header* pkt = (c_packet_header*)msg;
+    c_packet_entry* e;
+    char name[sr_IFACE_NAMELEN + 1];
+    uint32_t type = ntohl(pkt->mType), count, flen;
+    unsigned int off;
+
+    memset(name, 0, sizeof(name));
+    if(type == VNSPACKET && len >= sizeof(c_packet_header))
+    {
+        memcpy(name, pkt->mInterfaceName, sizeof(pkt->mInterfaceName));
+        vl_handle_frame(vl, name, (unsigned char*)(pkt + 1),
+                len - sizeof(c_packet_header));
+    }
+    else if(type == VNSPACKET_BATCH && len >= sizeof(c_packet_batch))
+    {
+        count = ntohl(((c_packet_batch*)msg)->mCount);
+        for(off = sizeof(c_packet_batch); count > 0; count--)
+        {
+            e = (c_packet_entry*)(msg + off);
+            if(len - off < sizeof(*e) ||
+                    (flen = ntohl(e->mFrameLen)) > len - off - sizeof(*e))
+            { vl->unexpected++; return; }
+            memcpy(name, e->mInterfaceName, sizeof(e->mInterfaceName));
+            vl_handle_frame(vl, name, (unsigned char*)(e + 1), flen);
+            off += sizeof(*e) + flen;
+        }
+    }
+    else if(type == VNSCLOSE)
+    { vl->closed = 1; }
+} /* -- vl_dispatch -- */
+
+static int vl_read_shm(struct vl_state* vl)
+{
+    struct sr_shm_ring* ring = &vl->shm->rings[SR_SHM_TO_SOURCE];
+    uint8_t* msg;
+    uint32_t len;
+    int r;
+
+    while((r = sr_shm_peek(ring, &msg, &len)) == 1)
+    {
+        vl_dispatch(vl, msg, len);
+        sr_shm_release(ring, len);
+    }
+    return r;
+} /* -- vl_read_shm -- */
+
+static int vl_read(struct vl_state* vl)
+{
+    unsigned int off = 0;
+    uint32_t len;
+    ssize_t n;
+
+    if(vl->shm)
+    { return vl_read_shm(vl); }
+
+    n = recv(vl->fd, vl->in + vl->in_len, VL_MAX_MSG - vl->in_len, 0);
+    if(n < 0)
+    { return errno == EAGAIN || errno == EINTR ? 0 : -1; }
+    if(n == 0)
+    { vl->closed = 1; return 0; }
+    vl->in_len += n;
+
+    while(vl->in_len - off >= sizeof(c_base))
+    {
+        len = ntohl(((c_base*)(vl->in + off))->mLen);
+        if(len < sizeof(c_base) || len > VL_MAX_MSG)
+        { fprintf(stderr, "bad message length %u\n", len); return -1; }
+        if(vl->in_len - off < len)
+        { break; }
+
+        vl_dispatch(vl, vl->in + off, len);
+        off += len;
+    }
+
+    memmove(vl->in, vl->in + off, vl->in_len - off);
+    vl->in_len -= off;
+    return 0;
+} /* -- vl_read -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: vl_run(..)
+ *
+ * Send for duration_ns at rate pps (or keeping window probes outstanding
+ * when rate is 0), then wait drain_ns for stragglers.  Probes sent in the
+ * first warmup_ns, while the router is still resolving ARP, do not count.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int vl_run(struct vl_state* vl, double rate, unsigned int window,
+                  uint64_t warmup_ns, uint64_t duration_ns, uint64_t drain_ns,
+                  uint64_t* elapsed_ns)
+{
+    struct pollfd pfd[2];
+    struct timespec ts;
+    uint64_t start, now, next, measure_start = 0, stop, timeout;
+    uint64_t interval = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+    int sending = 1, counted = 0, npfd = 1;
+
+    start = next = vl->last_rx_ns = vl_now();
+    stop = start + warmup_ns + duration_ns;
+
+    while(!vl->closed)
+    {
+        now = vl_now();
+
+        if(sending && now >= stop)
+        {
+            sending = 0;
+            stop = now + drain_ns;
+            *elapsed_ns = now - measure_start;
+        }
+        if(!sending && (now >= stop || vl->received == vl->sent))
+        { break; }
+
+        if(sending && !counted && now >= start + warmup_ns)
+        {
+            counted = 1;
+            vl->measure_from = vl->seq;
+            measure_start = now;
+        }
+
+        /* -- generate what is due -- */
+        while(sending && (interval ? now >= next : vl->outstanding < window))
+        {
+            if(vl->out_len > VL_OUT_HIGH)
+            {
+                vl->throttled++;
+                next += interval;
+                if(!interval)
+                { break; }
+                continue;
+            }
+            vl_send_probe(vl, counted);
+            next += interval;
+        }
+
+        /* -- closed loop: replies stopped, assume the window was lost -- */
+        if(sending && !interval && vl->outstanding >= window &&
+                now - vl->last_rx_ns > VL_STALL_NS)
+        {
+            vl->stalls++;
+            vl->outstanding = 0;
+            vl->last_rx_ns = now;
+        }
+
+        if(vl_flush(vl) != 0)
+        { return -1; }
+
+        timeout = sending && interval && next > now ? next - now :
+                  sending ? VL_STALL_NS : stop - now;
+        if(sending && interval && next <= now)
+        { timeout = 0; }
+
+        pfd[0].fd = vl->fd;
+        pfd[0].events = POLLIN | (vl->out_len && !vl->shm ? POLLOUT : 0);
+        if(vl->shm)
+        {
+            /* -- the router takes from a full ring without telling us -- */
+            if(vl->out_len && timeout > VL_SHM_RETRY_NS)
+            { timeout = VL_SHM_RETRY_NS; }
+            if(!sr_shm_empty(&vl->shm->rings[SR_SHM_TO_SOURCE]))
+            { timeout = 0; }
+            pfd[1].fd = vl->shm->bell[SR_SHM_TO_SOURCE];
+            pfd[1].events = POLLIN;
+            npfd = 2;
+        }
+        ts.tv_sec = timeout / 1000000000;
+        ts.tv_nsec = timeout % 1000000000;
+
+        if(ppoll(pfd, npfd, &ts, 0) < 0 && errno != EINTR)
+        { perror("ppoll"); return -1; }
+        if(vl->shm)
+        {
+            if(pfd[1].revents & POLLIN)
+            { sr_shm_clear_bell(pfd[1].fd); }
+            if(vl_read(vl) != 0)
+            { return -1; }
+            /* -- the router never writes to the socket after the handover -- */
+            if(pfd[0].revents)
+            { vl->closed = 1; }
+        }
+        else if(pfd[0].revents & (POLLIN | POLLHUP))
+        {
+            if(vl_read(vl) != 0)
+            { return -1; }
+        }
+    }
+
+    if(sending)
+    { *elapsed_ns = vl_now() - measure_start; }
+    return 0;
+} /* -- vl_run -- */
+
+static int vl_cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+} /* -- vl_cmp_u64 -- */
+
+static double vl_pct(const uint64_t* v, uint64_t n, double p)
+{
+    uint64_t i;
+
+    if(n == 0)
+    { return 0; }
+    i = (uint64_t)(p / 100.0 * (n - 1) + 0.5);
+    return v[i] / 1e3;
+} /* -- vl_pct -- */
+
+static void vl_report(struct vl_state* vl, uint64_t elapsed_ns)
+{
+    double secs = elapsed_ns / 1e9;
+    uint64_t lost = vl->sent - (vl->received < vl->sent ? vl->received
+                                                        : vl->sent);
+
+    qsort(vl->rtt, vl->rtt_len, sizeof(uint64_t), vl_cmp_u64);
+
+    printf("vnsload: sent %llu (%.0f pkts/s, %.1f Mbit/s), received %llu, "
+           "lost %llu (%.3f%%)\n",
+           (unsigned long long)vl->sent, secs > 0 ? vl->sent / secs : 0.0,
+           secs > 0 ? vl->sent_bytes * 8 / secs / 1e6 : 0.0,
+           (unsigned long long)vl->received, (unsigned long long)lost,
+           vl->sent ? 100.0 * lost / vl->sent : 0.0);
+    printf("vnsload: rtt us min %.1f p50 %.1f p90 %.1f p99 %.1f "
+           "p99.9 %.1f max %.1f\n",
+           vl_pct(vl->rtt, vl->rtt_len, 0), vl_pct(vl->rtt, vl->rtt_len, 50),
+           vl_pct(vl->rtt, vl->rtt_len, 90), vl_pct(vl->rtt, vl->rtt_len, 99),
+           vl_pct(vl->rtt, vl->rtt_len, 99.9),
+           vl_pct(vl->rtt, vl->rtt_len, 100));
+    printf("vnsload: %llu arp replies, %llu icmp errors, %llu unexpected, "
+           "%llu throttled, %llu stalls\n",
+           (unsigned long long)vl->arp_replies,
+           (unsigned long long)vl->icmp_errors,
+           (unsigned long long)vl->unexpected,
+           (unsigned long long)vl->throttled,
+           (unsigned long long)vl->stalls);
+} /* -- vl_report -- */
+
+static void usage(const char* argv0)
+{
+    printf("Stand-in VNS server and load generator for sr\n");
+    printf("Format: %s [-h] [-p port] [-I topology] [-k auth_key]\n", argv0);
+    printf("           [-m fwd|echo] [-r pkts/s] [-w window] [-s size,...]\n");
+    printf("           [-d seconds] [-u warmup ms] [-D drain ms]\n");
+    printf("           [-W rtable out] [-M unix socket path] "
+           "[-B frames per batch]\n");
+    printf("   -r 0 keeps -w probes outstanding instead of a fixed rate\n");
+    printf("   -M hands the router (sr -M) shared memory rings instead\n");
+    printf("   -B > 1 packs frames into VNSPACKET_BATCH, both ways\n");
+    printf("   sizes are ethernet frame lengths, %u..%u\n",
+           (unsigned)(sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr)
+               + 8 + sizeof(struct vl_probe)), VNS_MAX_FRAME);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct vl_state vl;
+    struct sockaddr_in addr;
+    struct sockaddr_un uaddr;
+    struct sr_shm shm;
+    unsigned int port = VL_DEFAULT_PORT, window = 64, minsize;
+    double rate = 1000, secs = 5;
+    uint64_t warmup_ms = 200, drain_ms = 500, elapsed = 0;
+    const char *topo = 0, *keyfile = 0, *rtable_out = 0, *shm_path = 0;
+    char key[VL_KEY_LEN + 1], *sizes = "64", *tok;
+    int c, lfd, one = 1;
+    FILE* fp;
+    c_close* bye;
+
+    memset(&vl, 0, sizeof(vl));
+    memset(key, 0, sizeof(key));
+    vl.measure_from = ~(uint32_t)0;
+
+    while((c = getopt(argc, argv, "hp:I:k:m:r:w:s:d:u:D:W:M:B:")) != EOF)
+    {
+        switch(c)
+        {
+            case 'p': port = atoi(optarg); break;
+            case 'I': topo = optarg; break;
+            case 'k': keyfile = optarg; break;
+            case 'm': vl.echo = strcmp(optarg, "echo") == 0; break;
+            case 'r': rate = atof(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 's': sizes = optarg; break;
+            case 'd': secs = atof(optarg); break;
+            case 'u': warmup_ms = atoi(optarg); break;
+            case 'D': drain_ms = atoi(optarg); break;
+            case 'W': rtable_out = optarg; break;
+            case 'M': shm_path = optarg; break;
+            case 'B': vl.batch = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+
+    if(vl_load_topology(&vl, topo) != 0)
+    { exit(1); }
+
+    minsize = sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_ip_hdr) + 8 +
+        sizeof(struct vl_probe);
+    for(tok = strtok(sizes, ","); tok && vl.nsizes < VL_MAX_SIZES;
+            tok = strtok(0, ","))
+    {
+        vl.sizes[vl.nsizes] = atoi(tok);
+        if(vl.sizes[vl.nsizes] < minsize || vl.sizes[vl.nsizes] > VNS_MAX_FRAME)
+        { fprintf(stderr, "bad size %s\n", tok); exit(1); }
+        vl.nsizes++;
+    }
+    if(window == 0)
+    { window = 1; }
+
+    if(keyfile)
+    {
+        if((fp = fopen(keyfile, "r")) == 0 || !fgets(key, sizeof(key), fp))
+        { perror(keyfile); exit(1); }
+        fclose(fp);
+    }
+
+    /* -- the router needs its routing table before it connects -- */
+    if(rtable_out)
+    {
+        char text[8192];
+        int n = vl_rtable(&vl, text, sizeof(text));
+
+        if((fp = fopen(rtable_out, "w")) == 0)
+        { perror(rtable_out); exit(1); }
+        fwrite(text, n, 1, fp);
+        fclose(fp);
+    }
+
+    vl.in = (unsigned char*)malloc(VL_MAX_MSG);
+    assert(vl.in);
+    srand(time(0) ^ getpid());
+
+    if(shm_path)
+    {
+        lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+        memset(&uaddr, 0, sizeof(uaddr));
+        uaddr.sun_family = AF_UNIX;
+        strncpy(uaddr.sun_path, shm_path, sizeof(uaddr.sun_path) - 1);
+        unlink(shm_path);
+        if(bind(lfd, (struct sockaddr*)&uaddr, sizeof(uaddr)) != 0 ||
+                listen(lfd, 1) != 0)
+        { perror(shm_path); exit(1); }
+        printf("vnsload: waiting for a router on %s\n", shm_path);
+    }
+    else
+    {
+        lfd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+                listen(lfd, 1) != 0)
+        { perror("bind"); exit(1); }
+        printf("vnsload: waiting for a router on port %u\n", port);
+    }
+
+    fflush(stdout);
+    if((vl.fd = accept(lfd, 0, 0)) < 0)
+    { perror("accept"); exit(1); }
+    close(lfd);
+
+    if(shm_path)
+    {
+        unlink(shm_path);
+        if(sr_shm_create(&shm) != 0 || sr_shm_send(vl.fd, &shm) != 0)
+        { close(vl.fd); exit(1); }
+        vl.shm = &shm;
+    }
+    else
+    { setsockopt(vl.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); }
+
+    if(vl_handshake(&vl, keyfile ? key : 0) != 0)
+    { close(vl.fd); exit(1); }
+
+    fcntl(vl.fd, F_SETFL, fcntl(vl.fd, F_GETFL) | O_NONBLOCK);
+
+    if(vl_run(&vl, rate, window, warmup_ms * 1000000,
+                (uint64_t)(secs * 1e9), drain_ms * 1000000, &elapsed) != 0)
+    { vl.closed = 1; }
+
+    vl_report(&vl, elapsed);
+
+    if(!vl.closed)
+    {
+        bye = (c_close*)vl_queue(&vl, VNSCLOSE, sizeof(c_close));
+        strcpy(bye->mErrorMessage, "load test finished");
+        fcntl(vl.fd, F_SETFL, fcntl(vl.fd, F_GETFL) & ~O_NONBLOCK);
+        vl_flush(&vl);
+    }
+    close(vl.fd);
+    if(vl.shm)
+    { sr_shm_destroy(vl.shm); }
+    return 0;
+} /* -- main -- */